@@ -1,6 +1,9 @@
 
 #include "gxact.h"
 
+#include <cmath>
+#include <algorithm>
+
 
 ////////////////////////////////////////////////////////////
 
@@ -38,58 +41,84 @@ int GX_ActFunc :: getType() const
 	return mType;
 }
 
-void GX_ActFunc :: activate( const GX_DataVector & input, GX_DataVector * output ) const
+void GX_ActFunc :: activate( const GX_DataType * input, GX_DataType * output, size_t count ) const
 {
 	if( eSigmoid == mType ) {
-		*output = 1.0f / ( 1.0f + std::exp( - input ) );
+		for( size_t i = 0; i < count; i++ ) output[ i ] = 1.0f / ( 1.0f + std::exp( - input[ i ] ) );
 	}
 
 	if( eLeakyReLU == mType ) {
-		for( size_t i = 0; i < input.size(); i++ ) {
+		for( size_t i = 0; i < count; i++ ) {
 			if( input[ i ] < 0 ) {
-				( *output )[ i ] = 0.01 * input[ i ];
+				output[ i ] = 0.01 * input[ i ];
 			} else if( input[ i ] > 1 ) {
-				( *output )[ i ] = 1 + 0.01 * ( input[ i ] - 1 );
+				output[ i ] = 1 + 0.01 * ( input[ i ] - 1 );
 			}
 		}
 	}
 
 	if( eTanh == mType ) {
-		*output = std::tanh( input );
+		for( size_t i = 0; i < count; i++ ) output[ i ] = std::tanh( input[ i ] );
 	}
 
 	if( eSoftmax == mType ) {
-		*output = std::exp( input - input.max() );
-		*output /= output->sum();
+		GX_DataType maxValue = *std::max_element( input, input + count );
+
+		for( size_t i = 0; i < count; i++ ) output[ i ] = std::exp( input[ i ] - maxValue );
+
+		// summed in the order of valarray::sum
+		GX_AccumType sum = output[ 0 ];
+		for( size_t i = 1; i < count; i++ ) sum += output[ i ];
+
+		for( size_t i = 0; i < count; i++ ) output[ i ] /= sum;
 	}
 }
 
-void GX_ActFunc :: derivate( const GX_DataVector & output, GX_DataVector * outDelta ) const
+void GX_ActFunc :: derivate( const GX_DataType * output, GX_DataType * outDelta, size_t count ) const
 {
 	if( eSigmoid == mType ) {
-		*outDelta = output * ( 1 - output ) * ( *outDelta );
+		for( size_t i = 0; i < count; i++ ) outDelta[ i ] = output[ i ] * ( 1 - output[ i ] ) * outDelta[ i ];
 	}
 
 	if( eLeakyReLU == mType ) {
-		for( size_t i = 0; i < output.size(); i++ ) {
-			( *outDelta )[ i ] = ( *outDelta )[ i ] * ( output[ i ] < 0 || output[ i ] > 1 ? 0.01 : 1 );
+		for( size_t i = 0; i < count; i++ ) {
+			outDelta[ i ] = outDelta[ i ] * ( output[ i ] < 0 || output[ i ] > 1 ? 0.01 : 1 );
 		}
 	}
 
 	if( eTanh == mType ) {
-		*outDelta = ( *outDelta ) * ( 1 - output * output );
+		for( size_t i = 0; i < count; i++ ) outDelta[ i ] = outDelta[ i ] * ( 1 - output[ i ] * output[ i ] );
 	}
 
 	if( eSoftmax == mType ) {
-		GX_DataVector dOutput = *outDelta;
-		for( size_t j = 0; j < output.size(); j++ ) {
-			GX_DataVector dSoftmax( output.size() );
-			for( size_t k = 0; k < output.size(); k++ ) {
-				dSoftmax[ k ] = ( k == j ) ? output[ j ] * ( 1.0 - output[ j ] ) : -output[ k ] * output[ j ];
-			}
-
-			( *outDelta )[ j ] = ( dOutput * dSoftmax ).sum();
+		GX_DataVector dOutput( outDelta, count );
+		for( size_t j = 0; j < count; j++ ) {
+			auto term = [ & ]( size_t k ) {
+				GX_DataType dSoftmax = ( k == j ) ? output[ j ] * ( 1.0 - output[ j ] ) : -output[ k ] * output[ j ];
+				return dOutput[ k ] * dSoftmax;
+			};
+
+			// summed from the back in the order of valarray::sum
+			GX_AccumType sum = term( count - 1 );
+			for( size_t k = count - 1; k > 0; k-- ) sum += term( k - 1 );
+
+			outDelta[ j ] = sum;
 		}
 	}
 }
 
+double GX_ActFunc :: getFlops( size_t count, bool isDerivate ) const
+{
+	double ret = 0;
+
+	// exp and tanh are counted as a single operation
+	if( eSigmoid == mType ) ret = 3.0 * count;
+
+	if( eLeakyReLU == mType ) ret = isDerivate ? 1.0 * count : 2.0 * count;
+
+	if( eTanh == mType ) ret = isDerivate ? 3.0 * count : 1.0 * count;
+
+	if( eSoftmax == mType ) ret = isDerivate ? 3.0 * count * count : 4.0 * count;
+
+	return ret;
+}
@@ -12,9 +12,13 @@ public:
 
 	int getType() const;
 
-	void activate( const GX_DataVector & input, GX_DataVector * output ) const;
+	// input and output hold count items, they may be the same buffer
+	void activate( const GX_DataType * input, GX_DataType * output, size_t count ) const;
 
-	void derivate( const GX_DataVector & output, GX_DataVector * outDelta ) const;
+	void derivate( const GX_DataType * output, GX_DataType * outDelta, size_t count ) const;
+
+	// approximate FLOPs of activate or derivate over count elements
+	double getFlops( size_t count, bool isDerivate ) const;
 
 public:
 
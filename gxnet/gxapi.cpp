@@ -0,0 +1,121 @@
+
+#include "gxapi.h"
+#include "gxnet.h"
+#include "gxutils.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <type_traits>
+
+#ifndef GX_MIXED_PRECISION
+static_assert( std::is_same< GX_DataType, double >::value, "gxapi.h exposes GX_DataType as double" );
+#endif
+
+struct gx_model {
+	GX_Network mNetwork;
+};
+
+struct gx_context {
+	gx_context( const gx_model_t * model )
+		: mModel( model ), mCtx( model->mNetwork )
+	{
+#ifdef GX_MIXED_PRECISION
+		mImage.resize( gx_model_input_size( model ) );
+#endif
+	}
+
+	const gx_model_t * mModel;
+	GX_InferenceContext mCtx;
+
+	// the image converted to GX_DataType in the mixed build
+	GX_DataVector mImage;
+};
+
+gx_model_t * gx_model_load( const char * path )
+{
+	gx_model_t * model = NULL;
+
+	bool ret = false;
+
+	// the text parser throws on malformed numbers and any allocation may throw bad_alloc,
+	// nothing may escape the C ABI
+	try {
+		model = new gx_model_t();
+		ret = GX_Utils::load( path, &( model->mNetwork ) ) && ! model->mNetwork.getLayers().empty();
+	} catch( const std::exception & e ) {
+		printf( "%s( %s ) fail, %s\n", __func__, path, e.what() );
+	}
+
+	if( ! ret ) {
+		delete model;
+		model = NULL;
+	}
+
+	return model;
+}
+
+void gx_model_free( gx_model_t * model )
+{
+	delete model;
+}
+
+size_t gx_model_input_size( const gx_model_t * model )
+{
+	return model->mNetwork.getLayers().front()->getInputSize();
+}
+
+size_t gx_model_output_size( const gx_model_t * model )
+{
+	return model->mNetwork.getLayers().back()->getOutputSize();
+}
+
+gx_context_t * gx_context_new( const gx_model_t * model )
+{
+	gx_context_t * ctx = NULL;
+
+	// the buffers of the plan may throw bad_alloc
+	try {
+		ctx = new gx_context_t( model );
+	} catch( const std::exception & e ) {
+		printf( "%s fail, %s\n", __func__, e.what() );
+	}
+
+	return ctx;
+}
+
+void gx_context_free( gx_context_t * ctx )
+{
+	delete ctx;
+}
+
+int gx_classify( gx_context_t * ctx, const double * image, double * scores )
+{
+#ifdef GX_MIXED_PRECISION
+	std::copy( image, image + ctx->mImage.size(), std::begin( ctx->mImage ) );
+
+	if( ! ctx->mModel->mNetwork.forward( std::begin( ctx->mImage ), &( ctx->mCtx ) ) ) return -1;
+#else
+	if( ! ctx->mModel->mNetwork.forward( image, &( ctx->mCtx ) ) ) return -1;
+#endif
+
+	const GX_DataVector & output = ctx->mCtx.getOutput();
+
+	if( NULL != scores ) std::copy( std::begin( output ), std::end( output ), scores );
+
+	return GX_Utils::max_index( std::begin( output ), std::end( output ) );
+}
+
+int gx_classify_batch( gx_context_t * ctx, const double * images, size_t count,
+		double * scores, int * classes )
+{
+	size_t inputSize = gx_model_input_size( ctx->mModel );
+	size_t outputSize = gx_model_output_size( ctx->mModel );
+
+	for( size_t i = 0; i < count; i++ ) {
+		classes[ i ] = gx_classify( ctx, images + i * inputSize, NULL == scores ? NULL : scores + i * outputSize );
+
+		if( classes[ i ] < 0 ) return -1;
+	}
+
+	return 0;
+}
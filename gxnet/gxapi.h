@@ -0,0 +1,46 @@
+#pragma once
+
+/*
+* C inference API of libgxnet, for services that classify in-process instead of
+* running gxocr. A model is read-only once loaded and may be shared by any number
+* of threads, each thread creates its own context.
+*/
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct gx_model gx_model_t;
+
+typedef struct gx_context gx_context_t;
+
+// text or binary model, NULL on failure
+gx_model_t * gx_model_load( const char * path );
+
+void gx_model_free( gx_model_t * model );
+
+// doubles per input image
+size_t gx_model_input_size( const gx_model_t * model );
+
+// scores per input image
+size_t gx_model_output_size( const gx_model_t * model );
+
+// per-thread buffers, the model must outlive its contexts. NULL on failure
+gx_context_t * gx_context_new( const gx_model_t * model );
+
+void gx_context_free( gx_context_t * ctx );
+
+// image holds input_size doubles and is read in place, scores receives output_size doubles
+// or may be NULL. return the index of the max score, -1 on failure
+int gx_classify( gx_context_t * ctx, const double * image, double * scores );
+
+// count images back to back, scores receives count * output_size doubles or may be NULL,
+// classes receives count indexes. return 0 on success, -1 on failure
+int gx_classify_batch( gx_context_t * ctx, const double * images, size_t count,
+		double * scores, int * classes );
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,269 @@
+
+#include "gxaugment.h"
+
+#include <cmath>
+#include <climits>
+#include <random>
+#include <algorithm>
+
+GX_Augmenter :: GX_Augmenter( size_t side )
+{
+	mSide = side;
+	mPadding = 0;
+	mCenterRate = mMaxDegrees = 0;
+	mMaxPixels = 0;
+	mSeed = 0;
+}
+
+GX_Augmenter :: ~GX_Augmenter()
+{
+}
+
+void GX_Augmenter :: setCenterRate( GX_DataType rate )
+{
+	mCenterRate = rate;
+}
+
+void GX_Augmenter :: setRotation( GX_DataType maxDegrees )
+{
+	mMaxDegrees = maxDegrees;
+}
+
+void GX_Augmenter :: setTranslation( int maxPixels )
+{
+	mMaxPixels = maxPixels;
+}
+
+void GX_Augmenter :: setPadding( size_t padding )
+{
+	mPadding = padding;
+}
+
+void GX_Augmenter :: setSeed( uint32_t seed )
+{
+	mSeed = seed;
+}
+
+size_t GX_Augmenter :: getInputSize() const
+{
+	return mSide * mSide;
+}
+
+size_t GX_Augmenter :: getOutputSize() const
+{
+	return ( mSide + 2 * mPadding ) * ( mSide + 2 * mPadding );
+}
+
+// zero outside of the image, a whole pixel position reads the pixel as it is
+static GX_DataType readBilinear( const GX_DataType * image, int side, double x, double y )
+{
+	int x0 = (int)std::floor( x ), y0 = (int)std::floor( y );
+	double fx = x - x0, fy = y - y0;
+
+	auto at = [ & ]( int px, int py ) -> double {
+		return px >= 0 && px < side && py >= 0 && py < side ? image[ px * side + py ] : 0;
+	};
+
+	if( 0 == fx && 0 == fy ) return at( x0, y0 );
+
+	return at( x0, y0 ) * ( 1 - fx ) * ( 1 - fy ) + at( x0 + 1, y0 ) * fx * ( 1 - fy )
+			+ at( x0, y0 + 1 ) * ( 1 - fx ) * fy + at( x0 + 1, y0 + 1 ) * fx * fy;
+}
+
+void GX_Augmenter :: apply( const GX_DataType * input, size_t epoch, size_t index, GX_DataType * output ) const
+{
+	std::seed_seq seq{ mSeed, (uint32_t)epoch, (uint32_t)index, (uint32_t)( (uint64_t)index >> 32 ) };
+	std::mt19937 gen( seq );
+
+	int side = mSide;
+
+	// same shift as GX_Utils::centerMnistImage, the bounding box of the ink goes to the middle
+	int centerX = 0, centerY = 0;
+
+	if( mCenterRate > 0 && std::uniform_real_distribution< double >( 0, 1 )( gen ) < mCenterRate ) {
+		int beginX = INT_MAX, beginY = INT_MAX, endX = INT_MIN, endY = INT_MIN;
+
+		for( int x = 0; x < side; x++ ) {
+			for( int y = 0; y < side; y++ ) {
+				if( input[ x * side + y ] != 0 ) {
+					beginX = std::min( x, beginX );
+					beginY = std::min( y, beginY );
+
+					endX = std::max( x, endX );
+					endY = std::max( y, endY );
+				}
+			}
+		}
+
+		if( beginX <= endX ) {
+			centerX = ( side - ( endX + 1 - beginX ) ) / 2 - beginX;
+			centerY = ( side - ( endY + 1 - beginY ) ) / 2 - beginY;
+		}
+	}
+
+	double theta = 0;
+	if( mMaxDegrees > 0 ) theta = std::uniform_real_distribution< double >( -mMaxDegrees, mMaxDegrees )( gen ) * M_PI / 180;
+
+	int shiftX = 0, shiftY = 0;
+	if( mMaxPixels > 0 ) {
+		std::uniform_int_distribution<> shift( -mMaxPixels, mMaxPixels );
+		shiftX = shift( gen );
+		shiftY = shift( gen );
+	}
+
+	double cosT = std::cos( theta ), sinT = std::sin( theta );
+	double mid = ( side - 1 ) / 2.0;
+
+	int padding = mPadding, outSide = side + 2 * padding;
+
+	for( int x = 0; x < outSide; x++ ) {
+		for( int y = 0; y < outSide; y++ ) {
+			// back through the padding and the translation, the rotation around the middle, then the centering
+			double qx = x - padding - shiftX - mid, qy = y - padding - shiftY - mid;
+
+			double srcX = cosT * qx + sinT * qy + mid - centerX;
+			double srcY = cosT * qy - sinT * qx + mid - centerY;
+
+			output[ x * outSide + y ] = readBilinear( input, side, srcX, srcY );
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////
+
+GX_AugmentLoader :: GX_AugmentLoader( const GX_Augmenter & augmenter, const GX_Dataset & input,
+		int threadCount, size_t batchSize, size_t depth )
+	: mAugmenter( augmenter ), mInput( input )
+{
+	mBatchSize = std::max( batchSize, (size_t)1 );
+
+	// inline, only the batch being read is kept
+	if( threadCount <= 0 ) depth = 1;
+
+	depth = std::max( depth, (size_t)1 );
+
+	for( size_t i = 0; i < depth; i++ ) mSlots.emplace_back( mBatchSize, augmenter.getOutputSize() );
+	mFilled.resize( depth, 0 );
+
+	mEpoch = mNextPos = mNextBatch = mReleased = 0;
+	mIsStop = false;
+
+	for( int i = 0; i < threadCount; i++ ) mThreads.emplace_back( &GX_AugmentLoader::run, this );
+}
+
+GX_AugmentLoader :: ~GX_AugmentLoader()
+{
+	{
+		std::unique_lock< std::mutex > lock( mMutex );
+		mIsStop = true;
+	}
+
+	mLoaderCond.notify_all();
+
+	for( auto & item : mThreads ) item.join();
+}
+
+size_t GX_AugmentLoader :: getBatchSize( size_t batch ) const
+{
+	return std::min( mBatchSize, mOrder.size() - batch * mBatchSize );
+}
+
+void GX_AugmentLoader :: start( size_t epoch, const std::vector< int > & order )
+{
+	{
+		std::unique_lock< std::mutex > lock( mMutex );
+
+		mOrder = order;
+		mEpoch = epoch;
+		mNextPos = mNextBatch = mReleased = 0;
+		std::fill( mFilled.begin(), mFilled.end(), 0 );
+	}
+
+	mLoaderCond.notify_all();
+}
+
+void GX_AugmentLoader :: run()
+{
+	for( ; ; ) {
+		size_t pos = 0, epoch = 0;
+		int index = 0;
+
+		{
+			std::unique_lock< std::mutex > lock( mMutex );
+
+			mLoaderCond.wait( lock, [ & ] {
+				return mIsStop || ( mNextPos < mOrder.size() && mNextPos / mBatchSize < mReleased + mSlots.size() );
+			} );
+
+			if( mIsStop ) return;
+
+			pos = mNextPos++;
+			epoch = mEpoch;
+			index = mOrder[ pos ];
+		}
+
+		size_t batch = pos / mBatchSize;
+
+		// the other loaders write other samples of the slot
+		mAugmenter.apply( mInput[ index ], epoch, index, mSlots[ batch % mSlots.size() ][ pos % mBatchSize ] );
+
+		{
+			std::unique_lock< std::mutex > lock( mMutex );
+
+			if( ++mFilled[ batch % mSlots.size() ] == getBatchSize( batch ) ) mTrainerCond.notify_one();
+		}
+	}
+}
+
+const GX_Dataset & GX_AugmentLoader :: nextBatch()
+{
+	size_t batch = mNextBatch++;
+	GX_Dataset & slot = mSlots[ batch % mSlots.size() ];
+
+	if( mThreads.empty() ) {
+		for( size_t i = 0; i < getBatchSize( batch ); i++ ) {
+			int index = mOrder[ batch * mBatchSize + i ];
+			mAugmenter.apply( mInput[ index ], mEpoch, index, slot[ i ] );
+		}
+
+		return slot;
+	}
+
+	std::unique_lock< std::mutex > lock( mMutex );
+
+	// the batch read before this one is done with, its slot takes the batch depth ahead
+	if( batch > 0 ) {
+		mFilled[ ( batch - 1 ) % mSlots.size() ] = 0;
+		mReleased = batch;
+
+		mLoaderCond.notify_all();
+	}
+
+	mTrainerCond.wait( lock, [ & ] { return mFilled[ batch % mSlots.size() ] == getBatchSize( batch ); } );
+
+	return slot;
+}
+
+size_t GX_AugmentLoader :: getBytes() const
+{
+	size_t ret = 0;
+
+	for( auto & item : mSlots ) ret += item.getBytes();
+
+	return ret;
+}
+
+size_t GX_AugmentLoader :: getReadyCount() const
+{
+	std::unique_lock< std::mutex > lock( mMutex );
+
+	size_t ret = 0;
+
+	for( auto & item : mFilled ) ret += item;
+
+	// the slot of the batch being read stays filled until the next one is asked for
+	if( mNextBatch > 0 ) ret -= mFilled[ ( mNextBatch - 1 ) % mSlots.size() ];
+
+	return ret;
+}
+
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "gxcomm.h"
+#include "gxdataset.h"
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <stdint.h>
+
+/*
+* Per sample transforms of side x side images, drawn at training time instead of
+* stored: centering by the bounding box of the ink, a random rotation around the
+* image center, a random translation, then zero padding on every border. Every
+* output pixel is one bilinear read of the input through the inverse transform,
+* so there is no intermediate image, and a transform without rotation reads whole
+* pixels, it gives the same values as GX_Utils::centerMnistImage and expandMnistImage.
+*
+* The draws of a sample come from ( seed, epoch, index ) only, so the result does
+* not depend on the thread or the order that produced it.
+*/
+class GX_Augmenter {
+public:
+	GX_Augmenter( size_t side );
+	~GX_Augmenter();
+
+	// share of the samples that are centered, 0 for none and 1 for every one
+	void setCenterRate( GX_DataType rate );
+
+	// rotation drawn from [ -maxDegrees, maxDegrees ]
+	void setRotation( GX_DataType maxDegrees );
+
+	// shift of each axis drawn from [ -maxPixels, maxPixels ]
+	void setTranslation( int maxPixels );
+
+	// the output is ( side + 2 * padding ) x ( side + 2 * padding )
+	void setPadding( size_t padding );
+
+	void setSeed( uint32_t seed );
+
+	size_t getInputSize() const;
+
+	size_t getOutputSize() const;
+
+	// input holds getInputSize() items, output getOutputSize() items
+	void apply( const GX_DataType * input, size_t epoch, size_t index, GX_DataType * output ) const;
+
+private:
+	size_t mSide, mPadding;
+	GX_DataType mCenterRate, mMaxDegrees;
+	int mMaxPixels;
+	uint32_t mSeed;
+};
+
+/*
+* Loader threads that augment the samples of an epoch ahead of the training loop.
+* The mini-batches go through a ring of depth slots, a loader takes the next
+* position of the epoch order as long as its batch has a free slot, and the
+* trainer waits only when the batch it asks for is not complete yet. With no
+* threads the batch is augmented by the caller when it is asked for.
+*/
+class GX_AugmentLoader {
+public:
+	GX_AugmentLoader( const GX_Augmenter & augmenter, const GX_Dataset & input,
+			int threadCount, size_t batchSize, size_t depth = 4 );
+	~GX_AugmentLoader();
+
+	// the previous epoch must have been read to its end
+	void start( size_t epoch, const std::vector< int > & order );
+
+	// the next mini-batch of the order, sample i is order[ begin + i ]. the batch before it
+	// goes back to the loaders, the reference is valid until the next call
+	const GX_Dataset & nextBatch();
+
+	// heap bytes of the slots
+	size_t getBytes() const;
+
+	// samples augmented ahead of the batch being read, 0 inline
+	size_t getReadyCount() const;
+
+private:
+	void run();
+
+	size_t getBatchSize( size_t batch ) const;
+
+private:
+	const GX_Augmenter & mAugmenter;
+	const GX_Dataset & mInput;
+	size_t mBatchSize;
+
+	std::vector< GX_Dataset > mSlots;
+	std::vector< size_t > mFilled;
+
+	std::vector< int > mOrder;
+	size_t mEpoch, mNextPos, mNextBatch, mReleased;
+	bool mIsStop;
+
+	mutable std::mutex mMutex;
+	std::condition_variable mLoaderCond, mTrainerCond;
+	std::vector< std::thread > mThreads;
+};
+
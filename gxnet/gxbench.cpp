@@ -0,0 +1,1092 @@
+
+#include "gxnet.h"
+#include "gxact.h"
+#include "gxutils.h"
+#include "gxprof.h"
+#include "gxtrace.h"
+#include "gxstats.h"
+#include "gxckpt.h"
+#include "gxpool.h"
+#include "gxdist.h"
+#include "gxpipe.h"
+#include "gxaugment.h"
+#include "gxcache.h"
+#include "gxstream.h"
+#include "gxonline.h"
+#include "gxsynth.h"
+
+#include <random>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <numeric>
+
+#include <unistd.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <string.h>
+
+/*
+* Synthetic throughput benchmark for the testmnist and testemnist topologies.
+* It needs no dataset on disk, so it can run anywhere the code builds. The bit
+* for bit checks of the same paths live in the test programs.
+*/
+
+typedef struct tagBenchArgs {
+	const char * mNet;
+	int mTrainingCount;
+	int mEvalCount;
+	int mEpochCount;
+	int mMiniBatchCount;
+	float mLearningRate;
+	unsigned int mSeed;
+	bool mIsProfile;
+	const char * mPerfRegion;
+	const char * mTracePath;
+	const char * mStatsPath;
+	int mThreadCount;
+	int mHogwildCount;
+	int mPoolCount;
+	int mProcCount;
+	const char * mTransport;
+	int mStageCount;
+	int mMicroBatchCount;
+	const char * mSchedule;
+	int mCheckpointInterval;
+	const char * mHalf;
+	int mLoaderCount;
+} BenchArgs_t;
+
+typedef std::chrono::steady_clock BenchClock_t;
+
+static double elapsedSeconds( const BenchClock_t::time_point & beginTime )
+{
+	std::chrono::duration< double > span = BenchClock_t::now() - beginTime;
+
+	return span.count();
+}
+
+/*
+* Full text checkpoints against delta checkpoints over a few short epochs. The caller
+* only pays for the snapshot, serialization runs on the writer thread.
+*/
+bool benchCheckpoint( const char * tag, GX_Network & network, const GX_Dataset & input, const GX_Dataset & target )
+{
+	enum { CHECKPOINT_COUNT = 4 };
+
+	size_t sliceCount = std::max( input.size() / 5, (size_t)1 );
+	GX_Dataset inputSlice, targetSlice;
+	for( size_t i = 0; i < sliceCount; i++ ) {
+		inputSlice.append( input[ i ], input.getDim() );
+		targetSlice.append( target[ i ], target.getDim() );
+	}
+
+	char textPrefix[ 128 ] = { 0 }, deltaPrefix[ 128 ] = { 0 };
+	snprintf( textPrefix, sizeof( textPrefix ), "./gxbench.%s.%d.text", tag, getpid() );
+	snprintf( deltaPrefix, sizeof( deltaPrefix ), "./gxbench.%s.%d.delta", tag, getpid() );
+
+	long textMicros = 0, deltaMicros = 0;
+	size_t textBytes = 0, deltaBytes = 0;
+	double textTime = 0, deltaTime = 0;
+	bool isSucc = true;
+
+	GX_Checkpointer text( textPrefix, 0, GX_Checkpointer::eText );
+	GX_Checkpointer delta( deltaPrefix, 0, GX_Checkpointer::eDelta );
+
+	for( int i = 0; i < CHECKPOINT_COUNT; i++ ) {
+		if( i > 0 ) network.train( inputSlice, targetSlice, 1, 100, 0.1 );
+
+		BenchClock_t::time_point beginTime = BenchClock_t::now();
+		isSucc = text.save( network, i ) && isSucc;
+		textMicros += text.getSnapshotMicros();
+		isSucc = text.flush() && isSucc;
+		textTime += elapsedSeconds( beginTime );
+
+		beginTime = BenchClock_t::now();
+		isSucc = delta.save( network, i ) && isSucc;
+		deltaMicros += delta.getSnapshotMicros();
+		isSucc = delta.flush() && isSucc;
+		deltaTime += elapsedSeconds( beginTime );
+	}
+
+	textBytes = text.getWrittenBytes();
+	deltaBytes = delta.getWrittenBytes();
+
+	for( int i = 0; i < CHECKPOINT_COUNT; i++ ) {
+		char path[ 256 ] = { 0 };
+		snprintf( path, sizeof( path ), "%s.%d.model", textPrefix, i );
+		unlink( path );
+		snprintf( path, sizeof( path ), "%s.%d.base.model", deltaPrefix, i );
+		unlink( path );
+		snprintf( path, sizeof( path ), "%s.%d.delta", deltaPrefix, i );
+		unlink( path );
+	}
+
+	printf( "\nbench %s checkpoint, %d epochs of %zu samples:\n", tag, CHECKPOINT_COUNT, sliceCount );
+	printf( "\ttext    %s, snapshot %ld us, written in %.3f s, %.1f KB\n", isSucc ? "succ" : "fail",
+			textMicros / CHECKPOINT_COUNT, textTime, textBytes / 1024.0 );
+	printf( "\tdelta   %s, snapshot %ld us, written in %.3f s, %.1f KB, %.1fx smaller\n\n",
+			isSucc ? "succ" : "fail", deltaMicros / CHECKPOINT_COUNT, deltaTime, deltaBytes / 1024.0,
+			(double)textBytes / std::max( deltaBytes, (size_t)1 ) );
+
+	return isSucc;
+}
+
+// share of input4eval the network classifies right
+double evalAccuracy( const GX_Network & network, const GX_DataMatrix & input4eval, const GX_DataMatrix & target4eval )
+{
+	GX_InferenceContext ctx( network );
+
+	size_t correct = 0;
+	for( size_t i = 0; i < input4eval.size(); i++ ) {
+		network.forward( input4eval[ i ], &ctx );
+		if( GX_Utils::max_index( std::begin( ctx.getOutput() ), std::end( ctx.getOutput() ) )
+				== GX_Utils::max_index( std::begin( target4eval[ i ] ), std::end( target4eval[ i ] ) ) ) correct++;
+	}
+
+	return (double)correct / input4eval.size();
+}
+
+// data-parallel train of a copy in args.mProcCount processes, rank 0 reports
+bool benchDataParallel( const char * tag, const GX_Network & network, const BenchArgs_t & args,
+		const GX_Dataset & input, const GX_Dataset & target,
+		const GX_DataMatrix & input4eval, const GX_DataMatrix & target4eval )
+{
+	GX_Network replica;
+	network.clone( &replica );
+
+	fflush( stdout );
+
+	return GX_Launcher::run( args.mProcCount, GX_Launcher::getTransport( args.mTransport ), [ & ]( GX_Communicator * comm ) {
+		// rank 0 prints the epochs, the others keep quiet
+		if( 0 != comm->getRank() ) freopen( "/dev/null", "w", stdout );
+
+		BenchClock_t::time_point beginTime = BenchClock_t::now();
+
+		GX_DataVector losses;
+		bool ret = replica.trainDataParallel( input, target, args.mEpochCount, args.mMiniBatchCount,
+				args.mLearningRate, 0, comm, &losses );
+
+		double trainTime = elapsedSeconds( beginTime );
+
+		if( 0 == comm->getRank() ) {
+			printf( "\nbench %s data-parallel:\n", tag );
+			printf( "\tdp      %zu samples x %d epochs on %d procs over %s, %.3f s, %.1f samples/sec, loss %.6f, accuracy %.4f\n",
+					input.size(), args.mEpochCount, comm->getSize(), args.mTransport, trainTime,
+					input.size() * args.mEpochCount / trainTime, losses[ losses.size() - 1 ],
+					evalAccuracy( replica, input4eval, target4eval ) );
+		}
+
+		return ret ? 0 : 1;
+	} );
+}
+
+// train three copies, serial, with the layer loops on the pool and the memory plan, and with
+// the backward task graph on the pool
+bool benchPoolTrain( const char * tag, const GX_Network & network, const BenchArgs_t & args,
+		const GX_Dataset & input, const GX_Dataset & target )
+{
+	GX_Network planned, overlapped, serial;
+	network.clone( &planned );
+	network.clone( &overlapped );
+	network.clone( &serial );
+
+	overlapped.setOverlap( true );
+
+	BenchClock_t::time_point beginTime = BenchClock_t::now();
+
+	bool isSucc = serial.train( input, target, args.mEpochCount, args.mMiniBatchCount, args.mLearningRate, 0 );
+
+	double serialTime = elapsedSeconds( beginTime );
+
+	GX_ThreadPool::setDefault( args.mPoolCount );
+
+	beginTime = BenchClock_t::now();
+
+	isSucc = planned.train( input, target, args.mEpochCount, args.mMiniBatchCount, args.mLearningRate, 0 ) && isSucc;
+
+	double plannedTime = elapsedSeconds( beginTime );
+
+	beginTime = BenchClock_t::now();
+
+	isSucc = overlapped.train( input, target, args.mEpochCount, args.mMiniBatchCount, args.mLearningRate, 0 ) && isSucc;
+
+	double overlapTime = elapsedSeconds( beginTime );
+
+	GX_ThreadPool::setDefault( 0 );
+
+	printf( "\nbench %s pool train:\n", tag );
+	printf( "\tserial  %zu samples x %d epochs, %.3f s, %.1f samples/sec\n", input.size(), args.mEpochCount,
+			serialTime, input.size() * args.mEpochCount / serialTime );
+	printf( "\tpool    %d threads, planned, %.3f s, %.1f samples/sec\n", args.mPoolCount, plannedTime,
+			input.size() * args.mEpochCount / plannedTime );
+	printf( "\tpool    %d threads, overlap, %.3f s, %.1f samples/sec\n", args.mPoolCount, overlapTime,
+			input.size() * args.mEpochCount / overlapTime );
+
+	return isSucc;
+}
+
+// train two copies, one against the one-hot rows and one against the class indexes
+bool benchLabels( const char * tag, const GX_Network & network, const BenchArgs_t & args,
+		const GX_Dataset & input, const GX_Dataset & target )
+{
+	GX_LabelVector labels;
+	labels.reserve( target.size() );
+	for( size_t i = 0; i < target.size(); i++ ) {
+		labels.push_back( GX_Utils::max_index( target[ i ], target[ i ] + target.getDim() ) );
+	}
+
+	GX_Network labeled, oneHot;
+	network.clone( &labeled );
+	network.clone( &oneHot );
+
+	BenchClock_t::time_point beginTime = BenchClock_t::now();
+
+	bool isSucc = oneHot.train( input, target, args.mEpochCount, args.mMiniBatchCount, args.mLearningRate, 0 );
+
+	double oneHotTime = elapsedSeconds( beginTime );
+
+	beginTime = BenchClock_t::now();
+
+	isSucc = labeled.train( input, labels, args.mEpochCount, args.mMiniBatchCount, args.mLearningRate, 0 ) && isSucc;
+
+	double labeledTime = elapsedSeconds( beginTime );
+
+	printf( "\nbench %s labels:\n", tag );
+	printf( "\tone-hot %zu samples x %d epochs, %.3f s, %.1f samples/sec, target %.1f KB\n", input.size(),
+			args.mEpochCount, oneHotTime, input.size() * args.mEpochCount / oneHotTime, target.getBytes() / 1024.0 );
+	printf( "\tlabels  %.3f s, %.1f samples/sec, target %.1f KB\n", labeledTime,
+			input.size() * args.mEpochCount / labeledTime, gx_heap_bytes( labels.capacity() * sizeof( uint16_t ) ) / 1024.0 );
+
+	return isSucc;
+}
+
+// the training set written to shards, trained from them in order against the in-memory run,
+// then one shuffled pass through the stream buffer
+bool benchStream( const char * tag, const GX_Network & network, const BenchArgs_t & args,
+		const GX_Dataset & input, const GX_Dataset & target )
+{
+	char prefix[ 128 ] = { 0 };
+	snprintf( prefix, sizeof( prefix ), "./gxbench.%s.%d.shard", tag, getpid() );
+
+	size_t shardSamples = std::max( input.size() / 8, (size_t)1 );
+	size_t bufferSamples = std::max( input.size() / 4, (size_t)1 );
+
+	BenchClock_t::time_point beginTime = BenchClock_t::now();
+
+	GX_ShardWriter writer( prefix, shardSamples );
+
+	bool isWritten = true;
+	for( size_t i = 0; isWritten && i < input.size(); i++ ) {
+		isWritten = writer.append( input[ i ], input.getDim(), target[ i ], target.getDim() );
+	}
+	isWritten = writer.close() && isWritten;
+
+	double writeTime = elapsedSeconds( beginTime );
+
+	GX_ShardStream stream( prefix, bufferSamples, args.mSeed );
+	bool isOpened = isWritten && stream.open();
+
+	GX_Network streamed, resident;
+	network.clone( &streamed );
+	network.clone( &resident );
+
+	streamed.setShuffle( false );
+	resident.setShuffle( false );
+
+	beginTime = BenchClock_t::now();
+
+	bool isTrained = resident.train( input, target, args.mEpochCount, args.mMiniBatchCount, args.mLearningRate, 0 );
+
+	double residentTime = elapsedSeconds( beginTime );
+
+	beginTime = BenchClock_t::now();
+
+	isTrained = isOpened && streamed.train( stream, args.mEpochCount, args.mMiniBatchCount, args.mLearningRate, 0 )
+			&& isTrained;
+
+	double streamTime = elapsedSeconds( beginTime );
+
+	GX_Dataset batchInput( std::max( args.mMiniBatchCount, 1 ), input.getDim() );
+	GX_Dataset batchRows( std::max( args.mMiniBatchCount, 1 ), target.getDim() );
+	GX_LabelVector batchLabels;
+
+	size_t passCount = 0;
+
+	beginTime = BenchClock_t::now();
+
+	if( isOpened ) stream.start( 0, true );
+
+	for( size_t count = 0; isOpened && ( count = stream.next( &batchInput, &batchRows, &batchLabels ) ) > 0; ) {
+		passCount += count;
+	}
+
+	double shuffleTime = elapsedSeconds( beginTime );
+
+	size_t streamBytes = stream.getBytes();
+
+	for( size_t i = 0; i < writer.getShardCount(); i++ ) {
+		char path[ 160 ] = { 0 };
+		snprintf( path, sizeof( path ), "%s.%05zu", prefix, i );
+		unlink( path );
+	}
+
+	printf( "\nbench %s stream:\n", tag );
+	printf( "\tshards  %zu of %zu samples, %s, %.3f ms\n", writer.getShardCount(), shardSamples,
+			isWritten ? "succ" : "fail", writeTime * 1000 );
+	printf( "\tin order %.3f s, %.1f samples/sec, resident %.3f s, %.1f samples/sec\n", streamTime,
+			input.size() * args.mEpochCount / streamTime, residentTime, input.size() * args.mEpochCount / residentTime );
+	printf( "\tshuffled pass of %zu samples %.3f ms, buffer %zu samples, stream %.1f KB of %.1f KB\n",
+			passCount, shuffleTime * 1000, bufferSamples, streamBytes / 1024.0,
+			( input.getBytes() + target.getBytes() ) / 1024.0 );
+
+	return isWritten && isTrained;
+}
+
+// one epoch pushed sample by sample into online trainers, inline with target rows and through the
+// trainer thread with class indexes and a checkpoint every quarter, against train with the same
+// L2 decay over the same sample count
+bool benchOnline( const char * tag, const GX_Network & network, const BenchArgs_t & args,
+		const GX_Dataset & input, const GX_Dataset & target )
+{
+	GX_Network resident, inlined, queued;
+	network.clone( &resident );
+	network.clone( &inlined );
+	network.clone( &queued );
+
+	GX_DataType lambda = 5.0;
+	int trainingCount = (int)input.size();
+
+	BenchClock_t::time_point beginTime = BenchClock_t::now();
+
+	resident.train( input, target, 1, args.mMiniBatchCount, args.mLearningRate, lambda );
+
+	double residentTime = elapsedSeconds( beginTime );
+
+	beginTime = BenchClock_t::now();
+
+	bool isPushed = true;
+
+	{
+		GX_OnlineTrainer trainer( &inlined, args.mMiniBatchCount, args.mLearningRate, lambda, trainingCount );
+
+		for( size_t i = 0; isPushed && i < input.size(); i++ ) {
+			isPushed = trainer.push( input[ i ], input.getDim(), target[ i ], target.getDim() );
+		}
+
+		isPushed = trainer.stop() && isPushed;
+	}
+
+	double inlineTime = elapsedSeconds( beginTime );
+
+	char prefix[ 128 ] = { 0 };
+	snprintf( prefix, sizeof( prefix ), "./gxbench.%s.%d.online", tag, getpid() );
+
+	GX_Checkpointer checkpointer( prefix, 2, GX_Checkpointer::eBinary );
+
+	size_t checkpointCount = 0, trainerBytes = 0;
+
+	beginTime = BenchClock_t::now();
+
+	{
+		GX_OnlineTrainer trainer( &queued, args.mMiniBatchCount, args.mLearningRate, lambda, trainingCount,
+				4 * std::max( args.mMiniBatchCount, 1 ) );
+		trainer.setCheckpointer( &checkpointer, std::max( input.size() / 4, (size_t)1 ), 0 );
+
+		for( size_t i = 0; isPushed && i < input.size(); i++ ) {
+			uint16_t label = GX_Utils::max_index( target[ i ], target[ i ] + target.getDim() );
+			isPushed = trainer.push( input[ i ], input.getDim(), label );
+		}
+
+		isPushed = trainer.stop() && isPushed;
+
+		checkpointCount = trainer.getCheckpointCount();
+		trainerBytes = trainer.getBytes();
+	}
+
+	double queueTime = elapsedSeconds( beginTime );
+
+	for( size_t i = 0; i < checkpointCount; i++ ) {
+		char path[ 256 ] = { 0 };
+		snprintf( path, sizeof( path ), "%s.%zu.model", prefix, i );
+		unlink( path );
+	}
+
+	printf( "\nbench %s online:\n", tag );
+	printf( "\tresident 1 epoch of %zu samples, lambda %g, %.3f s, %.1f samples/sec\n", input.size(),
+			(double)lambda, residentTime, input.size() / residentTime );
+	printf( "\tinline  %.3f s, %.1f samples/sec\n", inlineTime, input.size() / inlineTime );
+	printf( "\tqueue   %.3f s, %.1f samples/sec, %.1f KB, %zu checkpoints\n",
+			queueTime, input.size() / queueTime, trainerBytes / 1024.0, checkpointCount );
+
+	return isPushed;
+}
+
+// two copies trained on rotated and shifted samples, one fed by the loader threads and one
+// augmenting inline
+bool benchAugment( const char * tag, const GX_Network & network, const BenchArgs_t & args,
+		const GX_Dataset & input, const GX_Dataset & target )
+{
+	size_t side = (size_t)std::sqrt( (double)input.getDim() );
+
+	GX_Augmenter augmenter( side );
+	augmenter.setCenterRate( 0.5 );
+	augmenter.setRotation( 15 );
+	augmenter.setTranslation( 2 );
+	augmenter.setSeed( args.mSeed );
+
+	GX_Network loaded, inlined;
+	network.clone( &loaded );
+	network.clone( &inlined );
+
+	loaded.setAugmenter( &augmenter, args.mLoaderCount );
+	inlined.setAugmenter( &augmenter, 0 );
+
+	BenchClock_t::time_point beginTime = BenchClock_t::now();
+
+	bool isSucc = inlined.train( input, target, args.mEpochCount, args.mMiniBatchCount, args.mLearningRate, 0 );
+
+	double inlineTime = elapsedSeconds( beginTime );
+
+	beginTime = BenchClock_t::now();
+
+	isSucc = loaded.train( input, target, args.mEpochCount, args.mMiniBatchCount, args.mLearningRate, 0 ) && isSucc;
+
+	double loaderTime = elapsedSeconds( beginTime );
+
+	GX_AugmentLoader loader( augmenter, input, args.mLoaderCount, args.mMiniBatchCount );
+
+	printf( "\nbench %s augment:\n", tag );
+	printf( "\tinline  %zu samples x %d epochs, %.3f s, %.1f samples/sec\n", input.size(), args.mEpochCount,
+			inlineTime, input.size() * args.mEpochCount / inlineTime );
+	printf( "\tloaders %d threads, %.3f s, %.1f samples/sec, slots %.1f KB against %.1f KB per stored copy\n",
+			args.mLoaderCount, loaderTime, input.size() * args.mEpochCount / loaderTime, loader.getBytes() / 1024.0,
+			input.getBytes() / 1024.0 );
+
+	return isSucc;
+}
+
+// train two copies, one recomputing the outputs between checkpoints
+bool benchRecompute( const char * tag, const GX_Network & network, const BenchArgs_t & args,
+		const GX_Dataset & input, const GX_Dataset & target )
+{
+	GX_Network recompute, serial;
+	network.clone( &recompute );
+	network.clone( &serial );
+
+	recompute.setCheckpointInterval( args.mCheckpointInterval );
+
+	std::vector< bool > checkpoints;
+	recompute.getCheckpoints( &checkpoints );
+
+	GX_MemPlan fullPlan( serial.getLayers(), GX_MemPlan::eTraining );
+	GX_MemPlan plan( recompute.getLayers(), GX_MemPlan::eTraining, checkpoints );
+
+	BenchClock_t::time_point beginTime = BenchClock_t::now();
+
+	bool isSucc = serial.train( input, target, args.mEpochCount, args.mMiniBatchCount, args.mLearningRate, 0 );
+
+	double serialTime = elapsedSeconds( beginTime );
+
+	beginTime = BenchClock_t::now();
+
+	isSucc = recompute.train( input, target, args.mEpochCount, args.mMiniBatchCount, args.mLearningRate, 0 ) && isSucc;
+
+	double recomputeTime = elapsedSeconds( beginTime );
+
+	printf( "\nbench %s recompute:\n", tag );
+	printf( "\tserial    %zu samples x %d epochs, %.3f s, %.1f samples/sec, plan %.1f KB\n", input.size(),
+			args.mEpochCount, serialTime, input.size() * args.mEpochCount / serialTime, fullPlan.getPlannedBytes() / 1024.0 );
+	printf( "\trecompute every %d layers, %zu layers recomputed, %.3f s, %.1f samples/sec, plan %.1f KB\n",
+			args.mCheckpointInterval, plan.getRecomputeCount(), recomputeTime, input.size() * args.mEpochCount / recomputeTime,
+			plan.getPlannedBytes() / 1024.0 );
+
+	return isSucc;
+}
+
+// pipeline train of a copy against a serial train of another copy
+bool benchPipeline( const char * tag, const GX_Network & network, const BenchArgs_t & args,
+		const GX_Dataset & input, const GX_Dataset & target,
+		const GX_DataMatrix & input4eval, const GX_DataMatrix & target4eval )
+{
+	GX_Network staged, serial;
+	network.clone( &staged );
+	network.clone( &serial );
+
+	std::vector< size_t > splits;
+	GX_Pipeline::balance( staged, args.mStageCount, &splits );
+
+	// the pipeline takes its micro-batches as rows
+	GX_DataMatrix inputRows, targetRows;
+	input.toMatrix( &inputRows );
+	target.toMatrix( &targetRows );
+
+	GX_Pipeline pipeline( &staged, splits, GX_Pipeline::getSchedule( args.mSchedule ) );
+
+	BenchClock_t::time_point beginTime = BenchClock_t::now();
+
+	GX_DataVector losses;
+	bool isSucc = pipeline.train( inputRows, targetRows, args.mEpochCount, args.mMiniBatchCount, args.mMicroBatchCount,
+			args.mLearningRate, 0, &losses );
+
+	double pipelineTime = elapsedSeconds( beginTime );
+
+	beginTime = BenchClock_t::now();
+
+	bool isSerial = serial.train( input, target, args.mEpochCount, args.mMiniBatchCount, args.mLearningRate, 0 );
+
+	double serialTime = elapsedSeconds( beginTime );
+
+	printf( "\nbench %s pipeline:\n", tag );
+	printf( "\tpipe    %zu samples x %d epochs, %zu stages, micro-batch %d, %.3f s, %.1f samples/sec, loss %.6f, accuracy %.4f\n",
+			input.size(), args.mEpochCount, splits.size() + 1, args.mMicroBatchCount, pipelineTime,
+			input.size() * args.mEpochCount / pipelineTime, isSucc ? losses[ losses.size() - 1 ] : 0,
+			evalAccuracy( staged, input4eval, target4eval ) );
+	printf( "\tserial  %.3f s, %.1f samples/sec\n", serialTime, input.size() * args.mEpochCount / serialTime );
+
+	pipeline.printStageStats();
+
+	return isSucc && isSerial;
+}
+
+// forward of a copy with 16-bit storage against the full width outputs in expected
+void benchHalf( const char * tag, const GX_Network & network, int format,
+		const GX_DataMatrix & input4eval, const GX_DataMatrix & expected )
+{
+	GX_Network half;
+	network.clone( &half );
+	half.setStorage( format );
+
+	size_t fullBytes = 0, halfBytes = 0;
+	for( auto & layer : half.getLayers() ) {
+		fullBytes += layer->getParamCount() * sizeof( GX_DataType );
+		halfBytes += layer->getPackedParams().size() * sizeof( GX_HalfType );
+	}
+
+	GX_InferenceContext fullCtx( network ), ctx( half );
+
+	GX_DataMatrix output;
+
+	BenchClock_t::time_point beginTime = BenchClock_t::now();
+
+	for( auto & item : input4eval ) {
+		half.forward( item, &ctx );
+		output.emplace_back( ctx.getOutput() );
+	}
+
+	double halfTime = elapsedSeconds( beginTime );
+
+	beginTime = BenchClock_t::now();
+
+	for( auto & item : input4eval ) network.forward( item, &fullCtx );
+
+	double fullTime = elapsedSeconds( beginTime );
+
+	size_t agree = 0;
+	GX_DataType maxDiff = 0;
+
+	for( size_t i = 0; i < input4eval.size(); i++ ) {
+		if( GX_Utils::max_index( std::begin( output[ i ] ), std::end( output[ i ] ) )
+				== GX_Utils::max_index( std::begin( expected[ i ] ), std::end( expected[ i ] ) ) ) agree++;
+		maxDiff = std::max( maxDiff, std::abs( output[ i ] - expected[ i ] ).max() );
+	}
+
+	printf( "\nbench %s %s%s:\n", tag, GX_Half::getName( format ),
+			GX_Half::eFP16 == format && ! GX_Half::isF16C() ? ", software conversion" : "" );
+	printf( "\tweights %.1f KB, full %.1f KB, context %.1f KB, full %.1f KB\n", halfBytes / 1024.0, fullBytes / 1024.0,
+			ctx.getBytes() / 1024.0, fullCtx.getBytes() / 1024.0 );
+	printf( "\tforward %zu samples, %.3f s, %.1f samples/sec, full %.3f s, %.1f samples/sec\n", input4eval.size(),
+			halfTime, input4eval.size() / halfTime, fullTime, input4eval.size() / fullTime );
+	printf( "\targmax agrees with full on %zu of %zu, max abs diff %g\n", agree, input4eval.size(), (double)maxDiff );
+}
+
+bool bench( const char * tag, GX_Network & network, const BenchArgs_t & args,
+		const GX_Dataset & input, const GX_Dataset & target,
+		const GX_DataMatrix & input4eval, const GX_DataMatrix & target4eval )
+{
+	bool ret = true;
+
+	// fork before any thread of the serial run is started, the copy starts from the same weights
+	if( args.mProcCount > 1 && ! benchDataParallel( tag, network, args, input, target, input4eval, target4eval ) ) {
+		printf( "bench %s data-parallel fail\n", tag );
+		ret = false;
+	}
+
+	if( args.mPoolCount > 0 ) ret = benchPoolTrain( tag, network, args, input, target ) && ret;
+
+	if( args.mStageCount > 1 ) ret = benchPipeline( tag, network, args, input, target, input4eval, target4eval ) && ret;
+
+	if( args.mCheckpointInterval > 1 ) ret = benchRecompute( tag, network, args, input, target ) && ret;
+
+	ret = benchLabels( tag, network, args, input, target ) && ret;
+
+	ret = benchStream( tag, network, args, input, target ) && ret;
+
+	ret = benchOnline( tag, network, args, input, target ) && ret;
+
+	if( args.mLoaderCount > 0 ) ret = benchAugment( tag, network, args, input, target ) && ret;
+
+	// hogwild starts from the same weights as the serial run
+	GX_Network hogwild;
+	if( args.mHogwildCount > 0 ) network.clone( &hogwild );
+
+	GX_Profiler profiler;
+	if( NULL != args.mPerfRegion ) profiler.enablePerf( args.mPerfRegion, network.getLayers().size() );
+	if( args.mIsProfile || NULL != args.mPerfRegion ) network.setProfiler( &profiler );
+
+	GX_Tracer tracer;
+	if( NULL != args.mTracePath ) network.setTracer( &tracer );
+
+	GX_StatsWriter statsWriter;
+	if( NULL != args.mStatsPath && statsWriter.open( args.mStatsPath ) ) network.setStatsWriter( &statsWriter );
+
+	BenchClock_t::time_point beginTime = BenchClock_t::now();
+
+	GX_DataVector losses;
+	ret = network.train( input, target, args.mEpochCount, args.mMiniBatchCount, args.mLearningRate, 0, &losses ) && ret;
+
+	double trainTime = elapsedSeconds( beginTime );
+
+	double hogwildTime = 0;
+	GX_DataVector hogwildLosses;
+
+	if( args.mHogwildCount > 0 ) {
+		beginTime = BenchClock_t::now();
+		hogwild.trainHogwild( input, target, args.mEpochCount, args.mMiniBatchCount, args.mLearningRate, 0,
+				args.mHogwildCount, &hogwildLosses );
+		hogwildTime = elapsedSeconds( beginTime );
+	}
+
+	beginTime = BenchClock_t::now();
+
+	GX_DataMatrix output;
+	for( auto & item : input4eval ) network.forward( item, &output );
+
+	double forwardTime = elapsedSeconds( beginTime );
+
+	// one shared network, one inference context per thread, checked against a run that keeps
+	// every layer output, so the ping-pong slots of the context plan are checked too
+	GX_DataMatrix expected;
+	for( auto & item : input4eval ) {
+		network.forward( item, &output );
+		expected.emplace_back( output.back() );
+	}
+
+	GX_InferenceContext serialCtx( network );
+	serialCtx.getPlan().print( tag );
+
+	std::vector< size_t > mismatches( args.mThreadCount, 0 );
+	std::vector< std::thread > threads;
+
+	beginTime = BenchClock_t::now();
+
+	for( int t = 0; t < args.mThreadCount; t++ ) {
+		threads.emplace_back( [ & ]( int index ) {
+			GX_InferenceContext ctx( network );
+			for( size_t i = index; i < input4eval.size(); i += args.mThreadCount ) {
+				network.forward( input4eval[ i ], &ctx );
+				if( ( ctx.getOutput() != expected[ i ] ).max() ) mismatches[ index ]++;
+			}
+		}, t );
+	}
+
+	for( auto & item : threads ) item.join();
+
+	double concurrentTime = elapsedSeconds( beginTime );
+
+	// single caller, the layer loops split over the pool, must match the serial run bit for bit
+	double poolTime = 0;
+	size_t poolMismatch = 0;
+
+	if( args.mPoolCount > 0 ) {
+		GX_ThreadPool::setDefault( args.mPoolCount );
+
+		beginTime = BenchClock_t::now();
+
+		for( size_t i = 0; i < input4eval.size(); i++ ) {
+			network.forward( input4eval[ i ], &serialCtx );
+			if( ( serialCtx.getOutput() != expected[ i ] ).max() ) poolMismatch++;
+		}
+
+		poolTime = elapsedSeconds( beginTime );
+
+		GX_ThreadPool::setDefault( 0 );
+	}
+
+	network.setProfiler( NULL );
+	network.setTracer( NULL );
+	network.setStatsWriter( NULL );
+
+	if( NULL != args.mTracePath ) {
+		char tracePath[ 256 ] = { 0 };
+		snprintf( tracePath, sizeof( tracePath ), "%s.%s.json", args.mTracePath, tag );
+		tracer.save( tracePath );
+	}
+
+	char path[ 128 ] = { 0 };
+	snprintf( path, sizeof( path ), "./gxbench.%s.%d.model", tag, getpid() );
+
+	beginTime = BenchClock_t::now();
+	bool isSaved = GX_Utils::save( path, network );
+	double saveTime = elapsedSeconds( beginTime );
+
+	GX_Network loaded;
+
+	beginTime = BenchClock_t::now();
+	bool isLoaded = isSaved && GX_Utils::load( path, &loaded );
+	double loadTime = elapsedSeconds( beginTime );
+
+	unlink( path );
+
+	beginTime = BenchClock_t::now();
+	bool isBinarySaved = GX_Utils::saveBinary( path, network );
+	double binarySaveTime = elapsedSeconds( beginTime );
+
+	GX_Network binaryLoaded;
+
+	beginTime = BenchClock_t::now();
+	bool isBinaryLoaded = isBinarySaved && GX_Utils::loadBinary( path, &binaryLoaded );
+	double binaryLoadTime = elapsedSeconds( beginTime );
+
+	unlink( path );
+
+	printf( "\nbench %s:\n", tag );
+	printf( "\ttrain   %zu samples x %d epochs, %.3f s, %.1f samples/sec, loss %.6f, accuracy %.4f\n",
+			input.size(), args.mEpochCount, trainTime, input.size() * args.mEpochCount / trainTime,
+			losses[ losses.size() - 1 ], evalAccuracy( network, input4eval, target4eval ) );
+	if( args.mHogwildCount > 0 ) {
+		printf( "\thogwild %zu samples x %d epochs on %d threads, %.3f s, %.1f samples/sec, loss %.6f, accuracy %.4f\n",
+				input.size(), args.mEpochCount, args.mHogwildCount, hogwildTime,
+				input.size() * args.mEpochCount / hogwildTime,
+				hogwildLosses[ hogwildLosses.size() - 1 ], evalAccuracy( hogwild, input4eval, target4eval ) );
+	}
+	printf( "\tforward %zu samples, %.3f s, %.1f samples/sec\n", input4eval.size(),
+			forwardTime, input4eval.size() / forwardTime );
+	printf( "\tforward %zu samples on %d threads, %.3f s, %.1f samples/sec, %zu mismatch\n",
+			input4eval.size(), args.mThreadCount, concurrentTime, input4eval.size() / concurrentTime,
+			std::accumulate( mismatches.begin(), mismatches.end(), (size_t)0 ) );
+	if( args.mPoolCount > 0 ) {
+		printf( "\tforward %zu samples on a pool of %d threads, %.3f s, %.1f samples/sec, %.1f us/sample, %zu mismatch\n",
+				input4eval.size(), args.mPoolCount, poolTime, input4eval.size() / poolTime,
+				poolTime * 1e6 / input4eval.size(), poolMismatch );
+	}
+	printf( "\tsave    %s, %.3f s\n", isSaved ? "succ" : "fail", saveTime );
+	printf( "\tload    %s, %.3f s\n", isLoaded ? "succ" : "fail", loadTime );
+	printf( "\tsave    binary %s, %.3f s\n", isBinarySaved ? "succ" : "fail", binarySaveTime );
+	printf( "\tload    binary %s, %.3f s\n", isBinaryLoaded ? "succ" : "fail", binaryLoadTime );
+	printf( "\tpeakRSS %ld KB\n\n", GX_Utils::getPeakRSS() );
+
+	size_t mismatch = std::accumulate( mismatches.begin(), mismatches.end(), (size_t)0 ) + poolMismatch;
+
+	ret = ret && 0 == mismatch && isLoaded && isBinaryLoaded;
+
+	if( args.mIsProfile ) profiler.printRoofline( network );
+
+	if( NULL != args.mHalf ) {
+		std::string half = args.mHalf;
+
+		if( "all" == half || "bf16" == half ) benchHalf( tag, network, GX_Half::eBF16, input4eval, expected );
+		if( "all" == half || "fp16" == half ) benchHalf( tag, network, GX_Half::eFP16, input4eval, expected );
+	}
+
+	ret = benchCheckpoint( tag, network, input, target ) && ret;
+
+	return ret;
+}
+
+// one shuffled pass over every item of the training input, one heap block per row against the slab
+void benchDataset( const char * tag, const GX_DataMatrix & rows, const GX_Dataset & data )
+{
+	std::vector< size_t > order( rows.size() );
+	std::iota( order.begin(), order.end(), 0 );
+	std::shuffle( order.begin(), order.end(), std::mt19937( 2024 ) );
+
+	BenchClock_t::time_point beginTime = BenchClock_t::now();
+
+	GX_AccumType rowsSum = 0;
+	for( auto & i : order ) {
+		for( size_t j = 0; j < rows[ i ].size(); j++ ) rowsSum += rows[ i ][ j ];
+	}
+
+	double rowsTime = elapsedSeconds( beginTime );
+
+	beginTime = BenchClock_t::now();
+
+	GX_AccumType dataSum = 0;
+	size_t dim = data.getDim();
+	for( auto & i : order ) {
+		const GX_DataType * sample = data[ i ];
+		for( size_t j = 0; j < dim; j++ ) dataSum += sample[ j ];
+	}
+
+	double dataTime = elapsedSeconds( beginTime );
+
+	printf( "\nbench %s dataset:\n", tag );
+	printf( "\tmatrix  %zu samples, %.1f KB, shuffled pass %.3f ms, sum %.3f\n", rows.size(), gx_matrix_bytes( rows ) / 1024.0,
+			rowsTime * 1000, (double)rowsSum );
+	printf( "\tdataset stride %zu, %.1f KB, shuffled pass %.3f ms, sum %.3f\n", data.getStride(), data.getBytes() / 1024.0,
+			dataTime * 1000, (double)dataSum );
+}
+
+// the training sets through a cache file, saved and mapped back
+bool benchCache( const char * tag, const GX_Dataset & input, const GX_Dataset & target, unsigned int seed )
+{
+	char path[ 128 ] = { 0 };
+	snprintf( path, sizeof( path ), "./gxbench.%s.%d.cache", tag, getpid() );
+
+	GX_DataCache cache;
+	cache.addValue( seed );
+	cache.addValue( input.size() );
+
+	BenchClock_t::time_point beginTime = BenchClock_t::now();
+	bool isSaved = cache.save( path, { &input, &target }, {} );
+	double saveTime = elapsedSeconds( beginTime );
+
+	GX_Dataset mappedInput, mappedTarget;
+
+	beginTime = BenchClock_t::now();
+	bool isMapped = isSaved && cache.load( path, { &mappedInput, &mappedTarget }, {} );
+	double mapTime = elapsedSeconds( beginTime );
+
+	// the pages are read on the first touch
+	beginTime = BenchClock_t::now();
+
+	GX_AccumType sum = 0;
+	size_t dim = mappedInput.getDim();
+	for( size_t i = 0; i < mappedInput.size(); i++ ) {
+		const GX_DataType * sample = mappedInput[ i ];
+		for( size_t j = 0; j < dim; j++ ) sum += sample[ j ];
+	}
+
+	double passTime = elapsedSeconds( beginTime );
+
+	unlink( path );
+
+	printf( "\nbench %s cache:\n", tag );
+	printf( "\tsave    %s, %.1f KB, %.3f ms\n", isSaved ? "succ" : "fail",
+			( mappedInput.getBytes() + mappedTarget.getBytes() ) / 1024.0, saveTime * 1000 );
+	printf( "\tmap     %s, %.3f ms, first pass %.3f ms, sum %.3f\n", isMapped ? "succ" : "fail",
+			mapTime * 1000, passTime * 1000, (double)sum );
+
+	return isSaved && isMapped;
+}
+
+bool benchMnist( const BenchArgs_t & args )
+{
+	GX_DataMatrix input, target, input4eval, target4eval;
+
+	GX_Network network;
+	GX_Synth::make( "mnist", args.mTrainingCount, args.mSeed, &network, &input, &target );
+	GX_Synth::makeData( args.mEvalCount, 28, 10, args.mSeed, args.mSeed + 1, &input4eval, &target4eval );
+
+	GX_Dataset trainInput( input ), trainTarget( target );
+
+	benchDataset( "mnist", input, trainInput );
+
+	bool ret = benchCache( "mnist", trainInput, trainTarget, args.mSeed );
+
+	return bench( "mnist", network, args, trainInput, trainTarget, input4eval, target4eval ) && ret;
+}
+
+bool benchEmnist( const BenchArgs_t & args )
+{
+	GX_DataMatrix input, target, input4eval, target4eval;
+
+	// emnist topology is much heavier, scale the sample count down
+	size_t evalCount = std::max( args.mEvalCount / 10, 1 );
+
+	GX_Network network;
+	GX_Synth::make( "emnist", args.mTrainingCount, args.mSeed, &network, &input, &target );
+	GX_Synth::makeData( evalCount, 32, 26, args.mSeed, args.mSeed + 1, &input4eval, &target4eval );
+
+	GX_Dataset trainInput( input ), trainTarget( target );
+
+	benchDataset( "emnist", input, trainInput );
+
+	bool ret = benchCache( "emnist", trainInput, trainTarget, args.mSeed );
+
+	return bench( "emnist", network, args, trainInput, trainTarget, input4eval, target4eval ) && ret;
+}
+
+void usage( const char * name, const BenchArgs_t & defaultArgs )
+{
+	printf( "Usage: %s [--help]\n", name );
+	printf( "\t--net <mnist|emnist|all> default is %s\n", defaultArgs.mNet );
+	printf( "\t--training <training data count> default is %d, emnist uses 1/10\n", defaultArgs.mTrainingCount );
+	printf( "\t--eval <forward data count> default is %d, emnist uses 1/10\n", defaultArgs.mEvalCount );
+	printf( "\t--epoch <epoch count> default is %d\n", defaultArgs.mEpochCount );
+	printf( "\t--minibatch <mini batch count> default is %d\n", defaultArgs.mMiniBatchCount );
+	printf( "\t--lr <learning rate> default is %.2f\n", defaultArgs.mLearningRate );
+	printf( "\t--seed <random seed> default is %u\n", defaultArgs.mSeed );
+	printf( "\t--profile print per layer roofline report\n" );
+	printf( "\t--perf <epoch|layer:N> count cpu events of the region\n" );
+	printf( "\t--trace <trace prefix> write chrome trace json of every batch\n" );
+	printf( "\t--stats <stats path> publish live counters for gxtop\n" );
+	printf( "\t--threads <thread count> concurrent forward threads sharing the network, default is %d\n",
+			defaultArgs.mThreadCount );
+	printf( "\t--hogwild <thread count> also train a copy with hogwild on N threads, default is off\n" );
+	printf( "\t--procs <process count> also train a copy data-parallel in N processes, default is off\n" );
+	printf( "\t--transport <shm|socket> all-reduce transport of --procs, default is %s\n", defaultArgs.mTransport );
+	printf( "\t--pipeline <stage count> also train a copy pipeline-parallel over N stages, default is off\n" );
+	printf( "\t--micro <micro-batch count> samples per micro-batch of --pipeline, default is %d\n", defaultArgs.mMicroBatchCount );
+	printf( "\t--schedule <gpipe|1f1b> schedule of --pipeline, default is %s\n", defaultArgs.mSchedule );
+	printf( "\t--pool <thread count> also time forward and train with the layer loops split over N pool threads, default is off\n" );
+	printf( "\t--checkpoint <interval> also train a copy that keeps every N-th layer output and recomputes the others, default is off\n" );
+	printf( "\t--half <bf16|fp16|all> also run forward with 16-bit weights and activations, default is off\n" );
+	printf( "\t--augment <loader count> also train copies on samples augmented by N loader threads and inline, default is off\n" );
+}
+
+int main( const int argc, char * argv[] )
+{
+	static struct option opts[] = {
+		{ "net",       required_argument,  NULL, 1 },
+		{ "training",  required_argument,  NULL, 2 },
+		{ "eval",      required_argument,  NULL, 3 },
+		{ "epoch",     required_argument,  NULL, 4 },
+		{ "minibatch", required_argument,  NULL, 5 },
+		{ "seed",      required_argument,  NULL, 6 },
+		{ "profile",   no_argument,        NULL, 7 },
+		{ "perf",      required_argument,  NULL, 8 },
+		{ "trace",     required_argument,  NULL, 9 },
+		{ "stats",     required_argument,  NULL, 10 },
+		{ "threads",   required_argument,  NULL, 11 },
+		{ "hogwild",   required_argument,  NULL, 12 },
+		{ "lr",        required_argument,  NULL, 13 },
+		{ "pool",      required_argument,  NULL, 14 },
+		{ "procs",     required_argument,  NULL, 15 },
+		{ "transport", required_argument,  NULL, 16 },
+		{ "pipeline",  required_argument,  NULL, 17 },
+		{ "micro",     required_argument,  NULL, 18 },
+		{ "schedule",  required_argument,  NULL, 19 },
+		{ "checkpoint", required_argument, NULL, 20 },
+		{ "half",      required_argument,  NULL, 22 },
+		{ "augment",   required_argument,  NULL, 23 },
+		{ "help",      no_argument,        NULL, 21 },
+		{ 0, 0, 0, 0}
+	};
+
+	BenchArgs_t defaultArgs = {
+		.mNet = "all",
+		.mTrainingCount = 5000,
+		.mEvalCount = 5000,
+		.mEpochCount = 1,
+		.mMiniBatchCount = 100,
+		.mLearningRate = 3.0,
+		.mSeed = 2024,
+		.mIsProfile = false,
+		.mPerfRegion = NULL,
+		.mTracePath = NULL,
+		.mStatsPath = NULL,
+		.mThreadCount = 4,
+		.mHogwildCount = 0,
+		.mPoolCount = 0,
+		.mProcCount = 0,
+		.mTransport = "shm",
+		.mStageCount = 0,
+		.mMicroBatchCount = 10,
+		.mSchedule = "1f1b",
+		.mCheckpointInterval = 0,
+		.mHalf = NULL,
+		.mLoaderCount = 0,
+	};
+
+	BenchArgs_t args = defaultArgs;
+
+	int c = 0;
+	while( ( c = getopt_long( argc, argv, "", opts, NULL ) ) != EOF ) {
+		switch( c ) {
+			case 1:
+				args.mNet = optarg;
+				break;
+			case 2:
+				args.mTrainingCount = std::max( atoi( optarg ), 1 );
+				break;
+			case 3:
+				args.mEvalCount = std::max( atoi( optarg ), 1 );
+				break;
+			case 4:
+				args.mEpochCount = std::max( atoi( optarg ), 1 );
+				break;
+			case 5:
+				args.mMiniBatchCount = std::max( atoi( optarg ), 1 );
+				break;
+			case 6:
+				args.mSeed = strtoul( optarg, NULL, 10 );
+				break;
+			case 7:
+				args.mIsProfile = true;
+				break;
+			case 8:
+				args.mPerfRegion = optarg;
+				break;
+			case 9:
+				args.mTracePath = optarg;
+				break;
+			case 10:
+				args.mStatsPath = optarg;
+				break;
+			case 11:
+				args.mThreadCount = std::max( atoi( optarg ), 1 );
+				break;
+			case 12:
+				args.mHogwildCount = std::max( atoi( optarg ), 0 );
+				break;
+			case 13:
+				args.mLearningRate = std::stof( optarg );
+				break;
+			case 14:
+				args.mPoolCount = std::max( atoi( optarg ), 0 );
+				break;
+			case 15:
+				args.mProcCount = std::max( atoi( optarg ), 0 );
+				break;
+			case 17:
+				args.mStageCount = std::max( atoi( optarg ), 0 );
+				break;
+			case 18:
+				args.mMicroBatchCount = std::max( atoi( optarg ), 1 );
+				break;
+			case 19:
+				args.mSchedule = optarg;
+				if( GX_Pipeline::getSchedule( optarg ) < 0 ) {
+					usage( argv[ 0 ], defaultArgs );
+					return 0;
+				}
+				break;
+			case 20:
+				args.mCheckpointInterval = std::max( atoi( optarg ), 0 );
+				break;
+			case 22:
+				args.mHalf = optarg;
+				if( strcmp( optarg, "all" ) && GX_Half::getFormat( optarg ) <= GX_Half::eNone ) {
+					usage( argv[ 0 ], defaultArgs );
+					return 0;
+				}
+				break;
+			case 23:
+				args.mLoaderCount = std::max( atoi( optarg ), 0 );
+				break;
+			case 16:
+				args.mTransport = optarg;
+				if( GX_Launcher::getTransport( optarg ) < 0 ) {
+					usage( argv[ 0 ], defaultArgs );
+					return 0;
+				}
+				break;
+			default:
+				usage( argv[ 0 ], defaultArgs );
+				return 0;
+		}
+	}
+
+	std::string net = args.mNet;
+
+	bool isSucc = true;
+
+	if( "all" == net || "mnist" == net ) isSucc = benchMnist( args ) && isSucc;
+	if( "all" == net || "emnist" == net ) isSucc = benchEmnist( args ) && isSucc;
+
+	printf( "bench %s\n", isSucc ? "succ" : "fail" );
+
+	return isSucc ? 0 : 1;
+}
@@ -0,0 +1,232 @@
+
+#include "gxcache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+static const char GX_CACHE_MAGIC[ 4 ] = { 'G', 'X', 'D', 'C' };
+static const uint32_t GX_CACHE_VERSION = 1;
+
+// multiple of the page size of every common platform, so any section can be mapped
+enum { eSectionAlign = 64 * 1024 };
+
+enum { eDatasetSection = 1, eLabelSection = 2 };
+
+static const uint64_t FNV_OFFSET = 14695981039346656037ULL;
+static const uint64_t FNV_PRIME = 1099511628211ULL;
+
+// cache file header, followed by sectionCount GX_CacheSection_t
+typedef struct tagCacheHeader {
+	char mMagic[ 4 ];
+	uint32_t mVersion;
+	uint64_t mKey;
+	uint32_t mItemBytes;
+	uint32_t mSectionCount;
+} GX_CacheHeader_t;
+
+typedef struct tagCacheSection {
+	uint32_t mType;
+	uint32_t mReserved;
+	uint64_t mCount, mDim, mStride;
+	uint64_t mOffset, mBytes;
+} GX_CacheSection_t;
+
+static size_t alignSection( size_t offset )
+{
+	return ( offset + eSectionAlign - 1 ) / eSectionAlign * eSectionAlign;
+}
+
+GX_DataCache :: GX_DataCache()
+{
+	mKey = FNV_OFFSET;
+
+	// a build with another item type can not map the slabs
+	addValue( (uint32_t)sizeof( GX_DataType ) );
+}
+
+GX_DataCache :: ~GX_DataCache()
+{
+}
+
+bool GX_DataCache :: addFile( const char * path )
+{
+	FILE * fp = fopen( path, "rb" );
+
+	if( NULL == fp ) {
+		printf( "%s open %s fail, errno %d, %s\n", __func__, path, errno, strerror( errno ) );
+		return false;
+	}
+
+	std::vector< char > buff( 64 * 1024 );
+
+	size_t total = 0;
+
+	for( size_t len = 0; ( len = fread( buff.data(), 1, buff.size(), fp ) ) > 0; ) {
+		addBytes( buff.data(), len );
+		total += len;
+	}
+
+	bool ret = 0 == ferror( fp );
+
+	fclose( fp );
+
+	addValue( (uint64_t)total );
+
+	return ret;
+}
+
+void GX_DataCache :: addBytes( const void * data, size_t len )
+{
+	const unsigned char * bytes = (const unsigned char *)data;
+
+	for( size_t i = 0; i < len; i++ ) {
+		mKey ^= bytes[ i ];
+		mKey *= FNV_PRIME;
+	}
+}
+
+uint64_t GX_DataCache :: getKey() const
+{
+	return mKey;
+}
+
+bool GX_DataCache :: load( const char * path, const std::vector< GX_Dataset * > & datasets,
+		const std::vector< GX_LabelVector * > & labels ) const
+{
+	FILE * fp = fopen( path, "rb" );
+
+	if( NULL == fp ) return false;
+
+	GX_CacheHeader_t header;
+	memset( &header, 0, sizeof( header ) );
+
+	bool ret = 1 == fread( &header, sizeof( header ), 1, fp );
+
+	ret = ret && 0 == memcmp( header.mMagic, GX_CACHE_MAGIC, sizeof( header.mMagic ) )
+			&& GX_CACHE_VERSION == header.mVersion && mKey == header.mKey
+			&& sizeof( GX_DataType ) == header.mItemBytes
+			&& datasets.size() + labels.size() == header.mSectionCount;
+
+	std::vector< GX_CacheSection_t > sections( ret ? header.mSectionCount : 0 );
+
+	ret = ret && sections.size() == fread( sections.data(), sizeof( GX_CacheSection_t ), sections.size(), fp );
+
+	struct stat fileStat;
+	ret = ret && 0 == fstat( fileno( fp ), &fileStat );
+
+	for( size_t i = 0; ret && i < sections.size(); i++ ) {
+		const GX_CacheSection_t & section = sections[ i ];
+
+		ret = 0 == section.mBytes || section.mOffset + section.mBytes <= (uint64_t)fileStat.st_size;
+
+		if( ret && i < datasets.size() ) {
+			ret = eDatasetSection == section.mType && GX_Dataset::getStrideOf( section.mDim ) == section.mStride
+					&& GX_Dataset::getSlabBytes( section.mCount, section.mDim ) == section.mBytes
+					&& datasets[ i ]->map( path, section.mOffset, section.mCount, section.mDim );
+		}
+
+		if( ret && i >= datasets.size() ) {
+			GX_LabelVector * vec = labels[ i - datasets.size() ];
+
+			ret = eLabelSection == section.mType && section.mCount * sizeof( uint16_t ) == section.mBytes;
+
+			if( ret ) {
+				vec->resize( section.mCount );
+
+				ret = 0 == fseek( fp, section.mOffset, SEEK_SET )
+						&& vec->size() == fread( vec->data(), sizeof( uint16_t ), vec->size(), fp );
+			}
+		}
+	}
+
+	fclose( fp );
+
+	// nothing half loaded, the caller builds everything again
+	if( ! ret ) {
+		for( auto & item : datasets ) item->clear();
+		for( auto & item : labels ) item->clear();
+	}
+
+	return ret;
+}
+
+bool GX_DataCache :: save( const char * path, const std::vector< const GX_Dataset * > & datasets,
+		const std::vector< const GX_LabelVector * > & labels ) const
+{
+	char tmpPath[ 512 ] = { 0 };
+	snprintf( tmpPath, sizeof( tmpPath ), "%s.tmp", path );
+
+	FILE * fp = fopen( tmpPath, "wb" );
+
+	if( NULL == fp ) {
+		printf( "%s open %s fail, errno %d, %s\n", __func__, tmpPath, errno, strerror( errno ) );
+		return false;
+	}
+
+	GX_CacheHeader_t header;
+	memset( &header, 0, sizeof( header ) );
+
+	memcpy( header.mMagic, GX_CACHE_MAGIC, sizeof( header.mMagic ) );
+	header.mVersion = GX_CACHE_VERSION;
+	header.mKey = mKey;
+	header.mItemBytes = sizeof( GX_DataType );
+	header.mSectionCount = datasets.size() + labels.size();
+
+	std::vector< GX_CacheSection_t > sections( header.mSectionCount );
+	memset( sections.data(), 0, sections.size() * sizeof( GX_CacheSection_t ) );
+
+	size_t offset = sizeof( header ) + sections.size() * sizeof( GX_CacheSection_t );
+
+	for( size_t i = 0; i < sections.size(); i++ ) {
+		GX_CacheSection_t & section = sections[ i ];
+
+		if( i < datasets.size() ) {
+			section.mType = eDatasetSection;
+			section.mCount = datasets[ i ]->size();
+			section.mDim = datasets[ i ]->getDim();
+			section.mStride = datasets[ i ]->getStride();
+			section.mBytes = GX_Dataset::getSlabBytes( section.mCount, section.mDim );
+		} else {
+			section.mType = eLabelSection;
+			section.mCount = labels[ i - datasets.size() ]->size();
+			section.mBytes = section.mCount * sizeof( uint16_t );
+		}
+
+		section.mOffset = offset = alignSection( offset );
+		offset += section.mBytes;
+	}
+
+	bool ret = 1 == fwrite( &header, sizeof( header ), 1, fp )
+			&& sections.size() == fwrite( sections.data(), sizeof( GX_CacheSection_t ), sections.size(), fp );
+
+	for( size_t i = 0; ret && i < sections.size(); i++ ) {
+		const GX_CacheSection_t & section = sections[ i ];
+
+		// the gap up to the section reads as zeros
+		ret = 0 == fseek( fp, section.mOffset, SEEK_SET );
+
+		const void * data = i < datasets.size() ? datasets[ i ]->getSlab() : labels[ i - datasets.size() ]->data();
+
+		if( ret && section.mBytes > 0 ) ret = 1 == fwrite( data, section.mBytes, 1, fp );
+	}
+
+	// fsync the content before the rename publishes it
+	ret = 0 == fflush( fp ) && 0 == fsync( fileno( fp ) ) && ret;
+
+	ret = 0 == fclose( fp ) && ret;
+
+	if( ret && 0 != rename( tmpPath, path ) ) ret = false;
+
+	if( ! ret ) {
+		printf( "%s( %s ) fail, errno %d, %s\n", __func__, path, errno, strerror( errno ) );
+		unlink( tmpPath );
+	}
+
+	return ret;
+}
+
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "gxcomm.h"
+#include "gxdataset.h"
+
+#include <vector>
+#include <stdint.h>
+
+/*
+* On-disk cache of preprocessed training data. The key is a 64-bit FNV-1a hash
+* of the bytes of the source files and of the preprocessing parameters, so a
+* changed file or parameter misses the cache instead of loading stale samples.
+*
+* The file is a header and a table of sections, one per dataset or label vector,
+* each section starts on a 64 KB boundary. A dataset section is its slab as it
+* is in memory, stride padding included, so load maps it with GX_Dataset::map
+* and training starts without reading or converting the samples first.
+*
+* save writes a temporary file and renames it, a crash while saving leaves the
+* old cache or none, never a partial one.
+*/
+class GX_DataCache {
+public:
+	GX_DataCache();
+	~GX_DataCache();
+
+	// chains the bytes of the file into the key
+	bool addFile( const char * path );
+
+	// chains a preprocessing parameter into the key
+	void addBytes( const void * data, size_t len );
+
+	template< typename T >
+	void addValue( const T & value )
+	{
+		addBytes( &value, sizeof( value ) );
+	}
+
+	uint64_t getKey() const;
+
+	// false when the file is missing, of another key or another build, the datasets are mapped
+	bool load( const char * path, const std::vector< GX_Dataset * > & datasets,
+			const std::vector< GX_LabelVector * > & labels ) const;
+
+	bool save( const char * path, const std::vector< const GX_Dataset * > & datasets,
+			const std::vector< const GX_LabelVector * > & labels ) const;
+
+private:
+	uint64_t mKey;
+};
+
@@ -0,0 +1,454 @@
+
+#include "gxckpt.h"
+#include "gxnet.h"
+#include "gxutils.h"
+#include "gxhalf.h"
+
+#include <chrono>
+
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+
+static const char GX_DELTA_MAGIC[ 4 ] = { 'G', 'X', 'N', 'D' };
+
+// the delta xors the bits of GX_DataType, 4 byte words in the mixed build
+#ifdef GX_MIXED_PRECISION
+typedef uint32_t GX_DataBits_t;
+#else
+typedef uint64_t GX_DataBits_t;
+#endif
+
+static_assert( sizeof( GX_DataBits_t ) == sizeof( GX_DataType ), "one word per GX_DataType" );
+
+static const uint32_t GX_DELTA_VERSION = 1;
+
+// delta file header, followed by encodedSize bytes
+typedef struct tagDeltaHeader {
+	char mMagic[ 4 ];
+	uint32_t mVersion;
+	int32_t mEpoch, mPrevEpoch;
+	uint64_t mParamCount;
+	uint64_t mEncodedSize;
+} GX_DeltaHeader_t;
+
+// fsync the content before the rename publishes it
+static bool publishFile( const char * tmpPath, const char * path, size_t * bytes )
+{
+	bool ret = true;
+
+	int fd = open( tmpPath, O_RDONLY );
+	if( fd < 0 || 0 != fsync( fd ) ) ret = false;
+
+	struct stat fileStat;
+	if( ret && 0 == fstat( fd, &fileStat ) ) *bytes = fileStat.st_size;
+
+	if( fd >= 0 ) close( fd );
+
+	if( ret && 0 != rename( tmpPath, path ) ) ret = false;
+
+	if( ! ret ) {
+		printf( "%s( %s ) fail, errno %d, %s\n", __func__, path, errno, strerror( errno ) );
+		unlink( tmpPath );
+	}
+
+	return ret;
+}
+
+static void putVarint( uint64_t value, std::string * buff )
+{
+	for( ; value >= 0x80; value >>= 7 ) buff->push_back( (char)( ( value & 0x7f ) | 0x80 ) );
+	buff->push_back( (char)value );
+}
+
+static bool getVarint( const std::string & buff, size_t * pos, uint64_t * value )
+{
+	*value = 0;
+
+	for( int shift = 0; *pos < buff.size() && shift < 64; shift += 7 ) {
+		uint8_t c = buff[ ( *pos )++ ];
+		*value |= (uint64_t)( c & 0x7f ) << shift;
+		if( 0 == ( c & 0x80 ) ) return true;
+	}
+
+	return false;
+}
+
+static bool readDeltaFile( const char * path, GX_DeltaHeader_t * header, std::string * buff )
+{
+	FILE * fp = fopen( path, "rb" );
+
+	if( NULL == fp ) return false;
+
+	bool ret = 1 == fread( header, sizeof( *header ), 1, fp )
+			&& 0 == memcmp( header->mMagic, GX_DELTA_MAGIC, sizeof( header->mMagic ) )
+			&& GX_DELTA_VERSION == header->mVersion;
+
+	if( ret ) {
+		// no plane can code to more than twice its size, reject anything else before allocating
+		ret = header->mEncodedSize <= 16 * header->mParamCount + 64;
+	}
+
+	if( ret ) {
+		buff->resize( header->mEncodedSize );
+		ret = buff->size() == fread( &( ( *buff )[ 0 ] ), 1, buff->size(), fp );
+	}
+
+	fclose( fp );
+
+	return ret;
+}
+
+////////////////////////////////////////////////////////////
+
+GX_Checkpointer :: GX_Checkpointer( const char * prefix, int keepCount, int format, int rebaseInterval )
+	: mPrefix( prefix ), mKeepCount( keepCount ), mFormat( format ), mRebaseInterval( rebaseInterval )
+{
+	mReplica = NULL;
+	mPendingEpoch = mPrevEpoch = mChainLength = 0;
+	mHasPending = mIsWriting = mIsStop = false;
+	mSnapshotMicros = 0;
+	mWrittenBytes = mFailedCount = mFlushedFailedCount = 0;
+
+	if( mRebaseInterval <= 0 ) mRebaseInterval = 1;
+
+	mThread = std::thread( &GX_Checkpointer::run, this );
+}
+
+GX_Checkpointer :: ~GX_Checkpointer()
+{
+	{
+		std::unique_lock< std::mutex > lock( mMutex );
+		mIsStop = true;
+	}
+
+	mCond.notify_all();
+	mThread.join();
+
+	if( NULL != mReplica ) delete mReplica;
+}
+
+bool GX_Checkpointer :: save( const GX_Network & network, int epoch )
+{
+	std::chrono::steady_clock::time_point beginTime = std::chrono::steady_clock::now();
+
+	{
+		std::unique_lock< std::mutex > lock( mMutex );
+
+		if( NULL == mReplica ) {
+			mReplica = new GX_Network();
+			network.clone( mReplica );
+
+			// saveBinary would write the 16-bit values, and the deltas are taken against full width
+			mReplica->setStorage( GX_Half::eNone );
+		}
+
+		if( mReplica->getParamCount() != network.getParamCount() ) {
+			printf( "%s network changed, paramCount %zu, checkpoint %zu\n", __func__,
+					network.getParamCount(), mReplica->getParamCount() );
+			return false;
+		}
+
+		network.exportParams( &mPending );
+		mPendingEpoch = epoch;
+		mHasPending = true;
+
+		mSnapshotMicros = std::chrono::duration_cast< std::chrono::microseconds >(
+				std::chrono::steady_clock::now() - beginTime ).count();
+	}
+
+	mCond.notify_all();
+
+	return true;
+}
+
+bool GX_Checkpointer :: flush()
+{
+	std::unique_lock< std::mutex > lock( mMutex );
+
+	mCond.wait( lock, [ this ] { return ! mHasPending && ! mIsWriting; } );
+
+	bool ret = mFailedCount == mFlushedFailedCount;
+	mFlushedFailedCount = mFailedCount;
+
+	return ret;
+}
+
+long GX_Checkpointer :: getSnapshotMicros() const
+{
+	return mSnapshotMicros;
+}
+
+size_t GX_Checkpointer :: getWrittenBytes() const
+{
+	std::unique_lock< std::mutex > lock( mMutex );
+
+	return mWrittenBytes;
+}
+
+size_t GX_Checkpointer :: getFailedCount() const
+{
+	std::unique_lock< std::mutex > lock( mMutex );
+
+	return mFailedCount;
+}
+
+void GX_Checkpointer :: run()
+{
+	std::unique_lock< std::mutex > lock( mMutex );
+
+	for( ; ; ) {
+		mCond.wait( lock, [ this ] { return mHasPending || mIsStop; } );
+
+		if( ! mHasPending ) break;
+
+		int epoch = mPendingEpoch;
+		mWriting.swap( mPending );
+		mHasPending = false;
+		mIsWriting = true;
+
+		lock.unlock();
+
+		bool isWritten = write( epoch );
+
+		lock.lock();
+
+		if( ! isWritten ) {
+			printf( "%s checkpoint %s epoch#%d fail\n", __func__, mPrefix.c_str(), epoch );
+			mFailedCount++;
+		}
+
+		mIsWriting = false;
+		mCond.notify_all();
+	}
+}
+
+bool GX_Checkpointer :: write( int epoch )
+{
+	char path[ 256 ] = { 0 };
+
+	bool isDelta = eDelta == mFormat && mChainLength > 0 && mChainLength < mRebaseInterval;
+
+	if( eDelta == mFormat ) {
+		snprintf( path, sizeof( path ), isDelta ? "%s.%d.delta" : "%s.%d.base.model", mPrefix.c_str(), epoch );
+	} else {
+		snprintf( path, sizeof( path ), "%s.%d.model", mPrefix.c_str(), epoch );
+	}
+
+	size_t bytes = 0;
+	bool ret = false;
+
+	if( isDelta ) {
+		ret = writeDelta( epoch, path, &bytes );
+	} else {
+		char tmpPath[ 256 ] = { 0 };
+		snprintf( tmpPath, sizeof( tmpPath ), "%s.tmp", path );
+
+		mReplica->importParams( mWriting );
+
+		ret = eText == mFormat ? GX_Utils::save( tmpPath, *mReplica ) : GX_Utils::saveBinary( tmpPath, *mReplica );
+		ret = ret && publishFile( tmpPath, path, &bytes );
+	}
+
+	if( ! ret ) return false;
+
+	{
+		std::unique_lock< std::mutex > lock( mMutex );
+		mWrittenBytes += bytes;
+	}
+
+	if( isDelta ) {
+		mFiles.back().emplace_back( path );
+		mChainLength++;
+	} else {
+		mFiles.emplace_back( 1, path );
+		mChainLength = 1;
+	}
+
+	if( eDelta == mFormat ) {
+		mPrevious = mWriting;
+		mPrevEpoch = epoch;
+	}
+
+	removeOldChains();
+
+	return true;
+}
+
+bool GX_Checkpointer :: writeDelta( int epoch, const char * path, size_t * bytes )
+{
+	std::string buff;
+	encodeDelta( mPrevious, mWriting, &buff );
+
+	GX_DeltaHeader_t header;
+	memset( &header, 0, sizeof( header ) );
+	memcpy( header.mMagic, GX_DELTA_MAGIC, sizeof( header.mMagic ) );
+	header.mVersion = GX_DELTA_VERSION;
+	header.mEpoch = epoch;
+	header.mPrevEpoch = mPrevEpoch;
+	header.mParamCount = mWriting.size();
+	header.mEncodedSize = buff.size();
+
+	char tmpPath[ 256 ] = { 0 };
+	snprintf( tmpPath, sizeof( tmpPath ), "%s.tmp", path );
+
+	FILE * fp = fopen( tmpPath, "wb" );
+
+	if( NULL == fp ) {
+		printf( "%s( %s ) fail, errno %d, %s\n", __func__, tmpPath, errno, strerror( errno ) );
+		return false;
+	}
+
+	bool ret = 1 == fwrite( &header, sizeof( header ), 1, fp )
+			&& buff.size() == fwrite( buff.data(), 1, buff.size(), fp );
+
+	if( 0 != fclose( fp ) ) ret = false;
+
+	return ret && publishFile( tmpPath, path, bytes );
+}
+
+void GX_Checkpointer :: removeOldChains()
+{
+	if( mKeepCount <= 0 ) return;
+
+	size_t total = 0;
+	for( auto & chain : mFiles ) total += chain.size();
+
+	// drop the oldest chain while the newer ones still hold keepCount epochs
+	while( mFiles.size() > 1 && total - mFiles.front().size() >= (size_t)mKeepCount ) {
+		for( auto & item : mFiles.front() ) unlink( item.c_str() );
+
+		total -= mFiles.front().size();
+		mFiles.pop_front();
+	}
+}
+
+void GX_Checkpointer :: encodeDelta( const GX_DataVector & prev, const GX_DataVector & curr, std::string * buff )
+{
+	assert( prev.size() == curr.size() );
+
+	size_t count = curr.size();
+
+	// plane 0 holds the most significant byte of every word
+	std::string planes( count * sizeof( GX_DataBits_t ), '\0' );
+
+	for( size_t i = 0; i < count; i++ ) {
+		GX_DataBits_t prevBits = 0, currBits = 0;
+		memcpy( &prevBits, &prev[ i ], sizeof( prevBits ) );
+		memcpy( &currBits, &curr[ i ], sizeof( currBits ) );
+
+		GX_DataBits_t word = prevBits ^ currBits;
+
+		for( size_t b = 0; b < sizeof( word ); b++ ) {
+			planes[ b * count + i ] = (char)( word >> ( 8 * ( sizeof( word ) - 1 - b ) ) );
+		}
+	}
+
+	// tokens are varint( length << 1 | isZeroRun ), a literal run is followed by its bytes.
+	// zero runs shorter than 4 are cheaper inside a literal
+	enum { MIN_ZERO_RUN = 4 };
+
+	buff->clear();
+
+	auto zeroRun = [ & ]( size_t pos ) {
+		size_t end = pos;
+		while( end < planes.size() && 0 == planes[ end ] ) end++;
+		return end - pos;
+	};
+
+	for( size_t pos = 0; pos < planes.size(); ) {
+		size_t zeros = zeroRun( pos );
+
+		if( zeros >= MIN_ZERO_RUN || ( zeros > 0 && pos + zeros == planes.size() ) ) {
+			putVarint( ( zeros << 1 ) | 1, buff );
+			pos += zeros;
+			continue;
+		}
+
+		size_t end = pos;
+		while( end < planes.size() ) {
+			zeros = zeroRun( end );
+			if( zeros >= MIN_ZERO_RUN ) break;
+			end += std::max( zeros, (size_t)1 );
+		}
+
+		putVarint( ( end - pos ) << 1, buff );
+		buff->append( planes, pos, end - pos );
+		pos = end;
+	}
+}
+
+bool GX_Checkpointer :: decodeDelta( const std::string & buff, const GX_DataVector & prev, GX_DataVector * curr )
+{
+	size_t count = curr->size();
+
+	if( prev.size() != count ) return false;
+
+	std::string planes;
+	planes.reserve( count * sizeof( GX_DataBits_t ) );
+
+	for( size_t pos = 0; pos < buff.size(); ) {
+		uint64_t token = 0;
+		if( ! getVarint( buff, &pos, &token ) ) return false;
+
+		size_t length = token >> 1;
+
+		if( planes.size() + length > count * sizeof( GX_DataBits_t ) ) return false;
+
+		if( token & 1 ) {
+			planes.append( length, '\0' );
+		} else {
+			if( pos + length > buff.size() ) return false;
+			planes.append( buff, pos, length );
+			pos += length;
+		}
+	}
+
+	if( planes.size() != count * sizeof( GX_DataBits_t ) ) return false;
+
+	for( size_t i = 0; i < count; i++ ) {
+		GX_DataBits_t word = 0;
+		for( size_t b = 0; b < sizeof( word ); b++ ) word = ( word << 8 ) | (uint8_t)planes[ b * count + i ];
+
+		GX_DataBits_t bits = 0;
+		memcpy( &bits, &prev[ i ], sizeof( bits ) );
+		bits ^= word;
+		memcpy( &( ( *curr )[ i ] ), &bits, sizeof( bits ) );
+	}
+
+	return true;
+}
+
+bool GX_Checkpointer :: rebuild( const char * prefix, int epoch, GX_Network * network )
+{
+	char path[ 256 ] = { 0 };
+
+	snprintf( path, sizeof( path ), "%s.%d.base.model", prefix, epoch );
+	if( 0 == access( path, F_OK ) ) return GX_Utils::loadBinary( path, network );
+
+	snprintf( path, sizeof( path ), "%s.%d.delta", prefix, epoch );
+
+	GX_DeltaHeader_t header;
+	std::string buff;
+
+	if( ! readDeltaFile( path, &header, &buff ) ) {
+		printf( "%s read %s fail\n", __func__, path );
+		return false;
+	}
+
+	if( header.mPrevEpoch >= epoch || ! rebuild( prefix, header.mPrevEpoch, network ) ) return false;
+
+	GX_DataVector prev, curr( header.mParamCount );
+	network->exportParams( &prev );
+
+	if( ! decodeDelta( buff, prev, &curr ) ) {
+		printf( "%s decode %s fail, paramCount %zu, model %zu\n", __func__, path,
+				(size_t)header.mParamCount, prev.size() );
+		return false;
+	}
+
+	return network->importParams( curr );
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "gxcomm.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <string>
+#include <stdint.h>
+
+class GX_Network;
+
+/*
+* Checkpoints written on a background thread. save() only copies the parameters
+* into a staging buffer, the model file is serialized, fsync'ed and renamed into
+* place by the writer thread while training goes on.
+*
+* eDelta writes a binary base model every rebaseInterval checkpoints and, in
+* between, only the XOR of the IEEE bits against the previous checkpoint. The
+* XOR words are split into byte planes and run-length coded: sign, exponent and
+* high mantissa bytes barely move between epochs, so their planes are mostly zero.
+*/
+class GX_Checkpointer {
+public:
+	enum { eText = 0, eBinary = 1, eDelta = 2 };
+
+	// eText and eBinary files are <prefix>.<epoch>.model, only the newest keepCount are kept.
+	// eDelta files are <prefix>.<epoch>.base.model and <prefix>.<epoch>.delta, whole chains
+	// are removed once the newest keepCount epochs do not need them. 0 keeps all
+	GX_Checkpointer( const char * prefix, int keepCount, int format = eText, int rebaseInterval = 10 );
+
+	// wait for the pending snapshot to be written
+	~GX_Checkpointer();
+
+	// snapshot the parameters and return. a snapshot still waiting behind
+	// the running write is replaced, the newest one always reaches disk.
+	// the files hold the full-width parameters whatever the storage format
+	bool save( const GX_Network & network, int epoch );
+
+	// block until every snapshot taken so far is written, false if a write failed since
+	// the last flush: save() returns before the file is written, so this is where it shows
+	bool flush();
+
+	// microseconds spent in the last save() on the caller thread
+	long getSnapshotMicros() const;
+
+	// bytes of the files written so far, including the removed ones
+	size_t getWrittenBytes() const;
+
+	// snapshots that never reached disk
+	size_t getFailedCount() const;
+
+public:
+
+	// load the base of the epoch and apply the deltas up to it, network must be empty
+	static bool rebuild( const char * prefix, int epoch, GX_Network * network );
+
+	// byte-plane split and run-length code of the XOR words
+	static void encodeDelta( const GX_DataVector & prev, const GX_DataVector & curr, std::string * buff );
+
+	// curr = prev ^ decoded words, curr must have the size of the encoded vector
+	static bool decodeDelta( const std::string & buff, const GX_DataVector & prev, GX_DataVector * curr );
+
+private:
+
+	void run();
+
+	bool write( int epoch );
+
+	bool writeDelta( int epoch, const char * path, size_t * bytes );
+
+	void removeOldChains();
+
+private:
+	std::string mPrefix;
+	int mKeepCount, mFormat, mRebaseInterval;
+
+	std::thread mThread;
+	mutable std::mutex mMutex;
+	std::condition_variable mCond;
+
+	// mReplica is built by the first save(), after that the writer thread owns it
+	// together with mWriting, mPrevious, mPrevEpoch, mChainLength and mFiles,
+	// the rest is guarded by mMutex
+	GX_Network * mReplica;
+	GX_DataVector mPending, mWriting, mPrevious;
+	int mPendingEpoch, mPrevEpoch, mChainLength;
+	bool mHasPending, mIsWriting, mIsStop;
+	long mSnapshotMicros;
+	size_t mWrittenBytes, mFailedCount, mFlushedFailedCount;
+
+	// files of every kept checkpoint, or of every kept chain for eDelta
+	std::deque< std::vector< std::string > > mFiles;
+};
@@ -7,13 +7,30 @@
 #include <iostream>
 
 #include <assert.h>
-
+#include <stdint.h>
+
+/*
+* make mixed=1 builds with float activations, deltas, gradients and weights.
+* Long sums, losses and the master weights that applyGradient updates are
+* kept in GX_AccumType, double in both builds.
+*/
+#ifdef GX_MIXED_PRECISION
+typedef float GX_DataType;
+#else
 typedef double GX_DataType;
+#endif
+
+typedef double GX_AccumType;
 
 typedef std::valarray< GX_DataType > GX_DataVector;
 
+typedef std::valarray< GX_AccumType > GX_AccumVector;
+
 typedef std::vector< GX_DataVector > GX_DataMatrix;
 
+// class index of every sample of a classification, a one-hot target without the zeros
+typedef std::vector< uint16_t > GX_LabelVector;
+
 typedef std::vector< std::string > GX_StringList;
 
 typedef std::vector< size_t > GX_Dims;
@@ -33,6 +50,29 @@ inline size_t gx_dims_flatten_size( const GX_Dims & dims )
 	return ret;
 }
 
+// heap bytes of one allocation, including an estimate of the malloc chunk overhead
+inline size_t gx_heap_bytes( size_t size )
+{
+	if( 0 == size ) return 0;
+
+	size_t ret = ( size + sizeof( size_t ) + 15 ) & ~( (size_t)15 );
+
+	return ret < 32 ? 32 : ret;
+}
+
+inline size_t gx_vector_bytes( const GX_DataVector & vec )
+{
+	return gx_heap_bytes( vec.size() * sizeof( GX_DataType ) );
+}
+
+inline size_t gx_matrix_bytes( const GX_DataMatrix & matrix )
+{
+	size_t ret = gx_heap_bytes( matrix.capacity() * sizeof( GX_DataVector ) );
+	for( auto & vec : matrix ) ret += gx_vector_bytes( vec );
+
+	return ret;
+}
+
 template< typename NumberVector >
 std::string gx_vector2string( const NumberVector & vec, const char delim = ',' )
 {
@@ -70,10 +110,15 @@ inline void gx_string2valarray( const std::string & buff, GX_DataVector * vec, c
 class GX_MDSpanRO {
 public:
 	GX_MDSpanRO( const GX_DataVector & data, const GX_Dims & dims )
-			: mData( data ), mDims( dims ) {
+			: mData( std::begin( data ) ), mDims( dims ) {
 		assert( gx_dims_flatten_size( dims ) == data.size() );
 	}
 
+	// data must hold gx_dims_flatten_size( dims ) items
+	GX_MDSpanRO( const GX_DataType * data, const GX_Dims & dims )
+			: mData( data ), mDims( dims ) {
+	}
+
 	~GX_MDSpanRO() {}
 
 	const GX_Dims & dims() const { return mDims; }
@@ -104,17 +149,22 @@ public:
 	}
 
 private:
-	const GX_DataVector & mData;
+	const GX_DataType * mData;
 	const GX_Dims & mDims;
 };
 
 class GX_MDSpanRW {
 public:
 	GX_MDSpanRW( GX_DataVector & data, const GX_Dims & dims )
-			: mData( data ), mDims( dims ) {
+			: mData( std::begin( data ) ), mDims( dims ) {
 		assert( gx_dims_flatten_size( dims ) == data.size() );
 	}
 
+	// data must hold gx_dims_flatten_size( dims ) items
+	GX_MDSpanRW( GX_DataType * data, const GX_Dims & dims )
+			: mData( data ), mDims( dims ) {
+	}
+
 	~GX_MDSpanRW() {}
 
 	const GX_Dims & dims() const { return mDims; }
@@ -145,7 +195,7 @@ public:
 	}
 
 private:
-	GX_DataVector & mData;
+	GX_DataType * mData;
 	const GX_Dims & mDims;
 };
 
@@ -0,0 +1,292 @@
+
+#include "gxdataset.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+
+enum { eCacheLine = 64 };
+
+// dim rounded up to whole cache lines
+static size_t strideOf( size_t dim )
+{
+	size_t lineItems = eCacheLine / sizeof( GX_DataType );
+
+	return ( dim + lineItems - 1 ) / lineItems * lineItems;
+}
+
+GX_Dataset :: GX_Dataset()
+{
+	mCount = mCapacity = mStride = 0;
+	mData = NULL;
+	mMappedBytes = 0;
+}
+
+GX_Dataset :: GX_Dataset( size_t count, size_t dim )
+	: GX_Dataset()
+{
+	mDims = { dim };
+	mStride = strideOf( dim );
+
+	grow( count );
+
+	mCount = count;
+}
+
+GX_Dataset :: GX_Dataset( const GX_DataMatrix & matrix )
+	: GX_Dataset()
+{
+	reserve( matrix.size() );
+
+	for( auto & item : matrix ) {
+		if( ! append( item ) ) break;
+	}
+}
+
+GX_Dataset :: GX_Dataset( const GX_Dataset & other )
+	: GX_Dataset()
+{
+	*this = other;
+}
+
+GX_Dataset & GX_Dataset :: operator=( const GX_Dataset & other )
+{
+	if( this == &other ) return *this;
+
+	clear();
+
+	mDims = other.mDims;
+	mStride = other.mStride;
+
+	grow( other.mCount );
+
+	if( other.mCount > 0 ) memcpy( mData, other.mData, other.mCount * mStride * sizeof( GX_DataType ) );
+	mCount = other.mCount;
+
+	return *this;
+}
+
+GX_Dataset :: ~GX_Dataset()
+{
+	release();
+}
+
+size_t GX_Dataset :: size() const
+{
+	return mCount;
+}
+
+size_t GX_Dataset :: getDim() const
+{
+	return mDims.empty() ? 0 : mDims[ 0 ];
+}
+
+size_t GX_Dataset :: getStride() const
+{
+	return mStride;
+}
+
+GX_DataType * GX_Dataset :: operator[]( size_t index )
+{
+	assert( index < mCount );
+
+	return mData + index * mStride;
+}
+
+const GX_DataType * GX_Dataset :: operator[]( size_t index ) const
+{
+	assert( index < mCount );
+
+	return mData + index * mStride;
+}
+
+GX_MDSpanRO GX_Dataset :: getSpan( size_t index ) const
+{
+	return GX_MDSpanRO( ( *this )[ index ], mDims );
+}
+
+void GX_Dataset :: copySample( size_t index, GX_DataVector * sample ) const
+{
+	if( sample->size() != getDim() ) sample->resize( getDim() );
+
+	const GX_DataType * from = ( *this )[ index ];
+	std::copy( from, from + getDim(), std::begin( *sample ) );
+}
+
+bool GX_Dataset :: append( const GX_DataType * sample, size_t dim )
+{
+	if( 0 == dim ) return false;
+
+	if( mDims.empty() ) {
+		mDims = { dim };
+		mStride = strideOf( dim );
+	}
+
+	if( dim != getDim() ) {
+		printf( "%s dim %zu, dataset dim %zu\n", __func__, dim, getDim() );
+		return false;
+	}
+
+	// the first sample allocates what reserve asked for
+	if( NULL == mData || mCount == mCapacity ) {
+		// a sample of this dataset moves with the slab
+		bool isInside = NULL != mData && sample >= mData && sample < mData + mCount * mStride;
+		size_t offset = isInside ? sample - mData : 0;
+
+		grow( NULL == mData ? std::max( mCapacity, (size_t)16 ) : mCapacity * 2 );
+
+		if( isInside ) sample = mData + offset;
+	}
+
+	GX_DataType * to = mData + mCount * mStride;
+	std::copy( sample, sample + dim, to );
+
+	mCount++;
+
+	return true;
+}
+
+bool GX_Dataset :: append( const GX_DataVector & sample )
+{
+	return append( std::begin( sample ), sample.size() );
+}
+
+void GX_Dataset :: reserve( size_t count )
+{
+	// the stride is not known before the first sample
+	if( count > mCapacity && mStride > 0 ) grow( count );
+
+	if( 0 == mStride ) mCapacity = std::max( mCapacity, count );
+}
+
+void GX_Dataset :: grow( size_t capacity )
+{
+	size_t bytes = capacity * mStride * sizeof( GX_DataType );
+
+	void * data = NULL;
+	if( bytes > 0 && 0 != posix_memalign( &data, eCacheLine, bytes ) ) {
+		printf( "%s alloc %zu bytes fail\n", __func__, bytes );
+		abort();
+	}
+
+	// the padding of every stride is zeroed too, so the slab can be compared and written whole
+	if( bytes > 0 ) memset( data, 0, bytes );
+	if( mCount > 0 ) memcpy( data, mData, mCount * mStride * sizeof( GX_DataType ) );
+
+	release();
+
+	mData = (GX_DataType *)data;
+	mCapacity = capacity;
+}
+
+void GX_Dataset :: release()
+{
+	if( mMappedBytes > 0 ) {
+		munmap( mData, mMappedBytes );
+	} else {
+		free( mData );
+	}
+
+	mData = NULL;
+	mMappedBytes = 0;
+}
+
+void GX_Dataset :: clear()
+{
+	release();
+
+	mDims.clear();
+	mCount = mCapacity = mStride = 0;
+	mData = NULL;
+}
+
+void GX_Dataset :: swap( GX_Dataset & other )
+{
+	mDims.swap( other.mDims );
+	std::swap( mCount, other.mCount );
+	std::swap( mCapacity, other.mCapacity );
+	std::swap( mStride, other.mStride );
+	std::swap( mData, other.mData );
+	std::swap( mMappedBytes, other.mMappedBytes );
+}
+
+size_t GX_Dataset :: getBytes() const
+{
+	if( mMappedBytes > 0 ) return mMappedBytes;
+
+	return gx_heap_bytes( mCapacity * mStride * sizeof( GX_DataType ) );
+}
+
+size_t GX_Dataset :: getStrideOf( size_t dim )
+{
+	return strideOf( dim );
+}
+
+size_t GX_Dataset :: getSlabBytes( size_t count, size_t dim )
+{
+	return count * strideOf( dim ) * sizeof( GX_DataType );
+}
+
+bool GX_Dataset :: map( const char * path, size_t offset, size_t count, size_t dim )
+{
+	size_t bytes = getSlabBytes( count, dim );
+
+	if( 0 == count || 0 == dim || 0 != offset % sysconf( _SC_PAGESIZE ) ) return false;
+
+	int fd = open( path, O_RDONLY );
+
+	if( fd < 0 ) {
+		printf( "%s open %s fail, errno %d, %s\n", __func__, path, errno, strerror( errno ) );
+		return false;
+	}
+
+	// private and writable, a write copies the page instead of changing the file
+	void * data = mmap( NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, offset );
+
+	close( fd );
+
+	if( MAP_FAILED == data ) {
+		printf( "%s mmap %s %zu bytes fail, errno %d, %s\n", __func__, path, bytes, errno, strerror( errno ) );
+		return false;
+	}
+
+	// the first epoch reads in shuffled order, start the read-ahead of the whole slab
+	madvise( data, bytes, MADV_WILLNEED );
+
+	clear();
+
+	mDims = { dim };
+	mStride = strideOf( dim );
+	mCount = mCapacity = count;
+	mData = (GX_DataType *)data;
+	mMappedBytes = bytes;
+
+	return true;
+}
+
+const void * GX_Dataset :: getSlab() const
+{
+	return mData;
+}
+
+bool GX_Dataset :: isMapped() const
+{
+	return mMappedBytes > 0;
+}
+
+void GX_Dataset :: toMatrix( GX_DataMatrix * matrix ) const
+{
+	matrix->reserve( matrix->size() + mCount );
+
+	for( size_t i = 0; i < mCount; i++ ) {
+		const GX_DataType * from = ( *this )[ i ];
+		matrix->emplace_back( GX_DataVector( from, getDim() ) );
+	}
+}
+
@@ -0,0 +1,97 @@
+#pragma once
+
+#include "gxcomm.h"
+
+/*
+* Training data in one slab: sample i starts at i * getStride() items, the
+* stride is the sample size rounded up to a cache line and the slab is cache
+* line aligned, so every sample begins on its own line. Taking a sample is
+* pointer arithmetic and a shuffled walk touches one region the hardware
+* prefetchers can follow, instead of one heap block per GX_DataVector.
+*
+* A GX_DataMatrix converts implicitly, so the callers of train that still
+* hold one keep working, at the cost of one copy.
+*
+* The slab can also be a private mapping of a file that holds it in the same
+* layout, see GX_DataCache, the pages are read when they are touched and the
+* first write to one makes a private copy of it.
+*/
+class GX_Dataset {
+public:
+	GX_Dataset();
+
+	// count zero filled samples of dim items each
+	GX_Dataset( size_t count, size_t dim );
+
+	// every row must have the size of the first one
+	GX_Dataset( const GX_DataMatrix & matrix );
+
+	GX_Dataset( const GX_Dataset & other );
+
+	GX_Dataset & operator=( const GX_Dataset & other );
+
+	~GX_Dataset();
+
+	// samples
+	size_t size() const;
+
+	// items of one sample
+	size_t getDim() const;
+
+	// items from one sample to the next
+	size_t getStride() const;
+
+	GX_DataType * operator[]( size_t index );
+
+	const GX_DataType * operator[]( size_t index ) const;
+
+	// sample as a { getDim() } span, valid while the dataset is not resized
+	GX_MDSpanRO getSpan( size_t index ) const;
+
+	void copySample( size_t index, GX_DataVector * sample ) const;
+
+	// the first sample sets the dim, the others must match it. sample may point into this dataset
+	bool append( const GX_DataType * sample, size_t dim );
+
+	bool append( const GX_DataVector & sample );
+
+	void reserve( size_t count );
+
+	void clear();
+
+	void swap( GX_Dataset & other );
+
+	// heap bytes of the slab, or the mapped bytes
+	size_t getBytes() const;
+
+	// items from one sample to the next for samples of dim items
+	static size_t getStrideOf( size_t dim );
+
+	// bytes of the slab of count samples of dim items, as written to a file
+	static size_t getSlabBytes( size_t count, size_t dim );
+
+	// the slab is count samples of dim items at offset of the file, offset is a multiple of the page size
+	bool map( const char * path, size_t offset, size_t count, size_t dim );
+
+	// the slab as it is in memory, getSlabBytes( size(), getDim() ) bytes
+	const void * getSlab() const;
+
+	bool isMapped() const;
+
+	// appends one row per sample
+	void toMatrix( GX_DataMatrix * matrix ) const;
+
+private:
+	// moves the samples to a slab of capacity samples
+	void grow( size_t capacity );
+
+	// frees or unmaps the slab
+	void release();
+
+private:
+	GX_Dims mDims;
+	size_t mCount, mCapacity, mStride;
+	GX_DataType * mData;
+	size_t mMappedBytes;
+};
+
@@ -0,0 +1,357 @@
+
+#include "gxdist.h"
+#include "gxpool.h"
+
+#include <atomic>
+#include <vector>
+#include <algorithm>
+#include <new>
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+GX_Communicator :: GX_Communicator( int rank, int size )
+	: mRank( rank ), mSize( size )
+{
+}
+
+GX_Communicator :: ~GX_Communicator()
+{
+}
+
+int GX_Communicator :: getRank() const
+{
+	return mRank;
+}
+
+int GX_Communicator :: getSize() const
+{
+	return mSize;
+}
+
+void GX_Communicator :: getChunk( size_t count, int index, size_t * begin, size_t * end ) const
+{
+	size_t chunkSize = ( count + mSize - 1 ) / mSize;
+
+	*begin = std::min( count, index * chunkSize );
+	*end = std::min( count, *begin + chunkSize );
+}
+
+bool GX_Communicator :: allReduce( GX_DataType * data, size_t count )
+{
+	if( mSize <= 1 ) return true;
+
+	size_t chunkSize = ( count + mSize - 1 ) / mSize;
+	if( mRecvBuff.size() < chunkSize ) mRecvBuff.resize( chunkSize );
+
+	GX_DataType * recv = std::begin( mRecvBuff );
+
+	// reduce-scatter: after step s rank r holds the sum of s + 2 ranks for chunk r - s - 1
+	for( int s = 0; s < mSize - 1; s++ ) {
+		size_t sendBegin, sendEnd, recvBegin, recvEnd;
+		getChunk( count, ( mRank - s + mSize ) % mSize, &sendBegin, &sendEnd );
+		getChunk( count, ( mRank - s - 1 + 2 * mSize ) % mSize, &recvBegin, &recvEnd );
+
+		if( ! exchange( data + sendBegin, sendEnd - sendBegin, recv, recvEnd - recvBegin ) ) return false;
+
+		for( size_t i = recvBegin; i < recvEnd; i++ ) data[ i ] += recv[ i - recvBegin ];
+	}
+
+	// all-gather: rank r owns the sum of chunk r + 1 and passes it on
+	for( int s = 0; s < mSize - 1; s++ ) {
+		size_t sendBegin, sendEnd, recvBegin, recvEnd;
+		getChunk( count, ( mRank + 1 - s + mSize ) % mSize, &sendBegin, &sendEnd );
+		getChunk( count, ( mRank - s + mSize ) % mSize, &recvBegin, &recvEnd );
+
+		if( ! exchange( data + sendBegin, sendEnd - sendBegin, data + recvBegin, recvEnd - recvBegin ) ) return false;
+	}
+
+	return true;
+}
+
+bool GX_Communicator :: broadcast( GX_DataType * data, size_t count, int root )
+{
+	// x + 0 is x, only the sign of a zero may change
+	if( mRank != root ) std::fill( data, data + count, 0.0 );
+
+	return allReduce( data, count );
+}
+
+////////////////////////////////////////////////////////////
+
+static_assert( ATOMIC_LLONG_LOCK_FREE == 2, "mailbox counters must be lock free to work across processes" );
+
+// rank r writes its mailbox, rank r + 1 reads it. one message in flight,
+// the writer waits until the reader consumed the previous one
+typedef struct tagShmMailbox {
+	enum { eCapacity = 64 * 1024 };
+
+	std::atomic< unsigned long long > mWriteSeq;
+	char mPadding0[ 64 - sizeof( std::atomic< unsigned long long > ) ];
+	std::atomic< unsigned long long > mReadSeq;
+	char mPadding1[ 64 - sizeof( std::atomic< unsigned long long > ) ];
+
+	GX_DataType mData[ eCapacity ];
+} GX_ShmMailbox_t;
+
+static void gx_spin_wait( const std::atomic< unsigned long long > & seq, unsigned long long expected )
+{
+	for( int spin = 0; seq.load( std::memory_order_acquire ) < expected; spin++ ) {
+		if( spin > 64 ) sched_yield();
+	}
+}
+
+class GX_ShmCommunicator : public GX_Communicator {
+public:
+	GX_ShmCommunicator( int rank, int size, GX_ShmMailbox_t * mailboxes )
+		: GX_Communicator( rank, size ), mMailboxes( mailboxes ), mSendSeq( 0 ), mRecvSeq( 0 ) {}
+
+	~GX_ShmCommunicator() {}
+
+protected:
+	bool exchange( const GX_DataType * send, size_t sendCount, GX_DataType * recv, size_t recvCount ) {
+		GX_ShmMailbox_t * outbox = mMailboxes + mRank;
+		GX_ShmMailbox_t * inbox = mMailboxes + ( mRank - 1 + mSize ) % mSize;
+
+		// the neighbours step through the same pieces, so a send never waits on a receive of ours
+		for( size_t sent = 0, received = 0; sent < sendCount || received < recvCount; ) {
+			if( sent < sendCount ) {
+				size_t count = std::min( sendCount - sent, (size_t)GX_ShmMailbox_t::eCapacity );
+
+				gx_spin_wait( outbox->mReadSeq, mSendSeq );
+				memcpy( outbox->mData, send + sent, count * sizeof( GX_DataType ) );
+				outbox->mWriteSeq.store( ++mSendSeq, std::memory_order_release );
+
+				sent += count;
+			}
+
+			if( received < recvCount ) {
+				size_t count = std::min( recvCount - received, (size_t)GX_ShmMailbox_t::eCapacity );
+
+				gx_spin_wait( inbox->mWriteSeq, ++mRecvSeq );
+				memcpy( recv + received, inbox->mData, count * sizeof( GX_DataType ) );
+				inbox->mReadSeq.store( mRecvSeq, std::memory_order_release );
+
+				received += count;
+			}
+		}
+
+		return true;
+	}
+
+private:
+	GX_ShmMailbox_t * mMailboxes;
+	unsigned long long mSendSeq, mRecvSeq;
+};
+
+////////////////////////////////////////////////////////////
+
+class GX_SocketCommunicator : public GX_Communicator {
+public:
+	GX_SocketCommunicator( int rank, int size, int prevFd, int nextFd )
+		: GX_Communicator( rank, size ), mPrevFd( prevFd ), mNextFd( nextFd ) {
+		fcntl( mPrevFd, F_SETFL, fcntl( mPrevFd, F_GETFL ) | O_NONBLOCK );
+		fcntl( mNextFd, F_SETFL, fcntl( mNextFd, F_GETFL ) | O_NONBLOCK );
+	}
+
+	~GX_SocketCommunicator() {
+		close( mPrevFd );
+		close( mNextFd );
+	}
+
+protected:
+	// both directions at once, a blocking send could wait on a full buffer forever
+	// while every rank of the ring does the same
+	bool exchange( const GX_DataType * send, size_t sendCount, GX_DataType * recv, size_t recvCount ) {
+		const char * sendPtr = (const char *)send;
+		char * recvPtr = (char *)recv;
+
+		size_t sendLeft = sendCount * sizeof( GX_DataType ), recvLeft = recvCount * sizeof( GX_DataType );
+
+		while( sendLeft > 0 || recvLeft > 0 ) {
+			// a finished direction is left out, poll still reports the hangup of a neighbour
+			// that is already done with the ring, which is no failure of this collective
+			struct pollfd fds[ 2 ] = {
+				{ sendLeft > 0 ? mNextFd : -1, POLLOUT, 0 },
+				{ recvLeft > 0 ? mPrevFd : -1, POLLIN, 0 }
+			};
+
+			if( poll( fds, 2, -1 ) < 0 ) {
+				if( EINTR == errno ) continue;
+				printf( "%s poll fail, errno %d, %s\n", __func__, errno, strerror( errno ) );
+				return false;
+			}
+
+			if( ( fds[ 0 ].revents | fds[ 1 ].revents ) & ( POLLERR | POLLNVAL ) ) {
+				printf( "%s rank %d, peer closed\n", __func__, mRank );
+				return false;
+			}
+
+			if( fds[ 0 ].revents & POLLOUT ) {
+				ssize_t len = ::send( mNextFd, sendPtr, sendLeft, MSG_NOSIGNAL );
+				if( len < 0 && EAGAIN != errno && EINTR != errno ) return false;
+				if( len > 0 ) {
+					sendPtr += len;
+					sendLeft -= len;
+				}
+			}
+
+			if( fds[ 1 ].revents & ( POLLIN | POLLHUP ) ) {
+				ssize_t len = ::recv( mPrevFd, recvPtr, recvLeft, 0 );
+				if( 0 == len || ( len < 0 && EAGAIN != errno && EINTR != errno ) ) {
+					printf( "%s rank %d, peer closed\n", __func__, mRank );
+					return false;
+				}
+				if( len > 0 ) {
+					recvPtr += len;
+					recvLeft -= len;
+				}
+			}
+		}
+
+		return true;
+	}
+
+private:
+	int mPrevFd, mNextFd;
+};
+
+////////////////////////////////////////////////////////////
+
+int GX_Launcher :: getTransport( const char * name )
+{
+	if( 0 == strcmp( name, "shm" ) ) return eShm;
+	if( 0 == strcmp( name, "socket" ) ) return eSocket;
+
+	return -1;
+}
+
+bool GX_Launcher :: run( int workerCount, int transport, const Worker_t & worker )
+{
+	if( workerCount < 1 || ( eShm != transport && eSocket != transport ) ) return false;
+
+	GX_ShmMailbox_t * mailboxes = NULL;
+	size_t mapBytes = workerCount * sizeof( GX_ShmMailbox_t );
+
+	// sockets[ r ] links rank r, end 0, to rank r + 1, end 1
+	std::vector< int > sockets( 2 * workerCount, -1 );
+
+	if( eShm == transport ) {
+		void * addr = mmap( NULL, mapBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0 );
+		if( MAP_FAILED == addr ) {
+			printf( "%s mmap %zu fail, errno %d, %s\n", __func__, mapBytes, errno, strerror( errno ) );
+			return false;
+		}
+
+		mailboxes = (GX_ShmMailbox_t *)addr;
+		for( int i = 0; i < workerCount; i++ ) {
+			new( &( mailboxes[ i ].mWriteSeq ) ) std::atomic< unsigned long long >( 0 );
+			new( &( mailboxes[ i ].mReadSeq ) ) std::atomic< unsigned long long >( 0 );
+		}
+	}
+
+	if( eSocket == transport ) {
+		for( int i = 0; i < workerCount; i++ ) {
+			if( 0 != socketpair( AF_UNIX, SOCK_STREAM, 0, &( sockets[ 2 * i ] ) ) ) {
+				printf( "%s socketpair fail, errno %d, %s\n", __func__, errno, strerror( errno ) );
+				for( auto & fd : sockets ) if( fd >= 0 ) close( fd );
+				return false;
+			}
+		}
+	}
+
+	fflush( stdout );
+
+	std::vector< pid_t > pids;
+
+	for( int rank = 0; rank < workerCount; rank++ ) {
+		pid_t pid = fork();
+
+		if( 0 == pid ) {
+			// the pool threads were not copied, only the pool object
+			if( NULL != GX_ThreadPool::getDefault() ) GX_ThreadPool::restartAfterFork();
+
+			GX_Communicator * comm = NULL;
+
+			if( eShm == transport ) comm = new GX_ShmCommunicator( rank, workerCount, mailboxes );
+
+			if( eSocket == transport ) {
+				int nextFd = sockets[ 2 * rank ];
+				int prevFd = sockets[ 2 * ( ( rank - 1 + workerCount ) % workerCount ) + 1 ];
+
+				for( auto & fd : sockets ) if( fd != nextFd && fd != prevFd ) close( fd );
+
+				comm = new GX_SocketCommunicator( rank, workerCount, prevFd, nextFd );
+			}
+
+			int ret = worker( comm );
+
+			delete comm;
+
+			fflush( stdout );
+			_exit( ret );
+		}
+
+		if( pid < 0 ) {
+			printf( "%s fork fail, errno %d, %s\n", __func__, errno, strerror( errno ) );
+			break;
+		}
+
+		pids.emplace_back( pid );
+	}
+
+	for( auto & fd : sockets ) if( fd >= 0 ) close( fd );
+
+	bool ret = (int)pids.size() == workerCount;
+
+	// a dead rank leaves its neighbours waiting forever, so the first failure stops the job
+	if( ! ret ) for( auto & pid : pids ) kill( pid, SIGTERM );
+
+	// only the workers are reaped, the other children of the caller are left to it. blocking on
+	// one worker would miss the failure of another, which leaves the ring waiting, so they are polled
+	std::vector< bool > isReaped( pids.size(), false );
+
+	for( size_t left = pids.size(); left > 0; ) {
+		bool isAny = false;
+
+		for( size_t i = 0; i < pids.size(); i++ ) {
+			if( isReaped[ i ] ) continue;
+
+			int status = 0;
+			pid_t pid = waitpid( pids[ i ], &status, WNOHANG );
+
+			if( 0 == pid || ( pid < 0 && EINTR == errno ) ) continue;
+
+			isReaped[ i ] = true;
+			isAny = true;
+			left--;
+
+			// reaped elsewhere, its status is lost
+			if( pid < 0 ) continue;
+
+			if( ! WIFEXITED( status ) || 0 != WEXITSTATUS( status ) ) {
+				if( ret ) {
+					printf( "%s worker %zu fail, status %d\n", __func__, i, status );
+					for( auto & item : pids ) if( item != pid ) kill( item, SIGTERM );
+				}
+				ret = false;
+			}
+		}
+
+		if( ! isAny && left > 0 ) usleep( 1000 );
+	}
+
+	if( NULL != mailboxes ) munmap( mailboxes, mapBytes );
+
+	return ret;
+}
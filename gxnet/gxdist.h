@@ -0,0 +1,59 @@
+#pragma once
+
+#include "gxcomm.h"
+
+#include <functional>
+
+/*
+* Collectives of the data-parallel training. The ranks form a ring, rank r sends
+* to rank r + 1 and receives from rank r - 1. allReduce is the classic ring:
+* a reduce-scatter in which every chunk is summed once, by one rank, then an
+* all-gather that copies the sums around, so every rank ends with the same bits.
+*/
+class GX_Communicator {
+public:
+	virtual ~GX_Communicator();
+
+	int getRank() const;
+
+	int getSize() const;
+
+	// sum data over all ranks in place, every rank must call it with the same count
+	bool allReduce( GX_DataType * data, size_t count );
+
+	// copy data of root to all ranks
+	bool broadcast( GX_DataType * data, size_t count, int root );
+
+protected:
+	GX_Communicator( int rank, int size );
+
+	// send sendCount items to the next rank while receiving recvCount items from the previous one
+	virtual bool exchange( const GX_DataType * send, size_t sendCount, GX_DataType * recv, size_t recvCount ) = 0;
+
+private:
+	void getChunk( size_t count, int index, size_t * begin, size_t * end ) const;
+
+protected:
+	int mRank, mSize;
+	GX_DataVector mRecvBuff;
+};
+
+/*
+* Forks the workers of a data-parallel job on this host. eShm links the ring
+* with mailboxes in a shared mapping, eSocket with Unix socket pairs for hosts
+* where shared memory is restricted. Fork before any thread is started, the
+* default thread pool is the only one restarted in the workers.
+*/
+class GX_Launcher {
+public:
+	enum { eShm = 0, eSocket = 1 };
+
+	typedef std::function< int( GX_Communicator * comm ) > Worker_t;
+
+	// run worker in workerCount processes, each process exits with the return value of
+	// its worker. once one fails the others are killed. true when all of them return 0
+	static bool run( int workerCount, int transport, const Worker_t & worker );
+
+	// "shm" or "socket", -1 for an unknown name
+	static int getTransport( const char * name );
+};
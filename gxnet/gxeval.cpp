@@ -1,28 +1,36 @@
 
 #include "gxeval.h"
 #include "gxutils.h"
+#include "gxprof.h"
 
-void gx_eval( const char * tag, GX_Network & network, GX_DataMatrix & input, GX_DataMatrix & target, bool isDebug )
+// targetOf( i ) is the class index of sample i
+template< typename TargetOf >
+static void evalInternal( const char * tag, GX_Network & network, const GX_Dataset & input,
+		size_t maxClasses, TargetOf targetOf, bool isDebug )
 {
-	printf( "%s( %s, ..., input { %ld }, target { %ld } )\n", __func__, tag, input.size(), target.size() );
-
 	if( isDebug ) network.print();
 
 	GX_DataMatrix confusionMatrix;
 	GX_DataVector targetTotal;
 
-	size_t maxClasses = target[ 0 ].size();
 	confusionMatrix.resize( maxClasses );
 	targetTotal.resize( maxClasses );
 	for( size_t i = 0; i < maxClasses; i++ ) confusionMatrix[ i ].resize( maxClasses, 0.0 );
 
 	int correct = 0;
 
+	GX_Profiler * profiler = network.getProfiler();
+	if( NULL != profiler ) profiler->beginRegion( GX_Profiler::eRegionEval );
+
+	// forward keeps every layer output and takes a vector, both are reused across samples
+	GX_DataMatrix output;
+	GX_DataVector sample;
+
 	for( size_t i = 0; i < input.size(); i++ ) {
 
-		GX_DataMatrix output;
+		input.copySample( i, &sample );
 
-		bool ret = network.forward( input[ i ], &output );
+		bool ret = network.forward( sample, &output );
 
 		if( ! ret ) {
 			printf( "forward fail\n" );
@@ -30,7 +38,7 @@ void gx_eval( const char * tag, GX_Network & network, GX_DataMatrix & input, GX_
 		}
 
 		int outputType = GX_Utils::max_index( std::begin( output.back() ), std::end( output.back() ) );
-		int targetType = GX_Utils::max_index( std::begin( target[ i ] ), std::end( target[ i ] ) );
+		int targetType = targetOf( i );
 
 		if( isDebug ) printf( "forward %d, index %zu, %d %d\n", ret, i, outputType, targetType );
 
@@ -40,10 +48,12 @@ void gx_eval( const char * tag, GX_Network & network, GX_DataMatrix & input, GX_
 		targetTotal[ targetType ] += 1;
 
 		for( size_t j = 0; isDebug && j < output.back().size() && j < 10; j++ ) {
-			printf( "\t%zu %.8f %.8f\n", j, output.back()[ j ], target[ i ][ j ] );
+			printf( "\t%zu %.8f %.8f\n", j, output.back()[ j ], targetType == (int)j ? 1.0 : 0.0 );
 		}
 	}
 
+	if( NULL != profiler ) profiler->endRegion( GX_Profiler::eRegionEval, tag );
+
 	printf( "check %s, %d/%ld = %.2f\n", tag, correct, input.size(), ((float)correct) / input.size() );
 
 	for( size_t i = 0; i < confusionMatrix.size(); i++ ) {
@@ -53,3 +63,23 @@ void gx_eval( const char * tag, GX_Network & network, GX_DataMatrix & input, GX_
 	GX_Utils::printMatrix( "confusion matrix", confusionMatrix, false, true );
 }
 
+void gx_eval( const char * tag, GX_Network & network, const GX_Dataset & input, const GX_Dataset & target, bool isDebug )
+{
+	printf( "%s( %s, ..., input { %ld }, target { %ld } )\n", __func__, tag, input.size(), target.size() );
+
+	size_t maxClasses = target.getDim();
+
+	evalInternal( tag, network, input, maxClasses, [&]( size_t i ) {
+		return GX_Utils::max_index( target[ i ], target[ i ] + maxClasses );
+	}, isDebug );
+}
+
+void gx_eval( const char * tag, GX_Network & network, const GX_Dataset & input, const GX_LabelVector & labels, bool isDebug )
+{
+	printf( "%s( %s, ..., input { %ld }, labels { %ld } )\n", __func__, tag, input.size(), labels.size() );
+
+	evalInternal( tag, network, input, network.getLayers().back()->getOutputSize(), [&]( size_t i ) {
+		return (int)labels[ i ];
+	}, isDebug );
+}
+
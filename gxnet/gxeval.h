@@ -5,5 +5,8 @@
 
 class GX_Network;
 
-void gx_eval( const char * tag, GX_Network & network, GX_DataMatrix & input, GX_DataMatrix & target, bool isDebug );
+void gx_eval( const char * tag, GX_Network & network, const GX_Dataset & input, const GX_Dataset & target, bool isDebug );
+
+// same as above, target as the class index of every sample
+void gx_eval( const char * tag, GX_Network & network, const GX_Dataset & input, const GX_LabelVector & labels, bool isDebug );
 
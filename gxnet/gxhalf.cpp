@@ -0,0 +1,277 @@
+
+#include "gxhalf.h"
+
+#include <cstring>
+#include <algorithm>
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+#include <immintrin.h>
+#define GX_HAS_F16C_TARGET
+#endif
+
+// floats widened at a time, small enough to stay in L1
+enum { eChunkSize = 64 };
+
+static uint32_t floatBits( float value )
+{
+	uint32_t ret = 0;
+	memcpy( &ret, &value, sizeof( ret ) );
+	return ret;
+}
+
+static float bitsFloat( uint32_t bits )
+{
+	float ret = 0;
+	memcpy( &ret, &bits, sizeof( ret ) );
+	return ret;
+}
+
+static GX_HalfType bf16FromFloat( float value )
+{
+	uint32_t bits = floatBits( value );
+
+	// NaN keeps its sign and high payload bits, and stays a quiet NaN
+	if( ( bits & 0x7fffffff ) > 0x7f800000 ) return ( bits >> 16 ) | 0x40;
+
+	bits += 0x7fff + ( ( bits >> 16 ) & 1 );
+
+	return bits >> 16;
+}
+
+static float bf16ToFloat( GX_HalfType value )
+{
+	return bitsFloat( (uint32_t)value << 16 );
+}
+
+// same results as vcvtps2ph with round to nearest even
+static GX_HalfType fp16FromFloat( float value )
+{
+	uint32_t bits = floatBits( value );
+
+	uint32_t sign = ( bits >> 16 ) & 0x8000;
+	uint32_t abs = bits & 0x7fffffff;
+
+	GX_HalfType ret = 0;
+
+	if( abs > 0x7f800000 ) {
+		ret = 0x7e00 | ( ( abs >> 13 ) & 0x3ff );
+	} else if( abs >= ( ( 127 + 16 ) << 23 ) ) {
+		// infinity, and every finite value from 65520 up
+		ret = 0x7c00;
+	} else if( abs < ( 113 << 23 ) ) {
+		// below the smallest normal half, the float add rounds the mantissa into place
+		static const uint32_t DENORM_MAGIC = ( ( 127 - 15 ) + ( 23 - 10 ) + 1 ) << 23;
+
+		ret = floatBits( bitsFloat( abs ) + bitsFloat( DENORM_MAGIC ) ) - DENORM_MAGIC;
+	} else {
+		uint32_t isOdd = ( abs >> 13 ) & 1;
+
+		abs += ( (uint32_t)( 15 - 127 ) << 23 ) + 0xfff + isOdd;
+
+		ret = abs >> 13;
+	}
+
+	return ret | sign;
+}
+
+static float fp16ToFloat( GX_HalfType value )
+{
+	uint32_t sign = (uint32_t)( value & 0x8000 ) << 16;
+	uint32_t exponent = ( value >> 10 ) & 0x1f;
+	uint32_t mantissa = value & 0x3ff;
+
+	if( 0 == exponent ) {
+		// zero and subnormals are mantissa * 2^-24, exact in float
+		float ret = mantissa * ( 1.0f / ( 1 << 24 ) );
+		return sign ? -ret : ret;
+	}
+
+	// a NaN comes back quiet, as vcvtph2ps does
+	if( 31 == exponent ) return bitsFloat( sign | 0x7f800000 | ( mantissa << 13 ) | ( mantissa ? 0x400000 : 0 ) );
+
+	return bitsFloat( sign | ( ( exponent + 112 ) << 23 ) | ( mantissa << 13 ) );
+}
+
+#ifdef GX_HAS_F16C_TARGET
+
+__attribute__(( target( "f16c" ) ))
+static void fp16EncodeF16C( const float * src, size_t count, GX_HalfType * dest )
+{
+	size_t i = 0;
+
+	for( ; i + 4 <= count; i += 4 ) {
+		__m128i half = _mm_cvtps_ph( _mm_loadu_ps( src + i ), _MM_FROUND_TO_NEAREST_INT );
+		_mm_storel_epi64( (__m128i *)( dest + i ), half );
+	}
+
+	for( ; i < count; i++ ) dest[ i ] = _cvtss_sh( src[ i ], _MM_FROUND_TO_NEAREST_INT );
+}
+
+__attribute__(( target( "f16c" ) ))
+static void fp16DecodeF16C( const GX_HalfType * src, size_t count, float * dest )
+{
+	size_t i = 0;
+
+	for( ; i + 4 <= count; i += 4 ) {
+		_mm_storeu_ps( dest + i, _mm_cvtph_ps( _mm_loadl_epi64( (const __m128i *)( src + i ) ) ) );
+	}
+
+	for( ; i < count; i++ ) dest[ i ] = _cvtsh_ss( src[ i ] );
+}
+
+static bool detectF16C()
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports( "f16c" );
+}
+
+bool GX_Half :: sIsF16C = detectF16C();
+
+#else
+
+bool GX_Half :: sIsF16C = false;
+
+#endif
+
+static void encodeFloat( int format, const float * src, size_t count, GX_HalfType * dest )
+{
+	if( GX_Half::eBF16 == format ) {
+		for( size_t i = 0; i < count; i++ ) dest[ i ] = bf16FromFloat( src[ i ] );
+	}
+
+	if( GX_Half::eFP16 == format ) {
+#ifdef GX_HAS_F16C_TARGET
+		if( GX_Half::isF16C() ) {
+			fp16EncodeF16C( src, count, dest );
+			return;
+		}
+#endif
+		for( size_t i = 0; i < count; i++ ) dest[ i ] = fp16FromFloat( src[ i ] );
+	}
+}
+
+static void decodeFloat( int format, const GX_HalfType * src, size_t count, float * dest )
+{
+	if( GX_Half::eBF16 == format ) {
+		for( size_t i = 0; i < count; i++ ) dest[ i ] = bf16ToFloat( src[ i ] );
+	}
+
+	if( GX_Half::eFP16 == format ) {
+#ifdef GX_HAS_F16C_TARGET
+		if( GX_Half::isF16C() ) {
+			fp16DecodeF16C( src, count, dest );
+			return;
+		}
+#endif
+		for( size_t i = 0; i < count; i++ ) dest[ i ] = fp16ToFloat( src[ i ] );
+	}
+}
+
+GX_HalfType GX_Half :: fromFloat( int format, float value )
+{
+	GX_HalfType ret = 0;
+
+	encodeFloat( format, &value, 1, &ret );
+
+	return ret;
+}
+
+float GX_Half :: toFloat( int format, GX_HalfType value )
+{
+	float ret = 0;
+
+	decodeFloat( format, &value, 1, &ret );
+
+	return ret;
+}
+
+void GX_Half :: encode( int format, const GX_DataType * src, size_t count, GX_HalfType * dest )
+{
+	float buff[ eChunkSize ];
+
+	for( size_t begin = 0; begin < count; begin += eChunkSize ) {
+		size_t n = std::min( count - begin, (size_t)eChunkSize );
+
+		std::copy( src + begin, src + begin + n, buff );
+
+		encodeFloat( format, buff, n, dest + begin );
+	}
+}
+
+void GX_Half :: decode( int format, const GX_HalfType * src, size_t count, GX_DataType * dest )
+{
+	float buff[ eChunkSize ];
+
+	for( size_t begin = 0; begin < count; begin += eChunkSize ) {
+		size_t n = std::min( count - begin, (size_t)eChunkSize );
+
+		decodeFloat( format, src + begin, n, buff );
+
+		std::copy( buff, buff + n, dest + begin );
+	}
+}
+
+GX_AccumType GX_Half :: dot( int format, const GX_HalfType * weights, const GX_DataType * input, size_t count )
+{
+	float buff[ eChunkSize ];
+
+	GX_AccumType ret = 0;
+
+	for( size_t begin = 0; begin < count; begin += eChunkSize ) {
+		size_t n = std::min( count - begin, (size_t)eChunkSize );
+
+		decodeFloat( format, weights + begin, n, buff );
+
+		for( size_t i = 0; i < n; i++ ) ret += buff[ i ] * input[ begin + i ];
+	}
+
+	return ret;
+}
+
+GX_AccumType GX_Half :: dot( int format, const GX_HalfType * weights, const GX_HalfType * input, size_t count )
+{
+	float buff[ eChunkSize ], inputBuff[ eChunkSize ];
+
+	GX_AccumType ret = 0;
+
+	for( size_t begin = 0; begin < count; begin += eChunkSize ) {
+		size_t n = std::min( count - begin, (size_t)eChunkSize );
+
+		decodeFloat( format, weights + begin, n, buff );
+		decodeFloat( format, input + begin, n, inputBuff );
+
+		for( size_t i = 0; i < n; i++ ) ret += buff[ i ] * inputBuff[ i ];
+	}
+
+	return ret;
+}
+
+const char * GX_Half :: getName( int format )
+{
+	if( eBF16 == format ) return "bf16";
+	if( eFP16 == format ) return "fp16";
+
+	return NULL;
+}
+
+int GX_Half :: getFormat( const char * name )
+{
+	if( 0 == strcmp( name, "none" ) ) return eNone;
+	if( 0 == strcmp( name, "bf16" ) ) return eBF16;
+	if( 0 == strcmp( name, "fp16" ) ) return eFP16;
+
+	return -1;
+}
+
+bool GX_Half :: isF16C()
+{
+	return sIsF16C;
+}
+
+void GX_Half :: setF16C( bool isEnabled )
+{
+#ifdef GX_HAS_F16C_TARGET
+	sIsF16C = isEnabled && detectF16C();
+#endif
+}
+
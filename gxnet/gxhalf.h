@@ -0,0 +1,53 @@
+#pragma once
+
+#include "gxcomm.h"
+
+#include <vector>
+#include <stdint.h>
+
+typedef uint16_t GX_HalfType;
+
+typedef std::vector< GX_HalfType > GX_HalfVector;
+
+/*
+* 16-bit storage of weights and activations for inference. eBF16 keeps the
+* float exponent and 7 mantissa bits, eFP16 is IEEE half with 5 exponent and
+* 10 mantissa bits. Both round to nearest even and are widened to float in
+* chunks that stay in L1 right before they are used, there is no calibration.
+*
+* eFP16 uses the F16C instructions when the cpu has them and a bit exact
+* software conversion otherwise, the choice is made at run time.
+*/
+class GX_Half {
+public:
+	enum { eNone = 0, eBF16 = 1, eFP16 = 2 };
+
+	static GX_HalfType fromFloat( int format, float value );
+
+	static float toFloat( int format, GX_HalfType value );
+
+	static void encode( int format, const GX_DataType * src, size_t count, GX_HalfType * dest );
+
+	static void decode( int format, const GX_HalfType * src, size_t count, GX_DataType * dest );
+
+	// sum of weights[ i ] * input[ i ]
+	static GX_AccumType dot( int format, const GX_HalfType * weights, const GX_DataType * input, size_t count );
+
+	// same as above, input packed to the same format
+	static GX_AccumType dot( int format, const GX_HalfType * weights, const GX_HalfType * input, size_t count );
+
+	// "bf16" or "fp16", NULL for eNone
+	static const char * getName( int format );
+
+	// -1 for an unknown name
+	static int getFormat( const char * name );
+
+	// true when eFP16 runs on F16C, false turns it off to compare with the software conversion
+	static bool isF16C();
+
+	static void setF16C( bool isEnabled );
+
+private:
+	static bool sIsF16C;
+};
+
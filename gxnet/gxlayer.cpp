@@ -2,17 +2,21 @@
 
 #include "gxutils.h"
 #include "gxact.h"
+#include "gxpool.h"
 
 #include <limits.h>
 #include <cstdio>
+#include <cstring>
 
 #include <iostream>
+#include <algorithm>
 
 GX_BaseLayer :: GX_BaseLayer( int type )
 {
 	mIsDebug = false;
 	mType = type;
 	mActFunc = NULL;
+	mStorage = GX_Half::eNone;
 }
 
 GX_BaseLayer :: ~GX_BaseLayer()
@@ -24,18 +28,59 @@ void GX_BaseLayer :: forward( const GX_DataVector & input, GX_DataVector * outpu
 {
 	assert( input.size() == getInputSize() );
 
+	forward( std::begin( input ), output );
+}
+
+void GX_BaseLayer :: forward( const GX_DataType * input, GX_DataVector * output ) const
+{
+	if( output->size() == 0 ) output->resize( getOutputSize() );
+
+	assert( output->size() == getOutputSize() );
+
+	forward( input, std::begin( *output ) );
+}
+
+void GX_BaseLayer :: forward( const GX_DataType * input, GX_DataType * output ) const
+{
 	calcOutput( input, output );
-	if( NULL != mActFunc ) mActFunc->activate( *output, output );
+	if( NULL != mActFunc ) mActFunc->activate( output, output, getOutputSize() );
+}
+
+void GX_BaseLayer :: forward( int format, const GX_HalfType * input, GX_DataType * scratch, GX_DataType * output ) const
+{
+	calcPackedOutput( format, input, scratch, output );
+	if( NULL != mActFunc ) mActFunc->activate( output, output, getOutputSize() );
+}
+
+void GX_BaseLayer :: calcPackedOutput( int format, const GX_HalfType * input, GX_DataType * scratch,
+		GX_DataType * output ) const
+{
+	GX_Half::decode( format, input, getInputSize(), scratch );
+
+	calcOutput( scratch, output );
+}
+
+size_t GX_BaseLayer :: getPackedScratchSize() const
+{
+	return getInputSize();
 }
 
 void GX_BaseLayer :: backward( const GX_DataVector & input, const GX_DataVector & output,
 		GX_DataVector * outDelta, GX_DataVector * inDelta ) const
 {
 	assert( output.size() == outDelta->size() );
+	assert( NULL == inDelta || inDelta->size() == input.size() );
 
-	if( NULL != mActFunc ) mActFunc->derivate( output, outDelta );
+	backward( std::begin( input ), std::begin( output ), std::begin( *outDelta ),
+			NULL != inDelta ? std::begin( *inDelta ) : NULL );
+}
+
+void GX_BaseLayer :: backward( const GX_DataType * input, const GX_DataType * output,
+		GX_DataType * outDelta, GX_DataType * inDelta ) const
+{
+	if( NULL != mActFunc ) mActFunc->derivate( output, outDelta, getOutputSize() );
 
-	if( NULL != inDelta ) backpropagate( input, output, *outDelta, inDelta );
+	if( NULL != inDelta ) backpropagate( input, output, outDelta, inDelta );
 }
 
 const size_t GX_BaseLayer :: getInputSize() const
@@ -89,13 +134,87 @@ void GX_BaseLayer :: print( bool isDetail ) const
 	printWeights( isDetail );
 }
 
+void GX_BaseLayer :: getCost( int phase, GX_LayerCost_t * cost ) const
+{
+	memset( cost, 0, sizeof( *cost ) );
+
+	calcCost( phase, cost );
+
+	if( NULL != mActFunc && ( eCalcOutput == phase || eBackpropagate == phase ) ) {
+		cost->mFlops += mActFunc->getFlops( getOutputSize(), eBackpropagate == phase );
+		cost->mActBytes += 2.0 * getOutputSize() * sizeof( GX_DataType );
+	}
+}
+
 void GX_BaseLayer :: initGradientMatrix( GX_DataMatrix * gradient ) const
+{
+	GX_DimsList dimsList;
+	getGradientDims( &dimsList );
+
+	for( auto & dims : dimsList ) gradient->emplace_back( GX_DataVector( gx_dims_flatten_size( dims ) ) );
+}
+
+void GX_BaseLayer :: getGradientDims( GX_DimsList * dims ) const
+{
+	/* do nothing */
+}
+
+size_t GX_BaseLayer :: getWeightBytes() const
+{
+	return 0;
+}
+
+size_t GX_BaseLayer :: getScratchBytes() const
+{
+	return 0;
+}
+
+size_t GX_BaseLayer :: getParamCount() const
+{
+	return 0;
+}
+
+void GX_BaseLayer :: exportParams( GX_DataType ** cursor ) const
 {
 	/* do nothing */
 }
 
+void GX_BaseLayer :: importParams( const GX_DataType ** cursor )
+{
+	/* do nothing */
+}
+
+GX_BaseLayer * GX_BaseLayer :: clone() const
+{
+	GX_BaseLayer * ret = newInstance();
+
+	if( NULL != mActFunc ) ret->setActFunc( new GX_ActFunc( mActFunc->getType() ) );
+	ret->setDebug( mIsDebug );
+	ret->setStorage( mStorage );
+
+#ifdef GX_MIXED_PRECISION
+	ret->mMasterParams = mMasterParams;
+#endif
+
+	return ret;
+}
+
 void GX_BaseLayer :: collectGradient( const GX_DataVector & input, const GX_DataVector & output,
 		const GX_DataVector & delta, GX_DataMatrix::iterator * iter ) const
+{
+	assert( output.size() == delta.size() );
+
+	calcGradient( std::begin( input ), std::begin( output ), std::begin( delta ), iter );
+}
+
+void GX_BaseLayer :: collectGradient( const GX_DataType * input, const GX_DataType * output,
+		const GX_DataType * delta, GX_DataMatrix::iterator * iter ) const
+{
+	calcGradient( input, output, delta, iter );
+}
+
+void GX_BaseLayer :: calcGradient( const GX_DataType * input, const GX_DataType * output,
+		const GX_DataType * delta, GX_DataMatrix::iterator * iter ) const
 {
 	/* do nothing */
 }
@@ -106,6 +225,73 @@ void GX_BaseLayer :: applyGradient( const GX_DataVector & delta, GX_DataMatrix::
 	/* do nothing */
 }
 
+GX_AccumType * GX_BaseLayer :: getMasterParams()
+{
+#ifdef GX_MIXED_PRECISION
+	return std::begin( mMasterParams );
+#else
+	return NULL;
+#endif
+}
+
+size_t GX_BaseLayer :: getCopyBytes() const
+{
+	size_t ret = gx_heap_bytes( mPackedParams.size() * sizeof( GX_HalfType ) );
+
+#ifdef GX_MIXED_PRECISION
+	ret += gx_heap_bytes( mMasterParams.size() * sizeof( GX_AccumType ) );
+#endif
+
+	return ret;
+}
+
+void GX_BaseLayer :: setStorage( int format )
+{
+	mStorage = format;
+
+	packParams();
+}
+
+int GX_BaseLayer :: getStorage() const
+{
+	return mStorage;
+}
+
+const GX_HalfVector & GX_BaseLayer :: getPackedParams() const
+{
+	return mPackedParams;
+}
+
+void GX_BaseLayer :: packParams()
+{
+	if( GX_Half::eNone == mStorage ) {
+		if( ! mPackedParams.empty() ) GX_HalfVector().swap( mPackedParams );
+		return;
+	}
+
+	// sized once, every applyGradient after it encodes in place
+	mPackedParams.resize( getParamCount() );
+	encodeParams( mStorage, mPackedParams.data() );
+}
+
+void GX_BaseLayer :: encodeParams( int format, GX_HalfType * packed ) const
+{
+	/* do nothing */
+}
+
+void GX_BaseLayer :: resetMasterParams()
+{
+#ifdef GX_MIXED_PRECISION
+	GX_DataVector params( getParamCount() );
+
+	GX_DataType * cursor = std::begin( params );
+	exportParams( &cursor );
+
+	mMasterParams.resize( params.size() );
+	std::copy( std::begin( params ), std::end( params ), std::begin( mMasterParams ) );
+#endif
+}
+
 ////////////////////////////////////////////////////////////
 
 GX_ConvLayer :: GX_ConvLayer( const GX_Dims & inputDims, size_t filterCount, size_t filterSize )
@@ -127,6 +313,8 @@ GX_ConvLayer :: GX_ConvLayer( const GX_Dims & inputDims, size_t filterCount, siz
 		mInputDims[ 1 ] - filterSize + 1,
 		mInputDims[ 2 ] - filterSize + 1
 	};
+
+	resetMasterParams();
 }
 
 GX_ConvLayer :: GX_ConvLayer( const GX_Dims & inputDims, const GX_DataVector & filters,
@@ -147,6 +335,8 @@ GX_ConvLayer :: GX_ConvLayer( const GX_Dims & inputDims, const GX_DataVector & f
 	mBiases = biases;
 
 	assert( mInputDims[ 0 ] == filterDims[ 1 ] );
+
+	resetMasterParams();
 }
 
 GX_ConvLayer :: ~GX_ConvLayer()
@@ -178,29 +368,75 @@ const GX_DataVector & GX_ConvLayer :: getBiases() const
 	return mBiases;
 }
 
-void GX_ConvLayer :: calcOutput( const GX_DataVector & input, GX_DataVector * output ) const
+void GX_ConvLayer :: calcCost( int phase, GX_LayerCost_t * cost ) const
 {
-	if( output->size() == 0 ) output->resize( gx_dims_flatten_size( mOutputDims ) );
+	double filterCount = gx_dims_flatten_size( mFilterDims );
+	double kernelSize = mFilterDims[ 1 ] * mFilterDims[ 2 ] * mFilterDims[ 3 ];
+	double inputCount = getInputSize(), outputCount = getOutputSize();
+
+	double paddingCount = mOutputDims[ 0 ] * ( mOutputDims[ 1 ] + 2 * ( mFilterDims[ 2 ] - 1 ) )
+			* ( mOutputDims[ 2 ] + 2 * ( mFilterDims[ 3 ] - 1 ) );
+
+	if( eCalcOutput == phase ) {
+		cost->mFlops = 2 * outputCount * kernelSize + outputCount;
+		cost->mWeightBytes = ( filterCount + mBiases.size() )
+				* ( GX_Half::eNone != mStorage ? sizeof( GX_HalfType ) : sizeof( GX_DataType ) );
+		cost->mActBytes = ( inputCount + outputCount ) * sizeof( GX_DataType );
+	}
 
+	if( eBackpropagate == phase ) {
+		// full convolution over the zero padded outDelta with the rotated filters
+		cost->mFlops = 2 * inputCount * mFilterDims[ 0 ] * mFilterDims[ 2 ] * mFilterDims[ 3 ];
+		cost->mWeightBytes = 3 * filterCount * sizeof( GX_DataType );
+		cost->mActBytes = ( outputCount + 2 * paddingCount + inputCount ) * sizeof( GX_DataType );
+	}
+
+	if( eCollectGradient == phase ) {
+		cost->mFlops = 2 * filterCount * mOutputDims[ 1 ] * mOutputDims[ 2 ];
+		cost->mWeightBytes = filterCount * sizeof( GX_DataType );
+		cost->mActBytes = ( inputCount + outputCount ) * sizeof( GX_DataType );
+	}
+
+	if( eApplyGradient == phase ) {
+		cost->mFlops = 5 * filterCount + outputCount + 3 * mBiases.size();
+		cost->mWeightBytes = ( 3 * filterCount + 2 * mBiases.size() ) * sizeof( GX_DataType );
+		cost->mActBytes = outputCount * sizeof( GX_DataType );
+	}
+}
+
+void GX_ConvLayer :: calcOutput( const GX_DataType * input, GX_DataType * output ) const
+{
 	GX_MDSpanRO inMS( input, mInputDims );
 
-	GX_MDSpanRW outMS( *output, mOutputDims );
+	GX_MDSpanRW outMS( output, mOutputDims );
 
-	GX_MDSpanRO filterMS( mFilters, mFilterDims );
+	const GX_DataType * filters = std::begin( mFilters ), * biases = std::begin( mBiases );
 
-	for( size_t f = 0; f < mFilterDims[ 0 ]; f++ ) {
-		for( size_t x = 0; x < mOutputDims[ 1 ]; x++ ) {
-			for( size_t y = 0; y < mOutputDims[ 2 ]; y++ ) {
-				outMS( f, x, y ) = forwardConv( inMS, f, x, y, filterMS ) + mBiases[ f ];
+	if( GX_Half::eNone != mStorage ) {
+		filters = std::begin( mWidenedParams );
+		biases = filters + mFilters.size();
+	}
+
+	GX_MDSpanRO filterMS( filters, mFilterDims );
+
+	// every filter writes its own output plane
+	size_t grain = gx_grain_size( 2.0 * mOutputDims[ 1 ] * mOutputDims[ 2 ] * mFilterDims[ 1 ] * mFilterDims[ 2 ] * mFilterDims[ 3 ] );
+
+	gx_parallel_for( 0, mFilterDims[ 0 ], grain, [ & ]( size_t begin, size_t end ) {
+		for( size_t f = begin; f < end; f++ ) {
+			for( size_t x = 0; x < mOutputDims[ 1 ]; x++ ) {
+				for( size_t y = 0; y < mOutputDims[ 2 ]; y++ ) {
+					outMS( f, x, y ) = forwardConv( inMS, f, x, y, filterMS ) + biases[ f ];
+				}
 			}
 		}
-	}
+	} );
 }
 
-GX_DataType GX_ConvLayer :: forwardConv( GX_MDSpanRO & inMS, size_t filterIndex, size_t beginX, size_t beginY,
+GX_AccumType GX_ConvLayer :: forwardConv( GX_MDSpanRO & inMS, size_t filterIndex, size_t beginX, size_t beginY,
 		GX_MDSpanRO & filterMS )
 {
-	GX_DataType total = 0;
+	GX_AccumType total = 0;
 
 	for( size_t c = 0; c < filterMS.dim( 1 ); c++ ) {
 		for( size_t x = 0; x < filterMS.dim( 2 ); x++ ) {
@@ -213,8 +449,8 @@ GX_DataType GX_ConvLayer :: forwardConv( GX_MDSpanRO & inMS, size_t filterIndex,
 	return total;
 }
 
-void GX_ConvLayer :: backpropagate( const GX_DataVector & input, const GX_DataVector & output,
-		const GX_DataVector & outDelta, GX_DataVector * inDelta ) const
+void GX_ConvLayer :: backpropagate( const GX_DataType * input, const GX_DataType * output,
+		const GX_DataType * outDelta, GX_DataType * inDelta ) const
 {
 	// 1. prepare outDelta padding data
 	GX_Dims outPaddingDims = {
@@ -237,23 +473,28 @@ void GX_ConvLayer :: backpropagate( const GX_DataVector & input, const GX_DataVe
 	if( mIsDebug ) GX_Utils::printVector( "rot180Filters", rot180Filters, mFilterDims, false );
 
 	// 3. convolution
-	GX_MDSpanRW inDeltaMS( *inDelta, mInputDims );
+	GX_MDSpanRW inDeltaMS( inDelta, mInputDims );
 	GX_MDSpanRO rot180FiltersMS( rot180Filters, mFilterDims );
 	GX_MDSpanRO outPaddingRO( outPadding, outPaddingDims );
 
-	for( size_t c = 0; c < mInputDims[ 0 ]; c++ ) {
-		for( size_t x = 0; x < mInputDims[ 1 ]; x++ ) {
-			for( size_t y = 0; y < mInputDims[ 2 ]; y++ ) {
-				inDeltaMS( c, x, y ) = backwardConv( outPaddingRO, c, x, y, rot180FiltersMS );
+	// every input channel writes its own inDelta plane
+	size_t grain = gx_grain_size( 2.0 * mInputDims[ 1 ] * mInputDims[ 2 ] * mFilterDims[ 0 ] * mFilterDims[ 2 ] * mFilterDims[ 3 ] );
+
+	gx_parallel_for( 0, mInputDims[ 0 ], grain, [ & ]( size_t begin, size_t end ) {
+		for( size_t c = begin; c < end; c++ ) {
+			for( size_t x = 0; x < mInputDims[ 1 ]; x++ ) {
+				for( size_t y = 0; y < mInputDims[ 2 ]; y++ ) {
+					inDeltaMS( c, x, y ) = backwardConv( outPaddingRO, c, x, y, rot180FiltersMS );
+				}
 			}
 		}
-	}
+	} );
 }
 
-GX_DataType GX_ConvLayer :: backwardConv( GX_MDSpanRO & inMS, size_t channelIndex, size_t beginX, size_t beginY,
+GX_AccumType GX_ConvLayer :: backwardConv( GX_MDSpanRO & inMS, size_t channelIndex, size_t beginX, size_t beginY,
 		GX_MDSpanRO & filterMS )
 {
-	GX_DataType total = 0;
+	GX_AccumType total = 0;
 
 	for( size_t f = 0; f < filterMS.dim( 0 ); f++ ) {
 		for( size_t x = 0; x < filterMS.dim( 2 ); x++ ) {
@@ -279,11 +520,11 @@ void GX_ConvLayer :: copyOutDelta( const GX_MDSpanRO & outDeltaMS, size_t filter
 
 void GX_ConvLayer :: rotate180Filter( const GX_DataVector & src, const GX_Dims & dims, GX_DataVector * dest )
 {
+	dest->resize( gx_dims_flatten_size( dims ) );
+
 	GX_MDSpanRO srcMS( src, dims );
 	GX_MDSpanRW destMS( *dest, dims );
 
-	dest->resize( gx_dims_flatten_size( dims ) );
-
 	for( size_t f = 0; f < dims[ 0 ]; f++ ) {
 		for( size_t c = 0; c < dims[ 1 ]; c++ ) {
 			for( size_t i = 0; i < dims[ 2 ]; i++ ) {
@@ -295,13 +536,74 @@ void GX_ConvLayer :: rotate180Filter( const GX_DataVector & src, const GX_Dims &
 	}
 }
 
-void GX_ConvLayer :: initGradientMatrix( GX_DataMatrix * gradient ) const
+void GX_ConvLayer :: getGradientDims( GX_DimsList * dims ) const
 {
-	gradient->emplace_back( GX_DataVector( gx_dims_flatten_size( mFilterDims ) ) );
+	dims->emplace_back( mFilterDims );
 }
 
-void GX_ConvLayer :: collectGradient( const GX_DataVector & input, const GX_DataVector & output,
-		const GX_DataVector & delta, GX_DataMatrix::iterator * iter ) const
+size_t GX_ConvLayer :: getWeightBytes() const
+{
+	return gx_vector_bytes( mFilters ) + gx_vector_bytes( mBiases ) + gx_vector_bytes( mWidenedParams ) + getCopyBytes();
+}
+
+size_t GX_ConvLayer :: getParamCount() const
+{
+	return mFilters.size() + mBiases.size();
+}
+
+void GX_ConvLayer :: exportParams( GX_DataType ** cursor ) const
+{
+	*cursor = std::copy( std::begin( mFilters ), std::end( mFilters ), *cursor );
+	*cursor = std::copy( std::begin( mBiases ), std::end( mBiases ), *cursor );
+}
+
+void GX_ConvLayer :: importParams( const GX_DataType ** cursor )
+{
+	std::copy( *cursor, *cursor + mFilters.size(), std::begin( mFilters ) );
+	*cursor += mFilters.size();
+
+	std::copy( *cursor, *cursor + mBiases.size(), std::begin( mBiases ) );
+	*cursor += mBiases.size();
+
+	resetMasterParams();
+	packParams();
+}
+
+void GX_ConvLayer :: packParams()
+{
+	GX_BaseLayer::packParams();
+
+	if( GX_Half::eNone == mStorage ) {
+		if( mWidenedParams.size() > 0 ) GX_DataVector().swap( mWidenedParams );
+		return;
+	}
+
+	if( mWidenedParams.size() != mPackedParams.size() ) mWidenedParams.resize( mPackedParams.size() );
+	GX_Half::decode( mStorage, mPackedParams.data(), mPackedParams.size(), std::begin( mWidenedParams ) );
+}
+
+void GX_ConvLayer :: encodeParams( int format, GX_HalfType * packed ) const
+{
+	GX_Half::encode( format, std::begin( mFilters ), mFilters.size(), packed );
+	GX_Half::encode( format, std::begin( mBiases ), mBiases.size(), packed + mFilters.size() );
+}
+
+GX_BaseLayer * GX_ConvLayer :: newInstance() const
+{
+	return new GX_ConvLayer( mInputDims, mFilters, mFilterDims, mBiases );
+}
+
+size_t GX_ConvLayer :: getScratchBytes() const
+{
+	// backpropagate: padding outDelta and rotated filters
+	size_t paddingCount = mOutputDims[ 0 ] * ( mOutputDims[ 1 ] + 2 * ( mFilterDims[ 2 ] - 1 ) )
+			* ( mOutputDims[ 2 ] + 2 * ( mFilterDims[ 3 ] - 1 ) );
+
+	return gx_heap_bytes( paddingCount * sizeof( GX_DataType ) ) + gx_vector_bytes( mFilters );
+}
+
+void GX_ConvLayer :: calcGradient( const GX_DataType * input, const GX_DataType * output,
+		const GX_DataType * delta, GX_DataMatrix::iterator * iter ) const
 {
 	GX_MDSpanRO inMS( input, mInputDims );
 	GX_MDSpanRO deltaMS( delta, mOutputDims );
@@ -321,10 +623,10 @@ void GX_ConvLayer :: collectGradient( const GX_DataVector & input, const GX_Data
 	( *iter )++;
 }
 
-GX_DataType GX_ConvLayer :: gradientConv( GX_MDSpanRO & inMS, size_t filterIndex, size_t channelIndex,
+GX_AccumType GX_ConvLayer :: gradientConv( GX_MDSpanRO & inMS, size_t filterIndex, size_t channelIndex,
 		size_t beginX, size_t beginY, GX_MDSpanRO & filterMS )
 {
-	GX_DataType total = 0;
+	GX_AccumType total = 0;
 
 	for( size_t x = 0; x < filterMS.dim( 1 ); x++ ) {
 		for( size_t y = 0; y < filterMS.dim( 2 ); y++ ) {
@@ -338,38 +640,45 @@ GX_DataType GX_ConvLayer :: gradientConv( GX_MDSpanRO & inMS, size_t filterIndex
 void GX_ConvLayer :: applyGradient( const GX_DataVector & delta, GX_DataMatrix::const_iterator * iter,
 		size_t miniBatchCount, GX_DataType learningRate, GX_DataType lambda, size_t trainingCount )
 {
-	GX_MDSpanRO gradientMS( *( *iter ), mFilterDims );
+	const GX_DataType * gradient = std::begin( *( *iter ) );
 
-	GX_MDSpanRW filtersMS( mFilters, mFilterDims );
+	// the filters are the first params, in the order of mFilterDims, then the biases
+	GX_AccumType * master = getMasterParams();
+	GX_AccumType rate = learningRate;
 
-	for( size_t f = 0; f < mFilterDims[ 0 ]; f++ ) {
-		for( size_t c = 0; c < mFilterDims[ 1 ]; c++ ) {
-			for( size_t i = 0; i < mFilterDims[ 2 ]; i++ ) {
-				for( size_t j = 0; j < mFilterDims[ 3 ]; j++ ) {
-					if( mIsDebug ) {
-						filtersMS( f, c, i, j ) = filtersMS( f, c, i, j ) - gradientMS( f, c, i, j ) * learningRate;
-					} else {
-						filtersMS( f, c, i, j ) = ( 1 - learningRate * lambda / trainingCount ) * filtersMS( f, c, i, j )
-								- gradientMS( f, c, i, j ) * learningRate / miniBatchCount;
-					}
-				}
-			}
+	for( size_t i = 0; i < mFilters.size(); i++ ) {
+		GX_AccumType weight = NULL != master ? master[ i ] : mFilters[ i ];
+
+		if( mIsDebug ) {
+			weight = weight - gradient[ i ] * rate;
+		} else {
+			weight = ( 1 - rate * lambda / trainingCount ) * weight - gradient[ i ] * rate / miniBatchCount;
 		}
+
+		if( NULL != master ) master[ i ] = weight;
+		mFilters[ i ] = weight;
 	}
 
 	( *iter )++;
 
 	GX_MDSpanRO deltaMS( delta, mOutputDims );
 	for( size_t f = 0; f < mOutputDims[ 0 ]; f++ ) {
-		GX_DataType biasGradient = 0;
+		GX_AccumType biasGradient = 0;
 		for( size_t i = 0; i < mOutputDims[ 1 ]; i++ ) {
 			for( size_t j = 0; j < mOutputDims[ 2 ]; j++ ) {
 				biasGradient += deltaMS( f, i, j );
 			}
 		}
 		if( mIsDebug ) printf( "bias#%zu.gradient %f\n", f, biasGradient );
-		mBiases[ f ] = mBiases[ f ] - biasGradient * learningRate / miniBatchCount;
+
+		GX_AccumType bias = NULL != master ? master[ mFilters.size() + f ] : mBiases[ f ];
+		bias = bias - biasGradient * rate / miniBatchCount;
+
+		if( NULL != master ) master[ mFilters.size() + f ] = bias;
+		mBiases[ f ] = bias;
 	}
+
+	packParams();
 }
 
 ////////////////////////////////////////////////////////////
@@ -394,18 +703,42 @@ void GX_MaxPoolLayer :: printWeights( bool isDetail ) const
 	printf( "\nPoolSize = %zu\n", mPoolSize );
 }
 
+GX_BaseLayer * GX_MaxPoolLayer :: newInstance() const
+{
+	return new GX_MaxPoolLayer( mInputDims, mPoolSize );
+}
+
 size_t GX_MaxPoolLayer :: getPoolSize() const
 {
 	return mPoolSize;
 }
 
-void GX_MaxPoolLayer :: calcOutput( const GX_DataVector & input, GX_DataVector * output ) const
+size_t GX_MaxPoolLayer :: getPackedScratchSize() const
 {
-	if( output->size() == 0 ) output->resize( gx_dims_flatten_size( mOutputDims ) );
+	return mInputDims[ 1 ] * mInputDims[ 2 ];
+}
 
+void GX_MaxPoolLayer :: calcCost( int phase, GX_LayerCost_t * cost ) const
+{
+	double inputCount = getInputSize(), outputCount = getOutputSize();
+	double windowCount = outputCount * mPoolSize * mPoolSize;
+
+	if( eCalcOutput == phase ) {
+		cost->mFlops = windowCount;
+		cost->mActBytes = ( windowCount + outputCount ) * sizeof( GX_DataType );
+	}
+
+	if( eBackpropagate == phase ) {
+		cost->mFlops = windowCount;
+		cost->mActBytes = ( 2 * inputCount + windowCount + 2 * outputCount ) * sizeof( GX_DataType );
+	}
+}
+
+void GX_MaxPoolLayer :: calcOutput( const GX_DataType * input, GX_DataType * output ) const
+{
 	GX_MDSpanRO inMS( input, mInputDims );
 
-	GX_MDSpanRW outMS( *output, mOutputDims );
+	GX_MDSpanRW outMS( output, mOutputDims );
 
 	for( size_t f = 0; f < mOutputDims[ 0 ]; f++ ) {
 		for( size_t x = 0; x < mOutputDims[ 1 ]; x++ ) {
@@ -416,6 +749,27 @@ void GX_MaxPoolLayer :: calcOutput( const GX_DataVector & input, GX_DataVector *
 	}
 }
 
+void GX_MaxPoolLayer :: calcPackedOutput( int format, const GX_HalfType * input, GX_DataType * scratch,
+		GX_DataType * output ) const
+{
+	size_t planeSize = getPackedScratchSize();
+
+	// scratch holds one plane, read as plane 0 of the input dims, the strides are the same
+	GX_MDSpanRO inMS( scratch, mInputDims );
+
+	GX_MDSpanRW outMS( output, mOutputDims );
+
+	for( size_t f = 0; f < mOutputDims[ 0 ]; f++ ) {
+		GX_Half::decode( format, input + f * planeSize, planeSize, scratch );
+
+		for( size_t x = 0; x < mOutputDims[ 1 ]; x++ ) {
+			for( size_t y = 0; y < mOutputDims[ 2 ]; y++ ) {
+				outMS( f, x, y ) = pool( inMS, 0, x * mPoolSize, y * mPoolSize );
+			}
+		}
+	}
+}
+
 GX_DataType GX_MaxPoolLayer :: pool( GX_MDSpanRO & inMS, size_t filterIndex,
 		size_t beginX, size_t beginY ) const
 {
@@ -430,11 +784,11 @@ GX_DataType GX_MaxPoolLayer :: pool( GX_MDSpanRO & inMS, size_t filterIndex,
 	return result;
 }
 
-void GX_MaxPoolLayer :: backpropagate( const GX_DataVector & input, const GX_DataVector & output,
-		const GX_DataVector & outDelta, GX_DataVector * inDelta ) const
+void GX_MaxPoolLayer :: backpropagate( const GX_DataType * input, const GX_DataType * output,
+		const GX_DataType * outDelta, GX_DataType * inDelta ) const
 {
-	*inDelta = 0;
-	GX_MDSpanRW inDeltaMS( *inDelta, mInputDims );
+	std::fill( inDelta, inDelta + getInputSize(), 0.0 );
+	GX_MDSpanRW inDeltaMS( inDelta, mInputDims );
 
 	GX_MDSpanRO outDeltaMS( outDelta, mOutputDims );
 
@@ -485,18 +839,42 @@ void GX_AvgPoolLayer :: printWeights( bool isDetail ) const
 	printf( "\nPoolSize = %zu\n", mPoolSize );
 }
 
+GX_BaseLayer * GX_AvgPoolLayer :: newInstance() const
+{
+	return new GX_AvgPoolLayer( mInputDims, mPoolSize );
+}
+
 size_t GX_AvgPoolLayer :: getPoolSize() const
 {
 	return mPoolSize;
 }
 
-void GX_AvgPoolLayer :: calcOutput( const GX_DataVector & input, GX_DataVector * output ) const
+size_t GX_AvgPoolLayer :: getPackedScratchSize() const
+{
+	return mInputDims[ 1 ] * mInputDims[ 2 ];
+}
+
+void GX_AvgPoolLayer :: calcCost( int phase, GX_LayerCost_t * cost ) const
 {
-	if( output->size() == 0 ) output->resize( gx_dims_flatten_size( mOutputDims ) );
+	double inputCount = getInputSize(), outputCount = getOutputSize();
+	double windowCount = outputCount * mPoolSize * mPoolSize;
 
+	if( eCalcOutput == phase ) {
+		cost->mFlops = windowCount + outputCount;
+		cost->mActBytes = ( windowCount + outputCount ) * sizeof( GX_DataType );
+	}
+
+	if( eBackpropagate == phase ) {
+		cost->mFlops = windowCount;
+		cost->mActBytes = ( 2 * inputCount + windowCount + 2 * outputCount ) * sizeof( GX_DataType );
+	}
+}
+
+void GX_AvgPoolLayer :: calcOutput( const GX_DataType * input, GX_DataType * output ) const
+{
 	GX_MDSpanRO inMS( input, mInputDims );
 
-	GX_MDSpanRW outMS( *output, mOutputDims );
+	GX_MDSpanRW outMS( output, mOutputDims );
 
 	for( size_t f = 0; f < mOutputDims[ 0 ]; f++ ) {
 		for( size_t x = 0; x < mOutputDims[ 1 ]; x++ ) {
@@ -507,6 +885,27 @@ void GX_AvgPoolLayer :: calcOutput( const GX_DataVector & input, GX_DataVector *
 	}
 }
 
+void GX_AvgPoolLayer :: calcPackedOutput( int format, const GX_HalfType * input, GX_DataType * scratch,
+		GX_DataType * output ) const
+{
+	size_t planeSize = getPackedScratchSize();
+
+	// scratch holds one plane, read as plane 0 of the input dims, the strides are the same
+	GX_MDSpanRO inMS( scratch, mInputDims );
+
+	GX_MDSpanRW outMS( output, mOutputDims );
+
+	for( size_t f = 0; f < mOutputDims[ 0 ]; f++ ) {
+		GX_Half::decode( format, input + f * planeSize, planeSize, scratch );
+
+		for( size_t x = 0; x < mOutputDims[ 1 ]; x++ ) {
+			for( size_t y = 0; y < mOutputDims[ 2 ]; y++ ) {
+				outMS( f, x, y ) = pool( inMS, 0, x * mPoolSize, y * mPoolSize );
+			}
+		}
+	}
+}
+
 GX_DataType GX_AvgPoolLayer :: pool( GX_MDSpanRO & inMS, size_t filterIndex,
 		size_t beginX, size_t beginY ) const
 {
@@ -521,11 +920,11 @@ GX_DataType GX_AvgPoolLayer :: pool( GX_MDSpanRO & inMS, size_t filterIndex,
 	return result / ( mPoolSize * mPoolSize );
 }
 
-void GX_AvgPoolLayer :: backpropagate( const GX_DataVector & input, const GX_DataVector & output,
-		const GX_DataVector & outDelta, GX_DataVector * inDelta ) const
+void GX_AvgPoolLayer :: backpropagate( const GX_DataType * input, const GX_DataType * output,
+		const GX_DataType * outDelta, GX_DataType * inDelta ) const
 {
-	*inDelta = 0;
-	GX_MDSpanRW inDeltaMS( *inDelta, mInputDims );
+	std::fill( inDelta, inDelta + getInputSize(), 0.0 );
+	GX_MDSpanRW inDeltaMS( inDelta, mInputDims );
 
 	GX_MDSpanRO outDeltaMS( outDelta, mOutputDims );
 
@@ -568,6 +967,20 @@ GX_FullConnLayer :: GX_FullConnLayer( size_t neuronCount, size_t inputCount )
 
 	mInputDims = { inputCount };
 	mOutputDims = { neuronCount };
+
+	resetMasterParams();
+}
+
+GX_FullConnLayer :: GX_FullConnLayer( const GX_DataMatrix & weights, const GX_DataVector & biases )
+	: GX_BaseLayer( GX_BaseLayer::eFullConn )
+{
+	mWeights = weights;
+	mBiases = biases;
+
+	mInputDims = { weights[ 0 ].size() };
+	mOutputDims = { weights.size() };
+
+	resetMasterParams();
 }
 
 GX_FullConnLayer :: ~GX_FullConnLayer()
@@ -605,42 +1018,164 @@ void GX_FullConnLayer :: setWeights( const GX_DataMatrix & weights, const GX_Dat
 {
 	mWeights = weights;
 	mBiases = biases;
+
+	resetMasterParams();
+	packParams();
 }
 
-void GX_FullConnLayer :: calcOutput( const GX_DataVector & input, GX_DataVector * output ) const
+void GX_FullConnLayer :: calcCost( int phase, GX_LayerCost_t * cost ) const
 {
-	if( output->size() == 0 ) output->resize( gx_dims_flatten_size( mOutputDims ) );
+	double inputCount = getInputSize(), outputCount = getOutputSize();
+	double weightCount = inputCount * outputCount;
+
+	if( eCalcOutput == phase ) {
+		cost->mFlops = 2 * weightCount + outputCount;
+		cost->mWeightBytes = ( weightCount + outputCount )
+				* ( GX_Half::eNone != mStorage ? sizeof( GX_HalfType ) : sizeof( GX_DataType ) );
+		cost->mActBytes = ( inputCount + outputCount ) * sizeof( GX_DataType );
+	}
 
-	assert( output->size() == mWeights.size() );
+	if( eBackpropagate == phase ) {
+		cost->mFlops = 2 * weightCount;
+		cost->mWeightBytes = weightCount * sizeof( GX_DataType );
+		cost->mActBytes = ( outputCount + 2 * inputCount ) * sizeof( GX_DataType );
+	}
 
-	for( size_t i = 0; i < mWeights.size(); i++ ) {
-		( *output )[ i ]  = ( mWeights[ i ] * input ).sum();
-		if( ! mIsDebug )  ( *output )[ i ] += mBiases[ i ];
+	if( eCollectGradient == phase ) {
+		cost->mFlops = weightCount;
+		cost->mWeightBytes = weightCount * sizeof( GX_DataType );
+		cost->mActBytes = ( inputCount + outputCount ) * sizeof( GX_DataType );
 	}
+
+	if( eApplyGradient == phase ) {
+		cost->mFlops = 5 * weightCount + 3 * outputCount;
+		cost->mWeightBytes = ( 3 * weightCount + 2 * outputCount ) * sizeof( GX_DataType );
+		cost->mActBytes = outputCount * sizeof( GX_DataType );
+	}
+}
+
+void GX_FullConnLayer :: calcOutput( const GX_DataType * input, GX_DataType * output ) const
+{
+	if( GX_Half::eNone != mStorage ) {
+		calcPackedWeights( input, output );
+		return;
+	}
+
+	gx_parallel_for( 0, mWeights.size(), gx_grain_size( 2.0 * getInputSize() ), [ & ]( size_t begin, size_t end ) {
+		for( size_t i = begin; i < end; i++ ) {
+			const GX_DataType * weights = std::begin( mWeights[ i ] );
+
+			// accumulate from the back as valarray::sum does
+			GX_AccumType sum = 0;
+			for( size_t j = mWeights[ i ].size(); j > 0; j-- ) sum += weights[ j - 1 ] * input[ j - 1 ];
+
+			if( ! mIsDebug )  sum += mBiases[ i ];
+			output[ i ] = sum;
+		}
+	} );
+}
+
+void GX_FullConnLayer :: calcPackedOutput( int format, const GX_HalfType * input, GX_DataType * scratch,
+		GX_DataType * output ) const
+{
+	// the weights and the input both stay packed until they reach the dot product
+	if( format != mStorage ) {
+		GX_BaseLayer::calcPackedOutput( format, input, scratch, output );
+		return;
+	}
+
+	calcPackedWeights( input, output );
+}
+
+size_t GX_FullConnLayer :: getPackedScratchSize() const
+{
+	return GX_Half::eNone != mStorage ? 0 : getInputSize();
+}
+
+template< typename InputType >
+void GX_FullConnLayer :: calcPackedWeights( const InputType * input, GX_DataType * output ) const
+{
+	size_t inputCount = getInputSize();
+	const GX_HalfType * weights = mPackedParams.data(), * biases = weights + mWeights.size() * inputCount;
+
+	gx_parallel_for( 0, mWeights.size(), gx_grain_size( 2.0 * inputCount ), [ & ]( size_t begin, size_t end ) {
+		for( size_t i = begin; i < end; i++ ) {
+			GX_AccumType sum = GX_Half::dot( mStorage, weights + i * inputCount, input, inputCount );
+
+			if( ! mIsDebug )  sum += GX_Half::toFloat( mStorage, biases[ i ] );
+			output[ i ] = sum;
+		}
+	} );
 }
 
-void GX_FullConnLayer :: backpropagate( const GX_DataVector & /* unused */, const GX_DataVector & output,
-		const GX_DataVector & outDelta, GX_DataVector * inDelta ) const
+void GX_FullConnLayer :: backpropagate( const GX_DataType * /* unused */, const GX_DataType * output,
+		const GX_DataType * outDelta, GX_DataType * inDelta ) const
 {
 	if( NULL != inDelta ) {
-		( *inDelta ) = 0;
-		for( size_t i = 0; i < inDelta->size(); i++ ) {
-			for( size_t j = 0; j < outDelta.size(); j++ ) {
-				( *inDelta )[ i ] += outDelta[ j ] * mWeights[ j ][ i ];
+		gx_parallel_for( 0, getInputSize(), gx_grain_size( 2.0 * mWeights.size() ), [ & ]( size_t begin, size_t end ) {
+			for( size_t i = begin; i < end; i++ ) {
+				GX_AccumType sum = 0;
+				for( size_t j = 0; j < mWeights.size(); j++ ) {
+					sum += outDelta[ j ] * mWeights[ j ][ i ];
+				}
+				inDelta[ i ] = sum;
 			}
-		}
+		} );
+	}
+}
+
+void GX_FullConnLayer :: getGradientDims( GX_DimsList * dims ) const
+{
+	for( size_t i = 0; i < getOutputSize(); i++ ) dims->emplace_back( mInputDims );
+}
+
+size_t GX_FullConnLayer :: getWeightBytes() const
+{
+	return gx_matrix_bytes( mWeights ) + gx_vector_bytes( mBiases ) + getCopyBytes();
+}
+
+size_t GX_FullConnLayer :: getParamCount() const
+{
+	return mWeights.size() * getInputSize() + mBiases.size();
+}
+
+void GX_FullConnLayer :: exportParams( GX_DataType ** cursor ) const
+{
+	for( auto & neuron : mWeights ) *cursor = std::copy( std::begin( neuron ), std::end( neuron ), *cursor );
+	*cursor = std::copy( std::begin( mBiases ), std::end( mBiases ), *cursor );
+}
+
+void GX_FullConnLayer :: importParams( const GX_DataType ** cursor )
+{
+	for( auto & neuron : mWeights ) {
+		std::copy( *cursor, *cursor + neuron.size(), std::begin( neuron ) );
+		*cursor += neuron.size();
 	}
+
+	std::copy( *cursor, *cursor + mBiases.size(), std::begin( mBiases ) );
+	*cursor += mBiases.size();
+
+	resetMasterParams();
+	packParams();
 }
 
-void GX_FullConnLayer :: initGradientMatrix( GX_DataMatrix * gradient ) const
+void GX_FullConnLayer :: encodeParams( int format, GX_HalfType * packed ) const
 {
-	for( size_t i = 0; i < getOutputSize(); i++ ) {
-		gradient->emplace_back( GX_DataVector( getInputSize() ) );
+	for( auto & neuron : mWeights ) {
+		GX_Half::encode( format, std::begin( neuron ), neuron.size(), packed );
+		packed += neuron.size();
 	}
+
+	GX_Half::encode( format, std::begin( mBiases ), mBiases.size(), packed );
+}
+
+GX_BaseLayer * GX_FullConnLayer :: newInstance() const
+{
+	return new GX_FullConnLayer( mWeights, mBiases );
 }
 
-void GX_FullConnLayer :: collectGradient( const GX_DataVector & input, const GX_DataVector & output,
-		const GX_DataVector & delta, GX_DataMatrix::iterator * gradient ) const
+void GX_FullConnLayer :: calcGradient( const GX_DataType * input, const GX_DataType * output,
+		const GX_DataType * delta, GX_DataMatrix::iterator * gradient ) const
 {
 	for( size_t i = 0; i < mWeights.size(); i++ ) {
 		for( size_t j = 0; j < mWeights[ 0 ].size(); j++ ) {
@@ -654,19 +1189,39 @@ void GX_FullConnLayer :: collectGradient( const GX_DataVector & input, const GX_
 void GX_FullConnLayer :: applyGradient( const GX_DataVector & delta, GX_DataMatrix::const_iterator * iter,
 		size_t miniBatchCount, GX_DataType learningRate, GX_DataType lambda, size_t trainingCount )
 {
+	// the weights are the first params, neuron by neuron, then the biases
+	GX_AccumType * master = getMasterParams();
+	GX_AccumType rate = learningRate;
+
 	for( size_t i = 0; i < mWeights.size(); i++ ) {
 		GX_DataVector & weights = mWeights[ i ];
+		const GX_DataVector & gradient = *( *iter );
+
 		for( size_t j = 0; j < weights.size(); j++ ) {
+			GX_AccumType weight = NULL != master ? master[ j ] : weights[ j ];
+
 			if( mIsDebug ) {
-				weights[ j ] = weights[ j ] - ( *( *iter ) )[ j ] * learningRate;
+				weight = weight - gradient[ j ] * rate;
 			} else {
-				weights[ j ] = ( 1 - learningRate * lambda / trainingCount ) * weights[ j ] 
-						- ( *( *iter ) )[ j ] * learningRate / miniBatchCount;
+				weight = ( 1 - rate * lambda / trainingCount ) * weight - gradient[ j ] * rate / miniBatchCount;
 			}
+
+			if( NULL != master ) master[ j ] = weight;
+			weights[ j ] = weight;
 		}
+
+		if( NULL != master ) master += weights.size();
 		( *iter )++;
 	}
 
-	if( ! mIsDebug ) mBiases -= learningRate * delta / miniBatchCount;
+	for( size_t i = 0; i < mBiases.size() && ! mIsDebug; i++ ) {
+		GX_AccumType bias = NULL != master ? master[ i ] : mBiases[ i ];
+		bias = bias - rate * delta[ i ] / miniBatchCount;
+
+		if( NULL != master ) master[ i ] = bias;
+		mBiases[ i ] = bias;
+	}
+
+	packParams();
 }
 
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "gxcomm.h"
+#include "gxhalf.h"
 #include <string>
 #include <vector>
 
@@ -10,41 +11,128 @@ typedef std::vector< GX_BaseLayer * > GX_BaseLayerPtrVector;
 
 class GX_ActFunc;
 
+// work done by one call of a layer phase
+typedef struct tagLayerCost {
+	double mFlops;
+	double mWeightBytes;
+	double mActBytes;
+} GX_LayerCost_t;
+
 class GX_BaseLayer {
 public:
 	enum { eConv = 1, eMaxPool = 2, eAvgPool = 3, eFullConn = 4 };
 
+	enum { eCalcOutput = 0, eBackpropagate = 1, eCollectGradient = 2, eApplyGradient = 3, ePhaseCount = 4 };
+
 public:
 	GX_BaseLayer( int type );
 
 	virtual ~GX_BaseLayer();
 
-	virtual void initGradientMatrix( GX_DataMatrix * gradient ) const;
+	void initGradientMatrix( GX_DataMatrix * gradient ) const;
 
-	virtual void collectGradient( const GX_DataVector & input, const GX_DataVector & output,
+	// dims of the gradient vectors this layer appends to the gradient matrix
+	virtual void getGradientDims( GX_DimsList * dims ) const;
+
+	void collectGradient( const GX_DataVector & input, const GX_DataVector & output,
 			const GX_DataVector & delta, GX_DataMatrix::iterator * iter ) const;
 
+	// same as above on raw buffers, sized as in backward
+	void collectGradient( const GX_DataType * input, const GX_DataType * output,
+			const GX_DataType * delta, GX_DataMatrix::iterator * iter ) const;
+
 	virtual void applyGradient( const GX_DataVector & delta,
 			GX_DataMatrix::const_iterator * iter, size_t miniBatchCount,
 			GX_DataType learningRate, GX_DataType lambda, size_t trainingCount );
 
+	// bytes held by weights and biases
+	virtual size_t getWeightBytes() const;
+
+	// peak bytes of the temporary buffers allocated by one call of any phase
+	virtual size_t getScratchBytes() const;
+
+	// trainable weights and biases, exportParams and importParams walk them in the same order
+	virtual size_t getParamCount() const;
+
+	virtual void exportParams( GX_DataType ** cursor ) const;
+
+	virtual void importParams( const GX_DataType ** cursor );
+
+	// deep copy, including the weights and the ActFunc
+	GX_BaseLayer * clone() const;
+
+	// keeps a copy of the params packed to GX_Half format, in exportParams order, that forward
+	// reads instead of the weights. GX_Half::eNone drops it, importParams and applyGradient pack again
+	void setStorage( int format );
+
+	int getStorage() const;
+
+	const GX_HalfVector & getPackedParams() const;
+
 public:
 
 	virtual void print( bool isDetail = false ) const;
 
 	void forward( const GX_DataVector & input, GX_DataVector * output ) const;
 
+	// input must hold getInputSize() items, it is read in place
+	void forward( const GX_DataType * input, GX_DataVector * output ) const;
+
+	// output must hold getOutputSize() items, such as a slot of a memory plan
+	void forward( const GX_DataType * input, GX_DataType * output ) const;
+
 	void backward( const GX_DataVector & input, const GX_DataVector & output,
 			GX_DataVector * outDelta, GX_DataVector * inDelta ) const;
 
+	// input and inDelta hold getInputSize() items, output and outDelta getOutputSize() items
+	void backward( const GX_DataType * input, const GX_DataType * output,
+			GX_DataType * outDelta, GX_DataType * inDelta ) const;
+
+	// input holds getInputSize() items packed to format, scratch getPackedScratchSize() items
+	void forward( int format, const GX_HalfType * input, GX_DataType * scratch, GX_DataType * output ) const;
+
+	// items of the scratch of the packed forward, the input widened, less for the layers that read it packed
+	virtual size_t getPackedScratchSize() const;
+
+	// cost of one call of the phase, calcOutput and backpropagate include the ActFunc
+	void getCost( int phase, GX_LayerCost_t * cost ) const;
+
 protected:
 
+	// same type and dims, with the weights of this layer
+	virtual GX_BaseLayer * newInstance() const = 0;
+
 	virtual void printWeights( bool isDetail ) const = 0;
 
-	virtual void calcOutput( const GX_DataVector & input, GX_DataVector * output ) const = 0;
+	virtual void calcCost( int phase, GX_LayerCost_t * cost ) const = 0;
+
+	virtual void calcOutput( const GX_DataType * input, GX_DataType * output ) const = 0;
+
+	// widens the input into scratch for calcOutput, layers that read the packed input override it
+	virtual void calcPackedOutput( int format, const GX_HalfType * input, GX_DataType * scratch, GX_DataType * output ) const;
+
+	virtual void backpropagate( const GX_DataType * input, const GX_DataType * output,
+			const GX_DataType * outDelta, GX_DataType * inDelta ) const = 0;
+
+	// layers with weights write the gradients of one sample at iter and move it past them
+	virtual void calcGradient( const GX_DataType * input, const GX_DataType * output,
+			const GX_DataType * delta, GX_DataMatrix::iterator * iter ) const;
 
-	virtual void backpropagate( const GX_DataVector & input, const GX_DataVector & output,
-			const GX_DataVector & outDelta, GX_DataVector * inDelta ) const = 0;
+	// double copy of the params in exportParams order that applyGradient updates in the mixed build.
+	// NULL in the all-double build, where the params are the master
+	GX_AccumType * getMasterParams();
+
+	// copies the params to the master, whenever they are set from outside applyGradient
+	void resetMasterParams();
+
+	// repacks the params after they changed, drops the packed copy without a storage format
+	virtual void packParams();
+
+	// the params packed to format in exportParams order, encoded straight from the weights
+	virtual void encodeParams( int format, GX_HalfType * packed ) const;
+
+	// bytes of the master and packed copies of the params
+	size_t getCopyBytes() const;
 
 public:
 	int getType() const;
@@ -69,6 +157,13 @@ protected:
 	bool mIsDebug;
 
 	GX_ActFunc * mActFunc;
+
+	int mStorage;
+	GX_HalfVector mPackedParams;
+
+#ifdef GX_MIXED_PRECISION
+	GX_AccumVector mMasterParams;
+#endif
 };
 
 class GX_ConvLayer : public GX_BaseLayer {
@@ -87,33 +182,52 @@ public:
 
 public:
 
-	virtual void initGradientMatrix( GX_DataMatrix * gradient ) const;
+	virtual void getGradientDims( GX_DimsList * dims ) const;
 
-	virtual void collectGradient( const GX_DataVector & input, const GX_DataVector & output,
-			const GX_DataVector & delta, GX_DataMatrix::iterator * iter ) const;
+	virtual size_t getWeightBytes() const;
 
 	virtual void applyGradient( const GX_DataVector & delta,
 			GX_DataMatrix::const_iterator * iter, size_t miniBatchCount,
 			GX_DataType learningRate, GX_DataType lambda, size_t trainingCount );
 
+	virtual size_t getScratchBytes() const;
+
+	virtual size_t getParamCount() const;
+
+	virtual void exportParams( GX_DataType ** cursor ) const;
+
+	virtual void importParams( const GX_DataType ** cursor );
+
 	void printWeights( bool isDetail ) const;
 
 protected:
 
-	virtual void calcOutput( const GX_DataVector & input, GX_DataVector * output ) const;
+	virtual GX_BaseLayer * newInstance() const;
+
+	virtual void calcOutput( const GX_DataType * input, GX_DataType * output ) const;
+
+	virtual void backpropagate( const GX_DataType * input, const GX_DataType * output,
+			const GX_DataType * outDelta, GX_DataType * inDelta ) const;
+
+	virtual void calcCost( int phase, GX_LayerCost_t * cost ) const;
+
+	virtual void calcGradient( const GX_DataType * input, const GX_DataType * output,
+			const GX_DataType * delta, GX_DataMatrix::iterator * iter ) const;
 
-	virtual void backpropagate( const GX_DataVector & input, const GX_DataVector & output,
-			const GX_DataVector & outDelta, GX_DataVector * inDelta ) const;
+	// also widens the packed params back, forward reads every filter for a whole output plane
+	virtual void packParams();
+
+	virtual void encodeParams( int format, GX_HalfType * packed ) const;
 
 private:
 
-	static GX_DataType forwardConv( GX_MDSpanRO & inMS, size_t filterIndex, size_t beginX, size_t beginY,
+	static GX_AccumType forwardConv( GX_MDSpanRO & inMS, size_t filterIndex, size_t beginX, size_t beginY,
 			GX_MDSpanRO & filterMS );
 
-	static GX_DataType backwardConv( GX_MDSpanRO & inMS, size_t channelIndex, size_t beginX, size_t beginY,
+	static GX_AccumType backwardConv( GX_MDSpanRO & inMS, size_t channelIndex, size_t beginX, size_t beginY,
 			GX_MDSpanRO & filterMS );
 
-	static GX_DataType gradientConv( GX_MDSpanRO & inMS, size_t filterIndex, size_t channelIndex,
+	static GX_AccumType gradientConv( GX_MDSpanRO & inMS, size_t filterIndex, size_t channelIndex,
 			size_t beginX, size_t beginY, GX_MDSpanRO & filterMS );
 
 	static void rotate180Filter( const GX_DataVector & src, const GX_Dims & dims, GX_DataVector * dest );
@@ -123,6 +237,9 @@ private:
 private:
 	GX_Dims mFilterDims;
 	GX_DataVector mFilters, mBiases;
+
+	// the packed filters and biases as forward reads them, empty without a storage format
+	GX_DataVector mWidenedParams;
 };
 
 class GX_MaxPoolLayer : public GX_BaseLayer {
@@ -134,12 +251,21 @@ public:
 
 	size_t getPoolSize() const;
 
+	virtual size_t getPackedScratchSize() const;
+
 protected:
 
-	virtual void calcOutput( const GX_DataVector & input, GX_DataVector * output ) const;
+	virtual GX_BaseLayer * newInstance() const;
+
+	virtual void calcOutput( const GX_DataType * input, GX_DataType * output ) const;
 
-	virtual void backpropagate( const GX_DataVector & input, const GX_DataVector & output,
-			const GX_DataVector & outDelta, GX_DataVector * inDelta ) const;
+	// widens one input plane at a time
+	virtual void calcPackedOutput( int format, const GX_HalfType * input, GX_DataType * scratch, GX_DataType * output ) const;
+
+	virtual void backpropagate( const GX_DataType * input, const GX_DataType * output,
+			const GX_DataType * outDelta, GX_DataType * inDelta ) const;
+
+	virtual void calcCost( int phase, GX_LayerCost_t * cost ) const;
 
 private:
 	GX_DataType pool( GX_MDSpanRO & inMS, size_t filterIndex, size_t beginX, size_t beginY ) const;
@@ -160,12 +286,21 @@ public:
 
 	size_t getPoolSize() const;
 
+	virtual size_t getPackedScratchSize() const;
+
 protected:
 
-	virtual void calcOutput( const GX_DataVector & input, GX_DataVector * output ) const;
+	virtual GX_BaseLayer * newInstance() const;
 
-	virtual void backpropagate( const GX_DataVector & input, const GX_DataVector & output,
-			const GX_DataVector & outDelta, GX_DataVector * inDelta ) const;
+	virtual void calcOutput( const GX_DataType * input, GX_DataType * output ) const;
+
+	// widens one input plane at a time
+	virtual void calcPackedOutput( int format, const GX_HalfType * input, GX_DataType * scratch, GX_DataType * output ) const;
+
+	virtual void backpropagate( const GX_DataType * input, const GX_DataType * output,
+			const GX_DataType * outDelta, GX_DataType * inDelta ) const;
+
+	virtual void calcCost( int phase, GX_LayerCost_t * cost ) const;
 
 private:
 	GX_DataType pool( GX_MDSpanRO & inMS, size_t filterIndex, size_t beginX, size_t beginY ) const;
@@ -180,6 +315,7 @@ private:
 class GX_FullConnLayer : public GX_BaseLayer {
 public:
 	GX_FullConnLayer( size_t neuronCount, size_t inputCount );
+	GX_FullConnLayer( const GX_DataMatrix & weights, const GX_DataVector & biases );
 
 	~GX_FullConnLayer();
 
@@ -192,21 +328,44 @@ public:
 
 	const GX_DataVector & getBiases() const;
 
-	virtual void initGradientMatrix( GX_DataMatrix * gradient ) const;
+	virtual void getGradientDims( GX_DimsList * dims ) const;
 
-	virtual void collectGradient( const GX_DataVector & input, const GX_DataVector & output,
-			const GX_DataVector & delta, GX_DataMatrix::iterator * iter ) const;
+	virtual size_t getWeightBytes() const;
+
+	virtual size_t getParamCount() const;
+
+	virtual void exportParams( GX_DataType ** cursor ) const;
+
+	virtual void importParams( const GX_DataType ** cursor );
 
 	virtual void applyGradient( const GX_DataVector & delta,
 			GX_DataMatrix::const_iterator * iter, size_t miniBatchCount,
 			GX_DataType learningRate, GX_DataType lambda, size_t trainingCount );
 
+	virtual size_t getPackedScratchSize() const;
+
 protected:
 
-	virtual void calcOutput( const GX_DataVector & input, GX_DataVector * output ) const;
+	virtual GX_BaseLayer * newInstance() const;
 
-	virtual void backpropagate( const GX_DataVector & input, const GX_DataVector & output,
-			const GX_DataVector & outDelta, GX_DataVector * inDelta ) const;
+	virtual void calcOutput( const GX_DataType * input, GX_DataType * output ) const;
+
+	virtual void calcPackedOutput( int format, const GX_HalfType * input, GX_DataType * scratch, GX_DataType * output ) const;
+
+	virtual void backpropagate( const GX_DataType * input, const GX_DataType * output,
+			const GX_DataType * outDelta, GX_DataType * inDelta ) const;
+
+	virtual void calcCost( int phase, GX_LayerCost_t * cost ) const;
+
+	virtual void calcGradient( const GX_DataType * input, const GX_DataType * output,
+			const GX_DataType * delta, GX_DataMatrix::iterator * iter ) const;
+
+	virtual void encodeParams( int format, GX_HalfType * packed ) const;
+
+private:
+	// packed weights, input is GX_DataType or packed to the same format
+	template< typename InputType >
+	void calcPackedWeights( const InputType * input, GX_DataType * output ) const;
 
 private:
 	GX_DataMatrix mWeights;
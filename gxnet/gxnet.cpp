@@ -1,26 +1,184 @@
 
 #include "gxnet.h"
 #include "gxutils.h"
+#include "gxprof.h"
+#include "gxtrace.h"
+#include "gxstats.h"
+#include "gxdist.h"
+#include "gxpool.h"
+#include "gxaugment.h"
+#include "gxstream.h"
 
 #include <random>
 #include <numeric>
+#include <memory>
 #include <algorithm>
 
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
 #include <sys/time.h>
 #include <sys/resource.h>
 #include <chrono>
 
+GX_InferenceContext :: GX_InferenceContext( const GX_Network & network )
+	: mStorage( network.getStorage() ), mPlan( network.getLayers(), GX_MemPlan::eInference )
+{
+	const GX_BaseLayerPtrVector & layers = network.getLayers();
+
+	if( GX_Half::eNone == mStorage ) {
+		mPlan.allocate( &mArena );
+	} else {
+		for( size_t i = 0; i < mPlan.getSlotCount(); i++ ) mPackedArena.emplace_back( mPlan.getSlotSize( i ) );
+
+		size_t inputSize = 0, scratchSize = 0;
+
+		for( size_t i = 0; i + 1 < layers.size(); i++ ) {
+			scratchSize = std::max( scratchSize, layers[ i ]->getOutputSize() );
+			inputSize = std::max( inputSize, layers[ i + 1 ]->getPackedScratchSize() );
+		}
+
+		mInput.resize( inputSize );
+		mScratch.resize( scratchSize );
+	}
+
+	if( layers.size() > 0 ) {
+		mOutput.resize( mPlan.getSize( GX_MemPlan::eOutput, layers.size() - 1 ) );
+	}
+}
+
+GX_InferenceContext :: ~GX_InferenceContext()
+{
+}
+
+const GX_DataVector & GX_InferenceContext :: getOutput() const
+{
+	return mOutput;
+}
+
+const GX_MemPlan & GX_InferenceContext :: getPlan() const
+{
+	return mPlan;
+}
+
+int GX_InferenceContext :: getStorage() const
+{
+	return mStorage;
+}
+
+size_t GX_InferenceContext :: getBytes() const
+{
+	size_t ret = gx_matrix_bytes( mArena ) + gx_vector_bytes( mOutput );
+
+	for( auto & item : mPackedArena ) ret += gx_heap_bytes( item.size() * sizeof( GX_HalfType ) );
+
+	return ret + gx_vector_bytes( mInput ) + gx_vector_bytes( mScratch );
+}
+
+////////////////////////////////////////////////////////////
+
+GX_MemUsage :: GX_MemUsage()
+{
+	mInputBytes = mTargetBytes = 0;
+}
+
+GX_MemUsage :: ~GX_MemUsage()
+{
+}
+
+void GX_MemUsage :: resize( size_t layerCount )
+{
+	mBytes.resize( layerCount * eCategoryCount, 0 );
+}
+
+void GX_MemUsage :: add( size_t layerIndex, int category, size_t bytes )
+{
+	if( ( layerIndex + 1 ) * eCategoryCount > mBytes.size() ) resize( layerIndex + 1 );
+
+	mBytes[ layerIndex * eCategoryCount + category ] += bytes;
+}
+
+size_t GX_MemUsage :: get( size_t layerIndex, int category ) const
+{
+	size_t index = layerIndex * eCategoryCount + category;
+
+	return index < mBytes.size() ? mBytes[ index ] : 0;
+}
+
+size_t GX_MemUsage :: getTotal( int category ) const
+{
+	size_t ret = 0;
+	for( size_t i = category; i < mBytes.size(); i += eCategoryCount ) ret += mBytes[ i ];
+
+	return ret;
+}
+
+size_t GX_MemUsage :: getTotal() const
+{
+	return std::accumulate( mBytes.begin(), mBytes.end(), (size_t)0 );
+}
+
+void GX_MemUsage :: setDataBytes( size_t inputBytes, size_t targetBytes )
+{
+	mInputBytes = inputBytes;
+	mTargetBytes = targetBytes;
+}
+
+void GX_MemUsage :: print( const char * tag ) const
+{
+	auto toKB = []( size_t bytes ) { return bytes / 1024.0; };
+
+	printf( "{{{ memory usage %s, KB\n", tag );
+	printf( "%-8s %10s %10s %10s %10s %10s %10s %10s %10s\n", "Layer", "Weights", "Gradient",
+			"BatchGrad", "Output", "Delta", "BatchDelta", "Scratch", "Total" );
+
+	for( size_t i = 0; i < mBytes.size() / eCategoryCount; i++ ) {
+		printf( "#%-7zu", i );
+
+		size_t total = 0;
+		for( int j = 0; j < eCategoryCount; j++ ) {
+			printf( " %10.1f", toKB( get( i, j ) ) );
+			total += get( i, j );
+		}
+		printf( " %10.1f\n", toKB( total ) );
+	}
+
+	printf( "%-8s", "Total" );
+	for( int j = 0; j < eCategoryCount; j++ ) printf( " %10.1f", toKB( getTotal( j ) ) );
+	printf( " %10.1f\n", toKB( getTotal() ) );
+
+	printf( "network %.1f, input %.1f, target %.1f, currRSS %ld, peakRSS %ld\n",
+			toKB( getTotal() ), toKB( mInputBytes ), toKB( mTargetBytes ),
+			GX_Utils::getCurrentRSS(), GX_Utils::getPeakRSS() );
+	printf( "}}}\n" );
+}
+
+////////////////////////////////////////////////////////////
+
 GX_Network :: GX_Network( int lossFuncType )
 {
 	mOnEpochEnd = NULL;
+	mProfiler = NULL;
+	mTracer = NULL;
+	mStatsWriter = NULL;
+	mPhaseTimes = NULL;
 	mLossFuncType = lossFuncType;
 	mIsDebug = false;
 	mIsShuffle = true;
+	mIsOverlap = false;
+	mCheckpointInterval = 0;
+	mCheckpointBudget = 0;
+	mStorage = GX_Half::eNone;
+	mAugmenter = NULL;
+	mLoaderCount = 0;
 }
 
 GX_Network :: ~GX_Network()
 {
 	for( auto & item : mLayers ) delete item;
+
+	if( NULL != mPhaseTimes ) delete mPhaseTimes;
 }
 
 void GX_Network :: print( bool isDetail ) const
@@ -36,6 +194,41 @@ void GX_Network :: print( bool isDetail ) const
 	printf( "}}}\n\n" );
 }
 
+void GX_Network :: getMemoryUsage( GX_MemUsage * usage, const GX_MemPlan * plan ) const
+{
+	usage->resize( mLayers.size() );
+
+	for( size_t i = 0; i < mLayers.size(); i++ ) {
+		GX_BaseLayer * layer = mLayers[ i ];
+
+		GX_DimsList dimsList;
+		layer->getGradientDims( &dimsList );
+
+		size_t gradientBytes = 0;
+		for( auto & dims : dimsList ) {
+			gradientBytes += sizeof( GX_DataVector ) + gx_heap_bytes( gx_dims_flatten_size( dims ) * sizeof( GX_DataType ) );
+		}
+
+		size_t vectorBytes = sizeof( GX_DataVector ) + gx_heap_bytes( layer->getOutputSize() * sizeof( GX_DataType ) );
+
+		usage->add( i, GX_MemUsage::eWeights, layer->getWeightBytes() );
+		usage->add( i, GX_MemUsage::eGradient, gradientBytes );
+		usage->add( i, GX_MemUsage::eBatchGradient, gradientBytes );
+
+		if( NULL != plan ) {
+			usage->add( i, GX_MemUsage::eOutput, plan->getBufferBytes( GX_MemPlan::eOutput, i )
+					+ plan->getBufferBytes( GX_MemPlan::eRecompute, i ) );
+			usage->add( i, GX_MemUsage::eDelta, plan->getBufferBytes( GX_MemPlan::eDelta, i ) );
+			usage->add( i, GX_MemUsage::eBatchDelta, plan->getBufferBytes( GX_MemPlan::eBatchDelta, i ) );
+		} else {
+			usage->add( i, GX_MemUsage::eOutput, vectorBytes );
+			usage->add( i, GX_MemUsage::eDelta, vectorBytes );
+			usage->add( i, GX_MemUsage::eBatchDelta, vectorBytes );
+		}
+		usage->add( i, GX_MemUsage::eScratch, layer->getScratchBytes() );
+	}
+}
+
 void GX_Network :: setOnEpochEnd( GX_OnEpochEnd_t onEpochEnd )
 {
 	mOnEpochEnd = onEpochEnd;
@@ -53,6 +246,120 @@ void GX_Network :: setShuffle( bool isShuffle )
 	mIsShuffle = isShuffle;
 }
 
+void GX_Network :: setProfiler( GX_Profiler * profiler )
+{
+	mProfiler = profiler;
+}
+
+GX_Profiler * GX_Network :: getProfiler() const
+{
+	return mProfiler;
+}
+
+void GX_Network :: setTracer( GX_Tracer * tracer )
+{
+	mTracer = tracer;
+}
+
+GX_Tracer * GX_Network :: getTracer() const
+{
+	return mTracer;
+}
+
+void GX_Network :: setStatsWriter( GX_StatsWriter * statsWriter )
+{
+	mStatsWriter = statsWriter;
+
+	// the layer times of the page are only taken while there is a page
+	if( NULL != mStatsWriter && NULL == mPhaseTimes ) mPhaseTimes = new GX_PhaseTimes();
+
+	if( NULL == mStatsWriter && NULL != mPhaseTimes ) {
+		delete mPhaseTimes;
+		mPhaseTimes = NULL;
+	}
+}
+
+void GX_Network :: publishStats( int epoch, int epochCount, size_t batch, size_t batchCount, size_t totalSamples,
+		size_t epochSamples, double seconds, GX_DataType totalLoss, GX_DataType learningRate, size_t queueDepth )
+{
+	GX_StatsPage_t * page = mStatsWriter->beginUpdate();
+
+	if( NULL == page ) return;
+
+	page->mEpoch = epoch;
+	page->mEpochCount = epochCount;
+	page->mBatch = batch;
+	page->mBatchCount = batchCount;
+	page->mSamples = totalSamples;
+	page->mSamplesPerSec = seconds > 0 ? epochSamples / seconds : 0;
+	page->mRunningLoss = epochSamples > 0 ? totalLoss / epochSamples : 0;
+	page->mLearningRate = learningRate;
+	page->mQueueDepth = (int32_t)std::min( queueDepth, (size_t)INT32_MAX );
+	page->mUpdateTime = std::chrono::duration_cast< std::chrono::milliseconds >(
+			std::chrono::system_clock::now().time_since_epoch() ).count();
+
+	page->mLayerCount = std::min( mLayers.size(), (size_t)GX_STATS_MAX_LAYERS );
+
+	for( int i = 0; NULL != mPhaseTimes && i < page->mLayerCount; i++ ) {
+		for( int j = 0; j < GX_STATS_PHASES; j++ ) {
+			page->mLayerMillis[ i ][ j ] = mPhaseTimes->getNanoseconds( i, j ) / 1e6;
+		}
+	}
+
+	mStatsWriter->endUpdate();
+}
+
+void GX_Network :: setCheckpointInterval( int interval )
+{
+	mCheckpointInterval = interval;
+	mCheckpointBudget = 0;
+}
+
+void GX_Network :: setOverlap( bool isOverlap )
+{
+	mIsOverlap = isOverlap;
+}
+
+void GX_Network :: setCheckpointBudget( size_t bytes )
+{
+	mCheckpointBudget = bytes;
+	mCheckpointInterval = 0;
+}
+
+void GX_Network :: getCheckpoints( std::vector< bool > * checkpoints ) const
+{
+	checkpoints->clear();
+
+	size_t interval = std::max( mCheckpointInterval, 0 );
+
+	if( mCheckpointBudget > 0 ) {
+		// a longer interval recomputes more layers, take the shortest one that fits
+		size_t bestBytes = 0;
+
+		for( size_t i = 1; i <= mLayers.size(); i++ ) {
+			std::vector< bool > candidate( mLayers.size() );
+			for( size_t j = 0; j < mLayers.size(); j++ ) candidate[ j ] = 0 == ( j + 1 ) % i;
+
+			size_t bytes = GX_MemPlan( mLayers, GX_MemPlan::eTraining, candidate ).getPlannedBytes();
+
+			if( 1 == i || bytes < bestBytes ) {
+				interval = i;
+				bestBytes = bytes;
+			}
+
+			if( bytes <= mCheckpointBudget ) {
+				interval = i;
+				break;
+			}
+		}
+	}
+
+	if( interval <= 1 ) return;
+
+	checkpoints->resize( mLayers.size() );
+	for( size_t j = 0; j < mLayers.size(); j++ ) ( *checkpoints )[ j ] = 0 == ( j + 1 ) % interval;
+}
+
 void GX_Network :: setLossFuncType( int lossFuncType )
 {
 	mLossFuncType = lossFuncType;
@@ -78,9 +385,58 @@ const GX_BaseLayerPtrVector & GX_Network :: getLayers() const
 	return mLayers;
 }
 
+void GX_Network :: setAugmenter( const GX_Augmenter * augmenter, int loaderCount )
+{
+	mAugmenter = augmenter;
+	mLoaderCount = loaderCount;
+}
+
+void GX_Network :: clone( GX_Network * other ) const
+{
+	other->setLossFuncType( mLossFuncType );
+	other->setDebug( mIsDebug );
+	other->setShuffle( mIsShuffle );
+	other->mIsOverlap = mIsOverlap;
+	other->mCheckpointInterval = mCheckpointInterval;
+	other->mCheckpointBudget = mCheckpointBudget;
+	other->mStorage = mStorage;
+
+	for( auto & item : mLayers ) other->addLayer( item->clone() );
+}
+
+size_t GX_Network :: getParamCount() const
+{
+	size_t ret = 0;
+	for( auto & item : mLayers ) ret += item->getParamCount();
+
+	return ret;
+}
+
+void GX_Network :: exportParams( GX_DataVector * params ) const
+{
+	if( params->size() != getParamCount() ) params->resize( getParamCount() );
+
+	GX_DataType * cursor = std::begin( *params );
+	for( auto & item : mLayers ) item->exportParams( &cursor );
+}
+
+bool GX_Network :: importParams( const GX_DataVector & params )
+{
+	if( params.size() != getParamCount() ) {
+		printf( "%s params.size %zu, paramCount %zu\n", __func__, params.size(), getParamCount() );
+		return false;
+	}
+
+	const GX_DataType * cursor = std::begin( params );
+	for( auto & item : mLayers ) item->importParams( &cursor );
+
+	return true;
+}
+
 void GX_Network :: addLayer( GX_BaseLayer * layer )
 {
 	layer->setDebug( mIsDebug );
+	if( layer->getStorage() != mStorage ) layer->setStorage( mStorage );
 
 	mLayers.emplace_back( layer );
 }
@@ -104,19 +460,105 @@ bool GX_Network :: forward( const GX_DataVector & input, GX_DataMatrix * output
 
 		if( i > 0 ) currInput = &( (*output)[ i - 1 ] );
 
+		GX_ProfScope scope( mProfiler, i, GX_BaseLayer::eCalcOutput, mPhaseTimes );
+		GX_TraceScope span( mTracer, "calcOutput", i );
+
 		layer->forward( *currInput, &( ( *output )[ i ] ) );
 	}
 
 	return true;
 }
 
+bool GX_Network :: forward( const GX_DataVector & input, GX_InferenceContext * ctx ) const
+{
+	if( input.size() != mLayers[ 0 ]->getInputSize() ) {
+		printf( "%s input.size %zu, layer[0].inputSize %zu\n",
+				__func__, input.size(), mLayers[ 0 ]->getInputSize() );
+		return false;
+	}
+
+	return forward( std::begin( input ), ctx );
+}
+
+bool GX_Network :: forward( const GX_DataType * input, GX_InferenceContext * ctx ) const
+{
+	if( ctx->mOutput.size() != mLayers.back()->getOutputSize() ) {
+		printf( "%s ctx.size %zu, output %zu\n", __func__, ctx->mOutput.size(), mLayers.back()->getOutputSize() );
+		return false;
+	}
+
+	if( ctx->mStorage != mStorage ) {
+		printf( "%s ctx.storage %d, storage %d\n", __func__, ctx->mStorage, mStorage );
+		return false;
+	}
+
+	if( GX_Half::eNone != mStorage ) return forwardPacked( input, ctx );
+
+	const GX_DataType * currInput = input;
+
+	for( size_t i = 0; i < mLayers.size(); i++ ) {
+		GX_DataType * output = ( i == mLayers.size() - 1 ) ? std::begin( ctx->mOutput )
+				: ctx->mPlan.getBuffer( &( ctx->mArena ), GX_MemPlan::eOutput, i );
+
+		mLayers[ i ]->forward( currInput, output );
+
+		currInput = output;
+	}
+
+	return true;
+}
+
+bool GX_Network :: forwardPacked( const GX_DataType * input, GX_InferenceContext * ctx ) const
+{
+	const GX_HalfType * currInput = NULL;
+
+	for( size_t i = 0; i < mLayers.size(); i++ ) {
+		bool isLast = i == mLayers.size() - 1;
+
+		GX_DataType * output = isLast ? std::begin( ctx->mOutput ) : std::begin( ctx->mScratch );
+
+		if( 0 == i ) {
+			mLayers[ i ]->forward( input, output );
+		} else {
+			mLayers[ i ]->forward( mStorage, currInput, std::begin( ctx->mInput ), output );
+		}
+
+		if( isLast ) break;
+
+		GX_HalfType * packed = ctx->mPackedArena[ ctx->mPlan.getSlot( GX_MemPlan::eOutput, i ) ].data();
+		GX_Half::encode( mStorage, output, mLayers[ i ]->getOutputSize(), packed );
+
+		currInput = packed;
+	}
+
+	return true;
+}
+
+void GX_Network :: setStorage( int format )
+{
+	mStorage = format;
+
+	for( auto & item : mLayers ) item->setStorage( format );
+}
+
+int GX_Network :: getStorage() const
+{
+	return mStorage;
+}
+
 bool GX_Network :: apply( const GX_DataMatrix & delta, const GX_DataMatrix & gradient,
 		int miniBatchCount, GX_DataType learningRate, GX_DataType lambda, int trainingCount )
 {
+	GX_TraceScope span( mTracer, "apply" );
+
 	GX_DataMatrix::const_iterator iter = gradient.begin();
 
 	for( size_t i = 0; i < mLayers.size(); i++ ) {
 		GX_BaseLayer * layer = mLayers[ i ];
+
+		GX_ProfScope scope( mProfiler, i, GX_BaseLayer::eApplyGradient, mPhaseTimes );
+		GX_TraceScope span( mTracer, "applyGradient", i );
+
 		layer->applyGradient( delta[ i ], &iter, miniBatchCount, learningRate, lambda, trainingCount );
 	}
 
@@ -135,6 +577,9 @@ void GX_Network :: collect( const GX_DataVector & input, const GX_DataMatrix & o
 
 		GX_BaseLayer * layer = mLayers[ i ];
 
+		GX_ProfScope scope( mProfiler, i, GX_BaseLayer::eCollectGradient, mPhaseTimes );
+		GX_TraceScope span( mTracer, "collectGradient", i );
+
 		layer->collectGradient( ( *currInput ), output[ i ], delta[ i ], &iter );
 	}
 
@@ -149,15 +594,7 @@ void GX_Network :: collect( const GX_DataVector & input, const GX_DataMatrix & o
 bool GX_Network :: backward( const GX_DataVector & input, const GX_DataVector & target,
 		const GX_DataMatrix & output, GX_DataMatrix * delta )
 {
-	const GX_DataVector & lastOutput = output.back();
-
-	if( eMeanSquaredError == mLossFuncType ) {
-		delta->back() = 2.0 * ( lastOutput - target );
-	}
-
-	if( eCrossEntropy == mLossFuncType ) {
-		delta->back() = lastOutput - target;
-	}
+	calcLossDelta( std::begin( target ), std::begin( output.back() ), std::begin( delta->back() ) );
 
 	for( ssize_t i = mLayers.size() - 1; i >= 0; i-- ) {
 		GX_DataVector * inDelta = ( i > 0 ) ? &( ( *delta )[ i - 1 ] ) : NULL;
@@ -165,111 +602,529 @@ bool GX_Network :: backward( const GX_DataVector & input, const GX_DataVector &
 		const GX_DataVector & currInput = ( i > 0 ) ? ( output[ i - 1 ] ) : input;
 
 		GX_BaseLayer * layer = mLayers[ i  ];
+
+		// the first layer only runs the ActFunc derivative, don't count it as backpropagate
+		GX_ProfScope scope( NULL != inDelta ? mProfiler : NULL, i, GX_BaseLayer::eBackpropagate,
+				NULL != inDelta ? mPhaseTimes : NULL );
+		GX_TraceScope span( mTracer, "backpropagate", i );
+
 		layer->backward( currInput, output[ i ], &( ( *delta ) [ i ] ), inDelta );
 	}
 
 	return true;
 }
 
-void GX_Network :: initGradientMatrix( GX_DataMatrix * batchGradient, GX_DataMatrix * gradient )
+void GX_Network :: backwardOverlap( const GX_DataVector & input, const GX_DataVector & target,
+		const GX_DataMatrix & output, const std::vector< size_t > & gradientBegin,
+		GX_DataMatrix * delta, GX_DataMatrix * gradient, GX_DataMatrix * batchDelta,
+		GX_DataMatrix * batchGradient, int applyCount, GX_DataType learningRate,
+		GX_DataType lambda, int trainingCount )
 {
-	size_t total = 0;
-	for( auto & layer : mLayers ) total += layer->getOutputSize();
+	calcLossDelta( std::begin( target ), std::begin( output.back() ), std::begin( delta->back() ) );
 
-	batchGradient->reserve( total );
-	gradient->reserve( total );
+	// lowest layer whose backward is done, delta[ i ] is final from then on
+	size_t doneLayer = mLayers.size();
+	std::mutex doneMutex;
+	std::condition_variable doneCond;
 
-	for( auto & layer : mLayers ) {
-		layer->initGradientMatrix( gradient );
-		layer->initGradientMatrix( batchGradient );
-	}
-}
+	gx_parallel_for( 0, 2, 1, [ & ]( size_t begin, size_t end ) {
+		for( size_t task = begin; task < end; task++ ) {
+			for( ssize_t i = mLayers.size() - 1; 0 == task && i >= 0; i-- ) {
+				GX_DataVector * inDelta = ( i > 0 ) ? &( ( *delta )[ i - 1 ] ) : NULL;
+				const GX_DataVector & currInput = ( i > 0 ) ? ( output[ i - 1 ] ) : input;
 
-void GX_Network :: initOutputAndDeltaMatrix( GX_DataMatrix * output, GX_DataMatrix * batchDelta, GX_DataMatrix * delta )
-{
-	for( auto & item : mLayers ) output->emplace_back( GX_DataVector( item->getOutputSize() ) );
+				{
+					GX_ProfScope scope( NULL, i, GX_BaseLayer::eBackpropagate, NULL != inDelta ? mPhaseTimes : NULL );
 
-	for( auto & item : mLayers ) delta->emplace_back( GX_DataVector( item->getOutputSize() ) );
+					mLayers[ i ]->backward( currInput, output[ i ], &( ( *delta )[ i ] ), inDelta );
+				}
 
-	for( auto & item : *delta ) batchDelta->emplace_back( GX_DataVector( item.size() ) );
-}
+				{
+					std::unique_lock< std::mutex > lock( doneMutex );
+					doneLayer = i;
+				}
 
-GX_DataType GX_Network :: calcLoss( const GX_DataVector & target, const GX_DataVector & output )
-{
-	GX_DataType ret = 0;
+				doneCond.notify_one();
+			}
 
-	if( eMeanSquaredError == mLossFuncType ) {
-		ret = GX_Utils::calcSSE( output, target );
-	}
+			// the chunks are claimed in order, so the backward task is running when this one starts.
+			// without a free pool thread this runs after the whole backward and never waits
+			for( ssize_t i = mLayers.size() - 1; 1 == task && i >= 0; i-- ) {
+				{
+					std::unique_lock< std::mutex > lock( doneMutex );
+					doneCond.wait( lock, [ & ] { return doneLayer <= (size_t)i; } );
+				}
 
-	if( eCrossEntropy == mLossFuncType ) {
-		for( size_t x = 0; x < target.size(); x++ ) {
-			GX_DataType y = target[ x ], a = output[ x ];
-			GX_DataType tmp = y * std::log( a ); // + ( 1 - y ) * std::log( 1 - a );
-			ret -= tmp;
-		}
-	}
+				const GX_DataVector & currInput = ( i > 0 ) ? ( output[ i - 1 ] ) : input;
 
-	return ret;
+				{
+					GX_ProfScope scope( NULL, i, GX_BaseLayer::eCollectGradient, mPhaseTimes );
+
+					GX_DataMatrix::iterator iter = gradient->begin() + gradientBegin[ i ];
+					mLayers[ i ]->collectGradient( currInput, output[ i ], ( *delta )[ i ], &iter );
+				}
+
+				( *batchDelta )[ i ] += ( *delta )[ i ];
+				for( size_t row = gradientBegin[ i ]; row < gradientBegin[ i + 1 ]; row++ ) {
+					( *batchGradient )[ row ] += ( *gradient )[ row ];
+				}
+
+				// backpropagate of this layer is done for the whole batch, its weights are free
+				if( applyCount > 0 ) {
+					GX_ProfScope scope( NULL, i, GX_BaseLayer::eApplyGradient, mPhaseTimes );
+
+					GX_DataMatrix::const_iterator batchIter = batchGradient->begin() + gradientBegin[ i ];
+					mLayers[ i ]->applyGradient( ( *batchDelta )[ i ], &batchIter, applyCount,
+							learningRate, lambda, trainingCount );
+				}
+			}
+		}
+	} );
 }
 
-bool GX_Network :: trainInternal( const GX_DataMatrix & input, const GX_DataMatrix & target, int epochCount,
-		int miniBatchCount, GX_DataType learningRate, GX_DataType lambda, GX_DataVector * losses )
+GX_DataType GX_Network :: trainSample( const GX_DataType * input, const Targets_t & target, size_t index,
+		const GX_MemPlan & plan, const std::vector< size_t > & gradientBegin, GX_DataMatrix * arena,
+		GX_DataMatrix * gradient, GX_DataMatrix * batchDelta, GX_DataMatrix * batchGradient )
 {
-	if( input.size() != target.size() ) return false;
+	const GX_DataType * currInput = input;
 
-	time_t beginTime = time( NULL );
+	for( size_t i = 0; i < mLayers.size(); i++ ) {
+		GX_DataType * output = plan.getBuffer( arena, GX_MemPlan::eOutput, i );
 
-	printf( "%s\tstart train, input { %zu }, target { %zu }\n",
-			ctime( &beginTime ), input.size(), target.size() );
+		GX_ProfScope scope( mProfiler, i, GX_BaseLayer::eCalcOutput, mPhaseTimes );
+		GX_TraceScope span( mTracer, "calcOutput", i );
 
-	int logInterval = epochCount / 10;
-	int progressInterval = ( input.size() / miniBatchCount ) / 10;
+		mLayers[ i ]->forward( currInput, output );
 
-	std::random_device rd;
-	std::mt19937 gen( rd() );
+		currInput = output;
+	}
 
-	assert( mLayers[ 0 ]->getInputSize() == input[ 0 ].size() );
+	GX_DataType loss = calcLoss( target, index, currInput, plan.getBuffer( arena, GX_MemPlan::eDelta, mLayers.size() - 1 ) );
 
-	GX_DataMatrix batchGradient, gradient;
-	initGradientMatrix( &batchGradient, &gradient );
+	// output of layer i as backward reads it, the input for i < 0
+	auto activation = [ & ]( ssize_t i ) -> GX_DataType * {
+		if( i < 0 ) return const_cast< GX_DataType * >( input );
 
-	GX_DataMatrix output, batchDelta, delta;
-	initOutputAndDeltaMatrix( &output, &batchDelta, &delta );
+		return plan.getBuffer( arena, plan.isCheckpoint( i ) ? GX_MemPlan::eOutput : GX_MemPlan::eRecompute, i );
+	};
 
-	if( NULL != losses ) losses->resize( epochCount, 0 );
+	// segments from the top, a segment ends at a checkpoint and begins above the one below it
+	for( ssize_t end = mLayers.size() - 1; end >= 0; ) {
+		ssize_t begin = end;
+		while( begin > 0 && ! plan.isCheckpoint( begin - 1 ) ) begin--;
+
+		for( ssize_t i = begin; i < end; i++ ) {
+			GX_ProfScope scope( mProfiler, i, GX_BaseLayer::eCalcOutput, mPhaseTimes );
+			GX_TraceScope span( mTracer, "recompute", i );
+
+			mLayers[ i ]->forward( activation( i - 1 ), activation( i ) );
+		}
+
+		for( ssize_t i = end; i >= begin; i-- ) {
+			GX_BaseLayer * layer = mLayers[ i ];
+
+			const GX_DataType * layerInput = activation( i - 1 );
+			const GX_DataType * output = activation( i );
+
+			GX_DataType * delta = plan.getBuffer( arena, GX_MemPlan::eDelta, i );
+			GX_DataType * inDelta = ( i > 0 ) ? plan.getBuffer( arena, GX_MemPlan::eDelta, i - 1 ) : NULL;
+
+			{
+				// the first layer only runs the ActFunc derivative, don't count it as backpropagate
+				GX_ProfScope scope( NULL != inDelta ? mProfiler : NULL, i, GX_BaseLayer::eBackpropagate,
+						NULL != inDelta ? mPhaseTimes : NULL );
+				GX_TraceScope span( mTracer, "backpropagate", i );
+
+				layer->backward( layerInput, output, delta, inDelta );
+			}
+
+			{
+				GX_ProfScope scope( mProfiler, i, GX_BaseLayer::eCollectGradient, mPhaseTimes );
+				GX_TraceScope span( mTracer, "collectGradient", i );
+
+				GX_DataMatrix::iterator iter = gradient->begin() + gradientBegin[ i ];
+				layer->collectGradient( layerInput, output, delta, &iter );
+			}
+
+			GX_DataVector & sum = ( *batchDelta )[ i ];
+			for( size_t j = 0; j < sum.size(); j++ ) sum[ j ] += delta[ j ];
+
+			for( size_t row = gradientBegin[ i ]; row < gradientBegin[ i + 1 ]; row++ ) {
+				( *batchGradient )[ row ] += ( *gradient )[ row ];
+			}
+		}
+
+		end = begin - 1;
+	}
+
+	return loss;
+}
+
+void GX_Network :: getGradientBegin( std::vector< size_t > * gradientBegin ) const
+{
+	gradientBegin->assign( 1, 0 );
+
+	for( auto & layer : mLayers ) {
+		GX_DimsList dims;
+		layer->getGradientDims( &dims );
+		gradientBegin->emplace_back( gradientBegin->back() + dims.size() );
+	}
+}
+
+void GX_Network :: initGradientMatrix( GX_DataMatrix * batchGradient, GX_DataMatrix * gradient )
+{
+	size_t total = 0;
+	for( auto & layer : mLayers ) total += layer->getOutputSize();
+
+	batchGradient->reserve( total );
+	gradient->reserve( total );
+
+	for( auto & layer : mLayers ) {
+		layer->initGradientMatrix( gradient );
+		layer->initGradientMatrix( batchGradient );
+	}
+}
+
+void GX_Network :: initOutputAndDeltaMatrix( GX_DataMatrix * output, GX_DataMatrix * batchDelta, GX_DataMatrix * delta )
+{
+	for( auto & item : mLayers ) output->emplace_back( GX_DataVector( item->getOutputSize() ) );
+
+	for( auto & item : mLayers ) delta->emplace_back( GX_DataVector( item->getOutputSize() ) );
+
+	for( auto & item : *delta ) batchDelta->emplace_back( GX_DataVector( item.size() ) );
+}
+
+void GX_Network :: calcLossDelta( const GX_DataType * target, const GX_DataType * output, GX_DataType * delta ) const
+{
+	size_t count = mLayers.back()->getOutputSize();
+
+	if( eMeanSquaredError == mLossFuncType ) {
+		for( size_t x = 0; x < count; x++ ) delta[ x ] = 2.0 * ( output[ x ] - target[ x ] );
+	}
+
+	if( eCrossEntropy == mLossFuncType ) {
+		for( size_t x = 0; x < count; x++ ) delta[ x ] = output[ x ] - target[ x ];
+	}
+}
+
+GX_DataType GX_Network :: calcLoss( const GX_DataType * target, const GX_DataType * output )
+{
+	size_t count = mLayers.back()->getOutputSize();
+
+	GX_AccumType ret = 0;
+
+	if( eMeanSquaredError == mLossFuncType ) {
+		// same as GX_Utils::calcSSE
+		for( size_t x = 0; x < count; x++ ) {
+			GX_DataType tmp = target[ x ] - output[ x ];
+			ret += tmp * tmp;
+		}
+	}
+
+	if( eCrossEntropy == mLossFuncType ) {
+		for( size_t x = 0; x < count; x++ ) {
+			GX_DataType y = target[ x ], a = output[ x ];
+			GX_DataType tmp = y * std::log( a ); // + ( 1 - y ) * std::log( 1 - a );
+			ret -= tmp;
+		}
+	}
+
+	return ret;
+}
+
+size_t GX_Network :: getTargetCount( const Targets_t & target )
+{
+	return NULL != target.mLabels ? target.mLabels->size() : target.mRows->size();
+}
+
+size_t GX_Network :: getTargetBytes( const Targets_t & target )
+{
+	return NULL != target.mLabels ? gx_heap_bytes( target.mLabels->size() * sizeof( uint16_t ) ) : target.mRows->getBytes();
+}
+
+bool GX_Network :: checkInput( size_t dim ) const
+{
+	size_t sampleSize = dim;
+
+	if( NULL != mAugmenter ) {
+		if( mAugmenter->getInputSize() != dim ) {
+			printf( "%s input dim %zu, augmenter input %zu\n", __func__, dim, mAugmenter->getInputSize() );
+			return false;
+		}
+
+		sampleSize = mAugmenter->getOutputSize();
+	}
+
+	if( mLayers[ 0 ]->getInputSize() != sampleSize ) {
+		printf( "%s sample size %zu, layer input %zu\n", __func__, sampleSize, mLayers[ 0 ]->getInputSize() );
+		return false;
+	}
+
+	return true;
+}
+
+const GX_DataType * GX_Network :: getSample( const GX_Dataset & input, size_t epoch, size_t index,
+		GX_DataVector * augmented ) const
+{
+	if( NULL == mAugmenter ) return input[ index ];
+
+	if( augmented->size() != mAugmenter->getOutputSize() ) augmented->resize( mAugmenter->getOutputSize() );
+
+	mAugmenter->apply( input[ index ], epoch, index, std::begin( *augmented ) );
+
+	return std::begin( *augmented );
+}
+
+bool GX_Network :: checkTargets( const GX_Dataset & input, const Targets_t & target ) const
+{
+	if( input.size() != getTargetCount( target ) ) return false;
+
+	if( NULL != target.mLabels ) {
+		size_t classes = mLayers.back()->getOutputSize();
+
+		for( size_t i = 0; i < target.mLabels->size(); i++ ) {
+			if( ( *target.mLabels )[ i ] >= classes ) {
+				printf( "%s labels[ %zu ] %d, classes %zu\n", __func__, i, ( *target.mLabels )[ i ], classes );
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+void GX_Network :: copyTarget( const Targets_t & target, size_t index, GX_DataVector * row )
+{
+	if( NULL != target.mLabels ) {
+		size_t classes = mLayers.back()->getOutputSize();
+
+		if( row->size() != classes ) row->resize( classes );
+		*row = 0;
+		( *row )[ ( *target.mLabels )[ index ] ] = 1;
+	} else {
+		target.mRows->copySample( index, row );
+	}
+}
+
+GX_DataType GX_Network :: calcLoss( const Targets_t & target, size_t index, const GX_DataType * output, GX_DataType * delta )
+{
+	if( NULL == target.mLabels ) {
+		const GX_DataType * row = ( *target.mRows )[ index ];
+
+		calcLossDelta( row, output, delta );
+
+		return calcLoss( row, output );
+	}
+
+	size_t count = mLayers.back()->getOutputSize(), label = ( *target.mLabels )[ index ];
+
+	GX_AccumType ret = 0;
+
+	// same results as the one-hot row, without reading it
+	if( eMeanSquaredError == mLossFuncType ) {
+		for( size_t x = 0; x < count; x++ ) {
+			GX_DataType y = x == label ? 1 : 0;
+			delta[ x ] = 2.0 * ( output[ x ] - y );
+
+			GX_DataType tmp = y - output[ x ];
+			ret += tmp * tmp;
+		}
+	}
+
+	if( eCrossEntropy == mLossFuncType ) {
+		std::copy( output, output + count, delta );
+		delta[ label ] -= 1;
+
+		ret = -std::log( output[ label ] );
+	}
+
+	return ret;
+}
+
+bool GX_Network :: trainInternal( const GX_Dataset & input, const Targets_t & target, int epochCount,
+		int miniBatchCount, GX_DataType learningRate, GX_DataType lambda, GX_DataVector * losses,
+		GX_ShardStream * stream )
+{
+	// the stream is checked by its train overload, input and target are empty then
+	if( NULL == stream && ( ! checkInput( input.getDim() ) || ! checkTargets( input, target ) ) ) return false;
+
+	size_t sampleCount = NULL != stream ? stream->size() : input.size();
+
+	if( NULL != mPhaseTimes ) mPhaseTimes->reset( mLayers.size() );
+
+	time_t beginTime = time( NULL );
+
+	printf( "%s\tstart train, input { %zu }, target { %zu }\n",
+			ctime( &beginTime ), sampleCount, NULL != stream ? sampleCount : getTargetCount( target ) );
+
+	int logInterval = epochCount / 10;
+	int progressInterval = ( sampleCount / miniBatchCount ) / 10;
+
+	std::random_device rd;
+	std::mt19937 gen( rd() );
+
+	GX_DataMatrix batchGradient, gradient;
+	initGradientMatrix( &batchGradient, &gradient );
+
+	std::vector< bool > checkpoints;
+	getCheckpoints( &checkpoints );
+
+	// the task graph is opt-in and needs a pool, and its phases overlap, so the per-phase profile and
+	// trace are kept serial. it keeps every output, so checkpointing takes the planned path
+	bool isOverlap = mIsOverlap && NULL != GX_ThreadPool::getDefault() && NULL == mProfiler && NULL == mTracer
+			&& ! mIsDebug && checkpoints.empty();
+
+	// the task graph collects a layer while the next one runs its backward, and debug prints
+	// every delta, both keep one output and delta per layer instead of the planned arena
+	bool isPlanned = ! isOverlap && ! mIsDebug;
+
+	GX_MemPlan plan( mLayers, GX_MemPlan::eTraining, checkpoints );
+
+	GX_DataMatrix output, batchDelta, delta, arena;
+
+	// the paths that keep one output per layer take the sample as a vector
+	GX_DataVector sampleInput, sampleTarget;
+
+	if( isPlanned ) {
+		plan.allocate( &arena );
+		for( size_t i = 0; i < mLayers.size(); i++ ) {
+			batchDelta.emplace_back( GX_DataVector( plan.getSize( GX_MemPlan::eBatchDelta, i ) ) );
+		}
+	} else {
+		initOutputAndDeltaMatrix( &output, &batchDelta, &delta );
+	}
+
+	std::vector< size_t > gradientBegin;
+	getGradientBegin( &gradientBegin );
+
+	{
+		GX_MemUsage usage;
+		getMemoryUsage( &usage, isPlanned ? &plan : NULL );
+		if( NULL != stream ) {
+			usage.setDataBytes( stream->getBytes(), 0 );
+		} else {
+			usage.setDataBytes( input.getBytes(), getTargetBytes( target ) );
+		}
+		usage.print( "train" );
+
+		if( isPlanned ) plan.print( "train" );
+	}
+
+	if( NULL != losses ) losses->resize( epochCount, 0 );
+
+	size_t totalSamples = 0;
+	size_t batchCount = ( sampleCount + std::max( miniBatchCount, 1 ) - 1 ) / std::max( miniBatchCount, 1 );
+
+	// the loaders augment the next mini-batches while this one trains
+	std::unique_ptr< GX_AugmentLoader > loader;
+	if( NULL != mAugmenter && NULL == stream ) {
+		loader.reset( new GX_AugmentLoader( *mAugmenter, input, mLoaderCount, std::max( miniBatchCount, 1 ) ) );
+	}
+
+	// a mini-batch of the stream, its samples are augmented inline
+	GX_Dataset streamInput, streamRows;
+	GX_LabelVector streamLabels;
+	Targets_t streamTargets = { NULL, NULL };
+	GX_DataVector augmented;
+
+	if( NULL != stream ) {
+		streamInput = GX_Dataset( std::max( miniBatchCount, 1 ), stream->getInputDim() );
+		if( stream->hasLabels() ) {
+			streamTargets.mLabels = &streamLabels;
+		} else {
+			streamRows = GX_Dataset( std::max( miniBatchCount, 1 ), stream->getTargetDim() );
+			streamTargets.mRows = &streamRows;
+		}
+	}
 
 	for( int n = 0; n < epochCount; n++ ) {
 
-		std::vector< int > idxOfData( input.size() );
-		std::iota( idxOfData.begin(), idxOfData.end(), 0 );
-		if( mIsShuffle ) std::shuffle( idxOfData.begin(), idxOfData.end(), gen );
+		std::vector< int > idxOfData;
+
+		if( NULL != stream ) {
+			stream->start( n, mIsShuffle );
+		} else {
+			idxOfData.resize( sampleCount );
+			std::iota( idxOfData.begin(), idxOfData.end(), 0 );
+			if( mIsShuffle ) std::shuffle( idxOfData.begin(), idxOfData.end(), gen );
+		}
+
+		if( loader ) loader->start( n, idxOfData );
+
+		GX_AccumType totalLoss = 0;
+
+		if( NULL != mProfiler ) mProfiler->beginRegion( GX_Profiler::eRegionEpoch );
 
-		GX_DataType totalLoss = 0;
+		if( NULL != mTracer ) mTracer->beginEpoch( n );
+
+		std::chrono::steady_clock::time_point epochBeginTime = std::chrono::steady_clock::now();
 
 		miniBatchCount = std::max( miniBatchCount, 1 );
 
-		for( size_t begin = 0; begin < idxOfData.size(); ) {
-			size_t end = std::min( idxOfData.size(), begin + miniBatchCount );
+		for( size_t begin = 0; begin < sampleCount; ) {
+			size_t end = std::min( sampleCount, begin + miniBatchCount );
+
+			if( NULL != mTracer ) mTracer->beginBatch( begin / miniBatchCount );
+
+			GX_TraceScope batchSpan( mTracer, "batch", begin / miniBatchCount );
 
 			for( auto & vec : batchGradient ) std::fill( std::begin( vec ), std::end( vec ), 0.0 );
 			for( auto & vec : batchDelta ) std::fill( std::begin( vec ), std::end( vec ), 0.0 );
 
+			const GX_Dataset * loaded = loader ? &( loader->nextBatch() ) : NULL;
+
+			if( NULL != stream && stream->next( &streamInput, &streamRows, &streamLabels ) != end - begin ) {
+				printf( "%s stream ended before sample %zu of %zu\n", __func__, end, sampleCount );
+				return false;
+			}
+
+			const Targets_t & currTarget = NULL != stream ? streamTargets : target;
+
 			for( size_t i = begin; i < end; i++ ) {
 
-				const GX_DataVector & currInput = input[ idxOfData[ i ] ];
-				const GX_DataVector & currTarget = target[ idxOfData[ i ] ];
+				GX_DataType loss = 0;
+
+				size_t index = NULL != stream ? i - begin : idxOfData[ i ];
+
+				const GX_DataType * currInput = NULL != loaded ? ( *loaded )[ i - begin ] : NULL;
+
+				if( NULL != stream ) {
+					currInput = streamInput[ index ];
 
-				forward( currInput, &output );
+					if( NULL != mAugmenter ) {
+						augmented.resize( mAugmenter->getOutputSize() );
+						mAugmenter->apply( currInput, n, i, std::begin( augmented ) );
+						currInput = std::begin( augmented );
+					}
+				} else if( NULL == currInput ) {
+					currInput = input[ index ];
+				}
 
-				backward( currInput, currTarget, output, &delta );
+				if( isPlanned ) {
+					loss = trainSample( currInput, currTarget, index, plan, gradientBegin,
+							&arena, &gradient, &batchDelta, &batchGradient );
+				} else {
+					sampleInput.resize( mLayers[ 0 ]->getInputSize() );
+					std::copy( currInput, currInput + sampleInput.size(), std::begin( sampleInput ) );
+					copyTarget( currTarget, index, &sampleTarget );
 
-				collect( currInput, output, delta, &gradient );
+					forward( sampleInput, &output );
 
-				gx_add_matrix( &batchDelta, delta );
-				gx_add_matrix( &batchGradient, gradient );
+					if( isOverlap ) {
+						backwardOverlap( sampleInput, sampleTarget, output, gradientBegin, &delta, &gradient,
+								&batchDelta, &batchGradient, i == end - 1 ? end - begin : 0,
+								learningRate, lambda, sampleCount );
+					} else {
+						backward( sampleInput, sampleTarget, output, &delta );
 
-				GX_DataType loss = calcLoss( currTarget, output.back() );
+						collect( sampleInput, output, delta, &gradient );
+
+						gx_add_matrix( &batchDelta, delta );
+						gx_add_matrix( &batchGradient, gradient );
+					}
+
+					loss = calcLoss( std::begin( sampleTarget ), std::begin( output.back() ) );
+				}
 
 				totalLoss += loss;
 
@@ -281,40 +1136,388 @@ bool GX_Network :: trainInternal( const GX_DataMatrix & input, const GX_DataMatr
 				GX_Utils::printMatrix( "batch gradient", batchGradient );
 			}
 
-			apply( batchDelta, batchGradient, end - begin, learningRate, lambda, input.size() );
+			if( ! isOverlap ) apply( batchDelta, batchGradient, end - begin, learningRate, lambda, sampleCount );
+
+			totalSamples += end - begin;
+
+			if( NULL != mStatsWriter ) {
+				std::chrono::duration< double > span = std::chrono::steady_clock::now() - epochBeginTime;
+				size_t queueDepth = loader ? loader->getReadyCount() : NULL != stream ? stream->getBufferCount() : 0;
+				publishStats( n, epochCount, begin / miniBatchCount + 1, batchCount, totalSamples,
+						end, span.count(), totalLoss, learningRate, queueDepth );
+			}
 
 			begin += miniBatchCount;
 			end = begin + miniBatchCount;
 
 			if( progressInterval > 0 && 0 == ( begin % ( progressInterval * miniBatchCount ) ) ) {
-				printf( "\r%zu / %zu", begin, idxOfData.size() );
+				printf( "\r%zu / %zu", begin, sampleCount );
 				fflush( stdout );
 			}
 		}
 
-		if( NULL != losses ) ( *losses )[ n ] = totalLoss / input.size();
+		if( NULL != mProfiler ) {
+			char tag[ 64 ] = { 0 };
+			snprintf( tag, sizeof( tag ), "epoch#%d", n );
+
+			// the report starts over the progress line
+			if( progressInterval > 0 ) printf( "\r" );
+			mProfiler->endRegion( GX_Profiler::eRegionEpoch, tag );
+		}
+
+		if( NULL != losses ) ( *losses )[ n ] = totalLoss / sampleCount;
 
 		if( logInterval <= 1 || ( logInterval > 1 && 0 == n % logInterval ) || n == ( epochCount - 1 ) ) {
 			time_t currTime = time( NULL );
 			printf( "\r%s\tinterval %ld [>] epoch %d, lr %f, loss %.8f\n",
-				ctime( &currTime ), currTime - beginTime, n, learningRate, totalLoss / input.size() );
+				ctime( &currTime ), currTime - beginTime, n, learningRate, totalLoss / sampleCount );
 			beginTime = time( NULL );
 		}
 
 		if( mIsDebug ) print();
 
+		if( NULL != mTracer ) mTracer->setActive( true );
+
+		if( mOnEpochEnd ) {
+			GX_TraceScope span( mTracer, "onEpochEnd", n );
+			mOnEpochEnd( *this, n, totalLoss / sampleCount );
+		}
+
+		if( NULL != mTracer ) mTracer->setActive( false );
+	}
+
+	return true;
+}
+
+void GX_Network :: hogwildWorker( const GX_Dataset & input, const Targets_t & target, int epoch,
+		const std::vector< int > & idxOfData, std::atomic< size_t > * next, int miniBatchCount,
+		GX_DataType learningRate, GX_DataType lambda, GX_AccumType * totalLoss )
+{
+	GX_DataMatrix batchGradient, gradient;
+	initGradientMatrix( &batchGradient, &gradient );
+
+	std::vector< bool > checkpoints;
+	getCheckpoints( &checkpoints );
+
+	GX_MemPlan plan( mLayers, GX_MemPlan::eTraining, checkpoints );
+
+	GX_DataMatrix arena, batchDelta;
+	plan.allocate( &arena );
+	for( size_t i = 0; i < mLayers.size(); i++ ) {
+		batchDelta.emplace_back( GX_DataVector( plan.getSize( GX_MemPlan::eBatchDelta, i ) ) );
+	}
+
+	std::vector< size_t > gradientBegin;
+	getGradientBegin( &gradientBegin );
+
+	GX_DataVector augmented;
+
+	for( ; ; ) {
+		size_t begin = next->fetch_add( miniBatchCount, std::memory_order_relaxed );
+
+		if( begin >= idxOfData.size() ) break;
+
+		size_t end = std::min( idxOfData.size(), begin + miniBatchCount );
+
+		for( auto & vec : batchGradient ) std::fill( std::begin( vec ), std::end( vec ), 0.0 );
+		for( auto & vec : batchDelta ) std::fill( std::begin( vec ), std::end( vec ), 0.0 );
+
+		for( size_t i = begin; i < end; i++ ) {
+			*totalLoss += trainSample( getSample( input, epoch, idxOfData[ i ], &augmented ), target, idxOfData[ i ],
+					plan, gradientBegin, &arena, &gradient, &batchDelta, &batchGradient );
+		}
+
+		// other workers read and write the same weights meanwhile
+		apply( batchDelta, batchGradient, end - begin, learningRate, lambda, input.size() );
+	}
+}
+
+bool GX_Network :: trainHogwild( const GX_Dataset & input, const GX_Dataset & target, int epochCount,
+		int miniBatchCount, GX_DataType learningRate, GX_DataType lambda, int threadCount,
+		GX_DataVector * losses )
+{
+	Targets_t targets = { &target, NULL };
+
+	return hogwildInternal( input, targets, epochCount, miniBatchCount, learningRate, lambda, threadCount, losses );
+}
+
+bool GX_Network :: trainHogwild( const GX_Dataset & input, const GX_LabelVector & labels, int epochCount,
+		int miniBatchCount, GX_DataType learningRate, GX_DataType lambda, int threadCount,
+		GX_DataVector * losses )
+{
+	Targets_t targets = { NULL, &labels };
+
+	return hogwildInternal( input, targets, epochCount, miniBatchCount, learningRate, lambda, threadCount, losses );
+}
+
+bool GX_Network :: hogwildInternal( const GX_Dataset & input, const Targets_t & target, int epochCount,
+		int miniBatchCount, GX_DataType learningRate, GX_DataType lambda, int threadCount,
+		GX_DataVector * losses )
+{
+	if( ! checkInput( input.getDim() ) || ! checkTargets( input, target ) || threadCount < 1 ) return false;
+
+	std::chrono::steady_clock::time_point beginTime = std::chrono::steady_clock::now();
+
+	time_t beginClock = time( NULL );
+
+	printf( "%s\tstart hogwild train, input { %zu }, target { %zu }, threads %d\n",
+			ctime( &beginClock ), input.size(), getTargetCount( target ), threadCount );
+
+	GX_Profiler * profiler = mProfiler;
+	GX_Tracer * tracer = mTracer;
+	GX_StatsWriter * statsWriter = mStatsWriter;
+
+	mProfiler = NULL;
+	mTracer = NULL;
+	mStatsWriter = NULL;
+
+	std::random_device rd;
+	std::mt19937 gen( rd() );
+
+	std::vector< int > idxOfData( input.size() );
+	std::iota( idxOfData.begin(), idxOfData.end(), 0 );
+
+	if( NULL != losses ) losses->resize( epochCount, 0 );
+
+	miniBatchCount = std::max( miniBatchCount, 1 );
+
+	for( int n = 0; n < epochCount; n++ ) {
+		if( mIsShuffle ) std::shuffle( idxOfData.begin(), idxOfData.end(), gen );
+
+		std::atomic< size_t > next( 0 );
+		std::vector< GX_AccumType > threadLosses( threadCount, 0 );
+		std::vector< std::thread > threads;
+
+		for( int t = 0; t < threadCount; t++ ) {
+			threads.emplace_back( &GX_Network::hogwildWorker, this, std::cref( input ), std::cref( target ), n,
+					std::cref( idxOfData ), &next, miniBatchCount, learningRate, lambda, &( threadLosses[ t ] ) );
+		}
+
+		for( auto & item : threads ) item.join();
+
+		GX_AccumType totalLoss = std::accumulate( threadLosses.begin(), threadLosses.end(), (GX_AccumType)0 );
+
+		if( NULL != losses ) ( *losses )[ n ] = totalLoss / input.size();
+
+		time_t currTime = time( NULL );
+		printf( "%s\thogwild epoch %d, lr %f, loss %.8f\n", ctime( &currTime ), n, learningRate, totalLoss / input.size() );
+
 		if( mOnEpochEnd ) mOnEpochEnd( *this, n, totalLoss / input.size() );
 	}
 
+	mProfiler = profiler;
+	mTracer = tracer;
+	mStatsWriter = statsWriter;
+
+	std::chrono::duration< double > span = std::chrono::steady_clock::now() - beginTime;
+
+	printf( "Elapsed time: %.3f\n", span.count() );
+
 	return true;
 }
 
-bool GX_Network :: train( const GX_DataMatrix & input, const GX_DataMatrix & target, int epochCount,
+bool GX_Network :: trainDataParallel( const GX_Dataset & input, const GX_Dataset & target, int epochCount,
+		int miniBatchCount, GX_DataType learningRate, GX_DataType lambda, GX_Communicator * comm,
+		GX_DataVector * losses )
+{
+	Targets_t targets = { &target, NULL };
+
+	return dataParallelInternal( input, targets, epochCount, miniBatchCount, learningRate, lambda, comm, losses );
+}
+
+bool GX_Network :: trainDataParallel( const GX_Dataset & input, const GX_LabelVector & labels, int epochCount,
+		int miniBatchCount, GX_DataType learningRate, GX_DataType lambda, GX_Communicator * comm,
+		GX_DataVector * losses )
+{
+	Targets_t targets = { NULL, &labels };
+
+	return dataParallelInternal( input, targets, epochCount, miniBatchCount, learningRate, lambda, comm, losses );
+}
+
+bool GX_Network :: dataParallelInternal( const GX_Dataset & input, const Targets_t & target, int epochCount,
+		int miniBatchCount, GX_DataType learningRate, GX_DataType lambda, GX_Communicator * comm,
+		GX_DataVector * losses )
+{
+	if( ! checkInput( input.getDim() ) || ! checkTargets( input, target ) ) return false;
+
+	std::chrono::steady_clock::time_point beginTime = std::chrono::steady_clock::now();
+
+	int rank = comm->getRank(), rankCount = comm->getSize();
+
+	if( 0 == rank ) {
+		time_t beginClock = time( NULL );
+		printf( "%s\tstart data-parallel train, input { %zu }, target { %zu }, ranks %d\n",
+				ctime( &beginClock ), input.size(), getTargetCount( target ), rankCount );
+	}
+
+	GX_Profiler * profiler = mProfiler;
+	GX_Tracer * tracer = mTracer;
+	GX_StatsWriter * statsWriter = mStatsWriter;
+
+	mProfiler = NULL;
+	mTracer = NULL;
+	mStatsWriter = NULL;
+
+	// start from the weights and the shuffle order of rank 0
+	GX_DataVector params;
+	exportParams( &params );
+
+	uint32_t seed = std::random_device()();
+
+	// as two 16-bit halves, a float of the mixed build holds each of them exactly
+	GX_DataType seedHalves[ 2 ] = { (GX_DataType)( seed >> 16 ), (GX_DataType)( seed & 0xffff ) };
+
+	bool ret = comm->broadcast( std::begin( params ), params.size(), 0 )
+			&& comm->broadcast( seedHalves, 2, 0 ) && importParams( params );
+
+	seed = ( (uint32_t)seedHalves[ 0 ] << 16 ) | (uint32_t)seedHalves[ 1 ];
+
+	std::mt19937 gen( seed );
+
+	GX_DataMatrix batchGradient, gradient;
+	initGradientMatrix( &batchGradient, &gradient );
+
+	std::vector< bool > checkpoints;
+	getCheckpoints( &checkpoints );
+
+	GX_MemPlan plan( mLayers, GX_MemPlan::eTraining, checkpoints );
+
+	GX_DataMatrix arena, batchDelta;
+	plan.allocate( &arena );
+	for( size_t i = 0; i < mLayers.size(); i++ ) {
+		batchDelta.emplace_back( GX_DataVector( plan.getSize( GX_MemPlan::eBatchDelta, i ) ) );
+	}
+
+	std::vector< size_t > gradientBegin;
+	getGradientBegin( &gradientBegin );
+
+	// batchDelta, batchGradient, sample count and loss of a mini-batch in one all-reduce
+	size_t packCount = 2;
+	for( auto & vec : batchDelta ) packCount += vec.size();
+	for( auto & vec : batchGradient ) packCount += vec.size();
+
+	GX_DataVector pack( packCount ), augmented;
+
+	std::vector< int > idxOfData( input.size() );
+	std::iota( idxOfData.begin(), idxOfData.end(), 0 );
+
+	if( NULL != losses ) losses->resize( epochCount, 0 );
+
+	miniBatchCount = std::max( miniBatchCount, 1 );
+
+	for( int n = 0; ret && n < epochCount; n++ ) {
+		if( mIsShuffle ) std::shuffle( idxOfData.begin(), idxOfData.end(), gen );
+
+		GX_AccumType totalLoss = 0;
+
+		for( size_t begin = 0; ret && begin < idxOfData.size(); begin += miniBatchCount ) {
+			size_t end = std::min( idxOfData.size(), begin + miniBatchCount );
+
+			for( auto & vec : batchGradient ) std::fill( std::begin( vec ), std::end( vec ), 0.0 );
+			for( auto & vec : batchDelta ) std::fill( std::begin( vec ), std::end( vec ), 0.0 );
+
+			GX_DataType count = 0, loss = 0;
+
+			// rank r takes every rankCount-th sample of the mini-batch
+			for( size_t i = begin + rank; i < end; i += rankCount ) {
+				loss += trainSample( getSample( input, n, idxOfData[ i ], &augmented ), target, idxOfData[ i ],
+						plan, gradientBegin, &arena, &gradient, &batchDelta, &batchGradient );
+				count++;
+			}
+
+			GX_DataType * cursor = std::begin( pack );
+			for( auto & vec : batchDelta ) cursor = std::copy( std::begin( vec ), std::end( vec ), cursor );
+			for( auto & vec : batchGradient ) cursor = std::copy( std::begin( vec ), std::end( vec ), cursor );
+			cursor[ 0 ] = count;
+			cursor[ 1 ] = loss;
+
+			ret = comm->allReduce( std::begin( pack ), pack.size() );
+
+			const GX_DataType * from = std::begin( pack );
+			for( auto & vec : batchDelta ) {
+				std::copy( from, from + vec.size(), std::begin( vec ) );
+				from += vec.size();
+			}
+			for( auto & vec : batchGradient ) {
+				std::copy( from, from + vec.size(), std::begin( vec ) );
+				from += vec.size();
+			}
+
+			totalLoss += from[ 1 ];
+
+			apply( batchDelta, batchGradient, (int)from[ 0 ], learningRate, lambda, input.size() );
+		}
+
+		if( NULL != losses ) ( *losses )[ n ] = totalLoss / input.size();
+
+		if( 0 == rank ) {
+			time_t currTime = time( NULL );
+			printf( "%s\tdata-parallel epoch %d, lr %f, loss %.8f\n", ctime( &currTime ), n, learningRate,
+					totalLoss / input.size() );
+		}
+
+		if( mOnEpochEnd && 0 == rank ) mOnEpochEnd( *this, n, totalLoss / input.size() );
+	}
+
+	mProfiler = profiler;
+	mTracer = tracer;
+	mStatsWriter = statsWriter;
+
+	if( ! ret ) printf( "%s rank %d, collective fail\n", __func__, rank );
+
+	std::chrono::duration< double > span = std::chrono::steady_clock::now() - beginTime;
+
+	if( 0 == rank ) printf( "Elapsed time: %.3f\n", span.count() );
+
+	return ret;
+}
+
+bool GX_Network :: train( const GX_Dataset & input, const GX_Dataset & target, int epochCount,
 		int miniBatchCount, GX_DataType learningRate, GX_DataType lambda, GX_DataVector * losses )
+{
+	Targets_t targets = { &target, NULL };
+
+	return trainTimed( input, targets, epochCount, miniBatchCount, learningRate, lambda, losses, NULL );
+}
+
+bool GX_Network :: train( const GX_Dataset & input, const GX_LabelVector & labels, int epochCount,
+		int miniBatchCount, GX_DataType learningRate, GX_DataType lambda, GX_DataVector * losses )
+{
+	Targets_t targets = { NULL, &labels };
+
+	return trainTimed( input, targets, epochCount, miniBatchCount, learningRate, lambda, losses, NULL );
+}
+
+bool GX_Network :: train( GX_ShardStream & stream, int epochCount, int miniBatchCount,
+		GX_DataType learningRate, GX_DataType lambda, GX_DataVector * losses )
+{
+	if( ! checkInput( stream.getInputDim() ) ) return false;
+
+	size_t classes = mLayers.back()->getOutputSize();
+
+	if( stream.hasLabels() && stream.getMaxLabel() >= classes ) {
+		printf( "%s max label %d, classes %zu\n", __func__, stream.getMaxLabel(), classes );
+		return false;
+	}
+
+	if( ! stream.hasLabels() && stream.getTargetDim() != classes ) {
+		printf( "%s target dim %zu, layer output %zu\n", __func__, stream.getTargetDim(), classes );
+		return false;
+	}
+
+	GX_Dataset input;
+	Targets_t targets = { NULL, NULL };
+
+	return trainTimed( input, targets, epochCount, miniBatchCount, learningRate, lambda, losses, &stream );
+}
+
+bool GX_Network :: trainTimed( const GX_Dataset & input, const Targets_t & target, int epochCount,
+		int miniBatchCount, GX_DataType learningRate, GX_DataType lambda, GX_DataVector * losses,
+		GX_ShardStream * stream )
 {
 	std::chrono::steady_clock::time_point beginTime = std::chrono::steady_clock::now();	
 
-	bool ret = trainInternal( input, target, epochCount, miniBatchCount, learningRate, lambda, losses );
+	bool ret = trainInternal( input, target, epochCount, miniBatchCount, learningRate, lambda, losses, stream );
 
 	std::chrono::steady_clock::time_point endTime = std::chrono::steady_clock::now();	
 
@@ -322,6 +1525,8 @@ bool GX_Network :: train( const GX_DataMatrix & input, const GX_DataMatrix & tar
 
 	printf( "Elapsed time: %.3f\n", timeSpan.count() / 1000.0 );
 
+	if( NULL != mProfiler ) mProfiler->printPerf();
+
 	return ret;
 }
 
@@ -2,8 +2,82 @@
 
 #include "gxcomm.h"
 #include "gxlayer.h"
+#include "gxplan.h"
+#include "gxdataset.h"
+
+#include <atomic>
 
 class GX_Network;
+class GX_Profiler;
+class GX_Tracer;
+class GX_StatsWriter;
+class GX_PhaseTimes;
+class GX_Communicator;
+class GX_Augmenter;
+class GX_ShardStream;
+
+// bytes held per layer and per category
+class GX_MemUsage {
+public:
+	enum { eWeights = 0, eGradient = 1, eBatchGradient = 2, eOutput = 3, eDelta = 4,
+			eBatchDelta = 5, eScratch = 6, eCategoryCount = 7 };
+
+	GX_MemUsage();
+	~GX_MemUsage();
+
+	void resize( size_t layerCount );
+
+	void add( size_t layerIndex, int category, size_t bytes );
+
+	size_t get( size_t layerIndex, int category ) const;
+
+	size_t getTotal( int category ) const;
+
+	size_t getTotal() const;
+
+	// bytes of the training dataset, printed with the layers
+	void setDataBytes( size_t inputBytes, size_t targetBytes );
+
+	void print( const char * tag ) const;
+
+private:
+	std::vector< size_t > mBytes;
+	size_t mInputBytes, mTargetBytes;
+};
+
+// per-request buffers of forward, pre-sized from an inference memory plan and reused across
+// calls, one context per thread lets N threads share one network without locks or allocation.
+// the hidden layers ping-pong between two arena slots, only the last output is kept
+class GX_InferenceContext {
+public:
+	GX_InferenceContext( const GX_Network & network );
+	~GX_InferenceContext();
+
+	// output of the last layer
+	const GX_DataVector & getOutput() const;
+
+	const GX_MemPlan & getPlan() const;
+
+	// the storage format of the network when the context was made
+	int getStorage() const;
+
+	// bytes of the buffers of one forward
+	size_t getBytes() const;
+
+private:
+	friend class GX_Network;
+
+	int mStorage;
+	GX_MemPlan mPlan;
+	GX_DataMatrix mArena;
+	GX_DataVector mOutput;
+
+	// with a storage format the hidden outputs are kept packed in the slots of the plan,
+	// mInput widens them for the layers that can not read them packed, mScratch takes
+	// the output of a hidden layer before it is packed
+	std::vector< GX_HalfVector > mPackedArena;
+	GX_DataVector mInput, mScratch;
+};
 
 typedef void ( * GX_OnEpochEnd_t )( GX_Network & network, int epoch, GX_DataType loss );
 
@@ -20,6 +94,50 @@ public:
 
 	void setShuffle( bool isShuffle );
 
+	// profiler is not owned by the network, NULL to turn off profiling
+	void setProfiler( GX_Profiler * profiler );
+
+	GX_Profiler * getProfiler() const;
+
+	// tracer is not owned by the network, NULL to turn off tracing
+	void setTracer( GX_Tracer * tracer );
+
+	GX_Tracer * getTracer() const;
+
+	// stats writer is not owned by the network, NULL to stop publishing
+	void setStatsWriter( GX_StatsWriter * statsWriter );
+
+	// gradient checkpointing of train, trainHogwild and trainDataParallel: forward keeps the output
+	// of every interval-th layer and of the last one, backward recomputes the others one segment
+	// at a time. the weights come out the same, for more compute and less activation memory.
+	// 0 or 1 keeps every output
+	void setCheckpointInterval( int interval );
+
+	// the interval with the fewest recomputed layers whose training plan fits in bytes,
+	// the smallest plan when none fits, 0 keeps every output
+	void setCheckpointBudget( size_t bytes );
+
+	// one flag per layer from the interval or budget, empty when every output is kept
+	void getCheckpoints( std::vector< bool > * checkpoints ) const;
+
+	// with a default pool, train collects and applies the gradients of a layer on a pool thread
+	// while backward goes on below it. it keeps one output and delta per layer instead of the
+	// memory plan, so it is off by default, and the profiler, tracer or checkpoints turn it off
+	void setOverlap( bool isOverlap );
+
+	// 16-bit storage for inference, GX_Half::eBF16 or eFP16: the layers keep packed copies of
+	// their weights and forward on a GX_InferenceContext keeps the hidden outputs packed too.
+	// contexts made before the call have to be made again. GX_Half::eNone goes back to full width
+	void setStorage( int format );
+
+	int getStorage() const;
+
+	// augmenter is not owned by the network, NULL trains on the input as it is. the samples hold
+	// augmenter->getInputSize() items and the first layer takes augmenter->getOutputSize().
+	// train augments on loaderCount threads ahead of the mini-batch loop, 0 augments inline,
+	// trainHogwild and trainDataParallel augment inline in their workers
+	void setAugmenter( const GX_Augmenter * augmenter, int loaderCount = 0 );
+
 	void setLossFuncType( int lossFuncType );
 
 	int getLossFuncType() const;
@@ -34,38 +152,190 @@ public:
 
 	bool forward( const GX_DataVector & input, GX_DataMatrix * output ) const;
 
+	// thread-safe: layers and weights are only read, so any number of threads may run
+	// this concurrently on one network as long as nothing trains or loads it meanwhile.
+	// the profiler and tracer are skipped, they are not meant to be shared by requests
+	bool forward( const GX_DataVector & input, GX_InferenceContext * ctx ) const;
+
+	// same as above, input must hold getLayers()[ 0 ]->getInputSize() items and is read in place
+	bool forward( const GX_DataType * input, GX_InferenceContext * ctx ) const;
+
 	bool backward( const GX_DataVector & input, const GX_DataVector & target,
 			const GX_DataMatrix & output, GX_DataMatrix * delta );
 
-	bool train( const GX_DataMatrix & input, const GX_DataMatrix & target, int epochCount,
+	// a GX_DataMatrix converts to a GX_Dataset, one copy per call
+	bool train( const GX_Dataset & input, const GX_Dataset & target, int epochCount,
 			int miniBatchCount, GX_DataType learningRate, GX_DataType lambda = 0,
 			GX_DataVector * losses = nullptr );
 
+	// Hogwild: threadCount workers pull mini-batches from one shuffled index and apply
+	// their updates straight to the shared weights, without locks and without waiting for
+	// each other. the stores race by design, threads only meet at the end of an epoch.
+	// the profiler, tracer and stats writer are not used in this mode
+	bool trainHogwild( const GX_Dataset & input, const GX_Dataset & target, int epochCount,
+			int miniBatchCount, GX_DataType learningRate, GX_DataType lambda, int threadCount,
+			GX_DataVector * losses = nullptr );
+
+	// data-parallel: every rank of comm calls this with the same input and target. rank 0
+	// broadcasts its weights and shuffle seed, each rank runs its share of every mini-batch,
+	// the gradient sums are all-reduced, so the ranks apply the same update and stay in sync.
+	// miniBatchCount is the batch size over all ranks, as in train.
+	// the profiler, tracer and stats writer are not used in this mode
+	bool trainDataParallel( const GX_Dataset & input, const GX_Dataset & target, int epochCount,
+			int miniBatchCount, GX_DataType learningRate, GX_DataType lambda, GX_Communicator * comm,
+			GX_DataVector * losses = nullptr );
+
+	// classification: the target of sample i is one-hot at labels[ i ], the loss and the
+	// delta of the last layer index the output instead of reading a target row.
+	// every label must be below the output size of the last layer
+	bool train( const GX_Dataset & input, const GX_LabelVector & labels, int epochCount,
+			int miniBatchCount, GX_DataType learningRate, GX_DataType lambda = 0,
+			GX_DataVector * losses = nullptr );
+
+	bool trainHogwild( const GX_Dataset & input, const GX_LabelVector & labels, int epochCount,
+			int miniBatchCount, GX_DataType learningRate, GX_DataType lambda, int threadCount,
+			GX_DataVector * losses = nullptr );
+
+	bool trainDataParallel( const GX_Dataset & input, const GX_LabelVector & labels, int epochCount,
+			int miniBatchCount, GX_DataType learningRate, GX_DataType lambda, GX_Communicator * comm,
+			GX_DataVector * losses = nullptr );
+
+	// out-of-core: the samples and targets come from the shards of an opened stream, one
+	// mini-batch at a time, shuffled through its buffer when setShuffle is on. only the
+	// buffer and one shard are in memory, the augmenter runs inline
+	bool train( GX_ShardStream & stream, int epochCount, int miniBatchCount,
+			GX_DataType learningRate, GX_DataType lambda = 0, GX_DataVector * losses = nullptr );
+
 	void print( bool isDetail = false ) const;
 
+	// deep copy of the layers and loss func into an empty network,
+	// the profiler, tracer, stats writer and onEpochEnd are not copied
+	void clone( GX_Network * other ) const;
+
+	// all trainable parameters, layer by layer
+	size_t getParamCount() const;
+
+	// params is resized to getParamCount() when needed
+	void exportParams( GX_DataVector * params ) const;
+
+	bool importParams( const GX_DataVector & params );
+
+	// weights, per sample buffers, mini-batch accumulators and scratch of train, the per sample
+	// buffers and batchDelta as the buffers of plan when train runs it
+	void getMemoryUsage( GX_MemUsage * usage, const GX_MemPlan * plan = NULL ) const;
+
 private:
+	// stages run the layers directly and share calcLoss
+	friend class GX_Pipeline;
+
+	// trains queued samples with the per sample path of train
+	friend class GX_OnlineTrainer;
+
+	// targets of train, one row per sample or one class index per sample
+	typedef struct tagTargets {
+		const GX_Dataset * mRows;
+		const GX_LabelVector * mLabels;
+	} Targets_t;
+
+	static size_t getTargetCount( const Targets_t & target );
+
+	static size_t getTargetBytes( const Targets_t & target );
+
+	// samples of dim items fit the first layer, through the augmenter if there is one
+	bool checkInput( size_t dim ) const;
+
+	// input[ index ] as it is, or augmented into augmented
+	const GX_DataType * getSample( const GX_Dataset & input, size_t epoch, size_t index,
+			GX_DataVector * augmented ) const;
+
+	// the counts match and the labels fit the last layer
+	bool checkTargets( const GX_Dataset & input, const Targets_t & target ) const;
+
+	// target of the sample as a row, one-hot for a label
+	void copyTarget( const Targets_t & target, size_t index, GX_DataVector * row );
+
+	// loss of the sample, and the delta of the last layer
+	GX_DataType calcLoss( const Targets_t & target, size_t index, const GX_DataType * output, GX_DataType * delta );
 
 	void collect( const GX_DataVector & input, const GX_DataMatrix & output,
 			const GX_DataMatrix & delta, GX_DataMatrix * gradient );
 
+	// forward, backward and collectGradient of one sample in the arena of a training plan,
+	// each layer is collected right after its backward so that its delta slot can be reused,
+	// the outputs that are not checkpoints are recomputed before the backward of their segment.
+	// the sums go to batchDelta and batchGradient, returns the loss of the sample
+	GX_DataType trainSample( const GX_DataType * input, const Targets_t & target, size_t index,
+			const GX_MemPlan & plan, const std::vector< size_t > & gradientBegin, GX_DataMatrix * arena,
+			GX_DataMatrix * gradient, GX_DataMatrix * batchDelta, GX_DataMatrix * batchGradient );
+
+	// backward of one sample as a task graph: collectGradient of layer i and its batch sums run
+	// on a pool thread while backpropagate goes on into layer i - 1. on the last sample of a
+	// mini-batch, applyCount > 0, layer i also applies its batch as soon as its sums are done.
+	// gradientBegin[ i ] is the first row of layer i in gradient, one more entry for the end
+	void backwardOverlap( const GX_DataVector & input, const GX_DataVector & target,
+			const GX_DataMatrix & output, const std::vector< size_t > & gradientBegin,
+			GX_DataMatrix * delta, GX_DataMatrix * gradient, GX_DataMatrix * batchDelta,
+			GX_DataMatrix * batchGradient, int applyCount, GX_DataType learningRate,
+			GX_DataType lambda, int trainingCount );
+
+	// forward of a context with a storage format, the hidden outputs go packed to the arena slots
+	bool forwardPacked( const GX_DataType * input, GX_InferenceContext * ctx ) const;
+
 	bool apply( const GX_DataMatrix & delta, const GX_DataMatrix & gradient,
 			int miniBatchCount, GX_DataType learningRate,
 			GX_DataType lambda, int trainingCount );
 
-	GX_DataType calcLoss( const GX_DataVector & target, const GX_DataVector & output );
+	// target, output and delta hold the output size of the last layer
+	GX_DataType calcLoss( const GX_DataType * target, const GX_DataType * output );
+
+	// delta of the last layer from the loss function
+	void calcLossDelta( const GX_DataType * target, const GX_DataType * output, GX_DataType * delta ) const;
+
+	// first row of every layer in the gradient matrix, one more entry for the end
+	void getGradientBegin( std::vector< size_t > * gradientBegin ) const;
+
+	void publishStats( int epoch, int epochCount, size_t batch, size_t batchCount, size_t totalSamples,
+			size_t epochSamples, double seconds, GX_DataType totalLoss, GX_DataType learningRate, size_t queueDepth );
 
 	void initGradientMatrix( GX_DataMatrix * batchGradient, GX_DataMatrix * gradient );
 
 	void initOutputAndDeltaMatrix( GX_DataMatrix * output, GX_DataMatrix * batchDelta, GX_DataMatrix * delta );
 
-	bool trainInternal( const GX_DataMatrix & input, const GX_DataMatrix & target, int epochCount,
+	// trainInternal with the elapsed time and the perf counters printed
+	bool trainTimed( const GX_Dataset & input, const Targets_t & target, int epochCount,
+			int miniBatchCount, GX_DataType learningRate, GX_DataType lambda, GX_DataVector * losses,
+			GX_ShardStream * stream );
+
+	// with a stream, input and target are not read, the samples come from the stream
+	bool trainInternal( const GX_Dataset & input, const Targets_t & target, int epochCount,
 			int miniBatchCount, GX_DataType learningRate, GX_DataType lambda = 0,
-			GX_DataVector * losses = nullptr );
+			GX_DataVector * losses = nullptr, GX_ShardStream * stream = NULL );
+
+	bool hogwildInternal( const GX_Dataset & input, const Targets_t & target, int epochCount,
+			int miniBatchCount, GX_DataType learningRate, GX_DataType lambda, int threadCount,
+			GX_DataVector * losses );
+
+	bool dataParallelInternal( const GX_Dataset & input, const Targets_t & target, int epochCount,
+			int miniBatchCount, GX_DataType learningRate, GX_DataType lambda, GX_Communicator * comm,
+			GX_DataVector * losses );
+
+	void hogwildWorker( const GX_Dataset & input, const Targets_t & target, int epoch,
+			const std::vector< int > & idxOfData, std::atomic< size_t > * next, int miniBatchCount,
+			GX_DataType learningRate, GX_DataType lambda, GX_AccumType * totalLoss );
 
 private:
 	GX_OnEpochEnd_t mOnEpochEnd;
+	GX_Profiler * mProfiler;
+	GX_Tracer * mTracer;
+	GX_StatsWriter * mStatsWriter;
+	GX_PhaseTimes * mPhaseTimes;
 	int mLossFuncType;
 	GX_BaseLayerPtrVector mLayers;
-	bool mIsDebug, mIsShuffle;
+	bool mIsDebug, mIsShuffle, mIsOverlap;
+	int mCheckpointInterval;
+	size_t mCheckpointBudget;
+	int mStorage;
+	const GX_Augmenter * mAugmenter;
+	int mLoaderCount;
 };
 
@@ -1,5 +1,6 @@
 #include "gxnet.h"
 #include "gxutils.h"
+#include "gxpool.h"
 
 #include <iostream>
 #include <fstream>
@@ -10,6 +11,7 @@
 #include <algorithm>
 #include <set>
 #include <float.h>
+#include <string.h>
 
 #include <unistd.h>
 #include <syslog.h>
@@ -54,7 +56,6 @@ bool readImage( const char * path, GX_DataVector * input )
 int test( const char * modelFile, const char * imgFile )
 {
 	GX_DataVector input;
-	GX_DataMatrix output;
 
 	if( ! readImage( imgFile, &input ) ) return -1;
 
@@ -68,23 +69,28 @@ int test( const char * modelFile, const char * imgFile )
 		input = newInput;
 	}
 
-	bool ret = network.forward( input, &output );
+	// only the last output is kept, the hidden layers share two buffers
+	GX_InferenceContext ctx( network );
+
+	bool ret = network.forward( input, &ctx );
 
 	if( ! ret ) {
 		printf( "forward fail\n" );
 		return -1;
 	}
 
-	int result = GX_Utils::max_index( std::begin( output.back() ), std::end( output.back() ) );
+	const GX_DataVector & output = ctx.getOutput();
+
+	int result = GX_Utils::max_index( std::begin( output ), std::end( output ) );
 
-	printf( "%s    \t-> %d, nn.output %f\n", imgFile, result, output.back()[ result ] );
+	printf( "%s    \t-> %d, nn.output %f\n", imgFile, result, output[ result ] );
 
 	return result;
 }
 
 void usage( const char * name )
 {
-	printf( "%s --model <model file> --file <mnist file>\n", name );
+	printf( "%s --model <model file> --file <mnist file> [--pool <thread count>]\n", name );
 }
 
 int main( const int argc, char * argv[] )
@@ -92,10 +98,12 @@ int main( const int argc, char * argv[] )
 	static struct option opts[] = {
 		{ "model",   required_argument,  NULL, 1 },
 		{ "file",  required_argument,  NULL, 2 },
+		{ "pool",  required_argument,  NULL, 3 },
 		{ 0, 0, 0, 0}
 	};
 
 	char * model = NULL, * file = NULL;
+	int poolSize = 0;
 
 	int c = 0;
 	while( ( c = getopt_long( argc, argv, "", opts, NULL ) ) != EOF ) {
@@ -106,6 +114,9 @@ int main( const int argc, char * argv[] )
 			case 2:
 				file = optarg;
 				break;
+			case 3:
+				poolSize = atoi( optarg );
+				break;
 			default:
 				usage( argv[ 0 ] );
 				break;
@@ -117,8 +128,12 @@ int main( const int argc, char * argv[] )
 		return 0;
 	}
 
+	GX_ThreadPool::setDefault( poolSize );
+
 	int ret = test( model, file );
 
+	GX_ThreadPool::setDefault( 0 );
+
 	return ret;
 }
 
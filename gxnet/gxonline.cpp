@@ -0,0 +1,382 @@
+
+#include "gxonline.h"
+#include "gxnet.h"
+#include "gxckpt.h"
+#include "gxaugment.h"
+
+#include <climits>
+#include <cmath>
+#include <algorithm>
+
+GX_OnlineTrainer :: GX_OnlineTrainer( GX_Network * network, int miniBatchCount, GX_DataType learningRate,
+		GX_DataType lambda, int trainingCount, size_t queueSamples )
+{
+	mNetwork = network;
+	mMiniBatchCount = std::max( miniBatchCount, 1 );
+	mLearningRate = learningRate;
+	mLambda = lambda;
+
+	mCheckpointer = NULL;
+	mSampleInterval = 0;
+	mSecondInterval = 0;
+
+	const GX_BaseLayerPtrVector & layers = mNetwork->getLayers();
+
+	size_t dim = NULL != mNetwork->mAugmenter ? mNetwork->mAugmenter->getInputSize() : layers[ 0 ]->getInputSize();
+
+	// without a thread one batch is enough, the pusher trains it when it is full
+	mInput = GX_Dataset( std::max( queueSamples, mMiniBatchCount ), dim );
+	mKind = eNoTarget;
+	mHead = mWaiting = 0;
+
+	// 1 - rate * lambda / trainingCount must stay above 0, or every apply flips the weights
+	int minCount = (int)std::min( std::floor( (double)mLearningRate * mLambda ) + 1, (double)INT_MAX );
+
+	mTrainingCount = trainingCount > 0 ? trainingCount : (int)std::min( mInput.size(), (size_t)INT_MAX );
+
+	if( mLambda > 0 && mTrainingCount < minCount ) {
+		if( trainingCount > 0 ) {
+			printf( "%s training count %d, at least %d for lr %g and lambda %g\n", __func__,
+					trainingCount, minCount, (double)mLearningRate, (double)mLambda );
+		}
+		mTrainingCount = minCount;
+	}
+
+	std::vector< bool > checkpoints;
+	mNetwork->getCheckpoints( &checkpoints );
+
+	mPlan.reset( new GX_MemPlan( layers, GX_MemPlan::eTraining, checkpoints ) );
+	mPlan->allocate( &mArena );
+
+	for( size_t i = 0; i < layers.size(); i++ ) {
+		mBatchDelta.emplace_back( GX_DataVector( mPlan->getSize( GX_MemPlan::eBatchDelta, i ) ) );
+	}
+
+	mNetwork->initGradientMatrix( &mBatchGradient, &mGradient );
+
+	if( NULL != mNetwork->mAugmenter ) mAugmented.resize( mNetwork->mAugmenter->getOutputSize() );
+	mNetwork->getGradientBegin( &mGradientBegin );
+
+	mSampleCount = mBatchCount = mCheckpointCount = mUnsaved = 0;
+	mLoss = 0;
+	mSavedTime = Clock_t::now();
+
+	mIsThreaded = queueSamples > 0;
+	mIsTraining = mIsFlush = mIsStop = false;
+
+	if( mIsThreaded ) mThread = std::thread( &GX_OnlineTrainer::run, this );
+}
+
+GX_OnlineTrainer :: ~GX_OnlineTrainer()
+{
+	stop();
+}
+
+void GX_OnlineTrainer :: setCheckpointer( GX_Checkpointer * checkpointer, size_t sampleInterval, double secondInterval )
+{
+	{
+		std::unique_lock< std::mutex > lock( mMutex );
+
+		mCheckpointer = checkpointer;
+		mSampleInterval = sampleInterval;
+		mSecondInterval = secondInterval;
+		mSavedTime = Clock_t::now();
+	}
+
+	mTrainerCond.notify_all();
+}
+
+bool GX_OnlineTrainer :: push( const GX_DataType * input, size_t dim, const GX_DataType * target, size_t targetDim )
+{
+	size_t classes = mNetwork->getLayers().back()->getOutputSize();
+
+	if( targetDim != classes ) {
+		printf( "%s target dim %zu, layer output %zu\n", __func__, targetDim, classes );
+		return false;
+	}
+
+	std::unique_lock< std::mutex > lock( mMutex );
+
+	size_t slot = 0;
+
+	if( ! reserveSlot( dim, eRowTarget, &lock, &slot ) ) return false;
+
+	std::copy( input, input + dim, mInput[ slot ] );
+	std::copy( target, target + targetDim, mRows[ slot ] );
+
+	commitSlot( &lock );
+
+	return true;
+}
+
+bool GX_OnlineTrainer :: push( const GX_DataType * input, size_t dim, uint16_t label )
+{
+	size_t classes = mNetwork->getLayers().back()->getOutputSize();
+
+	if( label >= classes ) {
+		printf( "%s label %d, classes %zu\n", __func__, label, classes );
+		return false;
+	}
+
+	std::unique_lock< std::mutex > lock( mMutex );
+
+	size_t slot = 0;
+
+	if( ! reserveSlot( dim, eLabelTarget, &lock, &slot ) ) return false;
+
+	std::copy( input, input + dim, mInput[ slot ] );
+	mLabels[ slot ] = label;
+
+	commitSlot( &lock );
+
+	return true;
+}
+
+bool GX_OnlineTrainer :: reserveSlot( size_t dim, int kind,
+		std::unique_lock< std::mutex > * lock, size_t * slot )
+{
+	if( mIsStop ) return false;
+
+	if( dim != mInput.getDim() ) {
+		printf( "%s input dim %zu, network input %zu\n", __func__, dim, mInput.getDim() );
+		return false;
+	}
+
+	if( eNoTarget == mKind ) {
+		mKind = kind;
+
+		if( eRowTarget == mKind ) {
+			mRows = GX_Dataset( mInput.size(), mNetwork->getLayers().back()->getOutputSize() );
+		} else {
+			mLabels.assign( mInput.size(), 0 );
+		}
+	}
+
+	if( kind != mKind ) {
+		printf( "%s %s target after %s targets\n", __func__, eRowTarget == kind ? "row" : "label",
+				eRowTarget == mKind ? "row" : "label" );
+		return false;
+	}
+
+	// the slots from mHead are read by the batch being trained until it is applied
+	mPusherCond.wait( *lock, [ this ] { return mWaiting < mInput.size() || mIsStop; } );
+
+	if( mIsStop ) return false;
+
+	*slot = ( mHead + mWaiting ) % mInput.size();
+
+	return true;
+}
+
+void GX_OnlineTrainer :: commitSlot( std::unique_lock< std::mutex > * lock )
+{
+	mWaiting++;
+
+	if( mIsThreaded ) {
+		if( mWaiting >= mMiniBatchCount ) mTrainerCond.notify_one();
+	} else {
+		trainWaiting( false, lock );
+	}
+}
+
+GX_DataType GX_OnlineTrainer :: trainBatch( size_t head, size_t count )
+{
+	for( auto & vec : mBatchGradient ) std::fill( std::begin( vec ), std::end( vec ), 0.0 );
+	for( auto & vec : mBatchDelta ) std::fill( std::begin( vec ), std::end( vec ), 0.0 );
+
+	GX_Network::Targets_t target = { eRowTarget == mKind ? &mRows : NULL, eLabelTarget == mKind ? &mLabels : NULL };
+
+	const GX_Augmenter * augmenter = mNetwork->mAugmenter;
+
+	GX_AccumType loss = 0;
+
+	for( size_t i = 0; i < count; i++ ) {
+		size_t slot = ( head + i ) % mInput.size();
+
+		const GX_DataType * input = mInput[ slot ];
+
+		// there are no epochs, the draws of a sample come from its position in the stream
+		if( NULL != augmenter ) {
+			augmenter->apply( input, 0, mSampleCount + i, std::begin( mAugmented ) );
+			input = std::begin( mAugmented );
+		}
+
+		loss += mNetwork->trainSample( input, target, slot, *mPlan, mGradientBegin,
+				&mArena, &mGradient, &mBatchDelta, &mBatchGradient );
+	}
+
+	mNetwork->apply( mBatchDelta, mBatchGradient, count, mLearningRate, mLambda, mTrainingCount );
+
+	return loss / count;
+}
+
+void GX_OnlineTrainer :: trainWaiting( bool isShort, std::unique_lock< std::mutex > * lock )
+{
+	while( ! mIsTraining && ( mWaiting >= mMiniBatchCount || ( isShort && mWaiting > 0 ) ) ) {
+		size_t head = mHead, count = std::min( mWaiting, mMiniBatchCount );
+
+		mIsTraining = true;
+
+		lock->unlock();
+
+		GX_DataType loss = trainBatch( head, count );
+
+		lock->lock();
+
+		mIsTraining = false;
+
+		mHead = ( head + count ) % mInput.size();
+		mWaiting -= count;
+
+		mSampleCount += count;
+		mBatchCount++;
+		mUnsaved += count;
+		mLoss = loss;
+
+		mPusherCond.notify_all();
+
+		checkpoint( false );
+	}
+}
+
+void GX_OnlineTrainer :: checkpoint( bool isForce )
+{
+	if( NULL == mCheckpointer || 0 == mUnsaved ) return;
+
+	std::chrono::duration< double > span = Clock_t::now() - mSavedTime;
+
+	bool isDue = isForce || ( mSampleInterval > 0 && mUnsaved >= mSampleInterval )
+			|| ( mSecondInterval > 0 && span.count() >= mSecondInterval );
+
+	if( ! isDue ) return;
+
+	// only copies the parameters, the lock keeps a pusher from training meanwhile
+	if( ! mCheckpointer->save( *mNetwork, (int)mCheckpointCount ) ) return;
+
+	printf( "online checkpoint %zu, samples %zu, batches %zu, loss %.8f\n",
+			mCheckpointCount, mSampleCount, mBatchCount, mLoss );
+
+	mCheckpointCount++;
+	mUnsaved = 0;
+	mSavedTime = Clock_t::now();
+}
+
+void GX_OnlineTrainer :: run()
+{
+	std::unique_lock< std::mutex > lock( mMutex );
+
+	for( ; ; ) {
+		bool isDrain = mIsFlush || mIsStop;
+
+		trainWaiting( isDrain, &lock );
+
+		if( isDrain ) {
+			checkpoint( true );
+
+			mIsFlush = false;
+			mPusherCond.notify_all();
+
+			if( mIsStop ) break;
+		}
+
+		checkpoint( false );
+
+		auto isReady = [ this ] { return mWaiting >= mMiniBatchCount || mIsFlush || mIsStop; };
+
+		// wake up for the time interval even when no sample comes
+		if( NULL != mCheckpointer && mSecondInterval > 0 && mUnsaved > 0 ) {
+			Clock_t::time_point deadline = mSavedTime + std::chrono::duration_cast< Clock_t::duration >(
+					std::chrono::duration< double >( mSecondInterval ) );
+			mTrainerCond.wait_until( lock, deadline, isReady );
+		} else {
+			mTrainerCond.wait( lock, isReady );
+		}
+	}
+}
+
+bool GX_OnlineTrainer :: flush()
+{
+	{
+		std::unique_lock< std::mutex > lock( mMutex );
+
+		if( mIsStop ) return true;
+
+		if( mIsThreaded ) {
+			mIsFlush = true;
+			mTrainerCond.notify_one();
+
+			mPusherCond.wait( lock, [ this ] { return ! mIsFlush; } );
+		} else {
+			mPusherCond.wait( lock, [ this ] { return ! mIsTraining; } );
+
+			trainWaiting( true, &lock );
+			checkpoint( true );
+		}
+	}
+
+	return NULL == mCheckpointer || mCheckpointer->flush();
+}
+
+bool GX_OnlineTrainer :: stop()
+{
+	{
+		std::unique_lock< std::mutex > lock( mMutex );
+
+		if( mIsStop ) return true;
+
+		if( ! mIsThreaded ) {
+			mPusherCond.wait( lock, [ this ] { return ! mIsTraining; } );
+
+			trainWaiting( true, &lock );
+			checkpoint( true );
+		}
+
+		// the thread trains what is waiting before it leaves
+		mIsStop = true;
+	}
+
+	mTrainerCond.notify_all();
+	mPusherCond.notify_all();
+
+	if( mThread.joinable() ) mThread.join();
+
+	return NULL == mCheckpointer || mCheckpointer->flush();
+}
+
+size_t GX_OnlineTrainer :: getSampleCount() const
+{
+	std::unique_lock< std::mutex > lock( mMutex );
+
+	return mSampleCount;
+}
+
+size_t GX_OnlineTrainer :: getBatchCount() const
+{
+	std::unique_lock< std::mutex > lock( mMutex );
+
+	return mBatchCount;
+}
+
+size_t GX_OnlineTrainer :: getCheckpointCount() const
+{
+	std::unique_lock< std::mutex > lock( mMutex );
+
+	return mCheckpointCount;
+}
+
+GX_DataType GX_OnlineTrainer :: getLoss() const
+{
+	std::unique_lock< std::mutex > lock( mMutex );
+
+	return mLoss;
+}
+
+size_t GX_OnlineTrainer :: getBytes() const
+{
+	std::unique_lock< std::mutex > lock( mMutex );
+
+	return mInput.getBytes() + mRows.getBytes() + gx_heap_bytes( mLabels.capacity() * sizeof( uint16_t ) )
+			+ gx_matrix_bytes( mArena ) + gx_matrix_bytes( mGradient ) + gx_matrix_bytes( mBatchDelta )
+			+ gx_matrix_bytes( mBatchGradient ) + gx_vector_bytes( mAugmented );
+}
+
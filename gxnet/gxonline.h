@@ -0,0 +1,126 @@
+#pragma once
+
+#include "gxcomm.h"
+#include "gxdataset.h"
+#include "gxplan.h"
+
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <stdint.h>
+
+class GX_Network;
+class GX_Checkpointer;
+
+/*
+* Continual training of a network from samples that arrive one at a time, such as
+* corrections of a deployed model. push queues a sample, a mini-batch is trained
+* and applied as soon as miniBatchCount samples wait, in the order they came, with
+* the same per sample path as GX_Network::train, so there are no epochs and no
+* dataset to keep: the queue is the only copy of the samples.
+*
+* A checkpointer, when set, gets a snapshot once sampleInterval samples or
+* secondInterval seconds were trained since the last one, whichever comes first.
+*/
+class GX_OnlineTrainer {
+public:
+	// network is not owned and must not be trained or changed elsewhere meanwhile. the L2 decay
+	// is spread over trainingCount samples as train spreads it over its dataset, 0 takes the
+	// queue size, and it is raised so every apply keeps a share of each weight. queueSamples 0
+	// trains on the thread that pushes, when a batch fills. more starts a trainer thread, push
+	// returns at once and blocks only while queueSamples samples wait
+	GX_OnlineTrainer( GX_Network * network, int miniBatchCount, GX_DataType learningRate,
+			GX_DataType lambda = 0, int trainingCount = 0, size_t queueSamples = 0 );
+
+	// stop
+	~GX_OnlineTrainer();
+
+	// checkpointer is not owned, 0 turns an interval off. without a trainer thread the time
+	// is only looked at when a batch is applied
+	void setCheckpointer( GX_Checkpointer * checkpointer, size_t sampleInterval, double secondInterval );
+
+	// target as a row of the output size of the last layer
+	bool push( const GX_DataType * input, size_t dim, const GX_DataType * target, size_t targetDim );
+
+	// target as a class index, the first push sets the kind of target for every later one
+	bool push( const GX_DataType * input, size_t dim, uint16_t label );
+
+	// trains the waiting samples, the last batch may be short, checkpoints what was trained
+	// since the last checkpoint and waits for it to be on disk. false if a checkpoint failed
+	// to be written since the last flush
+	bool flush();
+
+	// flush, push fails after it
+	bool stop();
+
+	// samples and mini-batches applied so far
+	size_t getSampleCount() const;
+
+	size_t getBatchCount() const;
+
+	size_t getCheckpointCount() const;
+
+	// mean loss of the last mini-batch
+	GX_DataType getLoss() const;
+
+	// heap bytes of the queue and of the per sample buffers
+	size_t getBytes() const;
+
+private:
+	typedef std::chrono::steady_clock Clock_t;
+
+	// the slot of the next sample, false when stopped or the kind of target changes
+	bool reserveSlot( size_t dim, int kind, std::unique_lock< std::mutex > * lock, size_t * slot );
+
+	// the sample in slot is ready
+	void commitSlot( std::unique_lock< std::mutex > * lock );
+
+	// forward, backward and apply of count samples from slot head, returns the mean loss
+	GX_DataType trainBatch( size_t head, size_t count );
+
+	// trains the waiting samples with the lock held around the bookkeeping only, isShort
+	// takes a last batch of less than miniBatchCount samples too
+	void trainWaiting( bool isShort, std::unique_lock< std::mutex > * lock );
+
+	// with the lock held: a snapshot when an interval has passed, or isForce and anything was trained since the last one
+	void checkpoint( bool isForce );
+
+	void run();
+
+private:
+	enum { eNoTarget = 0, eRowTarget = 1, eLabelTarget = 2 };
+
+	GX_Network * mNetwork;
+	size_t mMiniBatchCount;
+	GX_DataType mLearningRate, mLambda;
+	int mTrainingCount;
+
+	GX_Checkpointer * mCheckpointer;
+	size_t mSampleInterval;
+	double mSecondInterval;
+
+	// a ring of samples from mHead, mWaiting of them ready
+	GX_Dataset mInput, mRows;
+	GX_LabelVector mLabels;
+	int mKind;
+	size_t mHead, mWaiting;
+
+	std::unique_ptr< GX_MemPlan > mPlan;
+	std::vector< size_t > mGradientBegin;
+	GX_DataMatrix mArena, mGradient, mBatchDelta, mBatchGradient;
+	GX_DataVector mAugmented;
+
+	size_t mSampleCount, mBatchCount, mCheckpointCount, mUnsaved;
+	GX_DataType mLoss;
+	Clock_t::time_point mSavedTime;
+
+	bool mIsThreaded, mIsTraining, mIsFlush, mIsStop;
+
+	mutable std::mutex mMutex;
+	std::condition_variable mTrainerCond, mPusherCond;
+	std::thread mThread;
+};
+
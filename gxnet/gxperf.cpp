@@ -0,0 +1,154 @@
+#include "gxperf.h"
+
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+GX_PerfCounters :: GX_PerfCounters()
+{
+	for( int i = 0; i < eCounterCount; i++ ) mFds[ i ] = -1;
+	mCountOfOpened = 0;
+
+	reset();
+}
+
+GX_PerfCounters :: ~GX_PerfCounters()
+{
+	close();
+}
+
+bool GX_PerfCounters :: open()
+{
+	static const uint64_t configs[ eCounterCount ] = {
+		PERF_COUNT_HW_CPU_CYCLES,
+		PERF_COUNT_HW_INSTRUCTIONS,
+		PERF_COUNT_HW_CACHE_MISSES,
+		PERF_COUNT_HW_BRANCH_MISSES,
+		PERF_COUNT_HW_STALLED_CYCLES_FRONTEND,
+		PERF_COUNT_HW_STALLED_CYCLES_BACKEND
+	};
+
+	close();
+
+	for( int i = 0; i < eCounterCount; i++ ) {
+		struct perf_event_attr attr;
+		memset( &attr, 0, sizeof( attr ) );
+
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.size = sizeof( attr );
+		attr.config = configs[ i ];
+		attr.disabled = ( i == eCycles ) ? 1 : 0;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		attr.read_format = PERF_FORMAT_GROUP;
+
+		mFds[ i ] = syscall( __NR_perf_event_open, &attr, 0, -1, mFds[ eCycles ], 0 );
+
+		if( mFds[ i ] < 0 ) {
+			// the leader is required, the others are optional, eg. stalled cycles
+			if( i == eCycles ) {
+				printf( "perf_event_open fail, errno %d, %s, fall back to timing only\n", errno, strerror( errno ) );
+				return false;
+			}
+		} else {
+			mCountOfOpened++;
+		}
+	}
+
+	ioctl( mFds[ eCycles ], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP );
+	ioctl( mFds[ eCycles ], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP );
+
+	return true;
+}
+
+void GX_PerfCounters :: close()
+{
+	for( int i = 0; i < eCounterCount; i++ ) {
+		if( mFds[ i ] >= 0 ) ::close( mFds[ i ] );
+		mFds[ i ] = -1;
+	}
+
+	mCountOfOpened = 0;
+}
+
+bool GX_PerfCounters :: isAvailable() const
+{
+	return mFds[ eCycles ] >= 0;
+}
+
+bool GX_PerfCounters :: read( uint64_t * values ) const
+{
+	// PERF_FORMAT_GROUP: { nr, values[ nr ] } in the order the events were opened
+	uint64_t buff[ 1 + eCounterCount ] = { 0 };
+
+	if( ::read( mFds[ eCycles ], buff, sizeof( buff ) ) <= 0 ) return false;
+
+	for( int i = 0, n = 0; i < eCounterCount; i++ ) {
+		values[ i ] = ( mFds[ i ] >= 0 && n < (int)buff[ 0 ] ) ? buff[ 1 + n++ ] : 0;
+	}
+
+	return true;
+}
+
+void GX_PerfCounters :: start()
+{
+	if( isAvailable() ) read( mBeginValues );
+
+	mBeginTime = std::chrono::steady_clock::now();
+}
+
+void GX_PerfCounters :: stop()
+{
+	std::chrono::nanoseconds span = std::chrono::steady_clock::now() - mBeginTime;
+
+	mCalls++;
+	mNanoseconds += span.count();
+
+	uint64_t endValues[ eCounterCount ] = { 0 };
+
+	if( isAvailable() && read( endValues ) ) {
+		for( int i = 0; i < eCounterCount; i++ ) mValues[ i ] += endValues[ i ] - mBeginValues[ i ];
+	}
+}
+
+void GX_PerfCounters :: reset()
+{
+	memset( mBeginValues, 0, sizeof( mBeginValues ) );
+	memset( mValues, 0, sizeof( mValues ) );
+
+	mCalls = mNanoseconds = 0;
+}
+
+int64_t GX_PerfCounters :: getValue( int counter ) const
+{
+	return mFds[ counter ] >= 0 ? (int64_t)mValues[ counter ] : -1;
+}
+
+int64_t GX_PerfCounters :: getNanoseconds() const
+{
+	return mNanoseconds;
+}
+
+void GX_PerfCounters :: print( const char * tag ) const
+{
+	static const char * names[ eCounterCount ] = {
+		"cycles", "instructions", "cache-misses", "branch-misses", "stalled-frontend", "stalled-backend"
+	};
+
+	printf( "perf %s: calls %ld, time %.6f s", tag, mCalls, mNanoseconds / 1e9 );
+
+	if( isAvailable() ) {
+		for( int i = 0; i < eCounterCount; i++ ) {
+			if( mFds[ i ] >= 0 ) printf( ", %s %lu", names[ i ], mValues[ i ] );
+		}
+
+		if( mValues[ eCycles ] > 0 ) printf( ", IPC %.3f", 1.0 * mValues[ eInstructions ] / mValues[ eCycles ] );
+	}
+
+	printf( "\n" );
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdint.h>
+#include <chrono>
+
+/*
+* A group of hardware counters opened with perf_event_open. When the kernel
+* doesn't permit them, start/stop still measure the elapsed time.
+*/
+class GX_PerfCounters {
+public:
+	enum { eCycles = 0, eInstructions = 1, eCacheMisses = 2, eBranchMisses = 3,
+			eStalledFrontend = 4, eStalledBackend = 5, eCounterCount = 6 };
+
+	GX_PerfCounters();
+	~GX_PerfCounters();
+
+	// open the counter group for the calling thread, false for timing only. the group is read
+	// with PERF_FORMAT_GROUP, which the kernel refuses with inherit, so the threads of the pool,
+	// of hogwild and of the loaders are not counted, only the time covers their work
+	bool open();
+
+	void close();
+
+	bool isAvailable() const;
+
+	void start();
+
+	void stop();
+
+	void reset();
+
+	// -1 if the counter is not supported
+	int64_t getValue( int counter ) const;
+
+	int64_t getNanoseconds() const;
+
+	void print( const char * tag ) const;
+
+private:
+	bool read( uint64_t * values ) const;
+
+private:
+	int mFds[ eCounterCount ];
+	int mCountOfOpened;
+
+	uint64_t mBeginValues[ eCounterCount ], mValues[ eCounterCount ];
+
+	int64_t mCalls, mNanoseconds;
+	std::chrono::steady_clock::time_point mBeginTime;
+};
@@ -0,0 +1,472 @@
+
+#include "gxpipe.h"
+#include "gxnet.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <random>
+#include <numeric>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <memory>
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+typedef std::chrono::steady_clock GX_PipeClock_t;
+
+static double gx_pipe_seconds( const GX_PipeClock_t::time_point & beginTime )
+{
+	std::chrono::duration< double > span = GX_PipeClock_t::now() - beginTime;
+
+	return span.count();
+}
+
+// activations of a micro-batch going forward or its deltas going backward, one vector per sample
+typedef struct tagPipePacket {
+	bool mIsBackward;
+	GX_DataMatrix mData;
+} GX_PipePacket_t;
+
+// blocking queue with a fixed capacity, the inbox of a stage
+class GX_PipeQueue {
+public:
+	GX_PipeQueue( size_t capacity ) : mCapacity( capacity ) {}
+
+	void push( GX_PipePacket_t && packet ) {
+		std::unique_lock< std::mutex > lock( mMutex );
+
+		mNotFull.wait( lock, [ this ] { return mPackets.size() < mCapacity; } );
+
+		mPackets.emplace_back( std::move( packet ) );
+
+		mNotEmpty.notify_one();
+	}
+
+	void pop( GX_PipePacket_t * packet ) {
+		std::unique_lock< std::mutex > lock( mMutex );
+
+		mNotEmpty.wait( lock, [ this ] { return ! mPackets.empty(); } );
+
+		*packet = std::move( mPackets.front() );
+		mPackets.pop_front();
+
+		mNotFull.notify_one();
+	}
+
+private:
+	size_t mCapacity;
+	std::mutex mMutex;
+	std::condition_variable mNotEmpty, mNotFull;
+	std::deque< GX_PipePacket_t > mPackets;
+};
+
+// one micro-batch of the schedule, samples [ mBegin, mEnd ) of the epoch order
+typedef struct tagPipeMicro {
+	int mEpoch;
+	size_t mBatch, mBegin, mEnd;
+	size_t mBatchCount;
+	bool mIsBatchEnd, mIsEpochEnd;
+} GX_PipeMicro_t;
+
+struct GX_Pipeline::Context {
+	const GX_DataMatrix * mInput, * mTarget;
+	GX_DataType mLearningRate, mLambda;
+	GX_DataVector * mLosses;
+
+	std::vector< std::vector< int > > mOrders;
+	std::vector< GX_PipeMicro_t > mMicros;
+	std::vector< std::unique_ptr< GX_PipeQueue > > mInboxes;
+};
+
+// stage input and layer outputs of every sample of a micro-batch in flight
+typedef struct tagPipeInFlight {
+	std::vector< const GX_DataVector * > mInputs;
+	GX_DataMatrix mReceived;
+	std::vector< GX_DataMatrix > mOutputs;
+} GX_PipeInFlight_t;
+
+GX_Pipeline :: GX_Pipeline( GX_Network * network, const std::vector< size_t > & splits, int schedule )
+	: mNetwork( network ), mSplits( splits ), mSchedule( schedule )
+{
+}
+
+GX_Pipeline :: ~GX_Pipeline()
+{
+}
+
+const std::vector< GX_StageStats_t > & GX_Pipeline :: getStageStats() const
+{
+	return mStats;
+}
+
+int GX_Pipeline :: getSchedule( const char * name )
+{
+	if( 0 == strcmp( name, "gpipe" ) ) return eGPipe;
+	if( 0 == strcmp( name, "1f1b" ) ) return e1F1B;
+
+	return -1;
+}
+
+static double gx_layer_flops( const GX_BaseLayer * layer )
+{
+	double ret = 0;
+
+	for( int phase = GX_BaseLayer::eCalcOutput; phase <= GX_BaseLayer::eCollectGradient; phase++ ) {
+		GX_LayerCost_t cost;
+		layer->getCost( phase, &cost );
+		ret += cost.mFlops;
+	}
+
+	return ret;
+}
+
+void GX_Pipeline :: balance( const GX_Network & network, int stageCount, std::vector< size_t > * splits )
+{
+	const GX_BaseLayerPtrVector & layers = network.getLayers();
+
+	stageCount = std::max( 1, std::min( stageCount, (int)layers.size() ) );
+
+	std::vector< double > prefix( layers.size() + 1, 0 );
+	for( size_t i = 0; i < layers.size(); i++ ) prefix[ i + 1 ] = prefix[ i ] + gx_layer_flops( layers[ i ] );
+
+	// cost[ k ][ i ]: smallest busiest stage when the first i layers form k + 1 stages
+	std::vector< std::vector< double > > cost( stageCount, std::vector< double >( layers.size() + 1, HUGE_VAL ) );
+	std::vector< std::vector< size_t > > from( stageCount, std::vector< size_t >( layers.size() + 1, 0 ) );
+
+	for( size_t i = 1; i <= layers.size(); i++ ) cost[ 0 ][ i ] = prefix[ i ];
+
+	for( int k = 1; k < stageCount; k++ ) {
+		for( size_t i = k + 1; i <= layers.size(); i++ ) {
+			for( size_t j = k; j < i; j++ ) {
+				double busiest = std::max( cost[ k - 1 ][ j ], prefix[ i ] - prefix[ j ] );
+				if( busiest < cost[ k ][ i ] ) {
+					cost[ k ][ i ] = busiest;
+					from[ k ][ i ] = j;
+				}
+			}
+		}
+	}
+
+	splits->assign( stageCount - 1, 0 );
+
+	for( size_t k = stageCount - 1, i = layers.size(); k > 0; k-- ) {
+		i = from[ k ][ i ];
+		( *splits )[ k - 1 ] = i;
+	}
+}
+
+void GX_Pipeline :: printStageStats() const
+{
+	double maxBusy = 0, totalBusy = 0;
+
+	printf( "pipeline %zu stages, %s:\n", mStats.size(), eGPipe == mSchedule ? "gpipe" : "1f1b" );
+
+	for( size_t i = 0; i < mStats.size(); i++ ) {
+		const GX_StageStats_t & stats = mStats[ i ];
+
+		printf( "\tstage %zu, layers [ %zu, %zu ), %.1f kflops per sample, busy %.3f s, wait %.3f s\n",
+				i, stats.mBeginLayer, stats.mEndLayer, stats.mFlops / 1000,
+				stats.mBusySeconds, stats.mWaitSeconds );
+
+		maxBusy = std::max( maxBusy, stats.mBusySeconds );
+		totalBusy += stats.mBusySeconds;
+	}
+
+	// the busiest stage sets the pace, 1.00 is a perfect split
+	printf( "\timbalance %.2f, max busy over mean busy\n",
+			totalBusy > 0 ? maxBusy * mStats.size() / totalBusy : 0 );
+}
+
+bool GX_Pipeline :: train( const GX_DataMatrix & input, const GX_DataMatrix & target, int epochCount,
+		int miniBatchCount, int microBatchCount, GX_DataType learningRate, GX_DataType lambda,
+		GX_DataVector * losses )
+{
+	const GX_BaseLayerPtrVector & layers = mNetwork->getLayers();
+
+	if( input.size() != target.size() || input.empty() || layers.empty() ) return false;
+
+	for( size_t i = 0; i < mSplits.size(); i++ ) {
+		if( mSplits[ i ] == 0 || mSplits[ i ] >= layers.size() || ( i > 0 && mSplits[ i ] <= mSplits[ i - 1 ] ) ) {
+			printf( "%s invalid split #%zu %zu, layers %zu\n", __func__, i, mSplits[ i ], layers.size() );
+			return false;
+		}
+	}
+
+	assert( layers[ 0 ]->getInputSize() == input[ 0 ].size() );
+
+	std::chrono::steady_clock::time_point beginTime = std::chrono::steady_clock::now();
+
+	time_t beginClock = time( NULL );
+
+	printf( "%s\tstart pipeline train, input { %zu }, target { %zu }, stages %zu\n",
+			ctime( &beginClock ), input.size(), target.size(), mSplits.size() + 1 );
+
+	mStats.clear();
+
+	for( size_t i = 0; i <= mSplits.size(); i++ ) {
+		GX_StageStats_t stats;
+		memset( &stats, 0, sizeof( stats ) );
+
+		stats.mBeginLayer = 0 == i ? 0 : mSplits[ i - 1 ];
+		stats.mEndLayer = mSplits.size() == i ? layers.size() : mSplits[ i ];
+
+		for( size_t l = stats.mBeginLayer; l < stats.mEndLayer; l++ ) stats.mFlops += gx_layer_flops( layers[ l ] );
+
+		mStats.emplace_back( stats );
+	}
+
+	miniBatchCount = std::max( miniBatchCount, 1 );
+	microBatchCount = std::max( 1, std::min( microBatchCount, miniBatchCount ) );
+
+	Context ctx;
+	ctx.mInput = &input;
+	ctx.mTarget = &target;
+	ctx.mLearningRate = learningRate;
+	ctx.mLambda = lambda;
+	ctx.mLosses = losses;
+
+	if( NULL != losses ) losses->resize( epochCount, 0 );
+
+	// the sample order of every epoch and the micro-batches cut from it, known to all stages up front
+	std::random_device rd;
+	std::mt19937 gen( rd() );
+
+	size_t batch = 0;
+
+	for( int n = 0; n < epochCount; n++ ) {
+		ctx.mOrders.emplace_back( std::vector< int >( input.size() ) );
+		std::iota( ctx.mOrders.back().begin(), ctx.mOrders.back().end(), 0 );
+		if( mNetwork->mIsShuffle ) std::shuffle( ctx.mOrders.back().begin(), ctx.mOrders.back().end(), gen );
+
+		for( size_t begin = 0; begin < input.size(); begin += miniBatchCount, batch++ ) {
+			size_t end = std::min( input.size(), begin + miniBatchCount );
+
+			for( size_t micro = begin; micro < end; micro += microBatchCount ) {
+				GX_PipeMicro_t item = { n, batch, micro, std::min( end, micro + microBatchCount ), end - begin,
+						micro + microBatchCount >= end, micro + microBatchCount >= input.size() };
+				ctx.mMicros.emplace_back( item );
+			}
+		}
+	}
+
+	// nothing is ever pushed into a full inbox: a stage holds at most its in-flight limit of
+	// micro-batches, so forwards from the previous stage plus deltas from the next one fit
+	size_t limit = eGPipe == mSchedule ? ( miniBatchCount + microBatchCount - 1 ) / microBatchCount : mStats.size();
+
+	for( size_t i = 0; i < mStats.size(); i++ ) ctx.mInboxes.emplace_back( new GX_PipeQueue( 2 * limit + 2 ) );
+
+	std::vector< std::thread > threads;
+
+	for( size_t i = 0; i < mStats.size(); i++ ) threads.emplace_back( &GX_Pipeline::runStage, this, i, &ctx );
+
+	for( auto & item : threads ) item.join();
+
+	std::chrono::duration< double > span = std::chrono::steady_clock::now() - beginTime;
+
+	printf( "Elapsed time: %.3f\n", span.count() );
+
+	return true;
+}
+
+void GX_Pipeline :: runStage( size_t index, Context * ctx )
+{
+	GX_StageStats_t & stats = mStats[ index ];
+
+	const GX_BaseLayerPtrVector & layers = mNetwork->getLayers();
+
+	size_t layerBegin = stats.mBeginLayer, layerCount = stats.mEndLayer - stats.mBeginLayer;
+	bool isFirst = 0 == index, isLast = mStats.size() - 1 == index;
+
+	GX_DataMatrix batchGradient, gradient, batchDelta, delta;
+
+	for( size_t k = 0; k < layerCount; k++ ) {
+		layers[ layerBegin + k ]->initGradientMatrix( &gradient );
+		layers[ layerBegin + k ]->initGradientMatrix( &batchGradient );
+
+		delta.emplace_back( GX_DataVector( layers[ layerBegin + k ]->getOutputSize() ) );
+		batchDelta.emplace_back( GX_DataVector( layers[ layerBegin + k ]->getOutputSize() ) );
+	}
+
+	size_t limit = eGPipe == mSchedule ? SIZE_MAX : mStats.size() - index;
+
+	// in flight in forward order, the spent ones are kept for their buffers
+	std::deque< GX_PipeInFlight_t > inFlight, spent;
+	std::deque< GX_PipePacket_t > forwards, backwards;
+
+	size_t nextForward = 0, doneBackward = 0, total = ctx->mMicros.size();
+
+	GX_AccumType epochLoss = 0;
+
+	while( doneBackward < total ) {
+		// a stage applies its gradients before it forwards the next mini-batch
+		bool canForward = nextForward < total && inFlight.size() < limit
+				&& ctx->mMicros[ nextForward ].mBatch == ctx->mMicros[ doneBackward ].mBatch
+				&& ( isFirst || ! forwards.empty() );
+
+		bool canBackward = ! isLast && ! backwards.empty();
+
+		if( ! canForward && ! canBackward ) {
+			GX_PipeClock_t::time_point waitTime = GX_PipeClock_t::now();
+
+			GX_PipePacket_t packet;
+			ctx->mInboxes[ index ]->pop( &packet );
+
+			( packet.mIsBackward ? backwards : forwards ).emplace_back( std::move( packet ) );
+
+			stats.mWaitSeconds += gx_pipe_seconds( waitTime );
+			continue;
+		}
+
+		GX_PipeClock_t::time_point busyTime = GX_PipeClock_t::now();
+
+		bool isForward = canForward && ( eGPipe == mSchedule || ! canBackward );
+
+		if( isForward ) {
+			const GX_PipeMicro_t & micro = ctx->mMicros[ nextForward++ ];
+			const std::vector< int > & order = ctx->mOrders[ micro.mEpoch ];
+
+			size_t sampleCount = micro.mEnd - micro.mBegin;
+
+			if( spent.empty() ) {
+				inFlight.emplace_back();
+			} else {
+				inFlight.emplace_back( std::move( spent.front() ) );
+				spent.pop_front();
+			}
+
+			GX_PipeInFlight_t & item = inFlight.back();
+
+			if( isFirst ) {
+				item.mInputs.resize( sampleCount );
+				for( size_t j = 0; j < sampleCount; j++ ) item.mInputs[ j ] = &( ( *ctx->mInput )[ order[ micro.mBegin + j ] ] );
+			} else {
+				item.mReceived = std::move( forwards.front().mData );
+				forwards.pop_front();
+
+				item.mInputs.resize( sampleCount );
+				for( size_t j = 0; j < sampleCount; j++ ) item.mInputs[ j ] = &( item.mReceived[ j ] );
+			}
+
+			if( item.mOutputs.size() < sampleCount ) item.mOutputs.resize( sampleCount );
+
+			for( size_t j = 0; j < sampleCount; j++ ) {
+				GX_DataMatrix & outputs = item.mOutputs[ j ];
+
+				if( outputs.size() != layerCount ) {
+					outputs.clear();
+					for( size_t k = 0; k < layerCount; k++ ) {
+						outputs.emplace_back( GX_DataVector( layers[ layerBegin + k ]->getOutputSize() ) );
+					}
+				}
+
+				const GX_DataVector * currInput = item.mInputs[ j ];
+
+				for( size_t k = 0; k < layerCount; k++ ) {
+					layers[ layerBegin + k ]->forward( *currInput, &( outputs[ k ] ) );
+					currInput = &( outputs[ k ] );
+				}
+			}
+
+			if( ! isLast ) {
+				GX_PipePacket_t packet;
+				packet.mIsBackward = false;
+				for( size_t j = 0; j < sampleCount; j++ ) packet.mData.emplace_back( item.mOutputs[ j ].back() );
+
+				stats.mBusySeconds += gx_pipe_seconds( busyTime );
+
+				GX_PipeClock_t::time_point waitTime = GX_PipeClock_t::now();
+				ctx->mInboxes[ index + 1 ]->push( std::move( packet ) );
+				stats.mWaitSeconds += gx_pipe_seconds( waitTime );
+
+				continue;
+			}
+		}
+
+		// the last stage turns every forward into a backward right away
+		const GX_PipeMicro_t & micro = ctx->mMicros[ doneBackward++ ];
+		const std::vector< int > & order = ctx->mOrders[ micro.mEpoch ];
+
+		size_t sampleCount = micro.mEnd - micro.mBegin;
+
+		GX_PipeInFlight_t & item = inFlight.front();
+
+		GX_PipePacket_t packet;
+		packet.mIsBackward = true;
+		if( ! isFirst ) {
+			for( size_t j = 0; j < sampleCount; j++ ) packet.mData.emplace_back( GX_DataVector( layers[ layerBegin ]->getInputSize() ) );
+		}
+
+		for( size_t j = 0; j < sampleCount; j++ ) {
+			const GX_DataMatrix & outputs = item.mOutputs[ j ];
+
+			if( isLast ) {
+				const GX_DataVector & currTarget = ( *ctx->mTarget )[ order[ micro.mBegin + j ] ];
+
+				mNetwork->calcLossDelta( std::begin( currTarget ), std::begin( outputs.back() ), std::begin( delta.back() ) );
+
+				epochLoss += mNetwork->calcLoss( std::begin( currTarget ), std::begin( outputs.back() ) );
+			} else {
+				delta.back() = backwards.front().mData[ j ];
+			}
+
+			for( ssize_t k = (ssize_t)layerCount - 1; k >= 0; k-- ) {
+				GX_DataVector * inDelta = k > 0 ? &( delta[ k - 1 ] ) : ( isFirst ? NULL : &( packet.mData[ j ] ) );
+				const GX_DataVector & currInput = k > 0 ? outputs[ k - 1 ] : *( item.mInputs[ j ] );
+
+				layers[ layerBegin + k ]->backward( currInput, outputs[ k ], &( delta[ k ] ), inDelta );
+			}
+
+			GX_DataMatrix::iterator iter = gradient.begin();
+
+			for( size_t k = 0; k < layerCount; k++ ) {
+				const GX_DataVector & currInput = k > 0 ? outputs[ k - 1 ] : *( item.mInputs[ j ] );
+
+				layers[ layerBegin + k ]->collectGradient( currInput, outputs[ k ], delta[ k ], &iter );
+			}
+
+			gx_add_matrix( &batchDelta, delta );
+			gx_add_matrix( &batchGradient, gradient );
+		}
+
+		if( ! isLast ) backwards.pop_front();
+
+		spent.emplace_back( std::move( inFlight.front() ) );
+		inFlight.pop_front();
+
+		if( micro.mIsBatchEnd ) {
+			GX_DataMatrix::const_iterator iter = batchGradient.begin();
+
+			for( size_t k = 0; k < layerCount; k++ ) {
+				layers[ layerBegin + k ]->applyGradient( batchDelta[ k ], &iter, micro.mBatchCount,
+						ctx->mLearningRate, ctx->mLambda, ctx->mInput->size() );
+			}
+
+			for( auto & vec : batchGradient ) std::fill( std::begin( vec ), std::end( vec ), 0.0 );
+			for( auto & vec : batchDelta ) std::fill( std::begin( vec ), std::end( vec ), 0.0 );
+		}
+
+		if( isLast && micro.mIsEpochEnd ) {
+			if( NULL != ctx->mLosses ) ( *ctx->mLosses )[ micro.mEpoch ] = epochLoss / ctx->mInput->size();
+
+			time_t currTime = time( NULL );
+			printf( "%s\tpipeline epoch %d, lr %f, loss %.8f\n", ctime( &currTime ), micro.mEpoch,
+					ctx->mLearningRate, epochLoss / ctx->mInput->size() );
+
+			epochLoss = 0;
+		}
+
+		stats.mBusySeconds += gx_pipe_seconds( busyTime );
+
+		if( ! isFirst ) {
+			GX_PipeClock_t::time_point waitTime = GX_PipeClock_t::now();
+			ctx->mInboxes[ index - 1 ]->push( std::move( packet ) );
+			stats.mWaitSeconds += gx_pipe_seconds( waitTime );
+		}
+	}
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "gxcomm.h"
+
+#include <vector>
+
+class GX_Network;
+
+// time one stage spent on its layers and waiting for its neighbours
+typedef struct tagStageStats {
+	size_t mBeginLayer, mEndLayer;
+	double mFlops;
+	double mBusySeconds;
+	double mWaitSeconds;
+} GX_StageStats_t;
+
+/*
+* Pipeline-parallel training. Consecutive layers form a stage, every stage runs
+* on its own thread and only touches its own weights. A mini-batch is cut into
+* micro-batches, activations flow to the next stage and deltas back to the
+* previous one through bounded queues. The stages apply their gradients when
+* the last micro-batch of the mini-batch came back, the GPipe flush, so the
+* result is the same as train with the same sample order.
+*
+* eGPipe forwards all micro-batches of a mini-batch before the first backward,
+* e1F1B lets stage s hold at most stageCount - s micro-batches in flight and
+* runs a backward as soon as one is ready, which bounds the stored activations.
+*/
+class GX_Pipeline {
+public:
+	enum { eGPipe = 0, e1F1B = 1 };
+
+	// splits holds the first layer of every stage but the first one, in increasing order
+	GX_Pipeline( GX_Network * network, const std::vector< size_t > & splits, int schedule = e1F1B );
+	~GX_Pipeline();
+
+	bool train( const GX_DataMatrix & input, const GX_DataMatrix & target, int epochCount,
+			int miniBatchCount, int microBatchCount, GX_DataType learningRate, GX_DataType lambda = 0,
+			GX_DataVector * losses = nullptr );
+
+	const std::vector< GX_StageStats_t > & getStageStats() const;
+
+	// busy seconds and flops per stage, and the busiest stage over the mean one
+	void printStageStats() const;
+
+public:
+
+	// split points with the least flops per sample on the busiest stage
+	static void balance( const GX_Network & network, int stageCount, std::vector< size_t > * splits );
+
+	// "gpipe" or "1f1b", -1 for an unknown name
+	static int getSchedule( const char * name );
+
+private:
+	struct Context;
+
+	void runStage( size_t index, Context * ctx );
+
+private:
+	GX_Network * mNetwork;
+	std::vector< size_t > mSplits;
+	int mSchedule;
+	std::vector< GX_StageStats_t > mStats;
+};
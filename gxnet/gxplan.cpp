@@ -0,0 +1,260 @@
+
+#include "gxplan.h"
+
+#include <cstdio>
+#include <algorithm>
+
+static size_t vectorBytes( size_t count )
+{
+	return count > 0 ? sizeof( GX_DataVector ) + gx_heap_bytes( count * sizeof( GX_DataType ) ) : 0;
+}
+
+GX_MemPlan :: GX_MemPlan( const GX_BaseLayerPtrVector & layers, int mode, const std::vector< bool > & checkpoints )
+{
+	mMode = mode;
+	mLayerCount = layers.size();
+
+	Buffer_t none = { 0, 0, 0, -1 };
+	mBuffers.resize( mLayerCount * eKindCount, none );
+
+	int n = (int)mLayerCount;
+
+	mCheckpoints.assign( n, true );
+	if( eTraining == mMode && checkpoints.size() == mLayerCount ) mCheckpoints = checkpoints;
+	if( n > 0 ) mCheckpoints[ n - 1 ] = true;
+
+	if( eInference == mMode ) {
+		mStepCount = n;
+
+		// the output of layer i is read by layer i + 1, the last one is the result
+		for( int i = 0; i < n; i++ ) setLifetime( eOutput, i, layers[ i ]->getOutputSize(), i, i + 1 );
+	} else {
+		// forward of layer i runs in step i, then every segment recomputes and runs its backwards
+		std::vector< int > recomputeStep( n, 0 ), backwardStep( n, 0 );
+
+		int step = n;
+
+		for( int end = n - 1; end >= 0; ) {
+			int begin = end;
+			while( begin > 0 && ! mCheckpoints[ begin - 1 ] ) begin--;
+
+			for( int i = begin; i < end; i++ ) recomputeStep[ i ] = step++;
+			for( int i = end; i >= begin; i-- ) backwardStep[ i ] = step++;
+
+			end = begin - 1;
+		}
+
+		mStepCount = step;
+
+		for( int i = 0; i < n; i++ ) {
+			size_t size = layers[ i ]->getOutputSize();
+
+			// backward of layer i is the last one reading its output, the forward of layer i + 1
+			// is the last one reading an output that is not kept
+			if( mCheckpoints[ i ] ) {
+				setLifetime( eOutput, i, size, i, backwardStep[ i ] );
+			} else {
+				setLifetime( eOutput, i, size, i, i + 1 );
+				setLifetime( eRecompute, i, size, recomputeStep[ i ], backwardStep[ i ] );
+			}
+
+			// delta[ i ] is written by the backward of layer i + 1, or by the loss for the last layer
+			setLifetime( eDelta, i, size, i == n - 1 ? backwardStep[ i ] : backwardStep[ i + 1 ], backwardStep[ i ] );
+
+			// summed over the mini-batch, but only applyGradient of a layer with weights reads it
+			if( layers[ i ]->getParamCount() > 0 ) setLifetime( eBatchDelta, i, size, 0, mStepCount );
+		}
+	}
+
+	assignSlots();
+}
+
+GX_MemPlan :: ~GX_MemPlan()
+{
+}
+
+void GX_MemPlan :: setLifetime( int kind, size_t layerIndex, size_t size, int begin, int end )
+{
+	Buffer_t & buffer = mBuffers[ layerIndex * eKindCount + kind ];
+
+	buffer.mSize = size;
+	buffer.mBegin = begin;
+	buffer.mEnd = end;
+}
+
+void GX_MemPlan :: assignSlots()
+{
+	std::vector< size_t > order;
+
+	for( size_t i = 0; i < mBuffers.size(); i++ ) {
+		if( mBuffers[ i ].mSize > 0 && mBuffers[ i ].mEnd < mStepCount ) order.emplace_back( i );
+	}
+
+	// in step order, the larger buffer first when two begin together
+	std::stable_sort( order.begin(), order.end(), [ this ]( size_t x, size_t y ) {
+		const Buffer_t & a = mBuffers[ x ], & b = mBuffers[ y ];
+		return a.mBegin != b.mBegin ? a.mBegin < b.mBegin : a.mSize > b.mSize;
+	} );
+
+	std::vector< int > slotEnds;
+
+	for( auto & index : order ) {
+		Buffer_t & buffer = mBuffers[ index ];
+
+		// among the slots free in this step, the one that grows least, then the one wasting least
+		int best = -1;
+		size_t bestGrowth = 0, bestWaste = 0;
+
+		for( size_t i = 0; i < mSlotSizes.size(); i++ ) {
+			if( slotEnds[ i ] >= buffer.mBegin ) continue;
+
+			size_t size = std::max( mSlotSizes[ i ], buffer.mSize );
+			size_t growth = size - mSlotSizes[ i ], waste = size - buffer.mSize;
+
+			if( best < 0 || growth < bestGrowth || ( growth == bestGrowth && waste < bestWaste ) ) {
+				best = i;
+				bestGrowth = growth;
+				bestWaste = waste;
+			}
+		}
+
+		if( best < 0 ) {
+			best = mSlotSizes.size();
+			mSlotSizes.emplace_back( 0 );
+			mSlotOwners.emplace_back( index );
+			slotEnds.emplace_back( 0 );
+		}
+
+		buffer.mSlot = best;
+		mSlotSizes[ best ] = std::max( mSlotSizes[ best ], buffer.mSize );
+		slotEnds[ best ] = buffer.mEnd;
+	}
+}
+
+int GX_MemPlan :: getMode() const
+{
+	return mMode;
+}
+
+bool GX_MemPlan :: isCheckpoint( size_t layerIndex ) const
+{
+	return mCheckpoints[ layerIndex ];
+}
+
+size_t GX_MemPlan :: getRecomputeCount() const
+{
+	size_t ret = 0;
+	for( size_t i = 0; i < mLayerCount; i++ ) ret += getSize( eRecompute, i ) > 0 ? 1 : 0;
+
+	return ret;
+}
+
+size_t GX_MemPlan :: getSize( int kind, size_t layerIndex ) const
+{
+	return mBuffers[ layerIndex * eKindCount + kind ].mSize;
+}
+
+int GX_MemPlan :: getSlot( int kind, size_t layerIndex ) const
+{
+	return mBuffers[ layerIndex * eKindCount + kind ].mSlot;
+}
+
+size_t GX_MemPlan :: getSlotCount() const
+{
+	return mSlotSizes.size();
+}
+
+size_t GX_MemPlan :: getSlotSize( size_t slot ) const
+{
+	return mSlotSizes[ slot ];
+}
+
+void GX_MemPlan :: allocate( GX_DataMatrix * arena ) const
+{
+	arena->clear();
+
+	for( auto & size : mSlotSizes ) arena->emplace_back( GX_DataVector( size ) );
+}
+
+GX_DataType * GX_MemPlan :: getBuffer( GX_DataMatrix * arena, int kind, size_t layerIndex ) const
+{
+	int slot = getSlot( kind, layerIndex );
+
+	return slot >= 0 ? std::begin( ( *arena )[ slot ] ) : NULL;
+}
+
+size_t GX_MemPlan :: getBufferBytes( int kind, size_t layerIndex ) const
+{
+	size_t index = layerIndex * eKindCount + kind;
+	const Buffer_t & buffer = mBuffers[ index ];
+
+	if( buffer.mSlot < 0 ) return vectorBytes( buffer.mSize );
+
+	return mSlotOwners[ buffer.mSlot ] == index ? vectorBytes( mSlotSizes[ buffer.mSlot ] ) : 0;
+}
+
+size_t GX_MemPlan :: getPlannedBytes() const
+{
+	size_t ret = 0;
+
+	for( auto & size : mSlotSizes ) ret += vectorBytes( size );
+
+	for( auto & buffer : mBuffers ) {
+		if( buffer.mSlot < 0 ) ret += vectorBytes( buffer.mSize );
+	}
+
+	return ret;
+}
+
+size_t GX_MemPlan :: getNaiveBytes() const
+{
+	size_t ret = 0;
+
+	// every layer holds an output, training adds a delta and a batchDelta of the same size
+	for( size_t i = 0; i < mLayerCount; i++ ) {
+		ret += ( eInference == mMode ? 1 : 3 ) * vectorBytes( getSize( eOutput, i ) );
+	}
+
+	return ret;
+}
+
+void GX_MemPlan :: print( const char * tag ) const
+{
+	static const char * KIND_NAMES[] = { "Output", "Delta", "BatchDelta", "Recompute" };
+
+	auto toKB = []( size_t bytes ) { return bytes / 1024.0; };
+
+	printf( "{{{ memory plan %s, %s, KB\n", tag, eInference == mMode ? "inference" : "training" );
+	printf( "%-8s", "Layer" );
+	for( int j = 0; j < eKindCount; j++ ) printf( " %10s %6s", KIND_NAMES[ j ], "Slot" );
+	printf( "\n" );
+
+	for( size_t i = 0; i < mLayerCount; i++ ) {
+		printf( "#%-7zu", i );
+
+		for( int j = 0; j < eKindCount; j++ ) {
+			size_t size = getSize( j, i );
+			int slot = getSlot( j, i );
+
+			printf( " %10.1f", toKB( size * sizeof( GX_DataType ) ) );
+
+			if( slot >= 0 ) {
+				printf( " %6d", slot );
+			} else {
+				printf( " %6s", size > 0 ? "own" : "-" );
+			}
+		}
+		printf( "\n" );
+	}
+
+	for( size_t i = 0; i < mSlotSizes.size(); i++ ) {
+		printf( "slot#%-3zu %10.1f\n", i, toKB( mSlotSizes[ i ] * sizeof( GX_DataType ) ) );
+	}
+
+	size_t planned = getPlannedBytes(), naive = getNaiveBytes();
+
+	printf( "planned %.1f, naive %.1f, saved %.1f%%, recomputed layers %zu\n", toKB( planned ), toKB( naive ),
+			naive > 0 ? 100.0 * ( naive - std::min( planned, naive ) ) / naive : 0.0, getRecomputeCount() );
+	printf( "}}}\n" );
+}
+
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "gxlayer.h"
+
+#include <vector>
+
+/*
+* Activation memory planner. The output, delta and batchDelta vectors of one
+* sample are buffers with a lifetime in steps. In inference step i is the
+* forward of layer i. In training steps 0 .. n - 1 are the forwards, steps
+* n .. 2n - 1 the backwards of layer n - 1 down to 0, each followed by the
+* collectGradient of the same layer, so delta[ i ] dies in the step it is
+* collected. Buffers that outlive a sample, the inference result and the
+* batch sums, keep their own vector. The others go to arena slots, first fit
+* in step order, and buffers whose lifetimes do not overlap share a slot:
+* inference needs two ping-pong slots, training reuses the slots of the
+* outputs that backward is done with for the deltas, and drops batchDelta
+* for layers without weights.
+*
+* With checkpoints, training forward keeps only the outputs of the checkpoint
+* layers and of the last one, the others die as soon as the next layer has read
+* them. Backward walks the segments between checkpoints from the top, each one
+* first recomputes its outputs from the checkpoint below it into eRecompute
+* buffers, then runs the backward of its layers.
+*/
+class GX_MemPlan {
+public:
+	enum { eInference = 0, eTraining = 1 };
+
+	enum { eOutput = 0, eDelta = 1, eBatchDelta = 2, eRecompute = 3, eKindCount = 4 };
+
+	// checkpoints holds one flag per layer, empty keeps every output
+	GX_MemPlan( const GX_BaseLayerPtrVector & layers, int mode,
+			const std::vector< bool > & checkpoints = std::vector< bool >() );
+	~GX_MemPlan();
+
+	int getMode() const;
+
+	// the output of the layer is kept from forward to its backward, true for every layer without checkpoints
+	bool isCheckpoint( size_t layerIndex ) const;
+
+	// layers run twice per training sample
+	size_t getRecomputeCount() const;
+
+	// items of the buffer, 0 when the mode does not need it
+	size_t getSize( int kind, size_t layerIndex ) const;
+
+	// arena slot of the buffer, -1 when it keeps its own vector or is not needed
+	int getSlot( int kind, size_t layerIndex ) const;
+
+	size_t getSlotCount() const;
+
+	// items of the slot, the largest buffer assigned to it
+	size_t getSlotSize( size_t slot ) const;
+
+	// one vector per slot
+	void allocate( GX_DataMatrix * arena ) const;
+
+	// the buffer in an arena from allocate, NULL when it has no slot
+	GX_DataType * getBuffer( GX_DataMatrix * arena, int kind, size_t layerIndex ) const;
+
+	// bytes of its own vector, or of the whole slot for the buffer that opened it and 0 for
+	// the others sharing it, so the buffers add up to getPlannedBytes
+	size_t getBufferBytes( int kind, size_t layerIndex ) const;
+
+	// bytes of the slots and own vectors, and of one vector per layer and kind as without a plan
+	size_t getPlannedBytes() const;
+
+	size_t getNaiveBytes() const;
+
+	void print( const char * tag ) const;
+
+private:
+	typedef struct tagBuffer {
+		size_t mSize;
+		int mBegin, mEnd;
+		int mSlot;
+	} Buffer_t;
+
+	// first and last step that use the buffer, end past the last step for a buffer that outlives it
+	void setLifetime( int kind, size_t layerIndex, size_t size, int begin, int end );
+
+	void assignSlots();
+
+private:
+	int mMode, mStepCount;
+	size_t mLayerCount;
+	std::vector< bool > mCheckpoints;
+	std::vector< Buffer_t > mBuffers;
+	std::vector< size_t > mSlotSizes, mSlotOwners;
+};
+
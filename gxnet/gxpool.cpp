@@ -0,0 +1,225 @@
+
+#include "gxpool.h"
+
+#include <algorithm>
+
+// queue index of the current thread in its pool, the caller threads have none
+static thread_local const GX_ThreadPool * tlsPool = NULL;
+static thread_local size_t tlsIndex = 0;
+
+GX_ThreadPool * GX_ThreadPool :: sDefault = NULL;
+
+GX_ThreadPool :: GX_ThreadPool( int threadCount )
+	: mQueuedCount( 0 ), mIsStop( false )
+{
+	threadCount = std::max( threadCount, 1 );
+
+	for( int i = 0; i < threadCount; i++ ) {
+		mQueues.emplace_back( new Queue_t() );
+		mQueues.back()->mJobs.resize( 16 );
+		mQueues.back()->mHead = mQueues.back()->mCount = 0;
+	}
+
+	for( int i = 0; i < threadCount; i++ ) mThreads.emplace_back( &GX_ThreadPool::run, this, i );
+}
+
+GX_ThreadPool :: ~GX_ThreadPool()
+{
+	{
+		std::unique_lock< std::mutex > lock( mMutex );
+		mIsStop = true;
+	}
+
+	mCond.notify_all();
+
+	for( auto & item : mThreads ) item.join();
+}
+
+int GX_ThreadPool :: getThreadCount() const
+{
+	return mThreads.size();
+}
+
+GX_ThreadPool * GX_ThreadPool :: getDefault()
+{
+	return sDefault;
+}
+
+void GX_ThreadPool :: setDefault( int threadCount )
+{
+	if( NULL != sDefault ) delete sDefault;
+
+	sDefault = threadCount > 0 ? new GX_ThreadPool( threadCount ) : NULL;
+}
+
+void GX_ThreadPool :: restartAfterFork()
+{
+	// the inherited pool can not be destroyed, its threads do not exist here and its locks
+	// may have been held at fork time, so it is left behind
+	if( NULL != sDefault ) sDefault = new GX_ThreadPool( sDefault->getThreadCount() );
+}
+
+void GX_ThreadPool :: runChunks( Job_t * job )
+{
+	for( ; ; ) {
+		size_t i = job->mNext.fetch_add( 1, std::memory_order_relaxed );
+
+		if( i >= job->mChunkCount ) break;
+
+		size_t begin = job->mBegin + i * job->mGrain;
+
+		job->mFunc( job->mContext, begin, std::min( job->mEnd, begin + job->mGrain ) );
+	}
+}
+
+void GX_ThreadPool :: help( Job_t * job )
+{
+	runChunks( job );
+
+	// the caller may return and drop the job as soon as this reaches 0
+	job->mHelpers.fetch_sub( 1, std::memory_order_acq_rel );
+}
+
+void GX_ThreadPool :: push( size_t index, Job_t * job )
+{
+	{
+		Queue_t * queue = mQueues[ index ].get();
+
+		std::unique_lock< std::mutex > lock( queue->mMutex );
+
+		if( queue->mCount == queue->mJobs.size() ) {
+			std::vector< Job_t * > jobs( std::max( queue->mJobs.size() * 2, (size_t)16 ) );
+			for( size_t i = 0; i < queue->mCount; i++ ) {
+				jobs[ i ] = queue->mJobs[ ( queue->mHead + i ) % queue->mJobs.size() ];
+			}
+			queue->mJobs.swap( jobs );
+			queue->mHead = 0;
+		}
+
+		queue->mJobs[ ( queue->mHead + queue->mCount ) % queue->mJobs.size() ] = job;
+		queue->mCount++;
+	}
+
+	mQueuedCount.fetch_add( 1, std::memory_order_release );
+}
+
+bool GX_ThreadPool :: pop( size_t index, Job_t ** job, const Job_t * group )
+{
+	if( 0 == mQueuedCount.load( std::memory_order_acquire ) ) return false;
+
+	for( size_t i = 0; i < mQueues.size(); i++ ) {
+		Queue_t * queue = mQueues[ ( index + i ) % mQueues.size() ].get();
+
+		std::unique_lock< std::mutex > lock( queue->mMutex );
+
+		if( 0 == queue->mCount ) continue;
+
+		size_t size = queue->mJobs.size();
+
+		if( NULL != group ) {
+			size_t pos = 0;
+			while( pos < queue->mCount && queue->mJobs[ ( queue->mHead + pos ) % size ] != group ) pos++;
+
+			if( queue->mCount == pos ) continue;
+
+			*job = queue->mJobs[ ( queue->mHead + pos ) % size ];
+			for( ; pos + 1 < queue->mCount; pos++ ) {
+				queue->mJobs[ ( queue->mHead + pos ) % size ] = queue->mJobs[ ( queue->mHead + pos + 1 ) % size ];
+			}
+		} else if( 0 == i ) {
+			*job = queue->mJobs[ ( queue->mHead + queue->mCount - 1 ) % size ];
+		} else {
+			*job = queue->mJobs[ queue->mHead ];
+			queue->mHead = ( queue->mHead + 1 ) % size;
+		}
+
+		queue->mCount--;
+
+		mQueuedCount.fetch_sub( 1, std::memory_order_relaxed );
+
+		return true;
+	}
+
+	return false;
+}
+
+void GX_ThreadPool :: run( size_t index )
+{
+	tlsPool = this;
+	tlsIndex = index;
+
+	for( ; ; ) {
+		Job_t * job = NULL;
+
+		if( pop( index, &job ) ) {
+			help( job );
+			continue;
+		}
+
+		std::unique_lock< std::mutex > lock( mMutex );
+
+		mCond.wait( lock, [ this ] { return mIsStop || mQueuedCount.load( std::memory_order_acquire ) > 0; } );
+
+		if( mIsStop ) break;
+	}
+}
+
+void GX_ThreadPool :: parallelFor( size_t begin, size_t end, size_t grain, GX_RangeFunc_t func, void * context )
+{
+	if( begin >= end ) return;
+
+	grain = std::max( grain, (size_t)1 );
+
+	size_t chunkCount = ( end - begin + grain - 1 ) / grain;
+
+	if( chunkCount <= 1 ) {
+		func( context, begin, end );
+		return;
+	}
+
+	// a worker keeps its entries in its own queue, the others get them round robin
+	bool isWorker = this == tlsPool;
+	size_t home = isWorker ? tlsIndex : 0;
+
+	// one helper per chunk beyond the first, at most one per worker
+	size_t helperCount = std::min( chunkCount - 1, mQueues.size() );
+
+	Job_t job;
+	job.mFunc = func;
+	job.mContext = context;
+	job.mBegin = begin;
+	job.mEnd = end;
+	job.mGrain = grain;
+	job.mChunkCount = chunkCount;
+	job.mNext.store( 0, std::memory_order_relaxed );
+	job.mHelpers.store( helperCount, std::memory_order_relaxed );
+
+	for( size_t i = 0; i < helperCount; i++ ) push( isWorker ? home : i, &job );
+
+	{
+		// lock so that no worker misses the wakeup between its check and its wait
+		std::unique_lock< std::mutex > lock( mMutex );
+	}
+	mCond.notify_all();
+
+	runChunks( &job );
+
+	// every chunk is claimed, take back the entries no worker got to and wait for the others.
+	// an entry of another job may wait on the one running below us, taking it could deadlock
+	while( job.mHelpers.load( std::memory_order_acquire ) > 0 ) {
+		Job_t * own = NULL;
+		if( pop( home, &own, &job ) ) {
+			help( own );
+		} else {
+			std::this_thread::yield();
+		}
+	}
+}
+
+size_t gx_grain_size( double workPerItem )
+{
+	// about 32K multiply-adds per chunk, smaller chunks cost more to schedule than they save
+	static const double MIN_CHUNK_WORK = 32 * 1024;
+
+	return workPerItem >= MIN_CHUNK_WORK ? 1 : (size_t)( MIN_CHUNK_WORK / std::max( workPerItem, 1.0 ) );
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+// called with the context given to parallelFor and a sub-range [ begin, end ) of its range
+typedef void ( * GX_RangeFunc_t )( void * context, size_t begin, size_t end );
+
+/*
+* Work-stealing pool for the layer loops. A parallelFor call is one job on the
+* stack of its caller, the chunks are claimed from an atomic counter. The job is
+* pushed once per helping worker, not once per chunk, into rings that pop their
+* own entries from the back and let the others steal from the front. The calling
+* thread claims chunks too and waits by taking back the entries of its own job,
+* so nested or concurrent parallelFor calls, e.g. from inference threads, never
+* deadlock. Nothing is allocated per call once the rings have grown.
+*/
+class GX_ThreadPool {
+public:
+	GX_ThreadPool( int threadCount );
+	~GX_ThreadPool();
+
+	int getThreadCount() const;
+
+	// split [ begin, end ) into chunks of grain items and return when all of them ran
+	void parallelFor( size_t begin, size_t end, size_t grain, GX_RangeFunc_t func, void * context );
+
+public:
+
+	// pool used by the layers, NULL until setDefault, so layers run their loops inline.
+	// set it before training or serving starts, not while layers are running
+	static GX_ThreadPool * getDefault();
+
+	// threadCount workers besides the calling threads, 0 removes the pool
+	static void setDefault( int threadCount );
+
+	// in a forked child: the default pool lost its threads, start a new one of the same size
+	static void restartAfterFork();
+
+private:
+	typedef struct tagJob {
+		GX_RangeFunc_t mFunc;
+		void * mContext;
+		size_t mBegin, mEnd, mGrain, mChunkCount;
+		std::atomic< size_t > mNext;
+		std::atomic< size_t > mHelpers;
+	} Job_t;
+
+	// a ring of jobs, it only grows when full
+	typedef struct tagQueue {
+		std::mutex mMutex;
+		std::vector< Job_t * > mJobs;
+		size_t mHead, mCount;
+	} Queue_t;
+
+	void run( size_t index );
+
+	void push( size_t index, Job_t * job );
+
+	// own queue from the back first, then the other queues from the front.
+	// with a group only the entries of that job are taken
+	bool pop( size_t index, Job_t ** job, const Job_t * group = NULL );
+
+	// claim chunks until none is left
+	static void runChunks( Job_t * job );
+
+	// a helper entry: the chunks left, then it lets the job go
+	static void help( Job_t * job );
+
+private:
+	std::vector< std::unique_ptr< Queue_t > > mQueues;
+	std::vector< std::thread > mThreads;
+
+	std::mutex mMutex;
+	std::condition_variable mCond;
+	std::atomic< size_t > mQueuedCount;
+	bool mIsStop;
+
+	static GX_ThreadPool * sDefault;
+};
+
+// items per chunk so that one chunk does at least a few tens of microseconds of work
+size_t gx_grain_size( double workPerItem );
+
+// run func( begin, end ) over [ begin, end ) on the default pool, inline without a pool or when
+// one chunk covers it. func stays on the caller stack and is called through a plain pointer,
+// so a capturing lambda costs no heap allocation
+template< typename Func >
+void gx_parallel_for( size_t begin, size_t end, size_t grain, const Func & func )
+{
+	GX_ThreadPool * pool = GX_ThreadPool::getDefault();
+
+	if( NULL == pool || end - begin <= grain ) {
+		func( begin, end );
+	} else {
+		pool->parallelFor( begin, end, grain, []( void * context, size_t from, size_t to ) {
+			( *(const Func *)context )( from, to );
+		}, (void *)&func );
+	}
+}
@@ -0,0 +1,186 @@
+#include "gxprof.h"
+#include "gxnet.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+static const char * PHASE_NAMES[] = { "calcOutput", "backpropagate", "collectGradient", "applyGradient" };
+
+GX_Profiler :: GX_Profiler()
+{
+	mPerfRegion = eRegionNone;
+	mPerfLayer = 0;
+}
+
+GX_Profiler :: ~GX_Profiler()
+{
+}
+
+void GX_Profiler :: reset()
+{
+	mStats.clear();
+}
+
+bool GX_Profiler :: enablePerf( const char * region, size_t layerCount )
+{
+	std::string spec = region;
+
+	if( "epoch" == spec ) {
+		mPerfRegion = eRegionEpoch;
+	} else if( "eval" == spec ) {
+		mPerfRegion = eRegionEval;
+	} else if( 0 == spec.compare( 0, 6, "layer:" ) && spec.size() > 6 ) {
+		char * end = NULL;
+		unsigned long layer = strtoul( region + 6, &end, 10 );
+
+		if( '\0' != *end || '-' == region[ 6 ] || layer >= layerCount ) {
+			printf( "%s invalid layer %s, %zu layers\n", __func__, region + 6, layerCount );
+			return false;
+		}
+
+		mPerfRegion = eRegionLayer;
+		mPerfLayer = layer;
+	} else {
+		printf( "%s invalid region %s\n", __func__, region );
+		return false;
+	}
+
+	int groupCount = eRegionLayer == mPerfRegion ? GX_BaseLayer::ePhaseCount : 1;
+
+	for( int i = 0; i < groupCount; i++ ) {
+		if( ! mPerf[ i ].open() ) break;
+	}
+
+	return true;
+}
+
+void GX_Profiler :: beginRegion( int region )
+{
+	if( region == mPerfRegion ) mPerf[ 0 ].start();
+}
+
+void GX_Profiler :: endRegion( int region, const char * tag )
+{
+	if( region != mPerfRegion ) return;
+
+	mPerf[ 0 ].stop();
+	mPerf[ 0 ].print( tag );
+	mPerf[ 0 ].reset();
+}
+
+void GX_Profiler :: beginPhase( size_t layerIndex, int phase )
+{
+	if( eRegionLayer == mPerfRegion && layerIndex == mPerfLayer ) mPerf[ phase ].start();
+}
+
+void GX_Profiler :: printPerf() const
+{
+	if( eRegionLayer != mPerfRegion ) return;
+
+	for( int i = 0; i < GX_BaseLayer::ePhaseCount; i++ ) {
+		char tag[ 128 ] = { 0 };
+		snprintf( tag, sizeof( tag ), "layer#%zu.%s", mPerfLayer, PHASE_NAMES[ i ] );
+		mPerf[ i ].print( tag );
+	}
+}
+
+void GX_Profiler :: endPhase( size_t layerIndex, int phase, int64_t nanoseconds )
+{
+	if( eRegionLayer == mPerfRegion && layerIndex == mPerfLayer ) mPerf[ phase ].stop();
+
+	size_t index = layerIndex * GX_BaseLayer::ePhaseCount + phase;
+
+	if( index >= mStats.size() ) mStats.resize( ( layerIndex + 1 ) * GX_BaseLayer::ePhaseCount, PhaseStat_t() );
+
+	mStats[ index ].mCalls++;
+	mStats[ index ].mNanoseconds += nanoseconds;
+}
+
+int64_t GX_Profiler :: getCalls( size_t layerIndex, int phase ) const
+{
+	size_t index = layerIndex * GX_BaseLayer::ePhaseCount + phase;
+
+	return index < mStats.size() ? mStats[ index ].mCalls : 0;
+}
+
+int64_t GX_Profiler :: getNanoseconds( size_t layerIndex, int phase ) const
+{
+	size_t index = layerIndex * GX_BaseLayer::ePhaseCount + phase;
+
+	return index < mStats.size() ? mStats[ index ].mNanoseconds : 0;
+}
+
+void GX_Profiler :: printRoofline( const GX_Network & network ) const
+{
+	int64_t totalNanoseconds = 0;
+	for( auto & item : mStats ) totalNanoseconds += item.mNanoseconds;
+
+	printf( "\n{{{ roofline, total %.3f s\n", totalNanoseconds / 1e9 );
+	printf( "%-8s %-6s %-16s %10s %10s %8s %10s %10s %10s\n", "Layer", "Type", "Phase",
+			"Calls", "Avg(us)", "Time%", "GFLOP/s", "GB/s", "FLOP/Byte" );
+
+	const GX_BaseLayerPtrVector & layers = network.getLayers();
+
+	for( size_t i = 0; i < layers.size(); i++ ) {
+		for( int phase = 0; phase < GX_BaseLayer::ePhaseCount; phase++ ) {
+			int64_t calls = getCalls( i, phase ), nanoseconds = getNanoseconds( i, phase );
+
+			if( calls <= 0 ) continue;
+
+			GX_LayerCost_t cost;
+			layers[ i ]->getCost( phase, &cost );
+
+			double bytes = cost.mWeightBytes + cost.mActBytes;
+
+			// phases without weights, such as pool layer collectGradient
+			if( cost.mFlops <= 0 && bytes <= 0 ) continue;
+
+			printf( "#%-7zu %-6d %-16s %10ld %10.3f %7.2f%% %10.3f %10.3f %10.3f\n",
+					i, layers[ i ]->getType(), PHASE_NAMES[ phase ], calls,
+					nanoseconds / 1e3 / calls,
+					totalNanoseconds > 0 ? 100.0 * nanoseconds / totalNanoseconds : 0,
+					nanoseconds > 0 ? cost.mFlops * calls / nanoseconds : 0,
+					nanoseconds > 0 ? bytes * calls / nanoseconds : 0,
+					bytes > 0 ? cost.mFlops / bytes : 0 );
+		}
+	}
+
+	printf( "}}}\n\n" );
+}
+
+////////////////////////////////////////////////////////////
+
+GX_PhaseTimes :: GX_PhaseTimes()
+{
+	mCount = 0;
+}
+
+GX_PhaseTimes :: ~GX_PhaseTimes()
+{
+}
+
+void GX_PhaseTimes :: reset( size_t layerCount )
+{
+	if( layerCount * GX_BaseLayer::ePhaseCount != mCount ) {
+		mCount = layerCount * GX_BaseLayer::ePhaseCount;
+		mSums.reset( new std::atomic< int64_t >[ mCount ] );
+	}
+
+	for( size_t i = 0; i < mCount; i++ ) mSums[ i ].store( 0, std::memory_order_relaxed );
+}
+
+void GX_PhaseTimes :: add( size_t layerIndex, int phase, int64_t nanoseconds )
+{
+	size_t index = layerIndex * GX_BaseLayer::ePhaseCount + phase;
+
+	if( index < mCount ) mSums[ index ].fetch_add( nanoseconds, std::memory_order_relaxed );
+}
+
+int64_t GX_PhaseTimes :: getNanoseconds( size_t layerIndex, int phase ) const
+{
+	size_t index = layerIndex * GX_BaseLayer::ePhaseCount + phase;
+
+	return index < mCount ? mSums[ index ].load( std::memory_order_relaxed ) : 0;
+}
+
@@ -0,0 +1,114 @@
+#pragma once
+
+#include "gxcomm.h"
+#include "gxperf.h"
+#include "gxlayer.h"
+
+#include <chrono>
+#include <atomic>
+#include <memory>
+#include <stdint.h>
+
+class GX_Network;
+
+/*
+* Accumulates the time spent in every layer phase, and combines it with the
+* layer cost to report achieved GFLOP/s, GB/s and arithmetic intensity.
+* Optionally counts hardware events for one region with GX_PerfCounters.
+* Not thread safe, attach it to a network that is driven by one thread.
+*/
+class GX_Profiler {
+public:
+	typedef std::chrono::steady_clock Clock_t;
+
+	enum { eRegionNone = 0, eRegionEpoch = 1, eRegionEval = 2, eRegionLayer = 3 };
+
+	GX_Profiler();
+	~GX_Profiler();
+
+	void reset();
+
+	// region: "epoch", "eval" or "layer:N", false if the region is invalid or N is not below layerCount.
+	// the counters follow the thread that calls train or forward, see GX_PerfCounters::open
+	bool enablePerf( const char * region, size_t layerCount );
+
+	void beginRegion( int region );
+
+	// print and reset the counters if the region is the perf region
+	void endRegion( int region, const char * tag );
+
+	void beginPhase( size_t layerIndex, int phase );
+
+	void endPhase( size_t layerIndex, int phase, int64_t nanoseconds );
+
+	// print the counters of every phase of the perf layer
+	void printPerf() const;
+
+	int64_t getCalls( size_t layerIndex, int phase ) const;
+
+	int64_t getNanoseconds( size_t layerIndex, int phase ) const;
+
+	void printRoofline( const GX_Network & network ) const;
+
+private:
+	typedef struct tagPhaseStat {
+		int64_t mCalls;
+		int64_t mNanoseconds;
+	} PhaseStat_t;
+
+	std::vector< PhaseStat_t > mStats;
+
+	int mPerfRegion;
+	size_t mPerfLayer;
+
+	// eRegionLayer uses one group per phase, the others use the first one
+	GX_PerfCounters mPerf[ GX_BaseLayer::ePhaseCount ];
+};
+
+/*
+* Wall-clock sums per layer and phase for the stats page, kept without a profiler
+* so that watching a run does not change how it trains. The sums are atomic, the
+* overlapped backward adds to them from pool threads.
+*/
+class GX_PhaseTimes {
+public:
+	GX_PhaseTimes();
+	~GX_PhaseTimes();
+
+	// zeroed sums for layerCount layers
+	void reset( size_t layerCount );
+
+	void add( size_t layerIndex, int phase, int64_t nanoseconds );
+
+	int64_t getNanoseconds( size_t layerIndex, int phase ) const;
+
+private:
+	std::unique_ptr< std::atomic< int64_t >[] > mSums;
+	size_t mCount;
+};
+
+class GX_ProfScope {
+public:
+	GX_ProfScope( GX_Profiler * profiler, size_t layerIndex, int phase, GX_PhaseTimes * times = NULL )
+			: mProfiler( profiler ), mTimes( times ), mLayerIndex( layerIndex ), mPhase( phase ) {
+		if( NULL == mProfiler && NULL == mTimes ) return;
+
+		if( NULL != mProfiler ) mProfiler->beginPhase( mLayerIndex, mPhase );
+		mBeginTime = GX_Profiler::Clock_t::now();
+	}
+
+	~GX_ProfScope() {
+		if( NULL == mProfiler && NULL == mTimes ) return;
+
+		std::chrono::nanoseconds span = GX_Profiler::Clock_t::now() - mBeginTime;
+		if( NULL != mProfiler ) mProfiler->endPhase( mLayerIndex, mPhase, span.count() );
+		if( NULL != mTimes ) mTimes->add( mLayerIndex, mPhase, span.count() );
+	}
+
+private:
+	GX_Profiler * mProfiler;
+	GX_PhaseTimes * mTimes;
+	size_t mLayerIndex;
+	int mPhase;
+	GX_Profiler::Clock_t::time_point mBeginTime;
+};
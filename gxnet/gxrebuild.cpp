@@ -0,0 +1,72 @@
+
+#include "gxnet.h"
+#include "gxutils.h"
+#include "gxckpt.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+
+/*
+* Rebuild the model of any epoch from the delta checkpoints written with --delta.
+*/
+
+void usage( const char * name )
+{
+	printf( "%s --prefix <checkpoint prefix> --epoch <epoch> --output <model path> [--binary]\n", name );
+}
+
+int main( const int argc, char * argv[] )
+{
+	static struct option opts[] = {
+		{ "prefix",  required_argument,  NULL, 1 },
+		{ "epoch",   required_argument,  NULL, 2 },
+		{ "output",  required_argument,  NULL, 3 },
+		{ "binary",  no_argument,        NULL, 4 },
+		{ 0, 0, 0, 0}
+	};
+
+	char * prefix = NULL, * output = NULL;
+	int epoch = -1;
+	bool isBinary = false;
+
+	int c = 0;
+	while( ( c = getopt_long( argc, argv, "", opts, NULL ) ) != EOF ) {
+		switch( c ) {
+			case 1:
+				prefix = optarg;
+				break;
+			case 2:
+				epoch = atoi( optarg );
+				break;
+			case 3:
+				output = optarg;
+				break;
+			case 4:
+				isBinary = true;
+				break;
+			default:
+				usage( argv[ 0 ] );
+				return -1;
+		}
+	}
+
+	if( NULL == prefix || NULL == output || epoch < 0 ) {
+		usage( argv[ 0 ] );
+		return -1;
+	}
+
+	GX_Network network;
+
+	if( ! GX_Checkpointer::rebuild( prefix, epoch, &network ) ) {
+		printf( "rebuild %s epoch#%d fail\n", prefix, epoch );
+		return -1;
+	}
+
+	bool ret = isBinary ? GX_Utils::saveBinary( output, network ) : GX_Utils::save( output, network );
+
+	printf( "rebuild %s epoch#%d, %zu params -> %s %s\n", prefix, epoch, network.getParamCount(),
+			output, ret ? "succ" : "fail" );
+
+	return ret ? 0 : -1;
+}
@@ -0,0 +1,143 @@
+#include "gxstats.h"
+
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+GX_StatsWriter :: GX_StatsWriter()
+{
+	mPage = NULL;
+}
+
+GX_StatsWriter :: ~GX_StatsWriter()
+{
+	close();
+}
+
+bool GX_StatsWriter :: open( const char * path )
+{
+	close();
+
+	int fd = ::open( path, O_RDWR | O_CREAT | O_TRUNC, 0644 );
+
+	if( fd < 0 ) {
+		printf( "open %s fail, errno %d, %s\n", path, errno, strerror( errno ) );
+		return false;
+	}
+
+	void * addr = MAP_FAILED;
+
+	if( 0 == ftruncate( fd, sizeof( GX_StatsPage_t ) ) ) {
+		addr = mmap( NULL, sizeof( GX_StatsPage_t ), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+	}
+
+	::close( fd );
+
+	if( MAP_FAILED == addr ) {
+		printf( "mmap %s fail, errno %d, %s\n", path, errno, strerror( errno ) );
+		return false;
+	}
+
+	mPage = ( GX_StatsPage_t * )addr;
+
+	mPage->mSeq.store( 1, std::memory_order_relaxed );
+	mPage->mMagic = GX_STATS_MAGIC;
+	mPage->mVersion = GX_STATS_VERSION;
+	mPage->mPid = getpid();
+	mPage->mSeq.store( 2, std::memory_order_release );
+
+	return true;
+}
+
+void GX_StatsWriter :: close()
+{
+	if( NULL != mPage ) munmap( mPage, sizeof( GX_StatsPage_t ) );
+
+	mPage = NULL;
+}
+
+GX_StatsPage_t * GX_StatsWriter :: beginUpdate()
+{
+	if( NULL == mPage ) return NULL;
+
+	mPage->mSeq.store( mPage->mSeq.load( std::memory_order_relaxed ) + 1, std::memory_order_relaxed );
+	std::atomic_thread_fence( std::memory_order_release );
+
+	return mPage;
+}
+
+void GX_StatsWriter :: endUpdate()
+{
+	mPage->mSeq.store( mPage->mSeq.load( std::memory_order_relaxed ) + 1, std::memory_order_release );
+}
+
+////////////////////////////////////////////////////////////
+
+GX_StatsReader :: GX_StatsReader()
+{
+	mPage = NULL;
+}
+
+GX_StatsReader :: ~GX_StatsReader()
+{
+	close();
+}
+
+bool GX_StatsReader :: open( const char * path )
+{
+	close();
+
+	int fd = ::open( path, O_RDONLY );
+
+	if( fd < 0 ) {
+		printf( "open %s fail, errno %d, %s\n", path, errno, strerror( errno ) );
+		return false;
+	}
+
+	void * addr = mmap( NULL, sizeof( GX_StatsPage_t ), PROT_READ, MAP_SHARED, fd, 0 );
+
+	::close( fd );
+
+	if( MAP_FAILED == addr ) {
+		printf( "mmap %s fail, errno %d, %s\n", path, errno, strerror( errno ) );
+		return false;
+	}
+
+	mPage = ( const GX_StatsPage_t * )addr;
+
+	if( GX_STATS_MAGIC != mPage->mMagic || GX_STATS_VERSION != mPage->mVersion ) {
+		printf( "%s is not a stats file\n", path );
+		close();
+		return false;
+	}
+
+	return true;
+}
+
+void GX_StatsReader :: close()
+{
+	if( NULL != mPage ) munmap( ( void * )mPage, sizeof( GX_StatsPage_t ) );
+
+	mPage = NULL;
+}
+
+bool GX_StatsReader :: read( GX_StatsPage_t * page ) const
+{
+	for( int retry = 0; retry < 10000; retry++ ) {
+		uint32_t begin = mPage->mSeq.load( std::memory_order_acquire );
+
+		if( begin & 1 ) continue;
+
+		memcpy( ( void * )page, ( const void * )mPage, sizeof( GX_StatsPage_t ) );
+
+		std::atomic_thread_fence( std::memory_order_acquire );
+
+		if( begin == mPage->mSeq.load( std::memory_order_relaxed ) ) return true;
+	}
+
+	return false;
+}
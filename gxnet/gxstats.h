@@ -0,0 +1,72 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+
+/*
+* Live training counters published through a memory-mapped file, so that
+* another process (gxtop) can watch a long run. The writer never blocks: it
+* follows the seqlock protocol, readers retry until they get a consistent copy.
+*/
+
+enum { GX_STATS_MAGIC = 0x47585354, GX_STATS_VERSION = 1, GX_STATS_MAX_LAYERS = 32, GX_STATS_PHASES = 4 };
+
+typedef struct tagStatsPage {
+	uint32_t mMagic;
+	uint32_t mVersion;
+
+	// odd while the writer is updating the page
+	std::atomic< uint32_t > mSeq;
+
+	int32_t mPid;
+	int32_t mEpoch, mEpochCount;
+	int64_t mBatch, mBatchCount;
+	int64_t mSamples;
+	int64_t mUpdateTime;
+
+	double mSamplesPerSec;
+	double mRunningLoss;
+	double mLearningRate;
+
+	// samples augmented ahead by the loaders or waiting in the shuffle buffer of a shard
+	// stream, stays 0 while training reads from memory
+	int32_t mQueueDepth;
+	int32_t mLayerCount;
+
+	// accumulated milliseconds of calcOutput, backpropagate, collectGradient, applyGradient
+	double mLayerMillis[ GX_STATS_MAX_LAYERS ][ GX_STATS_PHASES ];
+} GX_StatsPage_t;
+
+class GX_StatsWriter {
+public:
+	GX_StatsWriter();
+	~GX_StatsWriter();
+
+	bool open( const char * path );
+
+	void close();
+
+	// NULL if not opened
+	GX_StatsPage_t * beginUpdate();
+
+	void endUpdate();
+
+private:
+	GX_StatsPage_t * mPage;
+};
+
+class GX_StatsReader {
+public:
+	GX_StatsReader();
+	~GX_StatsReader();
+
+	bool open( const char * path );
+
+	void close();
+
+	// copy a consistent snapshot of the page, false if the writer never settles
+	bool read( GX_StatsPage_t * page ) const;
+
+private:
+	const GX_StatsPage_t * mPage;
+};
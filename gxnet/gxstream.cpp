@@ -0,0 +1,433 @@
+
+#include "gxstream.h"
+
+#include <cstdio>
+#include <cstring>
+#include <numeric>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+
+static const char GX_SHARD_MAGIC[ 4 ] = { 'G', 'X', 'S', 'S' };
+static const uint32_t GX_SHARD_VERSION = 1;
+
+enum { eRowTargets = 1, eLabelTargets = 2 };
+
+// shard file header, followed by the input slab and the target slab or the labels
+typedef struct tagShardHeader {
+	char mMagic[ 4 ];
+	uint32_t mVersion;
+	uint32_t mItemBytes;
+	uint32_t mTargetKind;
+	uint64_t mCount, mInputDim, mTargetDim;
+	uint32_t mMaxLabel;
+	uint32_t mReserved;
+} GX_ShardHeader_t;
+
+static std::string shardPath( const std::string & prefix, size_t shard )
+{
+	char suffix[ 32 ] = { 0 };
+	snprintf( suffix, sizeof( suffix ), ".%05zu", shard );
+
+	return prefix + suffix;
+}
+
+static bool readFull( int fd, void * data, size_t bytes )
+{
+	char * cursor = (char *)data;
+
+	while( bytes > 0 ) {
+		ssize_t len = read( fd, cursor, bytes );
+
+		if( len < 0 && EINTR == errno ) continue;
+		if( len <= 0 ) return false;
+
+		cursor += len;
+		bytes -= len;
+	}
+
+	return true;
+}
+
+static bool readHeader( const std::string & path, GX_ShardHeader_t * header )
+{
+	int fd = open( path.c_str(), O_RDONLY );
+
+	if( fd < 0 ) return false;
+
+	bool ret = readFull( fd, header, sizeof( *header ) );
+
+	close( fd );
+
+	return ret && 0 == memcmp( header->mMagic, GX_SHARD_MAGIC, sizeof( header->mMagic ) )
+			&& GX_SHARD_VERSION == header->mVersion && sizeof( GX_DataType ) == header->mItemBytes;
+}
+
+GX_ShardWriter :: GX_ShardWriter( const char * prefix, size_t samplesPerShard )
+	: mPrefix( prefix )
+{
+	mSamplesPerShard = std::max( samplesPerShard, (size_t)1 );
+	mShardCount = 0;
+	mIsFailed = false;
+}
+
+GX_ShardWriter :: ~GX_ShardWriter()
+{
+}
+
+bool GX_ShardWriter :: append( const GX_DataType * input, size_t dim, const GX_DataType * target, size_t targetDim )
+{
+	if( mIsFailed || ! mLabels.empty() ) return false;
+
+	if( mInput.size() == 0 ) {
+		mInput.reserve( mSamplesPerShard );
+		mRows.reserve( mSamplesPerShard );
+	}
+
+	mIsFailed = ! mInput.append( input, dim ) || ! mRows.append( target, targetDim );
+
+	if( ! mIsFailed && mInput.size() == mSamplesPerShard ) mIsFailed = ! flush();
+
+	return ! mIsFailed;
+}
+
+bool GX_ShardWriter :: append( const GX_DataType * input, size_t dim, uint16_t label )
+{
+	if( mIsFailed || mRows.size() > 0 ) return false;
+
+	if( mInput.size() == 0 ) {
+		mInput.reserve( mSamplesPerShard );
+		mLabels.reserve( mSamplesPerShard );
+	}
+
+	mIsFailed = ! mInput.append( input, dim );
+	if( ! mIsFailed ) mLabels.push_back( label );
+
+	if( ! mIsFailed && mInput.size() == mSamplesPerShard ) mIsFailed = ! flush();
+
+	return ! mIsFailed;
+}
+
+bool GX_ShardWriter :: flush()
+{
+	std::string path = shardPath( mPrefix, mShardCount );
+
+	FILE * fp = fopen( path.c_str(), "wb" );
+
+	if( NULL == fp ) {
+		printf( "%s open %s fail, errno %d, %s\n", __func__, path.c_str(), errno, strerror( errno ) );
+		return false;
+	}
+
+	bool hasLabels = ! mLabels.empty();
+
+	GX_ShardHeader_t header;
+	memset( &header, 0, sizeof( header ) );
+
+	memcpy( header.mMagic, GX_SHARD_MAGIC, sizeof( header.mMagic ) );
+	header.mVersion = GX_SHARD_VERSION;
+	header.mItemBytes = sizeof( GX_DataType );
+	header.mTargetKind = hasLabels ? eLabelTargets : eRowTargets;
+	header.mCount = mInput.size();
+	header.mInputDim = mInput.getDim();
+	header.mTargetDim = hasLabels ? 0 : mRows.getDim();
+	header.mMaxLabel = hasLabels ? *std::max_element( mLabels.begin(), mLabels.end() ) : 0;
+
+	bool ret = 1 == fwrite( &header, sizeof( header ), 1, fp )
+			&& 1 == fwrite( mInput.getSlab(), GX_Dataset::getSlabBytes( mInput.size(), mInput.getDim() ), 1, fp );
+
+	if( hasLabels ) {
+		ret = ret && mLabels.size() == fwrite( mLabels.data(), sizeof( uint16_t ), mLabels.size(), fp );
+	} else {
+		ret = ret && 1 == fwrite( mRows.getSlab(), GX_Dataset::getSlabBytes( mRows.size(), mRows.getDim() ), 1, fp );
+	}
+
+	ret = 0 == fclose( fp ) && ret;
+
+	if( ! ret ) printf( "%s write %s fail, errno %d, %s\n", __func__, path.c_str(), errno, strerror( errno ) );
+
+	mShardCount++;
+
+	mInput.clear();
+	mRows.clear();
+	mLabels.clear();
+
+	return ret;
+}
+
+bool GX_ShardWriter :: close()
+{
+	if( ! mIsFailed && mInput.size() > 0 ) mIsFailed = ! flush();
+
+	return ! mIsFailed;
+}
+
+size_t GX_ShardWriter :: getShardCount() const
+{
+	return mShardCount;
+}
+
+////////////////////////////////////////////////////////////
+
+GX_ShardStream :: GX_ShardStream( const char * prefix, size_t bufferSamples, uint32_t seed )
+	: mPrefix( prefix )
+{
+	mBufferSamples = std::max( bufferSamples, (size_t)1 );
+	mSeed = seed;
+
+	mCount = mInputDim = mTargetDim = 0;
+	mMaxLabel = 0;
+
+	mIsShuffle = false;
+	mOrderPos = mSamplePos = 0;
+
+	mFill = 0;
+	mIsFilled = false;
+}
+
+GX_ShardStream :: ~GX_ShardStream()
+{
+}
+
+std::string GX_ShardStream :: getShardPath( size_t shard ) const
+{
+	return shardPath( mPrefix, shard );
+}
+
+bool GX_ShardStream :: open()
+{
+	mShardCounts.clear();
+	mCount = 0;
+
+	uint32_t targetKind = 0;
+
+	GX_ShardHeader_t header;
+
+	for( size_t shard = 0; readHeader( getShardPath( shard ), &header ); shard++ ) {
+		if( 0 == shard ) {
+			targetKind = header.mTargetKind;
+			mInputDim = header.mInputDim;
+			mTargetDim = header.mTargetDim;
+			mMaxLabel = 0;
+		}
+
+		if( header.mTargetKind != targetKind || header.mInputDim != mInputDim || header.mTargetDim != mTargetDim ) {
+			printf( "%s %s does not match the shards before it\n", __func__, getShardPath( shard ).c_str() );
+			return false;
+		}
+
+		mShardCounts.push_back( header.mCount );
+		mCount += header.mCount;
+		mMaxLabel = std::max( mMaxLabel, (uint16_t)header.mMaxLabel );
+	}
+
+	if( mShardCounts.empty() ) {
+		printf( "%s no shard at %s\n", __func__, getShardPath( 0 ).c_str() );
+		return false;
+	}
+
+	mBuffer = GX_Dataset( mBufferSamples, mInputDim );
+	if( hasLabels() ) {
+		mBufferLabels.assign( mBufferSamples, 0 );
+	} else {
+		mBufferRows = GX_Dataset( mBufferSamples, mTargetDim );
+	}
+
+	return true;
+}
+
+size_t GX_ShardStream :: size() const
+{
+	return mCount;
+}
+
+size_t GX_ShardStream :: getInputDim() const
+{
+	return mInputDim;
+}
+
+size_t GX_ShardStream :: getTargetDim() const
+{
+	return mTargetDim;
+}
+
+bool GX_ShardStream :: hasLabels() const
+{
+	return 0 == mTargetDim;
+}
+
+uint16_t GX_ShardStream :: getMaxLabel() const
+{
+	return mMaxLabel;
+}
+
+size_t GX_ShardStream :: getShardCount() const
+{
+	return mShardCounts.size();
+}
+
+void GX_ShardStream :: start( size_t epoch, bool isShuffle )
+{
+	std::seed_seq seq{ mSeed, (uint32_t)epoch };
+	mGen.seed( seq );
+
+	mIsShuffle = isShuffle;
+
+	mShardOrder.resize( mShardCounts.size() );
+	std::iota( mShardOrder.begin(), mShardOrder.end(), 0 );
+	if( mIsShuffle ) std::shuffle( mShardOrder.begin(), mShardOrder.end(), mGen );
+
+	mOrderPos = 0;
+	mSamplePos = mShard.size();
+
+	mFill = 0;
+	mIsFilled = false;
+
+	readAhead( mShardOrder[ 0 ] );
+}
+
+void GX_ShardStream :: readAhead( size_t shard ) const
+{
+	int fd = ::open( getShardPath( shard ).c_str(), O_RDONLY );
+
+	if( fd < 0 ) return;
+
+	posix_fadvise( fd, 0, 0, POSIX_FADV_WILLNEED );
+
+	close( fd );
+}
+
+bool GX_ShardStream :: readShard( size_t shard )
+{
+	std::string path = getShardPath( shard );
+
+	int fd = ::open( path.c_str(), O_RDONLY );
+
+	if( fd < 0 ) {
+		printf( "%s open %s fail, errno %d, %s\n", __func__, path.c_str(), errno, strerror( errno ) );
+		return false;
+	}
+
+	posix_fadvise( fd, 0, 0, POSIX_FADV_SEQUENTIAL );
+
+	GX_ShardHeader_t header;
+
+	bool ret = readFull( fd, &header, sizeof( header ) ) && header.mCount == mShardCounts[ shard ]
+			&& header.mInputDim == mInputDim && header.mTargetDim == mTargetDim;
+
+	// the buffers keep their size from one shard to the next, only the last shard is shorter
+	if( ret && ( mShard.size() != header.mCount || mShard.getDim() != mInputDim ) ) {
+		mShard = GX_Dataset( header.mCount, mInputDim );
+		if( ! hasLabels() ) mShardRows = GX_Dataset( header.mCount, mTargetDim );
+	}
+
+	ret = ret && readFull( fd, mShard[ 0 ], GX_Dataset::getSlabBytes( header.mCount, mInputDim ) );
+
+	if( hasLabels() ) {
+		mShardLabels.resize( header.mCount );
+		ret = ret && readFull( fd, mShardLabels.data(), header.mCount * sizeof( uint16_t ) );
+	} else {
+		ret = ret && readFull( fd, mShardRows[ 0 ], GX_Dataset::getSlabBytes( header.mCount, mTargetDim ) );
+	}
+
+	close( fd );
+
+	if( ! ret ) printf( "%s read %s fail\n", __func__, path.c_str() );
+
+	return ret;
+}
+
+bool GX_ShardStream :: pull( GX_Dataset * input, GX_Dataset * rows, GX_LabelVector * labels, size_t slot )
+{
+	while( mSamplePos >= mShard.size() ) {
+		if( mOrderPos >= mShardOrder.size() ) return false;
+
+		if( ! readShard( mShardOrder[ mOrderPos ] ) ) {
+			mShard.clear();
+			mOrderPos = mShardOrder.size();
+			return false;
+		}
+
+		mOrderPos++;
+		mSamplePos = 0;
+
+		// the kernel reads the next shard while this one is consumed
+		if( mOrderPos < mShardOrder.size() ) readAhead( mShardOrder[ mOrderPos ] );
+	}
+
+	const GX_DataType * from = mShard[ mSamplePos ];
+	std::copy( from, from + mInputDim, ( *input )[ slot ] );
+
+	if( hasLabels() ) {
+		( *labels )[ slot ] = mShardLabels[ mSamplePos ];
+	} else {
+		from = mShardRows[ mSamplePos ];
+		std::copy( from, from + mTargetDim, ( *rows )[ slot ] );
+	}
+
+	mSamplePos++;
+
+	return true;
+}
+
+size_t GX_ShardStream :: next( GX_Dataset * input, GX_Dataset * rows, GX_LabelVector * labels )
+{
+	size_t count = input->size(), ret = 0;
+
+	if( hasLabels() && labels->size() < count ) labels->resize( count );
+
+	if( ! mIsShuffle ) {
+		while( ret < count && pull( input, rows, labels, ret ) ) ret++;
+		return ret;
+	}
+
+	if( ! mIsFilled ) {
+		while( mFill < mBufferSamples && pull( &mBuffer, &mBufferRows, &mBufferLabels, mFill ) ) mFill++;
+		mIsFilled = true;
+	}
+
+	for( ; ret < count && mFill > 0; ret++ ) {
+		size_t slot = std::uniform_int_distribution< size_t >( 0, mFill - 1 )( mGen );
+
+		const GX_DataType * from = mBuffer[ slot ];
+		std::copy( from, from + mInputDim, ( *input )[ ret ] );
+
+		if( hasLabels() ) {
+			( *labels )[ ret ] = mBufferLabels[ slot ];
+		} else {
+			from = mBufferRows[ slot ];
+			std::copy( from, from + mTargetDim, ( *rows )[ ret ] );
+		}
+
+		// the next sample of the stream takes the slot, at the end the last slot moves into it
+		if( ! pull( &mBuffer, &mBufferRows, &mBufferLabels, slot ) ) {
+			mFill--;
+
+			if( slot != mFill ) {
+				std::copy( mBuffer[ mFill ], mBuffer[ mFill ] + mInputDim, mBuffer[ slot ] );
+
+				if( hasLabels() ) {
+					mBufferLabels[ slot ] = mBufferLabels[ mFill ];
+				} else {
+					std::copy( mBufferRows[ mFill ], mBufferRows[ mFill ] + mTargetDim, mBufferRows[ slot ] );
+				}
+			}
+		}
+	}
+
+	return ret;
+}
+
+size_t GX_ShardStream :: getBytes() const
+{
+	return mBuffer.getBytes() + mBufferRows.getBytes() + gx_heap_bytes( mBufferLabels.capacity() * sizeof( uint16_t ) )
+			+ mShard.getBytes() + mShardRows.getBytes() + gx_heap_bytes( mShardLabels.capacity() * sizeof( uint16_t ) );
+}
+
+size_t GX_ShardStream :: getBufferCount() const
+{
+	return mIsShuffle ? mFill : 0;
+}
+
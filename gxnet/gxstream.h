@@ -0,0 +1,126 @@
+#pragma once
+
+#include "gxcomm.h"
+#include "gxdataset.h"
+
+#include <vector>
+#include <random>
+#include <string>
+#include <stdint.h>
+
+/*
+* Training data that does not fit in memory, split into shard files of a fixed
+* number of samples: prefix.00000, prefix.00001 and so on. A shard is a header,
+* the input slab in the GX_Dataset layout and the targets, one-hot rows or class
+* indexes, so a whole shard comes in with one large sequential read.
+*
+* GX_ShardWriter appends samples and writes a shard whenever it is full, so the
+* shards can be made from a source that does not fit in memory either.
+*/
+class GX_ShardWriter {
+public:
+	GX_ShardWriter( const char * prefix, size_t samplesPerShard );
+	~GX_ShardWriter();
+
+	// target as a row of targetDim items
+	bool append( const GX_DataType * input, size_t dim, const GX_DataType * target, size_t targetDim );
+
+	// target as a class index, every sample of the shards has one or every sample has a row
+	bool append( const GX_DataType * input, size_t dim, uint16_t label );
+
+	// writes the last shard, false if a write failed
+	bool close();
+
+	size_t getShardCount() const;
+
+private:
+	bool flush();
+
+private:
+	std::string mPrefix;
+	size_t mSamplesPerShard, mShardCount;
+	bool mIsFailed;
+
+	GX_Dataset mInput, mRows;
+	GX_LabelVector mLabels;
+};
+
+/*
+* Reads the shards of a prefix for GX_Network::train. Every epoch the shard order
+* is a new permutation, the shards are read one at a time and their samples go
+* through a shuffle buffer: a sample leaves from a random slot of the buffer and
+* the next sample of the stream takes its slot. The kernel is asked to read the
+* next shard ahead while the current one is consumed.
+*
+* Memory is the buffer, one shard and the mini-batch, whatever the dataset size.
+* Both orders come from ( seed, epoch ), so a run can be repeated.
+*/
+class GX_ShardStream {
+public:
+	GX_ShardStream( const char * prefix, size_t bufferSamples, uint32_t seed = 0 );
+	~GX_ShardStream();
+
+	// reads the headers of every shard, false if there is none or they do not match
+	bool open();
+
+	// samples of every shard
+	size_t size() const;
+
+	size_t getInputDim() const;
+
+	// items of a target row, 0 for class indexes
+	size_t getTargetDim() const;
+
+	bool hasLabels() const;
+
+	// largest class index of every shard
+	uint16_t getMaxLabel() const;
+
+	size_t getShardCount() const;
+
+	// a new epoch, without shuffle the shards and their samples are read in order
+	void start( size_t epoch, bool isShuffle );
+
+	// the next samples of the epoch into the first rows of input and of rows or labels,
+	// as many as input holds or as are left, returns the count
+	size_t next( GX_Dataset * input, GX_Dataset * rows, GX_LabelVector * labels );
+
+	// heap bytes of the buffer and of the shard being read
+	size_t getBytes() const;
+
+	// samples waiting in the shuffle buffer, 0 in order
+	size_t getBufferCount() const;
+
+private:
+	// next sample of the shard order into slot of input and of rows or labels, false at the end
+	bool pull( GX_Dataset * input, GX_Dataset * rows, GX_LabelVector * labels, size_t slot );
+
+	bool readShard( size_t shard );
+
+	void readAhead( size_t shard ) const;
+
+	std::string getShardPath( size_t shard ) const;
+
+private:
+	std::string mPrefix;
+	size_t mBufferSamples;
+	uint32_t mSeed;
+
+	size_t mCount, mInputDim, mTargetDim;
+	uint16_t mMaxLabel;
+	std::vector< size_t > mShardCounts;
+
+	std::mt19937 mGen;
+	bool mIsShuffle;
+	std::vector< size_t > mShardOrder;
+	size_t mOrderPos, mSamplePos;
+
+	GX_Dataset mShard, mShardRows;
+	GX_LabelVector mShardLabels;
+
+	GX_Dataset mBuffer, mBufferRows;
+	GX_LabelVector mBufferLabels;
+	size_t mFill;
+	bool mIsFilled;
+};
+
@@ -0,0 +1,116 @@
+
+#include "gxsynth.h"
+#include "gxnet.h"
+#include "gxact.h"
+
+#include <random>
+#include <algorithm>
+
+#include <string.h>
+
+void GX_Synth :: makeData( size_t count, size_t side, size_t classes, unsigned int strokeSeed,
+		unsigned int sampleSeed, GX_DataMatrix * input, GX_DataMatrix * target )
+{
+	std::mt19937 gen( strokeSeed );
+
+	std::vector< GX_Dims > strokes( classes );
+	for( auto & item : strokes ) {
+		std::uniform_int_distribution<> pos( side / 4, side * 3 / 4 - 1 );
+		for( size_t i = 0; i < side * 3; i++ ) item.emplace_back( pos( gen ) * side + pos( gen ) );
+	}
+
+	gen.seed( sampleSeed );
+
+	std::uniform_int_distribution<> label( 0, classes - 1 );
+	std::uniform_int_distribution<> shift( -2, 2 );
+	std::uniform_real_distribution<> ink( 0.5, 1.0 );
+
+	input->reserve( input->size() + count );
+	target->reserve( target->size() + count );
+
+	for( size_t i = 0; i < count; i++ ) {
+		int type = label( gen );
+		int dx = shift( gen ), dy = shift( gen );
+
+		input->emplace_back( GX_DataVector( side * side ) );
+		for( auto & pixel : strokes[ type ] ) {
+			int x = pixel / side + dx, y = pixel % side + dy;
+			input->back()[ x * side + y ] = ink( gen );
+		}
+
+		target->emplace_back( GX_DataVector( classes ) );
+		target->back()[ type ] = 1;
+	}
+}
+
+void GX_Synth :: buildMnist( GX_Network * network, size_t inputSize, size_t classes )
+{
+	GX_BaseLayer * layer = NULL;
+
+	network->setLossFuncType( GX_Network::eCrossEntropy );
+
+	layer = new GX_FullConnLayer( 30, inputSize );
+	layer->setActFunc( GX_ActFunc::sigmoid() );
+	network->addLayer( layer );
+
+	layer = new GX_FullConnLayer( classes, layer->getOutputSize() );
+	layer->setActFunc( GX_ActFunc::softmax() );
+	network->addLayer( layer );
+}
+
+void GX_Synth :: buildEmnist( GX_Network * network, size_t classes )
+{
+	GX_BaseLayer * layer = NULL;
+
+	network->setLossFuncType( GX_Network::eCrossEntropy );
+
+	layer = new GX_ConvLayer( { 1, 32, 32 }, 8, 5 );
+	layer->setActFunc( GX_ActFunc::leakyReLU() );
+	network->addLayer( layer );
+
+	layer = new GX_MaxPoolLayer( layer->getOutputDims(), 2 );
+	network->addLayer( layer );
+
+	layer = new GX_ConvLayer( layer->getOutputDims(), 16, 3 );
+	layer->setActFunc( GX_ActFunc::leakyReLU() );
+	network->addLayer( layer );
+
+	layer = new GX_MaxPoolLayer( layer->getOutputDims(), 2 );
+	network->addLayer( layer );
+
+	layer = new GX_FullConnLayer( 60, layer->getOutputSize() );
+	layer->setActFunc( GX_ActFunc::sigmoid() );
+	network->addLayer( layer );
+
+	layer = new GX_FullConnLayer( classes, layer->getOutputSize() );
+	layer->setActFunc( GX_ActFunc::softmax() );
+	network->addLayer( layer );
+}
+
+bool GX_Synth :: make( const char * tag, size_t trainingCount, unsigned int seed,
+		GX_Network * network, GX_DataMatrix * input, GX_DataMatrix * target )
+{
+	if( 0 == strcmp( tag, "mnist" ) ) {
+		makeData( std::max( trainingCount, (size_t)1 ), 28, 10, seed, seed, input, target );
+		buildMnist( network, 28 * 28, 10 );
+		return true;
+	}
+
+	if( 0 == strcmp( tag, "emnist" ) ) {
+		makeData( std::max( trainingCount / 10, (size_t)1 ), 32, 26, seed, seed, input, target );
+		buildEmnist( network, 26 );
+		return true;
+	}
+
+	return false;
+}
+
+bool GX_Synth :: isSameParams( const GX_Network & network, const GX_Network & other )
+{
+	GX_DataVector params, otherParams;
+	network.exportParams( &params );
+	other.exportParams( &otherParams );
+
+	return params.size() == otherParams.size()
+			&& 0 == memcmp( std::begin( params ), std::begin( otherParams ), params.size() * sizeof( GX_DataType ) );
+}
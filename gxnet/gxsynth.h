@@ -0,0 +1,31 @@
+#pragma once
+
+#include "gxcomm.h"
+
+class GX_Network;
+
+/*
+* Deterministic MNIST-like data and the testmnist and testemnist topologies, so the
+* bench and the tests run anywhere the code builds, without a dataset on disk.
+*/
+class GX_Synth {
+public:
+
+	// every class owns a fixed stroke pattern drawn from strokeSeed, each sample is that
+	// pattern shifted by a few pixels with random ink drawn from sampleSeed. training and
+	// eval sets share the strokeSeed
+	static void makeData( size_t count, size_t side, size_t classes, unsigned int strokeSeed,
+			unsigned int sampleSeed, GX_DataMatrix * input, GX_DataMatrix * target );
+
+	static void buildMnist( GX_Network * network, size_t inputSize, size_t classes );
+
+	static void buildEmnist( GX_Network * network, size_t classes );
+
+	// "mnist" or "emnist" network and training set, emnist is much heavier and takes
+	// a tenth of the samples. false for an unknown tag
+	static bool make( const char * tag, size_t trainingCount, unsigned int seed,
+			GX_Network * network, GX_DataMatrix * input, GX_DataMatrix * target );
+
+	// the parameters of both networks, bit for bit
+	static bool isSameParams( const GX_Network & network, const GX_Network & other );
+};
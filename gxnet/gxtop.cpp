@@ -0,0 +1,107 @@
+
+#include "gxstats.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <algorithm>
+
+#include <unistd.h>
+#include <signal.h>
+#include <getopt.h>
+
+/*
+* Display the live counters a training process publishes with --stats.
+*/
+
+static int64_t nowMillis()
+{
+	return std::chrono::duration_cast< std::chrono::milliseconds >(
+			std::chrono::system_clock::now().time_since_epoch() ).count();
+}
+
+void printPage( const GX_StatsPage_t & page )
+{
+	bool isAlive = ( 0 == kill( page.mPid, 0 ) );
+
+	printf( "gxtop pid %d (%s), updated %.1f s ago\n\n", page.mPid, isAlive ? "running" : "exited",
+			( nowMillis() - page.mUpdateTime ) / 1000.0 );
+
+	printf( "epoch %d / %d, batch %ld / %ld, samples %ld\n", page.mEpoch + 1, page.mEpochCount,
+			page.mBatch, page.mBatchCount, page.mSamples );
+	printf( "%.1f samples/sec, running loss %.8f, lr %f, queue depth %d\n\n",
+			page.mSamplesPerSec, page.mRunningLoss, page.mLearningRate, page.mQueueDepth );
+
+	printf( "%-8s %16s %16s %16s %16s\n", "Layer(ms)", "calcOutput", "backpropagate",
+			"collectGradient", "applyGradient" );
+
+	for( int i = 0; i < page.mLayerCount && i < GX_STATS_MAX_LAYERS; i++ ) {
+		printf( "#%-8d %16.1f %16.1f %16.1f %16.1f\n", i, page.mLayerMillis[ i ][ 0 ],
+				page.mLayerMillis[ i ][ 1 ], page.mLayerMillis[ i ][ 2 ], page.mLayerMillis[ i ][ 3 ] );
+	}
+
+	fflush( stdout );
+}
+
+void usage( const char * name )
+{
+	printf( "%s --stats <stats file> [--interval <ms>] [--once]\n", name );
+}
+
+int main( const int argc, char * argv[] )
+{
+	static struct option opts[] = {
+		{ "stats",    required_argument,  NULL, 1 },
+		{ "interval", required_argument,  NULL, 2 },
+		{ "once",     no_argument,        NULL, 3 },
+		{ 0, 0, 0, 0}
+	};
+
+	const char * path = NULL;
+	int interval = 1000;
+	bool isOnce = false;
+
+	int c = 0;
+	while( ( c = getopt_long( argc, argv, "", opts, NULL ) ) != EOF ) {
+		switch( c ) {
+			case 1:
+				path = optarg;
+				break;
+			case 2:
+				interval = std::max( atoi( optarg ), 10 );
+				break;
+			case 3:
+				isOnce = true;
+				break;
+			default:
+				usage( argv[ 0 ] );
+				return 0;
+		}
+	}
+
+	if( NULL == path ) {
+		usage( argv[ 0 ] );
+		return 0;
+	}
+
+	GX_StatsReader reader;
+
+	if( ! reader.open( path ) ) return -1;
+
+	for( ; ; ) {
+		GX_StatsPage_t page;
+
+		if( ! reader.read( &page ) ) {
+			printf( "read %s fail, writer is busy\n", path );
+		} else {
+			if( ! isOnce ) printf( "\033[H\033[2J" );
+			printPage( page );
+		}
+
+		if( isOnce ) break;
+
+		usleep( interval * 1000 );
+	}
+
+	return 0;
+}
@@ -0,0 +1,141 @@
+#include "gxtrace.h"
+
+#include <cstdio>
+#include <algorithm>
+
+#include <unistd.h>
+#include <sys/syscall.h>
+
+GX_Tracer :: GX_Tracer( size_t capacityPerThread )
+{
+	static std::atomic< uint64_t > lastId( 0 );
+
+	mId = ++lastId;
+	mCapacity = std::max( capacityPerThread, (size_t)1 );
+	mBatchCount = -1;
+	mEpochInterval = 1;
+	mIsEpochInWindow = true;
+	mIsActive = false;
+	mBeginTime = Clock_t::now();
+}
+
+GX_Tracer :: ~GX_Tracer()
+{
+	for( auto & item : mRings ) delete item;
+}
+
+void GX_Tracer :: setWindow( int batchCount, int epochInterval )
+{
+	mBatchCount = batchCount;
+	mEpochInterval = std::max( epochInterval, 1 );
+}
+
+void GX_Tracer :: beginEpoch( int epoch )
+{
+	mIsEpochInWindow = ( 0 == epoch % mEpochInterval );
+}
+
+void GX_Tracer :: beginBatch( int batch )
+{
+	mIsActive.store( mIsEpochInWindow && ( mBatchCount < 0 || batch < mBatchCount ),
+			std::memory_order_relaxed );
+}
+
+void GX_Tracer :: setActive( bool isActive )
+{
+	mIsActive.store( isActive && mIsEpochInWindow, std::memory_order_relaxed );
+}
+
+bool GX_Tracer :: isActive() const
+{
+	return mIsActive.load( std::memory_order_relaxed );
+}
+
+int64_t GX_Tracer :: now() const
+{
+	std::chrono::nanoseconds span = Clock_t::now() - mBeginTime;
+
+	return span.count();
+}
+
+GX_Tracer::Ring_t * GX_Tracer :: getRing()
+{
+	// one cached ring per thread, looked up again only when the tracer changes
+	static thread_local uint64_t ownerId = 0;
+	static thread_local Ring_t * ring = NULL;
+
+	if( ownerId == mId ) return ring;
+
+	long threadId = syscall( SYS_gettid );
+
+	std::lock_guard< std::mutex > guard( mMutex );
+
+	ring = NULL;
+	for( auto & item : mRings ) {
+		if( item->mThreadId == threadId ) ring = item;
+	}
+
+	if( NULL == ring ) {
+		ring = new Ring_t();
+		ring->mThreadId = threadId;
+		ring->mHead = ring->mCount = 0;
+		ring->mSpans.resize( mCapacity );
+
+		mRings.emplace_back( ring );
+	}
+
+	ownerId = mId;
+
+	return ring;
+}
+
+void GX_Tracer :: addSpan( const char * name, int index, int64_t beginTime, int64_t endTime )
+{
+	Ring_t * ring = getRing();
+
+	Span_t & span = ring->mSpans[ ring->mHead ];
+	span.mName = name;
+	span.mIndex = index;
+	span.mBeginTime = beginTime;
+	span.mEndTime = endTime;
+
+	ring->mHead = ( ring->mHead + 1 ) % mCapacity;
+	if( ring->mCount < mCapacity ) ring->mCount++;
+}
+
+bool GX_Tracer :: save( const char * path ) const
+{
+	FILE * fp = fopen( path, "w" );
+
+	if( NULL == fp ) return false;
+
+	std::lock_guard< std::mutex > guard( mMutex );
+
+	int pid = getpid();
+	size_t count = 0;
+
+	fprintf( fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n" );
+
+	for( auto & ring : mRings ) {
+		fprintf( fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%ld,\"args\":{\"name\":\"%s#%ld\"}}",
+				count++ > 0 ? ",\n" : "", pid, ring->mThreadId,
+				ring->mThreadId == pid ? "main" : "worker", ring->mThreadId );
+
+		size_t first = ( ring->mHead + mCapacity - ring->mCount ) % mCapacity;
+
+		for( size_t i = 0; i < ring->mCount; i++ ) {
+			const Span_t & span = ring->mSpans[ ( first + i ) % mCapacity ];
+
+			fprintf( fp, ",\n{\"name\":\"%s", span.mName );
+			if( span.mIndex >= 0 ) fprintf( fp, "#%d", span.mIndex );
+			fprintf( fp, "\",\"ph\":\"X\",\"pid\":%d,\"tid\":%ld,\"ts\":%.3f,\"dur\":%.3f}",
+					pid, ring->mThreadId, span.mBeginTime / 1e3, ( span.mEndTime - span.mBeginTime ) / 1e3 );
+		}
+	}
+
+	fprintf( fp, "\n]}\n" );
+
+	fclose( fp );
+
+	return true;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
+
+/*
+* Low overhead span recorder. Every thread writes complete events into its own
+* ring buffer, the oldest events are overwritten when a ring is full. Only a
+* sampled window of training is recorded: the first N batches of every M-th
+* epoch. save() writes the Chrome trace JSON format, which Perfetto can open.
+*/
+class GX_Tracer {
+public:
+	typedef std::chrono::steady_clock Clock_t;
+
+	GX_Tracer( size_t capacityPerThread = 65536 );
+	~GX_Tracer();
+
+	// record batchCount batches every epochInterval epochs, batchCount < 0 for all batches
+	void setWindow( int batchCount, int epochInterval );
+
+	void beginEpoch( int epoch );
+
+	void beginBatch( int batch );
+
+	// spans outside of any batch, eg. the onEpochEnd callback
+	void setActive( bool isActive );
+
+	bool isActive() const;
+
+	int64_t now() const;
+
+	// name must be a string literal, index < 0 means no index
+	void addSpan( const char * name, int index, int64_t beginTime, int64_t endTime );
+
+	// call it when no thread is recording
+	bool save( const char * path ) const;
+
+private:
+	typedef struct tagSpan {
+		const char * mName;
+		int mIndex;
+		int64_t mBeginTime, mEndTime;
+	} Span_t;
+
+	typedef struct tagRing {
+		long mThreadId;
+		size_t mHead, mCount;
+		std::vector< Span_t > mSpans;
+	} Ring_t;
+
+	Ring_t * getRing();
+
+private:
+	uint64_t mId;
+	size_t mCapacity;
+	int mBatchCount, mEpochInterval;
+	bool mIsEpochInWindow;
+
+	std::atomic< bool > mIsActive;
+
+	Clock_t::time_point mBeginTime;
+
+	mutable std::mutex mMutex;
+	std::vector< Ring_t * > mRings;
+};
+
+class GX_TraceScope {
+public:
+	GX_TraceScope( GX_Tracer * tracer, const char * name, int index = -1 )
+			: mTracer( NULL ), mName( name ), mIndex( index ), mBeginTime( 0 ) {
+		if( NULL == tracer || ! tracer->isActive() ) return;
+
+		mTracer = tracer;
+		mBeginTime = mTracer->now();
+	}
+
+	~GX_TraceScope() {
+		if( NULL != mTracer ) mTracer->addSpan( mName, mIndex, mBeginTime, mTracer->now() );
+	}
+
+private:
+	GX_Tracer * mTracer;
+	const char * mName;
+	int mIndex;
+	int64_t mBeginTime;
+};
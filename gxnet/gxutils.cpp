@@ -2,6 +2,7 @@
 #include "gxutils.h"
 #include "gxnet.h"
 #include "gxact.h"
+#include "gxdataset.h"
 
 #include <iostream>
 #include <fstream>
@@ -16,8 +17,12 @@
 #include <unistd.h>
 #include <getopt.h>
 #include <assert.h>
+#include <string.h>
+
+#include <stdint.h>
 
 #include <arpa/inet.h>
+#include <sys/resource.h>
 
 GX_DataType GX_Utils :: calcSSE( const GX_DataVector & output, const GX_DataVector & target )
 {
@@ -134,6 +139,17 @@ bool GX_Utils :: expandMnistImage( GX_DataVector & orgImage, GX_DataVector * new
 }
 
 bool GX_Utils :: loadMnistImages( const int limitCount, const char * path, GX_DataMatrix * images )
+{
+	GX_Dataset dataset;
+
+	bool ret = loadMnistImages( limitCount, path, &dataset );
+
+	dataset.toMatrix( images );
+
+	return ret;
+}
+
+bool GX_Utils :: loadMnistImages( const int limitCount, const char * path, GX_Dataset * images )
 {
 	std::ifstream file( path, std::ios::binary );
 
@@ -165,7 +181,9 @@ bool GX_Utils :: loadMnistImages( const int limitCount, const char * path, GX_Da
 
 	if( limitCount > 0 ) imageCount = std::min( limitCount, imageCount );
 
-	images->reserve( imageCount );
+	images->reserve( images->size() + imageCount );
+
+	GX_DataVector image( imageSize );
 
 	unsigned char * buff = ( unsigned char * )malloc( imageSize );
 	for( int i = 0; i < imageCount; i++ ) {
@@ -175,19 +193,35 @@ bool GX_Utils :: loadMnistImages( const int limitCount, const char * path, GX_Da
 			break;
 		}
 
-		images->emplace_back( GX_DataVector( imageSize ) );
 		for( int j = 0; j < imageSize; j++ ) {
-			images->back()[ j ] = buff[ j ] / 255.0;
+			image[ j ] = buff[ j ] / 255.0;
+		}
+
+		if( ! images->append( image ) ) {
+			ret = false;
+			break;
 		}
 	}
 	free( buff );
 
-	printf( "%s load %s images %zu\n", __func__, path, images->size() );
+	printf( "%s load %s images %zu, %.1f KB\n", __func__, path, images->size(), images->getBytes() / 1024.0 );
 
 	return ret;
 }
 
 bool GX_Utils :: loadMnistLabels( int limitCount, const char * path, GX_DataMatrix * labels, int maxClasses )
+{
+	GX_Dataset dataset;
+
+	bool ret = loadMnistLabels( limitCount, path, &dataset, maxClasses );
+
+	dataset.toMatrix( labels );
+
+	return ret;
+}
+
+// class indexes of an idx1 file, every one below maxClasses
+static bool readMnistLabels( int limitCount, const char * path, GX_LabelVector * labels, int maxClasses )
 {
 	std::ifstream file( path, std::ios::binary );
 
@@ -209,26 +243,56 @@ bool GX_Utils :: loadMnistLabels( int limitCount, const char * path, GX_DataMatr
 	file.read( ( char * )&labelCount, sizeof( labelCount ) );
 	labelCount = ntohl( labelCount );
 
-	bool ret = true;
-
 	if( limitCount > 0 ) labelCount = std::min( limitCount, labelCount );
 
-	labels->reserve( labelCount );
+	labels->reserve( labels->size() + labelCount );
 
 	unsigned char buff = 0;
 
 	for(int i = 0; i < labelCount; i++) {
 		if( ( ! file.read( ( char * )&buff, 1 ) ) || buff >= maxClasses ) {
 			printf( "%s read fail, label %d\n", __func__, buff );
+			return false;
+		}
+
+		labels->push_back( buff );
+	}
+
+	return true;
+}
+
+bool GX_Utils :: loadMnistLabels( int limitCount, const char * path, GX_Dataset * labels, int maxClasses )
+{
+	GX_LabelVector indexes;
+
+	bool ret = readMnistLabels( limitCount, path, &indexes, maxClasses );
+
+	labels->reserve( labels->size() + indexes.size() );
+
+	GX_DataVector label( maxClasses );
+
+	for( auto & item : indexes ) {
+		label[ item ] = 1;
+		bool isOk = labels->append( label );
+		label[ item ] = 0;
+
+		if( ! isOk ) {
 			ret = false;
 			break;
 		}
-
-		labels->emplace_back( GX_DataVector( maxClasses ) );
-		labels->back()[ buff ] = 1;
 	}
 
-	printf( "%s load %s labels %zu\n", __func__, path, labels->size() );
+	printf( "%s load %s labels %zu, %.1f KB\n", __func__, path, labels->size(), labels->getBytes() / 1024.0 );
+
+	return ret;
+}
+
+bool GX_Utils :: loadMnistLabels( int limitCount, const char * path, GX_LabelVector * labels, int maxClasses )
+{
+	bool ret = readMnistLabels( limitCount, path, labels, maxClasses );
+
+	printf( "%s load %s labels %zu, %.1f KB\n", __func__, path, labels->size(),
+			gx_heap_bytes( labels->capacity() * sizeof( uint16_t ) ) / 1024.0 );
 
 	return ret;
 }
@@ -352,6 +416,26 @@ bool GX_Utils :: save( const char * path, const GX_Network & network )
 	return true;
 }
 
+static const char GX_BINARY_MAGIC[ 4 ] = { 'G', 'X', 'N', 'B' };
+
+// version 2 adds the storage format, the params of a network with one are written packed
+static const uint32_t GX_BINARY_VERSION = 2;
+
+static bool isBinaryModel( const char * path )
+{
+	char magic[ 4 ] = { 0 };
+
+	FILE * fp = fopen( path, "rb" );
+
+	if( NULL == fp ) return false;
+
+	bool ret = 1 == fread( magic, sizeof( magic ), 1, fp ) && 0 == memcmp( magic, GX_BINARY_MAGIC, sizeof( magic ) );
+
+	fclose( fp );
+
+	return ret;
+}
+
 bool GX_Utils :: load( const char * path, GX_Network * network )
 {
 	auto getString = []( std::string const & line, const char * fmt, const char * defaultValue ) {
@@ -364,6 +448,8 @@ bool GX_Utils :: load( const char * path, GX_Network * network )
 		return value;
 	};
 
+	if( isBinaryModel( path ) ) return loadBinary( path, network );
+
 	std::ifstream fp( path );
 
 	if( !fp ) return false;
@@ -464,6 +550,260 @@ bool GX_Utils :: load( const char * path, GX_Network * network )
 	return true;
 }
 
+bool GX_Utils :: saveBinary( const char * path, const GX_Network & network )
+{
+	FILE * fp = fopen( path, "wb" );
+
+	if( NULL == fp ) return false;
+
+	bool ret = true;
+
+	auto writeU32 = [ & ]( uint32_t value ) {
+		ret = ret && 1 == fwrite( &value, sizeof( value ), 1, fp );
+	};
+
+	int storage = network.getStorage();
+
+	// the file holds doubles in both builds, or the 16-bit values of the storage format
+	auto writeData = [ & ]( const GX_DataVector & data ) {
+		if( GX_Half::eNone != storage ) {
+			GX_HalfVector buff( data.size() );
+			GX_Half::encode( storage, std::begin( data ), data.size(), buff.data() );
+			ret = ret && buff.size() == fwrite( buff.data(), sizeof( GX_HalfType ), buff.size(), fp );
+		} else {
+			std::vector< double > buff( std::begin( data ), std::end( data ) );
+			ret = ret && buff.size() == fwrite( buff.data(), sizeof( double ), buff.size(), fp );
+		}
+	};
+
+	auto writeDims = [ & ]( const GX_Dims & dims ) {
+		writeU32( dims.size() );
+		for( auto & dim : dims ) writeU32( dim );
+	};
+
+	ret = 1 == fwrite( GX_BINARY_MAGIC, sizeof( GX_BINARY_MAGIC ), 1, fp );
+	writeU32( GX_BINARY_VERSION );
+	writeU32( network.getLayers().size() );
+	writeU32( network.getLossFuncType() );
+	writeU32( storage );
+
+	for( auto & layer : network.getLayers() ) {
+		writeU32( layer->getType() );
+		writeU32( layer->getActFunc() ? layer->getActFunc()->getType() : 0 );
+		writeDims( layer->getInputDims() );
+
+		if( GX_BaseLayer::eMaxPool == layer->getType() ) {
+			writeU32( ((GX_MaxPoolLayer*)layer)->getPoolSize() );
+		}
+		if( GX_BaseLayer::eAvgPool == layer->getType() ) {
+			writeU32( ((GX_AvgPoolLayer*)layer)->getPoolSize() );
+		}
+		if( GX_BaseLayer::eConv == layer->getType() ) {
+			GX_ConvLayer * conv = (GX_ConvLayer*)layer;
+			writeDims( conv->getFilterDims() );
+			writeData( conv->getFilters() );
+			writeData( conv->getBiases() );
+		}
+		if( GX_BaseLayer::eFullConn == layer->getType() ) {
+			GX_FullConnLayer * fc = (GX_FullConnLayer*)layer;
+			writeU32( fc->getWeights().size() );
+			for( auto & item : fc->getWeights() ) writeData( item );
+			writeData( fc->getBiases() );
+		}
+	}
+
+	if( 0 != fclose( fp ) ) ret = false;
+
+	return ret;
+}
+
+bool GX_Utils :: loadBinary( const char * path, GX_Network * network )
+{
+	FILE * fp = fopen( path, "rb" );
+
+	if( NULL == fp ) return false;
+
+	bool ret = true;
+
+	auto readU32 = [ & ]() {
+		uint32_t value = 0;
+		ret = ret && 1 == fread( &value, sizeof( value ), 1, fp );
+		return ret ? value : 0;
+	};
+
+	long fileSize = 0 == fseek( fp, 0, SEEK_END ) ? ftell( fp ) : -1;
+
+	if( fileSize < 0 || 0 != fseek( fp, 0, SEEK_SET ) ) {
+		fclose( fp );
+		return false;
+	}
+
+	int storage = GX_Half::eNone;
+
+	// every count read from the file is checked against the bytes left before allocating
+	auto getRemainItems = [ & ]() {
+		size_t itemBytes = GX_Half::eNone != storage ? sizeof( GX_HalfType ) : sizeof( double );
+		long offset = ftell( fp );
+		return offset < 0 || offset > fileSize ? 0 : ( fileSize - offset ) / itemBytes;
+	};
+
+	auto readData = [ & ]( GX_DataVector * data ) {
+		if( GX_Half::eNone != storage ) {
+			GX_HalfVector buff( data->size() );
+			ret = ret && buff.size() == fread( buff.data(), sizeof( GX_HalfType ), buff.size(), fp );
+			if( ret ) GX_Half::decode( storage, buff.data(), buff.size(), std::begin( *data ) );
+		} else {
+			std::vector< double > buff( data->size() );
+			ret = ret && buff.size() == fread( buff.data(), sizeof( double ), buff.size(), fp );
+			if( ret ) std::copy( buff.begin(), buff.end(), std::begin( *data ) );
+		}
+	};
+
+	// only 1 to 4 non-zero dims are meaningful, and the flatten size must not overflow
+	auto readDims = [ & ]( GX_Dims * dims ) {
+		uint32_t count = readU32();
+		ret = ret && count > 0 && count <= 4;
+		for( size_t i = 0, flatten = 1; ret && i < count; i++ ) {
+			size_t dim = readU32();
+			ret = ret && dim > 0 && dim <= SIZE_MAX / sizeof( double ) / flatten;
+			if( ret ) dims->emplace_back( dim );
+			flatten *= dim;
+		}
+	};
+
+	char magic[ 4 ] = { 0 };
+	ret = 1 == fread( magic, sizeof( magic ), 1, fp ) && 0 == memcmp( magic, GX_BINARY_MAGIC, sizeof( magic ) );
+
+	uint32_t version = ret ? readU32() : 0;
+
+	if( version < 1 || version > GX_BINARY_VERSION ) ret = false;
+
+	uint32_t layerCount = readU32();
+
+	network->setLossFuncType( readU32() );
+
+	if( version >= 2 ) storage = readU32();
+
+	if( ret && NULL == GX_Half::getName( storage ) && GX_Half::eNone != storage ) ret = false;
+
+	// a layer takes at least its type, act func and one dim
+	if( layerCount > fileSize / ( 4 * sizeof( uint32_t ) ) ) ret = false;
+
+	if( ret ) network->getLayers().reserve( layerCount );
+
+	for( uint32_t i = 0; ret && i < layerCount; i++ ) {
+		GX_BaseLayer * layer = NULL;
+
+		int layerType = readU32();
+		int actFuncType = readU32();
+
+		GX_Dims inputDims;
+		readDims( &inputDims );
+
+		// a layer takes what the one before it gives
+		if( i > 0 && ret ) {
+			ret = gx_dims_flatten_size( inputDims ) == network->getLayers().back()->getOutputSize();
+		}
+
+		if( ! ret ) break;
+
+		if( GX_BaseLayer::eConv == layerType ) {
+			GX_Dims filterDims;
+			readDims( &filterDims );
+
+			ret = ret && filterDims.size() == 4 && inputDims.size() == 3
+					&& inputDims[ 0 ] == filterDims[ 1 ] && inputDims[ 1 ] >= filterDims[ 2 ]
+					&& inputDims[ 2 ] >= filterDims[ 3 ]
+					&& gx_dims_flatten_size( filterDims ) + filterDims[ 0 ] <= getRemainItems();
+
+			if( ! ret ) break;
+
+			GX_DataVector filters( gx_dims_flatten_size( filterDims ) ), biases( filterDims[ 0 ] );
+			readData( &filters );
+			readData( &biases );
+
+			if( ret ) layer = new GX_ConvLayer( inputDims, filters, filterDims, biases );
+		}
+		if( GX_BaseLayer::eMaxPool == layerType ) {
+			size_t poolSize = readU32();
+
+			ret = ret && inputDims.size() == 3 && poolSize > 0;
+
+			if( ret ) layer = new GX_MaxPoolLayer( inputDims, poolSize );
+		}
+		if( GX_BaseLayer::eAvgPool == layerType ) {
+			size_t poolSize = readU32();
+
+			ret = ret && inputDims.size() == 3 && poolSize > 0;
+
+			if( ret ) layer = new GX_AvgPoolLayer( inputDims, poolSize );
+		}
+		if( GX_BaseLayer::eFullConn == layerType ) {
+			size_t count = readU32(), inputCount = gx_dims_flatten_size( inputDims );
+
+			// count neurons of inputCount weights and a bias each
+			ret = ret && count > 0 && count <= getRemainItems() / ( inputCount + 1 );
+
+			if( ! ret ) break;
+
+			GX_DataMatrix weights( count );
+			for( auto & item : weights ) {
+				item.resize( gx_dims_flatten_size( inputDims ) );
+				readData( &item );
+			}
+
+			GX_DataVector biases( count );
+			readData( &biases );
+
+			if( ret ) {
+				layer = new GX_FullConnLayer( count, gx_dims_flatten_size( inputDims ) );
+				((GX_FullConnLayer*)layer)->setWeights( weights, biases );
+			}
+		}
+
+		if( NULL == layer ) {
+			ret = false;
+			break;
+		}
+
+		if( actFuncType > 0 ) layer->setActFunc( new GX_ActFunc( actFuncType ) );
+
+		network->addLayer( layer );
+	}
+
+	// the weights were widened from the packed values, packing them again gives the same bits
+	if( ret ) network->setStorage( storage );
+
+	fclose( fp );
+
+	return ret;
+}
+
+long GX_Utils :: getPeakRSS()
+{
+	struct rusage usage;
+	memset( &usage, 0, sizeof( usage ) );
+
+	if( 0 != getrusage( RUSAGE_SELF, &usage ) ) return -1;
+
+	return usage.ru_maxrss;
+}
+
+long GX_Utils :: getCurrentRSS()
+{
+	long pages = -1;
+
+	FILE * fp = fopen( "/proc/self/statm", "r" );
+
+	if( NULL == fp ) return -1;
+
+	if( 1 != fscanf( fp, "%*s %ld", &pages ) ) pages = -1;
+
+	fclose( fp );
+
+	return pages < 0 ? -1 : pages * ( sysconf( _SC_PAGESIZE ) / 1024 );
+}
+
 void GX_Utils :: getCmdArgs( int argc, char * const argv[],
 		const CmdArgs_t & defaultArgs, CmdArgs_t * args )
 {
@@ -478,6 +818,15 @@ void GX_Utils :: getCmdArgs( int argc, char * const argv[],
 		{ "shuffle",   required_argument,  NULL, 8 },
 		{ "debug",     no_argument,        NULL, 9 },
 		{ "help",      no_argument,        NULL, 10 },
+		{ "perf",      required_argument,  NULL, 11 },
+		{ "trace",     required_argument,  NULL, 12 },
+		{ "tracewindow", required_argument, NULL, 13 },
+		{ "stats",     required_argument,  NULL, 14 },
+		{ "keep",      required_argument,  NULL, 15 },
+		{ "delta",     required_argument,  NULL, 16 },
+		{ "pool",      required_argument,  NULL, 17 },
+		{ "procs",     required_argument,  NULL, 18 },
+		{ "transport", required_argument,  NULL, 19 },
 		{ 0, 0, 0, 0}
 	};
 
@@ -486,6 +835,9 @@ void GX_Utils :: getCmdArgs( int argc, char * const argv[],
 
 	*args = defaultArgs;;
 
+	if( args->mTraceBatchCount <= 0 ) args->mTraceBatchCount = 10;
+	if( args->mTraceEpochInterval <= 0 ) args->mTraceEpochInterval = 1;
+
 	while( ( c = getopt_long( argc, argv, "v", opts, NULL )) != EOF ) {
 		switch ( c ) {
 			case 1:
@@ -515,6 +867,33 @@ void GX_Utils :: getCmdArgs( int argc, char * const argv[],
 			case 9:
 				args->mIsDebug = true;
 				break;
+			case 11:
+				args->mPerfRegion = optarg;
+				break;
+			case 12:
+				args->mTracePath = optarg;
+				break;
+			case 13:
+				sscanf( optarg, "%d,%d", &( args->mTraceBatchCount ), &( args->mTraceEpochInterval ) );
+				break;
+			case 14:
+				args->mStatsPath = optarg;
+				break;
+			case 15:
+				args->mKeepCount = atoi( optarg );
+				break;
+			case 16:
+				args->mDeltaInterval = atoi( optarg );
+				break;
+			case 17:
+				args->mPoolSize = atoi( optarg );
+				break;
+			case 18:
+				args->mProcCount = atoi( optarg );
+				break;
+			case 19:
+				args->mTransport = optarg;
+				break;
 			case '?' :
 			case 'v' :
 				printf( "Usage: %s [-v]\n", argv[ 0 ] );
@@ -527,6 +906,17 @@ void GX_Utils :: getCmdArgs( int argc, char * const argv[],
 				printf( "\t--lambda <lambda> default is %.2f\n", defaultArgs.mLambda );
 				printf( "\t--shuffle <shuffle> 0 for no shuffle, otherwise shuffle, default is %d\n", defaultArgs.mIsShuffle );
 				printf( "\t--debug debug mode on\n" );
+				printf( "\t--perf <epoch|eval|layer:N> count cpu events of the region, timing only if not permitted\n" );
+				printf( "\t--trace <trace path> write chrome trace json of the sampled batches\n" );
+				printf( "\t--tracewindow <N,M> trace the first N batches of every M epochs, default is 10,1\n" );
+				printf( "\t--stats <stats path> publish live counters for gxtop\n" );
+				printf( "\t--keep <checkpoint count> keep the newest N checkpoints, 0 keeps all, default is %d\n",
+						defaultArgs.mKeepCount );
+				printf( "\t--delta <rebase interval> delta checkpoints with a full base every N epochs, 0 for full text\n" );
+				printf( "\t--pool <thread count> split the conv and fc loops over N pool threads, default is %d\n",
+						defaultArgs.mPoolSize );
+				printf( "\t--procs <process count> data-parallel train in N processes, default is 1\n" );
+				printf( "\t--transport <shm|socket> all-reduce over shared memory or unix sockets, default is shm\n" );
 				printf( "\t--help show usage\n" );
 				exit( 0 );
 		}
@@ -538,6 +928,13 @@ void GX_Utils :: getCmdArgs( int argc, char * const argv[],
 		args->mEpochCount, args->mMiniBatchCount, args->mLearningRate, args->mLambda );
 	printf( "\tshuffle %s, debug %s\n", args->mIsShuffle ? "true" : "false", args->mIsDebug ? "true" : "false" );
 	printf( "\tmodelPath %s\n", NULL == args->mModelPath ? "NULL" : args->mModelPath );
+	printf( "\tperfRegion %s\n", NULL == args->mPerfRegion ? "NULL" : args->mPerfRegion );
+	printf( "\ttracePath %s, traceWindow %d,%d\n", NULL == args->mTracePath ? "NULL" : args->mTracePath,
+		args->mTraceBatchCount, args->mTraceEpochInterval );
+	printf( "\tstatsPath %s, keepCount %d, deltaInterval %d\n", NULL == args->mStatsPath ? "NULL" : args->mStatsPath,
+		args->mKeepCount, args->mDeltaInterval );
+	printf( "\tpoolSize %d, procCount %d, transport %s\n", args->mPoolSize, args->mProcCount,
+		NULL == args->mTransport ? "shm" : args->mTransport );
 	printf( "\n" );
 }
 
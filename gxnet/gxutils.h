@@ -14,9 +14,20 @@ typedef struct tagCmdArgs {
 	bool mIsDebug;
 	bool mIsShuffle;
 	const char * mModelPath;
+	const char * mPerfRegion;
+	const char * mTracePath;
+	int mTraceBatchCount;
+	int mTraceEpochInterval;
+	const char * mStatsPath;
+	int mKeepCount;
+	int mDeltaInterval;
+	int mPoolSize;
+	int mProcCount;
+	const char * mTransport;
 } CmdArgs_t;
 
 class GX_Network;
+class GX_Dataset;
 
 class GX_Utils {
 public:
@@ -40,6 +51,14 @@ public:
 
 	static bool loadMnistLabels( int limitCount, const char * path, GX_DataMatrix * labels, int maxClasses );
 
+	// same as above, the samples are appended to one slab
+	static bool loadMnistImages( const int limitCount, const char * path, GX_Dataset * images );
+
+	static bool loadMnistLabels( int limitCount, const char * path, GX_Dataset * labels, int maxClasses );
+
+	// class index per sample, for the GX_LabelVector overloads of train
+	static bool loadMnistLabels( int limitCount, const char * path, GX_LabelVector * labels, int maxClasses );
+
 	static void printMatrix( const char * tag, const GX_DataMatrix & data,
 			bool useSciFmt = true, bool colorMax = false);
 
@@ -51,8 +70,21 @@ public:
 
 	static bool save( const char * path, const GX_Network & network );
 
+	// text or binary, detected by the file magic
 	static bool load( const char * path, GX_Network * network );
 
+	// same content as save, raw little-endian doubles, loads without parsing text.
+	// a network with a storage format is written as its 16-bit values and loads with that format
+	static bool saveBinary( const char * path, const GX_Network & network );
+
+	static bool loadBinary( const char * path, GX_Network * network );
+
+	// peak resident set size of the current process, in KB
+	static long getPeakRSS();
+
+	// current resident set size of the current process, in KB
+	static long getCurrentRSS();
+
 public:
 
 	static void getCmdArgs( int argc, char * const argv[],
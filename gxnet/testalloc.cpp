@@ -0,0 +1,88 @@
+
+#include "gxnet.h"
+#include "gxlayer.h"
+#include "gxpool.h"
+#include "gxhalf.h"
+#include "gxutils.h"
+
+#include <atomic>
+#include <new>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// every operator new of the process, the pool workers included
+static std::atomic< size_t > gAllocCount( 0 );
+
+void * operator new( size_t size )
+{
+	gAllocCount.fetch_add( 1, std::memory_order_relaxed );
+
+	void * ptr = malloc( size > 0 ? size : 1 );
+
+	if( NULL == ptr ) throw std::bad_alloc();
+
+	return ptr;
+}
+
+void operator delete( void * ptr ) noexcept
+{
+	free( ptr );
+}
+
+void operator delete( void * ptr, size_t ) noexcept
+{
+	free( ptr );
+}
+
+// forward on a context must not allocate once the context is made
+int test( const GX_Network & network, const GX_DataVector & input, int poolSize )
+{
+	enum { CALL_COUNT = 100 };
+
+	GX_InferenceContext ctx( network );
+
+	// the first call may size what the context keeps
+	network.forward( std::begin( input ), &ctx );
+
+	size_t beginCount = gAllocCount.load();
+
+	for( int i = 0; i < CALL_COUNT; i++ ) network.forward( std::begin( input ), &ctx );
+
+	size_t allocCount = gAllocCount.load() - beginCount;
+
+	const char * storage = GX_Half::getName( network.getStorage() );
+
+	printf( "forward %s, pool %d: %zu allocations in %d calls\n",
+			NULL != storage ? storage : "full", poolSize, allocCount, CALL_COUNT );
+
+	return allocCount > 0 ? -1 : 0;
+}
+
+int main( int argc, const char * argv[] )
+{
+	GX_Network network;
+
+	network.addLayer( new GX_ConvLayer( { 1, 28, 28 }, 16, 5 ) );
+	network.addLayer( new GX_MaxPoolLayer( { 16, 24, 24 }, 2 ) );
+	network.addLayer( new GX_FullConnLayer( 100, 16 * 12 * 12 ) );
+	network.addLayer( new GX_FullConnLayer( 10, 100 ) );
+
+	GX_DataVector input( 28 * 28 );
+	for( auto & item : input ) item = GX_Utils::random();
+
+	int ret = 0;
+
+	for( int poolSize : { 0, 2 } ) {
+		GX_ThreadPool::setDefault( poolSize );
+
+		for( int format : { GX_Half::eNone, GX_Half::eBF16, GX_Half::eFP16 } ) {
+			network.setStorage( format );
+			ret |= test( network, input, poolSize );
+		}
+
+		GX_ThreadPool::setDefault( 0 );
+	}
+
+	return ret;
+}
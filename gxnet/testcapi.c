@@ -0,0 +1,122 @@
+
+#include "gxapi.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+* Plain C client of libgxnet, classify the seeds dataset with the models saved by testseeds.
+*/
+
+static int loadSeeds( const char * path, size_t inputSize, double ** images, int ** labels )
+{
+	FILE * fp = fopen( path, "r" );
+
+	if( NULL == fp ) return 0;
+
+	int count = 0, capacity = 256;
+
+	*images = (double*)malloc( capacity * inputSize * sizeof( double ) );
+	*labels = (int*)malloc( capacity * sizeof( int ) );
+
+	while( count < capacity ) {
+		double * image = *images + count * inputSize;
+
+		size_t i = 0;
+		for( ; i < inputSize; i++ ) {
+			if( 1 != fscanf( fp, "%lf,", image + i ) ) break;
+		}
+
+		if( i < inputSize || 1 != fscanf( fp, "%d", *labels + count ) ) break;
+
+		count++;
+	}
+
+	fclose( fp );
+
+	// min-max normalize every column, the same as testseeds
+	for( size_t i = 0; i < inputSize; i++ ) {
+		double min = ( *images )[ i ], max = ( *images )[ i ];
+		for( int j = 0; j < count; j++ ) {
+			double value = ( *images )[ j * inputSize + i ];
+			if( value < min ) min = value;
+			if( value > max ) max = value;
+		}
+		for( int j = 0; j < count; j++ ) {
+			( *images )[ j * inputSize + i ] = ( ( *images )[ j * inputSize + i ] - min ) / ( max - min );
+		}
+	}
+
+	return count;
+}
+
+static int test( const char * path )
+{
+	gx_model_t * model = gx_model_load( path );
+
+	if( NULL == model ) {
+		printf( "gx_model_load( %s ) fail\n", path );
+		return -1;
+	}
+
+	gx_context_t * ctx = gx_context_new( model );
+
+	if( NULL == ctx ) {
+		printf( "gx_context_new( %s ) fail\n", path );
+		gx_model_free( model );
+		return -1;
+	}
+
+	size_t inputSize = gx_model_input_size( model ), outputSize = gx_model_output_size( model );
+
+	double * images = NULL;
+	int * labels = NULL;
+
+	int count = loadSeeds( "seeds_dataset.csv", inputSize, &images, &labels );
+
+	double * scores = (double*)malloc( count * outputSize * sizeof( double ) );
+	double * batchScores = (double*)malloc( count * outputSize * sizeof( double ) );
+	int * classes = (int*)malloc( count * sizeof( int ) );
+
+	int correct = 0, mismatch = 0;
+
+	for( int i = 0; i < count; i++ ) {
+		int type = gx_classify( ctx, images + i * inputSize, scores + i * outputSize );
+
+		// labels in the csv start from 1
+		if( type + 1 == labels[ i ] ) correct++;
+	}
+
+	if( 0 != gx_classify_batch( ctx, images, count, batchScores, classes ) ) mismatch = count;
+
+	if( 0 != memcmp( scores, batchScores, count * outputSize * sizeof( double ) ) ) mismatch++;
+
+	printf( "%s: input %zu, output %zu, check %d/%d = %.2f, batch mismatch %d\n",
+			path, inputSize, outputSize, correct, count, ((float)correct) / count, mismatch );
+
+	gx_context_free( ctx );
+	gx_model_free( model );
+
+	free( images );
+	free( labels );
+	free( scores );
+	free( batchScores );
+	free( classes );
+
+	return mismatch > 0 ? -1 : 0;
+}
+
+int main( const int argc, char * argv[] )
+{
+	int ret = 0;
+
+	if( argc > 1 ) {
+		for( int i = 1; i < argc; i++ ) ret |= test( argv[ i ] );
+	} else {
+		ret |= test( "./seeds.model" );
+		ret |= test( "./seeds.bin.model" );
+	}
+
+	return ret;
+}
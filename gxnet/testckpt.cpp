@@ -0,0 +1,130 @@
+
+#include "gxnet.h"
+#include "gxckpt.h"
+#include "gxhalf.h"
+#include "gxutils.h"
+#include "gxsynth.h"
+
+#include <unistd.h>
+#include <stdio.h>
+
+enum { CHECKPOINT_COUNT = 4 };
+
+static void removeFiles( const char * textPrefix, const char * deltaPrefix, int count )
+{
+	for( int i = 0; i < count; i++ ) {
+		char path[ 256 ] = { 0 };
+		snprintf( path, sizeof( path ), "%s.%d.model", textPrefix, i );
+		unlink( path );
+		snprintf( path, sizeof( path ), "%s.%d.base.model", deltaPrefix, i );
+		unlink( path );
+		snprintf( path, sizeof( path ), "%s.%d.delta", deltaPrefix, i );
+		unlink( path );
+	}
+}
+
+// text and delta checkpoints of a few short epochs, the delta chain must rebuild the live
+// network bit for bit, also when the network keeps its weights packed to bf16
+bool testCheckpoint( const char * tag, GX_Network & network, const CmdArgs_t & args,
+		const GX_Dataset & input, const GX_Dataset & target )
+{
+	char textPrefix[ 128 ] = { 0 }, deltaPrefix[ 128 ] = { 0 };
+	snprintf( textPrefix, sizeof( textPrefix ), "./testckpt.%s.%d.text", tag, getpid() );
+	snprintf( deltaPrefix, sizeof( deltaPrefix ), "./testckpt.%s.%d.delta", tag, getpid() );
+
+	bool isSucc = true;
+
+	{
+		GX_Checkpointer text( textPrefix, 0, GX_Checkpointer::eText );
+		GX_Checkpointer delta( deltaPrefix, 0, GX_Checkpointer::eDelta );
+
+		for( int i = 0; i < CHECKPOINT_COUNT; i++ ) {
+			if( i > 0 ) network.train( input, target, 1, args.mMiniBatchCount, args.mLearningRate );
+
+			isSucc = text.save( network, i ) && text.flush() && isSucc;
+			isSucc = delta.save( network, i ) && delta.flush() && isSucc;
+		}
+
+		printf( "%s checkpoint, text %.1f KB, delta %.1f KB\n", tag,
+				text.getWrittenBytes() / 1024.0, delta.getWrittenBytes() / 1024.0 );
+	}
+
+	GX_Network rebuilt;
+	isSucc = GX_Checkpointer::rebuild( deltaPrefix, CHECKPOINT_COUNT - 1, &rebuilt ) && isSucc;
+
+	bool isSame = GX_Synth::isSameParams( network, rebuilt );
+
+	// a storage format must not leak into the chain, the bases stay full width
+	GX_Network stored;
+	network.clone( &stored );
+	stored.setStorage( GX_Half::eBF16 );
+
+	{
+		GX_Checkpointer delta( deltaPrefix, 0, GX_Checkpointer::eDelta, 2 );
+
+		for( int i = 0; i < CHECKPOINT_COUNT; i++ ) {
+			stored.train( input, target, 1, args.mMiniBatchCount, args.mLearningRate );
+			isSucc = delta.save( stored, CHECKPOINT_COUNT + i ) && isSucc;
+		}
+
+		isSucc = delta.flush() && isSucc;
+	}
+
+	GX_Network storedRebuilt;
+	isSucc = GX_Checkpointer::rebuild( deltaPrefix, 2 * CHECKPOINT_COUNT - 1, &storedRebuilt ) && isSucc;
+
+	bool isStoredSame = GX_Synth::isSameParams( stored, storedRebuilt );
+
+	removeFiles( textPrefix, deltaPrefix, 2 * CHECKPOINT_COUNT );
+
+	printf( "%s checkpoint %s, rebuild %s, bf16 rebuild %s\n", tag, isSucc ? "succ" : "fail",
+			isSame ? "identical" : "differ", isStoredSame ? "identical" : "differ" );
+
+	return isSucc && isSame && isStoredSame;
+}
+
+// a checkpoint that can not be written shows up in the next flush, and only there
+bool testFailure( const char * tag, GX_Network & network )
+{
+	GX_Checkpointer checkpointer( "./testckpt.missing/dir/model", 0, GX_Checkpointer::eDelta );
+
+	bool isSaved = checkpointer.save( network, 0 );
+	bool isFlushed = checkpointer.flush();
+	bool isFlushedAgain = checkpointer.flush();
+
+	printf( "%s unwritable checkpoint, save %s, flush %s, %zu failed, next flush %s\n",
+			tag, isSaved ? "succ" : "fail", isFlushed ? "succ" : "fail", checkpointer.getFailedCount(),
+			isFlushedAgain ? "succ" : "fail" );
+
+	return isSaved && ! isFlushed && 1 == checkpointer.getFailedCount() && isFlushedAgain;
+}
+
+int main( const int argc, char * argv[] )
+{
+	CmdArgs_t defaultArgs = {
+		.mTrainingCount = 500,
+		.mEvalCount = 0,
+		.mEpochCount = 1,
+		.mMiniBatchCount = 100,
+		.mLearningRate = 3.0,
+	};
+
+	CmdArgs_t args = defaultArgs;
+
+	GX_Utils::getCmdArgs( argc, argv, defaultArgs, &args );
+
+	bool isSucc = true;
+
+	for( const char * tag : { "mnist", "emnist" } ) {
+		GX_Network network;
+		GX_DataMatrix input, target;
+		GX_Synth::make( tag, args.mTrainingCount, 2024, &network, &input, &target );
+
+		isSucc = testCheckpoint( tag, network, args, GX_Dataset( input ), GX_Dataset( target ) ) && isSucc;
+		isSucc = testFailure( tag, network ) && isSucc;
+	}
+
+	printf( "testckpt %s\n", isSucc ? "succ" : "fail" );
+
+	return isSucc ? 0 : 1;
+}
@@ -0,0 +1,105 @@
+
+#include "gxnet.h"
+#include "gxutils.h"
+#include "gxdataset.h"
+#include "gxcache.h"
+#include "gxsynth.h"
+
+#include <random>
+#include <numeric>
+#include <algorithm>
+
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+
+enum { SEED = 2024 };
+
+// one shuffled pass over every item, one heap block per row against the slab, the sums must match
+bool testDataset( const char * tag, const GX_DataMatrix & rows, const GX_Dataset & data )
+{
+	std::vector< size_t > order( rows.size() );
+	std::iota( order.begin(), order.end(), 0 );
+	std::shuffle( order.begin(), order.end(), std::mt19937( SEED ) );
+
+	GX_AccumType rowsSum = 0;
+	for( auto & i : order ) {
+		for( size_t j = 0; j < rows[ i ].size(); j++ ) rowsSum += rows[ i ][ j ];
+	}
+
+	GX_AccumType dataSum = 0;
+	size_t dim = data.getDim();
+	for( auto & i : order ) {
+		const GX_DataType * sample = data[ i ];
+		for( size_t j = 0; j < dim; j++ ) dataSum += sample[ j ];
+	}
+
+	bool isSame = rows.size() == data.size() && rowsSum == dataSum;
+
+	printf( "%s dataset, %zu samples, stride %zu, sum %s\n", tag, data.size(), data.getStride(),
+			isSame ? "identical" : "differ" );
+
+	return isSame;
+}
+
+// the training set through a cache file: saved, mapped back bit for bit, and missed once the key changes
+bool testCache( const char * tag, const GX_Dataset & input, const GX_Dataset & target )
+{
+	char path[ 128 ] = { 0 };
+	snprintf( path, sizeof( path ), "./testdata.%s.%d.cache", tag, getpid() );
+
+	GX_DataCache cache;
+	cache.addValue( SEED );
+	cache.addValue( input.size() );
+
+	bool isSaved = cache.save( path, { &input, &target }, {} );
+
+	GX_Dataset mappedInput, mappedTarget;
+	bool isMapped = isSaved && cache.load( path, { &mappedInput, &mappedTarget }, {} );
+
+	bool isSame = isMapped && mappedInput.size() == input.size() && mappedTarget.size() == target.size()
+			&& 0 == memcmp( mappedInput.getSlab(), input.getSlab(), GX_Dataset::getSlabBytes( input.size(), input.getDim() ) )
+			&& 0 == memcmp( mappedTarget.getSlab(), target.getSlab(), GX_Dataset::getSlabBytes( target.size(), target.getDim() ) );
+
+	GX_DataCache changed;
+	changed.addValue( SEED + 1 );
+	changed.addValue( input.size() );
+
+	GX_Dataset missedInput, missedTarget;
+	bool isMissed = ! changed.load( path, { &missedInput, &missedTarget }, {} );
+
+	unlink( path );
+
+	printf( "%s cache, save %s, map %s, samples %s, changed key %s\n", tag, isSaved ? "succ" : "fail",
+			isMapped ? "succ" : "fail", isSame ? "identical" : "differ", isMissed ? "missed" : "hit" );
+
+	return isSaved && isMapped && isSame && isMissed;
+}
+
+int main( const int argc, char * argv[] )
+{
+	CmdArgs_t defaultArgs = {
+		.mTrainingCount = 1000,
+	};
+
+	CmdArgs_t args = defaultArgs;
+
+	GX_Utils::getCmdArgs( argc, argv, defaultArgs, &args );
+
+	bool isSucc = true;
+
+	for( const char * tag : { "mnist", "emnist" } ) {
+		GX_Network network;
+		GX_DataMatrix input, target;
+		GX_Synth::make( tag, args.mTrainingCount, SEED, &network, &input, &target );
+
+		GX_Dataset trainInput( input ), trainTarget( target );
+
+		isSucc = testDataset( tag, input, trainInput ) && isSucc;
+		isSucc = testCache( tag, trainInput, trainTarget ) && isSucc;
+	}
+
+	printf( "testdata %s\n", isSucc ? "succ" : "fail" );
+
+	return isSucc ? 0 : 1;
+}
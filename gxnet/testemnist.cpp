@@ -2,59 +2,66 @@
 #include "gxact.h"
 #include "gxutils.h"
 #include "gxeval.h"
+#include "gxprof.h"
+#include "gxtrace.h"
+#include "gxstats.h"
+#include "gxckpt.h"
+#include "gxpool.h"
+#include "gxaugment.h"
+#include "gxcache.h"
 
 #include <unistd.h>
 
-bool loadData( const CmdArgs_t & args, GX_DataMatrix * input, GX_DataMatrix * target,
-		GX_DataMatrix * input4eval, GX_DataMatrix * target4eval )
+// the expanded images have another size, they go to a new dataset
+void expandImages( GX_Dataset * images )
 {
-	const char * path = "emnist/train-images-idx3-ubyte";
+	GX_Dataset expanded;
+	expanded.reserve( images->size() );
+
+	GX_DataVector orgImage, newImage;
+
+	for( size_t i = 0; i < images->size(); i++ ) {
+		images->copySample( i, &orgImage );
+		GX_Utils::expandMnistImage( orgImage, &newImage );
+		expanded.append( newImage );
+	}
+
+	images->swap( expanded );
+}
+
+static const char * TRAIN_IMAGES = "emnist/train-images-idx3-ubyte";
+static const char * TRAIN_LABELS = "emnist/train-labels-idx1-ubyte";
+static const char * TEST_IMAGES = "emnist/test-images-idx3-ubyte";
+static const char * TEST_LABELS = "emnist/test-labels-idx1-ubyte";
+
+// the sets built from the idx files are kept here, mapped by the next run
+static const char * CACHE_PATH = "emnist/cache.bin";
+
+// change it with buildData, the old caches miss
+static const int PREPROCESS_VERSION = 1;
+
+bool buildData( const CmdArgs_t & args, GX_Dataset * input, GX_LabelVector * target,
+		GX_Dataset * input4eval, GX_LabelVector * target4eval )
+{
+	const char * path = TRAIN_IMAGES;
 	if( ! GX_Utils::loadMnistImages( args.mTrainingCount, path, input ) ) {
 		printf( "read %s fail\n", path );
 		return false;
 	}
 
-	path = "emnist/train-labels-idx1-ubyte";
+	path = TRAIN_LABELS;
 	if( ! GX_Utils::loadMnistLabels( args.mTrainingCount, path, target, 26 ) ) {
 		printf( "read %s fail\n", path );
 		return false;
 	}
 
-	// load rotated images
-	path = "emnist/train-images-idx3-ubyte.rot";
-	if( 0 == access( path, F_OK ) ) {
-		if( ! GX_Utils::loadMnistImages( args.mTrainingCount, path, input ) ) {
-			printf( "read %s fail\n", path );
-			return false;
-		}
-
-		path = "emnist/train-labels-idx1-ubyte.rot";
-		if( ! GX_Utils::loadMnistLabels( args.mTrainingCount, path, target, 26 ) ) {
-			printf( "read %s fail\n", path );
-			return false;
-		}
-	}
-
-	// center mnist images
-	size_t orgSize = input->size();
-
-	for( size_t i = 0; i < orgSize; i++ ) {
-		GX_DataVector newImage;
-		if( GX_Utils::centerMnistImage( input->at( i ), &newImage ) ) {
-			input->emplace_back( newImage );
-			target->emplace_back( target->at( i ) );
-		}
-	}
-
-	printf( "center %zu images\n", input->size() - orgSize );
-
-	path = "emnist/test-images-idx3-ubyte";
+	path = TEST_IMAGES;
 	if( ! GX_Utils::loadMnistImages( args.mEvalCount, path, input4eval ) ) {
 		printf( "read %s fail\n", path );
 		return false;
 	}
 
-	path = "emnist/test-labels-idx1-ubyte";
+	path = TEST_LABELS;
 	if( ! GX_Utils::loadMnistLabels( args.mEvalCount, path, target4eval, 26 ) ) {
 		printf( "read %s fail\n", path );
 		return false;
@@ -63,32 +70,58 @@ bool loadData( const CmdArgs_t & args, GX_DataMatrix * input, GX_DataMatrix * ta
 	printf( "input { %zu }, target { %zu }, input4eval { %zu }, target4eval { %zu }\n",
 			input->size(), target->size(), input4eval->size(), target4eval->size() );
 
-	// convert to 32 * 32
-	for( auto & item : *input ) {
-		GX_DataVector orgImage = item;
-		GX_Utils::expandMnistImage( orgImage, &item );
+	// the training images stay 28 * 28, the augmenter pads them while training
+	expandImages( input4eval );
+
+	return true;
+}
+
+// from the cache when the idx files and the counts are the same as when it was saved
+bool loadData( const CmdArgs_t & args, GX_Dataset * input, GX_LabelVector * target,
+		GX_Dataset * input4eval, GX_LabelVector * target4eval )
+{
+	GX_DataCache cache;
+
+	bool isHashed = true;
+	for( auto & path : { TRAIN_IMAGES, TRAIN_LABELS, TEST_IMAGES, TEST_LABELS } ) {
+		isHashed = cache.addFile( path ) && isHashed;
 	}
 
-	for( auto & item : *input4eval ) {
-		GX_DataVector orgImage = item;
-		GX_Utils::expandMnistImage( orgImage, &item );
+	cache.addValue( args.mTrainingCount );
+	cache.addValue( args.mEvalCount );
+	cache.addValue( PREPROCESS_VERSION );
+
+	if( isHashed && cache.load( CACHE_PATH, { input, input4eval }, { target, target4eval } ) ) {
+		printf( "map %s, key %016llx, input { %zu }, target { %zu }, input4eval { %zu }, target4eval { %zu }\n",
+				CACHE_PATH, (unsigned long long)cache.getKey(), input->size(), target->size(),
+				input4eval->size(), target4eval->size() );
+		return true;
+	}
+
+	if( ! buildData( args, input, target, input4eval, target4eval ) ) return false;
+
+	if( isHashed ) {
+		bool ret = cache.save( CACHE_PATH, { input, input4eval }, { target, target4eval } );
+		printf( "save %s, key %016llx, %s\n", CACHE_PATH, (unsigned long long)cache.getKey(), ret ? "succ" : "fail" );
 	}
 
 	return true;
 }
 
+static GX_Checkpointer * gCheckpointer = NULL;
+
 void save_checkpoint( GX_Network & network, int epoch, GX_DataType loss )
 {
-	char path[ 128 ] = { 0 };
-	snprintf( path, sizeof( path ), "./emnist.%d.model", epoch );
+	bool ret = gCheckpointer->save( network, epoch );
 
-	GX_Utils::save( path, network );
-	printf( "\tsave checkpoint (%s) for epoch#%d, loss %f\n", path, epoch, loss );
+	printf( "\tsave checkpoint (./emnist) for epoch#%d, loss %f, %s, snapshot %ld us\n",
+			epoch, loss, ret ? "succ" : "fail", gCheckpointer->getSnapshotMicros() );
 }
 
 void test( const CmdArgs_t & args )
 {
-	GX_DataMatrix input, target, input4eval, target4eval;
+	GX_Dataset input, input4eval;
+	GX_LabelVector target, target4eval;
 
 	if( ! loadData( args, &input, &target, &input4eval, &target4eval ) ) {
 		printf( "loadData fail\n" );
@@ -97,10 +130,26 @@ void test( const CmdArgs_t & args )
 
 	const char * path = "./emnist.model";
 
+	GX_Checkpointer checkpointer( "./emnist", args.mKeepCount,
+			args.mDeltaInterval > 0 ? GX_Checkpointer::eDelta : GX_Checkpointer::eText, args.mDeltaInterval );
+	gCheckpointer = &checkpointer;
+
+	GX_Profiler profiler;
+	bool isPerf = false;
+
+	GX_Tracer tracer;
+	tracer.setWindow( args.mTraceBatchCount, args.mTraceEpochInterval );
+
+	GX_StatsWriter statsWriter;
+	bool isStats = NULL != args.mStatsPath && statsWriter.open( args.mStatsPath );
+
 	//train & save model
 	{
 		GX_Network network;
 
+		if( NULL != args.mTracePath ) network.setTracer( &tracer );
+		if( isStats ) network.setStatsWriter( &statsWriter );
+
 		network.setOnEpochEnd( save_checkpoint );
 		network.setLossFuncType( GX_Network::eCrossEntropy );
 
@@ -128,26 +177,45 @@ void test( const CmdArgs_t & args )
 			layer = new GX_MaxPoolLayer( layer->getOutputDims(), 2 );
 			network.addLayer( layer );
 
-			layer = new GX_FullConnLayer( 60, layer ? layer->getOutputSize() : input[ 0 ].size() );
+			layer = new GX_FullConnLayer( 60, layer->getOutputSize() );
 			layer->setActFunc( GX_ActFunc::sigmoid() );
 			network.addLayer( layer );
 
-			layer = new GX_FullConnLayer( target[ 0 ].size(), layer->getOutputSize() );
+			layer = new GX_FullConnLayer( 26, layer->getOutputSize() );
 			layer->setActFunc( GX_ActFunc::softmax() );
 			network.addLayer( layer );
 		}
 
+		// a "layer:N" region needs the layers
+		isPerf = NULL != args.mPerfRegion && profiler.enablePerf( args.mPerfRegion, network.getLayers().size() );
+		if( isPerf ) network.setProfiler( &profiler );
+
 		gx_eval( "before train", network, input4eval, target4eval, args.mIsDebug );
 
 		network.print();
 
+		// fresh centering, rotation and shift of every sample in every epoch, padded to 32 * 32
+		GX_Augmenter augmenter( 28 );
+		augmenter.setCenterRate( 0.5 );
+		augmenter.setRotation( 15 );
+		augmenter.setTranslation( 2 );
+		augmenter.setPadding( 2 );
+
+		network.setAugmenter( &augmenter, 2 );
+
 		bool ret = network.train( input, target,
 				args.mEpochCount, args.mMiniBatchCount, args.mLearningRate, args.mLambda );
 
+		if( ! checkpointer.flush() ) printf( "checkpoint fail, %zu never written\n", checkpointer.getFailedCount() );
+
 		GX_Utils::save( path, network );
 
 		printf( "train %s\n", ret ? "succ" : "fail" );
 
+		if( NULL != args.mTracePath ) {
+			printf( "save trace %s %s\n", args.mTracePath, tracer.save( args.mTracePath ) ? "succ" : "fail" );
+		}
+
 		//gx_eval( "after train", network, input4eval, target4eval, args.mIsDebug );
 	}
 
@@ -155,6 +223,8 @@ void test( const CmdArgs_t & args )
 	{
 		GX_Network network;
 
+		if( isPerf ) network.setProfiler( &profiler );
+
 		GX_Utils::load( path, &network );
 
 		gx_eval( "load model", network, input4eval, target4eval, args.mIsDebug );
@@ -172,14 +242,19 @@ int main( const int argc, char * argv[] )
 		.mLambda = 5.0,
 		.mIsDebug = false,
 		.mIsShuffle = true,
+		.mKeepCount = 3,
 	};
 
 	CmdArgs_t args = defaultArgs;
 
 	GX_Utils::getCmdArgs( argc, argv, defaultArgs, &args );
 
+	GX_ThreadPool::setDefault( args.mPoolSize );
+
 	test( args );
 
+	GX_ThreadPool::setDefault( 0 );
+
 	return 0;
 }
 
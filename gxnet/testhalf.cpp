@@ -0,0 +1,111 @@
+
+#include "gxnet.h"
+#include "gxutils.h"
+#include "gxhalf.h"
+#include "gxsynth.h"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <math.h>
+
+enum { SEED = 2024 };
+
+// forward of a copy with 16-bit storage against the full width outputs, then the same copy
+// through a binary save and load, and fp16 with the software conversion: both must give the
+// outputs of the copy bit for bit
+bool testHalf( const char * tag, const GX_Network & network, int format, const GX_DataMatrix & input4eval )
+{
+	GX_Network half;
+	network.clone( &half );
+	half.setStorage( format );
+
+	GX_InferenceContext fullCtx( network ), ctx( half );
+
+	GX_DataMatrix output;
+
+	size_t agree = 0;
+
+	for( auto & item : input4eval ) {
+		half.forward( item, &ctx );
+		output.emplace_back( ctx.getOutput() );
+
+		network.forward( item, &fullCtx );
+
+		if( GX_Utils::max_index( std::begin( ctx.getOutput() ), std::end( ctx.getOutput() ) )
+				== GX_Utils::max_index( std::begin( fullCtx.getOutput() ), std::end( fullCtx.getOutput() ) ) ) agree++;
+	}
+
+	auto countMismatch = [ & ]( const GX_Network & other ) {
+		GX_InferenceContext otherCtx( other );
+
+		size_t ret = 0;
+		for( size_t i = 0; i < input4eval.size(); i++ ) {
+			other.forward( input4eval[ i ], &otherCtx );
+			if( ( otherCtx.getOutput() != output[ i ] ).max() ) ret++;
+		}
+
+		return ret;
+	};
+
+	char path[ 128 ] = { 0 };
+	snprintf( path, sizeof( path ), "./testhalf.%s.%d.%s.model", tag, getpid(), GX_Half::getName( format ) );
+
+	GX_Network loaded;
+	bool isLoaded = GX_Utils::saveBinary( path, half ) && GX_Utils::loadBinary( path, &loaded );
+
+	unlink( path );
+
+	size_t loadedMismatch = isLoaded ? countMismatch( loaded ) : input4eval.size();
+
+	printf( "%s %s, argmax agrees with full on %zu of %zu, binary load %s, %zu mismatch\n", tag, GX_Half::getName( format ),
+			agree, input4eval.size(), isLoaded ? "succ" : "fail", loadedMismatch );
+
+	size_t softMismatch = 0;
+
+	if( GX_Half::eFP16 == format && GX_Half::isF16C() ) {
+		GX_Half::setF16C( false );
+		softMismatch = countMismatch( half );
+		GX_Half::setF16C( true );
+
+		printf( "%s %s, f16c against software conversion, %zu mismatch\n", tag, GX_Half::getName( format ), softMismatch );
+	}
+
+	return isLoaded && 0 == loadedMismatch && 0 == softMismatch;
+}
+
+int main( const int argc, char * argv[] )
+{
+	CmdArgs_t defaultArgs = {
+		.mTrainingCount = 1000,
+		.mEvalCount = 1000,
+		.mEpochCount = 1,
+		.mMiniBatchCount = 100,
+		.mLearningRate = 3.0,
+	};
+
+	CmdArgs_t args = defaultArgs;
+
+	GX_Utils::getCmdArgs( argc, argv, defaultArgs, &args );
+
+	bool isSucc = true;
+
+	for( const char * tag : { "mnist", "emnist" } ) {
+		GX_Network network;
+		GX_DataMatrix input, target;
+		GX_Synth::make( tag, args.mTrainingCount, SEED, &network, &input, &target );
+
+		// the eval set shares the strokes of the training set
+		GX_DataMatrix input4eval, target4eval;
+		GX_Synth::makeData( args.mEvalCount, (size_t)sqrt( (double)input[ 0 ].size() ), target[ 0 ].size(), SEED, SEED + 1,
+				&input4eval, &target4eval );
+
+		network.train( GX_Dataset( input ), GX_Dataset( target ), args.mEpochCount, args.mMiniBatchCount, args.mLearningRate );
+
+		isSucc = testHalf( tag, network, GX_Half::eBF16, input4eval ) && isSucc;
+		isSucc = testHalf( tag, network, GX_Half::eFP16, input4eval ) && isSucc;
+	}
+
+	printf( "testhalf %s\n", isSucc ? "succ" : "fail" );
+
+	return isSucc ? 0 : 1;
+}
@@ -2,11 +2,15 @@
 #include "gxact.h"
 #include "gxutils.h"
 #include "gxeval.h"
+#include "gxprof.h"
+#include "gxtrace.h"
+#include "gxstats.h"
+#include "gxpool.h"
 
 #include <unistd.h>
 
-bool loadData( const CmdArgs_t & args, GX_DataMatrix * input, GX_DataMatrix * target,
-		GX_DataMatrix * input4eval, GX_DataMatrix * target4eval )
+bool loadData( const CmdArgs_t & args, GX_Dataset * input, GX_LabelVector * target,
+		GX_Dataset * input4eval, GX_LabelVector * target4eval )
 {
 	const char * path = "mnist/train-images-idx3-ubyte";
 	if( ! GX_Utils::loadMnistImages( args.mTrainingCount, path, input ) ) {
@@ -39,10 +43,11 @@ bool loadData( const CmdArgs_t & args, GX_DataMatrix * input, GX_DataMatrix * ta
 	size_t orgSize = input->size();
 
 	for( size_t i = 0; i < orgSize; i++ ) {
-		GX_DataVector newImage;
-		if( GX_Utils::centerMnistImage( ( *input )[ i ], &newImage ) ) {
-			input->emplace_back( newImage );
-			target->emplace_back( ( *target )[ i ] );
+		GX_DataVector image, newImage;
+		input->copySample( i, &image );
+		if( GX_Utils::centerMnistImage( image, &newImage ) ) {
+			input->append( newImage );
+			target->push_back( ( *target )[ i ] );
 		}
 	}
 
@@ -66,7 +71,8 @@ bool loadData( const CmdArgs_t & args, GX_DataMatrix * input, GX_DataMatrix * ta
 
 void test( const CmdArgs_t & args )
 {
-	GX_DataMatrix input, target, input4eval, target4eval;
+	GX_Dataset input, input4eval;
+	GX_LabelVector target, target4eval;
 
 	if( ! loadData( args, &input, &target, &input4eval, &target4eval ) ) {
 		printf( "loadData fail\n" );
@@ -75,10 +81,22 @@ void test( const CmdArgs_t & args )
 
 	const char * path = "./mnist.model";
 
+	GX_Profiler profiler;
+	bool isPerf = false;
+
+	GX_Tracer tracer;
+	tracer.setWindow( args.mTraceBatchCount, args.mTraceEpochInterval );
+
+	GX_StatsWriter statsWriter;
+	bool isStats = NULL != args.mStatsPath && statsWriter.open( args.mStatsPath );
+
 	//train & save model
 	{
 		GX_Network network;
 
+		if( NULL != args.mTracePath ) network.setTracer( &tracer );
+		if( isStats ) network.setStatsWriter( &statsWriter );
+
 		network.setLossFuncType( GX_Network::eCrossEntropy );
 
 		if( NULL != args.mModelPath && 0 == access( args.mModelPath, F_OK ) ) {
@@ -91,15 +109,19 @@ void test( const CmdArgs_t & args )
 		} else {
 			GX_BaseLayer * layer = NULL;
 
-			layer = new GX_FullConnLayer( 30, input[ 0 ].size() );
+			layer = new GX_FullConnLayer( 30, input.getDim() );
 			layer->setActFunc( GX_ActFunc::sigmoid() );
 			network.addLayer( layer );
 
-			layer = new GX_FullConnLayer( target[ 0 ].size(), layer->getOutputSize() );
+			layer = new GX_FullConnLayer( 10, layer->getOutputSize() );
 			layer->setActFunc( GX_ActFunc::softmax() );
 			network.addLayer( layer );
 		}
 
+		// a "layer:N" region needs the layers
+		isPerf = NULL != args.mPerfRegion && profiler.enablePerf( args.mPerfRegion, network.getLayers().size() );
+		if( isPerf ) network.setProfiler( &profiler );
+
 		gx_eval( "before train", network, input4eval, target4eval, args.mIsDebug );
 
 		network.print();
@@ -111,6 +133,10 @@ void test( const CmdArgs_t & args )
 
 		printf( "train %s\n", ret ? "succ" : "fail" );
 
+		if( NULL != args.mTracePath ) {
+			printf( "save trace %s %s\n", args.mTracePath, tracer.save( args.mTracePath ) ? "succ" : "fail" );
+		}
+
 		//gx_eval( "after train", network, input4eval, target4eval, args.mIsDebug );
 	}
 
@@ -118,6 +144,8 @@ void test( const CmdArgs_t & args )
 	{
 		GX_Network network;
 
+		if( isPerf ) network.setProfiler( &profiler );
+
 		GX_Utils::load( path, &network );
 
 		gx_eval( "load model", network, input4eval, target4eval, args.mIsDebug );
@@ -141,8 +169,12 @@ int main( const int argc, char * argv[] )
 
 	GX_Utils::getCmdArgs( argc, argv, defaultArgs, &args );
 
+	GX_ThreadPool::setDefault( args.mPoolSize );
+
 	test( args );
 
+	GX_ThreadPool::setDefault( 0 );
+
 	return 0;
 }
 
@@ -0,0 +1,161 @@
+
+#include "gxnet.h"
+#include "gxutils.h"
+#include "gxpool.h"
+#include "gxdist.h"
+#include "gxpipe.h"
+#include "gxsynth.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// data-parallel train of a copy in args.mProcCount processes, every rank checks its final
+// weights against the ones of rank 0
+bool testDataParallel( const char * tag, const GX_Network & network, const CmdArgs_t & args,
+		const GX_Dataset & input, const GX_Dataset & target )
+{
+	GX_Network replica;
+	network.clone( &replica );
+
+	const char * transport = NULL != args.mTransport ? args.mTransport : "shm";
+
+	fflush( stdout );
+
+	bool isSucc = GX_Launcher::run( args.mProcCount, GX_Launcher::getTransport( transport ), [ & ]( GX_Communicator * comm ) {
+		// rank 0 prints the epochs, the others keep quiet
+		if( 0 != comm->getRank() ) freopen( "/dev/null", "w", stdout );
+
+		bool ret = replica.trainDataParallel( input, target, args.mEpochCount, args.mMiniBatchCount,
+				args.mLearningRate, 0, comm );
+
+		GX_DataVector params, rootParams;
+		replica.exportParams( &params );
+		rootParams = params;
+
+		GX_DataType differCount = 0;
+
+		ret = ret && comm->broadcast( std::begin( rootParams ), rootParams.size(), 0 );
+		differCount = 0 != memcmp( std::begin( params ), std::begin( rootParams ), params.size() * sizeof( GX_DataType ) );
+		ret = ret && comm->allReduce( &differCount, 1 );
+
+		if( 0 == comm->getRank() ) {
+			printf( "%s data-parallel, %d procs over %s, %d ranks differ\n", tag, comm->getSize(),
+					transport, (int)differCount );
+		}
+
+		return ret && 0 == differCount ? 0 : 1;
+	} );
+
+	printf( "%s data-parallel %s\n", tag, isSucc ? "succ" : "fail" );
+
+	return isSucc;
+}
+
+// three copies in the same sample order, serial, with the layer loops on the pool and the
+// memory plan, and with the backward task graph on the pool, the weights must come out
+// bit for bit the same
+bool testPoolTrain( const char * tag, const GX_Network & network, const CmdArgs_t & args,
+		const GX_Dataset & input, const GX_Dataset & target )
+{
+	GX_Network planned, overlapped, serial;
+	network.clone( &planned );
+	network.clone( &overlapped );
+	network.clone( &serial );
+
+	planned.setShuffle( false );
+	overlapped.setShuffle( false );
+	overlapped.setOverlap( true );
+	serial.setShuffle( false );
+
+	serial.train( input, target, args.mEpochCount, args.mMiniBatchCount, args.mLearningRate, 0 );
+
+	GX_ThreadPool::setDefault( args.mPoolSize );
+
+	planned.train( input, target, args.mEpochCount, args.mMiniBatchCount, args.mLearningRate, 0 );
+	overlapped.train( input, target, args.mEpochCount, args.mMiniBatchCount, args.mLearningRate, 0 );
+
+	GX_ThreadPool::setDefault( 0 );
+
+	bool isPlannedSame = GX_Synth::isSameParams( planned, serial );
+	bool isOverlapSame = GX_Synth::isSameParams( overlapped, serial );
+
+	printf( "%s pool train, %d threads, planned weights %s, overlap weights %s\n", tag, args.mPoolSize,
+			isPlannedSame ? "identical" : "differ", isOverlapSame ? "identical" : "differ" );
+
+	return isPlannedSame && isOverlapSame;
+}
+
+// pipeline train of a copy against a serial train of another copy in the same sample order
+bool testPipeline( const char * tag, const GX_Network & network, const CmdArgs_t & args,
+		const GX_Dataset & input, const GX_Dataset & target, const char * schedule )
+{
+	enum { STAGE_COUNT = 3, MICRO_BATCH_COUNT = 10 };
+
+	GX_Network staged, serial;
+	network.clone( &staged );
+	network.clone( &serial );
+
+	staged.setShuffle( false );
+	serial.setShuffle( false );
+
+	std::vector< size_t > splits;
+	GX_Pipeline::balance( staged, STAGE_COUNT, &splits );
+
+	// the pipeline takes its micro-batches as rows
+	GX_DataMatrix inputRows, targetRows;
+	input.toMatrix( &inputRows );
+	target.toMatrix( &targetRows );
+
+	GX_Pipeline pipeline( &staged, splits, GX_Pipeline::getSchedule( schedule ) );
+
+	bool isSucc = pipeline.train( inputRows, targetRows, args.mEpochCount, args.mMiniBatchCount, MICRO_BATCH_COUNT,
+			args.mLearningRate, 0 );
+
+	serial.train( input, target, args.mEpochCount, args.mMiniBatchCount, args.mLearningRate, 0 );
+
+	bool isSame = GX_Synth::isSameParams( staged, serial );
+
+	printf( "%s pipeline %s, %zu stages, micro-batch %d, %s, weights %s\n", tag, schedule, splits.size() + 1,
+			MICRO_BATCH_COUNT, isSucc ? "succ" : "fail", isSame ? "identical" : "differ" );
+
+	return isSucc && isSame;
+}
+
+int main( const int argc, char * argv[] )
+{
+	CmdArgs_t defaultArgs = {
+		.mTrainingCount = 1000,
+		.mEvalCount = 0,
+		.mEpochCount = 1,
+		.mMiniBatchCount = 100,
+		.mLearningRate = 3.0,
+		.mPoolSize = 2,
+		.mProcCount = 2,
+	};
+
+	CmdArgs_t args = defaultArgs;
+
+	GX_Utils::getCmdArgs( argc, argv, defaultArgs, &args );
+
+	bool isSucc = true;
+
+	for( const char * tag : { "mnist", "emnist" } ) {
+		GX_Network network;
+		GX_DataMatrix inputRows, targetRows;
+		GX_Synth::make( tag, args.mTrainingCount, 2024, &network, &inputRows, &targetRows );
+
+		GX_Dataset input( inputRows ), target( targetRows );
+
+		// fork before any thread is started, the copies start from the same weights
+		if( args.mProcCount > 1 ) isSucc = testDataParallel( tag, network, args, input, target ) && isSucc;
+
+		if( args.mPoolSize > 0 ) isSucc = testPoolTrain( tag, network, args, input, target ) && isSucc;
+
+		isSucc = testPipeline( tag, network, args, input, target, "gpipe" ) && isSucc;
+		isSucc = testPipeline( tag, network, args, input, target, "1f1b" ) && isSucc;
+	}
+
+	printf( "testparallel %s\n", isSucc ? "succ" : "fail" );
+
+	return isSucc ? 0 : 1;
+}
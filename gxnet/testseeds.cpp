@@ -1,6 +1,8 @@
 #include "gxutils.h"
 #include "gxnet.h"
 #include "gxact.h"
+#include "gxpool.h"
+#include "gxdist.h"
 
 #include <iostream>
 #include <fstream>
@@ -148,6 +150,7 @@ void test( const CmdArgs_t & args )
 	splitData( args, data, labels, &input, &target, &input4eval, &target4eval );
 
 	const char * path = "./seeds.model";
+	const char * binaryPath = "./seeds.bin.model";
 
 	// train & check & save
 	{
@@ -168,14 +171,36 @@ void test( const CmdArgs_t & args )
 
 		check( "before train", network, input4eval, target4eval, args.mIsDebug );
 
-		bool ret = network.train( input, target,
-			args.mEpochCount, args.mMiniBatchCount, args.mLearningRate, args.mLambda );
+		if( args.mProcCount > 1 ) {
+			int transport = GX_Launcher::getTransport( NULL == args.mTransport ? "shm" : args.mTransport );
 
-		GX_Utils::save( path, network );
+			// the workers fork with the same weights, rank 0 saves and checks the result
+			bool ret = GX_Launcher::run( args.mProcCount, transport, [ & ]( GX_Communicator * comm ) {
+				bool ret = network.trainDataParallel( input, target, args.mEpochCount, args.mMiniBatchCount,
+						args.mLearningRate, args.mLambda, comm );
 
-		printf( "train %s\n", ret ? "succ" : "fail" );
+				if( ret && 0 == comm->getRank() ) {
+					GX_Utils::save( path, network );
+					GX_Utils::saveBinary( binaryPath, network );
 
-		check( "after train", network, input4eval, target4eval, args.mIsDebug );
+					check( "after train", network, input4eval, target4eval, args.mIsDebug );
+				}
+
+				return ret ? 0 : 1;
+			} );
+
+			printf( "train %s\n", ret ? "succ" : "fail" );
+		} else {
+			bool ret = network.train( input, target,
+				args.mEpochCount, args.mMiniBatchCount, args.mLearningRate, args.mLambda );
+
+			GX_Utils::save( path, network );
+			GX_Utils::saveBinary( binaryPath, network );
+
+			printf( "train %s\n", ret ? "succ" : "fail" );
+
+			check( "after train", network, input4eval, target4eval, args.mIsDebug );
+		}
 	}
 
 	{
@@ -187,6 +212,14 @@ void test( const CmdArgs_t & args )
 
 		check( "load model", network, input4eval, target4eval, args.mIsDebug );
 	}
+
+	{
+		GX_Network network;
+
+		GX_Utils::load( binaryPath, &network );
+
+		check( "load binary model", network, input4eval, target4eval, args.mIsDebug );
+	}
 }
 
 int main( const int argc, char * argv[] )
@@ -204,8 +237,12 @@ int main( const int argc, char * argv[] )
 
 	GX_Utils::getCmdArgs( argc, argv, defaultArgs, &args );
 
+	GX_ThreadPool::setDefault( args.mPoolSize );
+
 	test( args );
 
+	GX_ThreadPool::setDefault( 0 );
+
 	return 0;
 }
 
@@ -0,0 +1,322 @@
+
+#include "gxnet.h"
+#include "gxutils.h"
+#include "gxckpt.h"
+#include "gxplan.h"
+#include "gxaugment.h"
+#include "gxstream.h"
+#include "gxonline.h"
+#include "gxsynth.h"
+
+#include <algorithm>
+
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+enum { SEED = 2024 };
+
+// two copies in the same sample order, one against the one-hot rows and one against the
+// class indexes, the weights must come out bit for bit the same
+bool testLabels( const char * tag, const GX_Network & network, const CmdArgs_t & args,
+		const GX_Dataset & input, const GX_Dataset & target )
+{
+	GX_LabelVector labels;
+	labels.reserve( target.size() );
+	for( size_t i = 0; i < target.size(); i++ ) {
+		labels.push_back( GX_Utils::max_index( target[ i ], target[ i ] + target.getDim() ) );
+	}
+
+	GX_Network labeled, oneHot;
+	network.clone( &labeled );
+	network.clone( &oneHot );
+
+	labeled.setShuffle( false );
+	oneHot.setShuffle( false );
+
+	oneHot.train( input, target, args.mEpochCount, args.mMiniBatchCount, args.mLearningRate, 0 );
+	labeled.train( input, labels, args.mEpochCount, args.mMiniBatchCount, args.mLearningRate, 0 );
+
+	bool isSame = GX_Synth::isSameParams( labeled, oneHot );
+
+	printf( "%s labels, weights %s\n", tag, isSame ? "identical" : "differ" );
+
+	return isSame;
+}
+
+// the training set written to shards and trained from them: in order the weights must match the
+// in-memory run bit for bit, shuffled every sample and its target must come out once per epoch
+bool testStream( const char * tag, const GX_Network & network, const CmdArgs_t & args,
+		const GX_Dataset & input, const GX_Dataset & target )
+{
+	char prefix[ 128 ] = { 0 };
+	snprintf( prefix, sizeof( prefix ), "./testtrain.%s.%d.shard", tag, getpid() );
+
+	size_t shardSamples = std::max( input.size() / 8, (size_t)1 );
+	size_t bufferSamples = std::max( input.size() / 4, (size_t)1 );
+
+	GX_ShardWriter writer( prefix, shardSamples );
+
+	bool isWritten = true;
+	for( size_t i = 0; isWritten && i < input.size(); i++ ) {
+		isWritten = writer.append( input[ i ], input.getDim(), target[ i ], target.getDim() );
+	}
+	isWritten = writer.close() && isWritten;
+
+	GX_ShardStream stream( prefix, bufferSamples, SEED );
+	bool isOpened = isWritten && stream.open();
+
+	GX_Network streamed, resident;
+	network.clone( &streamed );
+	network.clone( &resident );
+
+	streamed.setShuffle( false );
+	resident.setShuffle( false );
+
+	resident.train( input, target, args.mEpochCount, args.mMiniBatchCount, args.mLearningRate, 0 );
+
+	bool isTrained = isOpened && streamed.train( stream, args.mEpochCount, args.mMiniBatchCount, args.mLearningRate, 0 );
+
+	bool isSame = isTrained && GX_Synth::isSameParams( streamed, resident );
+
+	// a key per sample that pairs the input with its target
+	auto keyOf = [ & ]( const GX_DataType * sample, const GX_DataType * row ) {
+		GX_AccumType key = 1000 * GX_Utils::max_index( row, row + target.getDim() );
+		for( size_t j = 0; j < input.getDim(); j++ ) key += sample[ j ];
+		return key;
+	};
+
+	std::vector< GX_AccumType > inputKeys, streamKeys;
+	for( size_t i = 0; i < input.size(); i++ ) inputKeys.push_back( keyOf( input[ i ], target[ i ] ) );
+
+	GX_Dataset batchInput( std::max( args.mMiniBatchCount, 1 ), input.getDim() );
+	GX_Dataset batchRows( std::max( args.mMiniBatchCount, 1 ), target.getDim() );
+	GX_LabelVector batchLabels;
+
+	if( isOpened ) stream.start( 0, true );
+
+	for( size_t count = 0; isOpened && ( count = stream.next( &batchInput, &batchRows, &batchLabels ) ) > 0; ) {
+		for( size_t i = 0; i < count && streamKeys.size() < input.size(); i++ ) {
+			streamKeys.push_back( keyOf( batchInput[ i ], batchRows[ i ] ) );
+		}
+	}
+
+	std::sort( inputKeys.begin(), inputKeys.end() );
+	std::sort( streamKeys.begin(), streamKeys.end() );
+
+	bool isOnce = isOpened && inputKeys == streamKeys;
+
+	for( size_t i = 0; i < writer.getShardCount(); i++ ) {
+		char path[ 160 ] = { 0 };
+		snprintf( path, sizeof( path ), "%s.%05zu", prefix, i );
+		unlink( path );
+	}
+
+	printf( "%s stream, %zu shards %s, in order weights %s, shuffled samples %s\n", tag, writer.getShardCount(),
+			isWritten ? "succ" : "fail", isSame ? "identical" : "differ", isOnce ? "once" : "differ" );
+
+	return isWritten && isSame && isOnce;
+}
+
+// one epoch pushed sample by sample into online trainers, inline with target rows and through the
+// trainer thread with class indexes and a checkpoint every quarter, against train in the same order
+// and with the same L2 decay over the same sample count: the weights and the last checkpoint must
+// come out bit for bit the same
+bool testOnline( const char * tag, const GX_Network & network, const CmdArgs_t & args,
+		const GX_Dataset & input, const GX_Dataset & target )
+{
+	GX_Network resident, inlined, queued;
+	network.clone( &resident );
+	network.clone( &inlined );
+	network.clone( &queued );
+
+	resident.setShuffle( false );
+
+	int trainingCount = (int)input.size();
+
+	resident.train( input, target, 1, args.mMiniBatchCount, args.mLearningRate, args.mLambda );
+
+	bool isPushed = true;
+
+	{
+		GX_OnlineTrainer trainer( &inlined, args.mMiniBatchCount, args.mLearningRate, args.mLambda, trainingCount );
+
+		for( size_t i = 0; isPushed && i < input.size(); i++ ) {
+			isPushed = trainer.push( input[ i ], input.getDim(), target[ i ], target.getDim() );
+		}
+
+		isPushed = trainer.stop() && isPushed;
+	}
+
+	char prefix[ 128 ] = { 0 };
+	snprintf( prefix, sizeof( prefix ), "./testtrain.%s.%d.online", tag, getpid() );
+
+	GX_Checkpointer checkpointer( prefix, 2, GX_Checkpointer::eBinary );
+
+	size_t checkpointCount = 0;
+
+	{
+		GX_OnlineTrainer trainer( &queued, args.mMiniBatchCount, args.mLearningRate, args.mLambda, trainingCount,
+				4 * std::max( args.mMiniBatchCount, 1 ) );
+		trainer.setCheckpointer( &checkpointer, std::max( input.size() / 4, (size_t)1 ), 0 );
+
+		for( size_t i = 0; isPushed && i < input.size(); i++ ) {
+			uint16_t label = GX_Utils::max_index( target[ i ], target[ i ] + target.getDim() );
+			isPushed = trainer.push( input[ i ], input.getDim(), label );
+		}
+
+		isPushed = trainer.stop() && isPushed;
+
+		checkpointCount = trainer.getCheckpointCount();
+	}
+
+	GX_Network saved;
+	char path[ 256 ] = { 0 };
+	snprintf( path, sizeof( path ), "%s.%zu.model", prefix, checkpointCount - 1 );
+	bool isLoaded = checkpointCount > 0 && GX_Utils::loadBinary( path, &saved );
+
+	for( size_t i = 0; i < checkpointCount; i++ ) {
+		snprintf( path, sizeof( path ), "%s.%zu.model", prefix, i );
+		unlink( path );
+	}
+
+	bool isInlineSame = isPushed && GX_Synth::isSameParams( inlined, resident );
+	bool isQueueSame = isPushed && GX_Synth::isSameParams( queued, resident );
+	bool isSavedSame = isLoaded && GX_Synth::isSameParams( saved, resident );
+
+	printf( "%s online, lambda %g, inline weights %s, queue weights %s, %zu checkpoints, last checkpoint %s\n",
+			tag, (double)args.mLambda, isInlineSame ? "identical" : "differ", isQueueSame ? "identical" : "differ",
+			checkpointCount, isSavedSame ? "identical" : "differ" );
+
+	return isInlineSame && isQueueSame && isSavedSame;
+}
+
+// two copies in the same sample order, one recomputing the outputs between checkpoints,
+// the weights must come out bit for bit the same
+bool testRecompute( const char * tag, const GX_Network & network, const CmdArgs_t & args,
+		const GX_Dataset & input, const GX_Dataset & target )
+{
+	enum { INTERVAL = 2 };
+
+	GX_Network recompute, serial;
+	network.clone( &recompute );
+	network.clone( &serial );
+
+	recompute.setShuffle( false );
+	serial.setShuffle( false );
+
+	recompute.setCheckpointInterval( INTERVAL );
+
+	std::vector< bool > checkpoints;
+	recompute.getCheckpoints( &checkpoints );
+
+	GX_MemPlan fullPlan( serial.getLayers(), GX_MemPlan::eTraining );
+	GX_MemPlan plan( recompute.getLayers(), GX_MemPlan::eTraining, checkpoints );
+
+	serial.train( input, target, args.mEpochCount, args.mMiniBatchCount, args.mLearningRate, 0 );
+	recompute.train( input, target, args.mEpochCount, args.mMiniBatchCount, args.mLearningRate, 0 );
+
+	bool isSame = GX_Synth::isSameParams( recompute, serial );
+
+	printf( "%s recompute every %d layers, %zu layers recomputed, plan %.1f KB of %.1f KB, weights %s\n",
+			tag, INTERVAL, plan.getRecomputeCount(), plan.getPlannedBytes() / 1024.0,
+			fullPlan.getPlannedBytes() / 1024.0, isSame ? "identical" : "differ" );
+
+	return isSame;
+}
+
+// centering and padding against the eager GX_Utils copies, then two copies trained in the same
+// sample order on rotated and shifted samples, one fed by the loader threads and one augmenting
+// inline, the weights must come out bit for bit the same
+bool testAugment( const char * tag, const GX_Network & network, const CmdArgs_t & args,
+		const GX_Dataset & input, const GX_Dataset & target )
+{
+	enum { LOADER_COUNT = 2 };
+
+	size_t side = (size_t)sqrt( (double)input.getDim() );
+
+	size_t mismatch = 0;
+
+	// GX_Utils only knows 28 x 28 images
+	if( 28 == side ) {
+		GX_Augmenter expander( side );
+		expander.setCenterRate( 1 );
+		expander.setPadding( 2 );
+
+		GX_DataVector image, centered, expected, output( expander.getOutputSize() );
+
+		for( size_t i = 0; i < input.size(); i++ ) {
+			input.copySample( i, &image );
+			if( ! GX_Utils::centerMnistImage( image, &centered ) ) centered = image;
+			GX_Utils::expandMnistImage( centered, &expected );
+
+			expander.apply( input[ i ], 0, i, std::begin( output ) );
+			if( ( output != expected ).max() ) mismatch++;
+		}
+
+		printf( "%s center and pad %zu samples against centerMnistImage and expandMnistImage, %zu mismatch\n",
+				tag, input.size(), mismatch );
+	}
+
+	GX_Augmenter augmenter( side );
+	augmenter.setCenterRate( 0.5 );
+	augmenter.setRotation( 15 );
+	augmenter.setTranslation( 2 );
+	augmenter.setSeed( SEED );
+
+	GX_Network loaded, inlined;
+	network.clone( &loaded );
+	network.clone( &inlined );
+
+	loaded.setShuffle( false );
+	inlined.setShuffle( false );
+
+	loaded.setAugmenter( &augmenter, LOADER_COUNT );
+	inlined.setAugmenter( &augmenter, 0 );
+
+	inlined.train( input, target, args.mEpochCount, args.mMiniBatchCount, args.mLearningRate, 0 );
+	loaded.train( input, target, args.mEpochCount, args.mMiniBatchCount, args.mLearningRate, 0 );
+
+	bool isSame = GX_Synth::isSameParams( loaded, inlined );
+
+	printf( "%s augment, %d loaders, weights %s\n", tag, LOADER_COUNT, isSame ? "identical" : "differ" );
+
+	return 0 == mismatch && isSame;
+}
+
+int main( const int argc, char * argv[] )
+{
+	CmdArgs_t defaultArgs = {
+		.mTrainingCount = 1000,
+		.mEvalCount = 0,
+		.mEpochCount = 1,
+		.mMiniBatchCount = 100,
+		.mLearningRate = 3.0,
+		.mLambda = 5.0,
+	};
+
+	CmdArgs_t args = defaultArgs;
+
+	GX_Utils::getCmdArgs( argc, argv, defaultArgs, &args );
+
+	bool isSucc = true;
+
+	for( const char * tag : { "mnist", "emnist" } ) {
+		GX_Network network;
+		GX_DataMatrix inputRows, targetRows;
+		GX_Synth::make( tag, args.mTrainingCount, SEED, &network, &inputRows, &targetRows );
+
+		GX_Dataset input( inputRows ), target( targetRows );
+
+		isSucc = testLabels( tag, network, args, input, target ) && isSucc;
+		isSucc = testStream( tag, network, args, input, target ) && isSucc;
+		isSucc = testOnline( tag, network, args, input, target ) && isSucc;
+		isSucc = testRecompute( tag, network, args, input, target ) && isSucc;
+		isSucc = testAugment( tag, network, args, input, target ) && isSucc;
+	}
+
+	printf( "testtrain %s\n", isSucc ? "succ" : "fail" );
+
+	return isSucc ? 0 : 1;
+}